@@ -85,6 +85,7 @@ static void show_help(const char* argv0)
                "  -q, --quality                  quality (for JPEG output)\n"
                "  -o, --output FILENAME          write output to FILENAME (optional)\n"
                "  -d, --decoder ID               use a specific decoder (see --list-decoders)\n"
+               "  -p, --param NAME=VALUE         set decoder parameter (see --list-decoders)\n"
                "      --with-aux                 also write auxiliary images (e.g. depth images)\n"
                "      --with-xmp                 write XMP metadata to file (output filename with .xmp suffix)\n"
                "      --with-exif                write EXIF metadata to file (output filename with .exif suffix)\n"
@@ -134,6 +135,7 @@ static struct option long_options[] = {
     {(char* const) "quality",          required_argument, 0,                        'q'},
     {(char* const) "strict",           no_argument,       0,                        's'},
     {(char* const) "decoder",          required_argument, 0,                        'd'},
+    {(char* const) "param",            required_argument, 0,                        'p'},
     {(char* const) "output",           required_argument, 0,                        'o'},
     {(char* const) "quiet",            no_argument,       &option_quiet,            1},
     {(char* const) "with-aux",         no_argument,       &option_aux,              1},
@@ -164,6 +166,11 @@ void list_decoders(heif_compression_format format)
     }
 
     std::cout << "- " << id << " = " << heif_decoder_descriptor_get_name(decoders[i]) << "\n";
+
+    const struct heif_encoder_parameter* const* params = heif_decoder_descriptor_list_parameters(decoders[i]);
+    for (int p = 0; params && params[p]; p++) {
+      std::cout << "    " << heif_encoder_parameter_get_name(params[p]) << "\n";
+    }
   }
 }
 
@@ -597,12 +604,13 @@ int main(int argc, char** argv)
   int quality = -1;  // Use default quality.
   bool strict_decoding = false;
   const char* decoder_id = nullptr;
+  std::vector<std::string> decoder_params;
 
   UNUSED(quality);  // The quality will only be used by encoders that support it.
   //while ((opt = getopt(argc, argv, "q:s")) != -1) {
   while (true) {
     int option_index = 0;
-    int c = getopt_long(argc, argv, "hq:sd:C:vo:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "hq:sd:p:C:vo:", long_options, &option_index);
     if (c == -1) {
       break;
     }
@@ -614,6 +622,17 @@ int main(int argc, char** argv)
       case 'd':
         decoder_id = optarg;
         break;
+      case 'p': {
+        std::string param(optarg);
+        size_t equal_pos = param.find('=');
+        if (equal_pos == std::string::npos || equal_pos == 0) {
+          std::cerr << "Decoder parameter must be given as NAME=VALUE.\n";
+          exit(5);
+        }
+        decoder_params.push_back(param.substr(0, equal_pos));
+        decoder_params.push_back(param.substr(equal_pos + 1));
+        break;
+      }
       case 's':
         strict_decoding = true;
         break;
@@ -666,6 +685,12 @@ int main(int argc, char** argv)
     return 5;
   }
 
+  std::vector<const char*> decoder_param_ptrs;
+  for (const auto& param : decoder_params) {
+    decoder_param_ptrs.push_back(param.c_str());
+  }
+  decoder_param_ptrs.push_back(nullptr);
+
   std::string input_filename(argv[optind++]);
   std::string output_filename_stem;
   std::string output_filename_suffix;
@@ -850,6 +875,7 @@ int main(int argc, char** argv)
 
     decode_options->strict_decoding = strict_decoding;
     decode_options->decoder_id = decoder_id;
+    decode_options->decoder_parameters = decoder_param_ptrs.data();
     decode_options->start_progress = start_progress;
     decode_options->on_progress = on_progress;
     decode_options->end_progress = end_progress;
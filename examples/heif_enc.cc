@@ -67,6 +67,7 @@ std::string chroma_downsampling;
 int tiled_image_width = 0;
 int tiled_image_height = 0;
 std::string tiling_method = "grid";
+int tile_encoding_threads = 1;
 heif_metadata_compression unci_compression = heif_metadata_compression_brotli;
 int add_pyramid_group = 0;
 
@@ -104,6 +105,7 @@ const int OPTION_TILED_IMAGE_WIDTH = 1011;
 const int OPTION_TILED_IMAGE_HEIGHT = 1012;
 const int OPTION_TILING_METHOD = 1013;
 const int OPTION_UNCI_COMPRESSION = 1014;
+const int OPTION_TILE_ENCODING_THREADS = 1015;
 
 
 static struct option long_options[] = {
@@ -146,6 +148,7 @@ static struct option long_options[] = {
     {(char* const) "tiled-image-height",          required_argument, nullptr, OPTION_TILED_IMAGE_HEIGHT},
     {(char* const) "tiled-input-x-y",             no_argument,       &tiled_input_x_y, 1},
     {(char* const) "tiling-method",               required_argument, nullptr, OPTION_TILING_METHOD},
+    {(char* const) "tile-encoding-threads",       required_argument, nullptr, OPTION_TILE_ENCODING_THREADS},
     {(char* const) "add-pyramid-group",           no_argument,       &add_pyramid_group, 1},
     {0, 0,                                                           0,  0},
 };
@@ -210,6 +213,8 @@ void show_help(const char* argv0)
             << "  --tiled-image-height #    override image height of tiled image\n"
             << "  --tiled-input-x-y         usually, the first number in the input tile filename should be the y position.\n"
             << "                            With this option, this can be swapped so that the first number is x, the second number y.\n"
+            << "  --tile-encoding-threads # number of tiles that are encoded in parallel (default: 1).\n"
+            << "                            Also used for encoding the image, its alpha channel and thumbnail in parallel.\n"
 #if ENABLE_EXPERIMENTAL_FEATURS
             << "  --tiling-method METHOD    choose one of these methods: grid, tili, unci. The default is 'grid'.\n"
             << "  --add-pyramid-group       when several images are given, put them into a multi-resolution pyramid group.\n"
@@ -799,7 +804,12 @@ heif_image_handle* encode_tiled(heif_context* ctx, heif_encoder* encoder, heif_e
 
   int tile_width = 0, tile_height = 0;
 
-  for (uint32_t ty = 0; ty < tile_generator.nRows(); ty++)
+  // The tiles are added row by row so that the tiles of a row can be encoded in parallel.
+
+  for (uint32_t ty = 0; ty < tile_generator.nRows(); ty++) {
+    std::vector<InputImage> row_images;
+    std::vector<const heif_image*> row_tiles;
+
     for (uint32_t tx = 0; tx < tile_generator.nColumns(); tx++) {
       std::string input_filename = tile_generator.filename(tx,ty).string();
 
@@ -821,18 +831,19 @@ heif_image_handle* encode_tiled(heif_context* ctx, heif_encoder* encoder, heif_e
         std::cerr << error.message << "\n";
       }
 
-      std::cout << "encoding tile " << ty+1 << " " << tx+1
-                << " (of " << tile_generator.nRows() << "x" << tile_generator.nColumns() << ")  \r";
-      std::cout.flush();
+      row_tiles.push_back(input_image.image.get());
+      row_images.push_back(std::move(input_image));
+    }
 
-      error = heif_context_add_image_tile(ctx, tiled_image, tx, ty,
-                                          input_image.image.get(),
-                                          encoder);
-      if (error.code != 0) {
-        std::cerr << "Could not encode HEIF/AVIF file: " << error.message << "\n";
-        return nullptr;
-      }
+    std::cout << "encoding tile row " << ty+1 << " (of " << tile_generator.nRows() << "x" << tile_generator.nColumns() << ")  \r";
+    std::cout.flush();
+
+    heif_error error = heif_context_add_image_tile_rows(ctx, tiled_image, ty, 1, row_tiles.data(), encoder);
+    if (error.code != 0) {
+      std::cerr << "Could not encode HEIF/AVIF file: " << error.message << "\n";
+      return nullptr;
     }
+  }
 
   std::cout << "\n";
 
@@ -971,6 +982,9 @@ int main(int argc, char** argv)
       case OPTION_TILED_IMAGE_HEIGHT:
         tiled_image_height = (int) strtol(optarg, nullptr, 0);
         break;
+      case OPTION_TILE_ENCODING_THREADS:
+        tile_encoding_threads = (int) strtol(optarg, nullptr, 0);
+        break;
       case OPTION_TILING_METHOD:
         tiling_method = optarg;
         if (tiling_method != "grid"
@@ -1095,6 +1109,8 @@ int main(int argc, char** argv)
     return 1;
   }
 
+  heif_context_set_max_encoding_threads(context.get(), tile_encoding_threads);
+
 
 #define MAX_ENCODERS 10
   const heif_encoder_descriptor* encoder_descriptors[MAX_ENCODERS];
@@ -1272,6 +1288,10 @@ int main(int argc, char** argv)
       handle = encode_tiled(context.get(), encoder, options, output_bit_depth, *tile_generator, tiling);
     }
     else {
+      // The thumbnail is encoded together with the image, see below for tiled images.
+      options->thumbnail_bbox_size = (uint32_t) std::max(thumbnail_bbox_size, 0);
+      options->save_thumbnail_alpha_channel = (uint8_t) thumb_alpha;
+
       error = heif_context_encode_image(context.get(),
                                         image.get(),
                                         encoder,
@@ -1327,7 +1347,7 @@ int main(int argc, char** argv)
       }
     }
 
-    if (thumbnail_bbox_size > 0) {
+    if (thumbnail_bbox_size > 0 && use_tiling) {
       // encode thumbnail
 
       struct heif_image_handle* thumbnail_handle;
@@ -25,8 +25,14 @@
 #include "context.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 #include "image-items/image_item.h"
 
+// Copies the (possibly lower version) input options over the default options. 'input_options' may be NULL.
+heif_decoding_options normalize_options(const heif_decoding_options* input_options);
+
+
 struct heif_image_handle
 {
   std::shared_ptr<ImageItem> image;
@@ -58,9 +64,28 @@ struct heif_encoder
 
   void release();
 
+  // Allocates another instance of the same encoder plugin and sets all parameters that have been set on this encoder.
+  Result<std::shared_ptr<heif_encoder>> clone() const;
+
 
   const struct heif_encoder_plugin* plugin;
   void* encoder = nullptr;
+
+  // All parameters that have been set through the public API, in the order in which they were set.
+  // These are replayed on the instances created by clone().
+  struct ParameterAssignment
+  {
+    enum class Type
+    {
+      quality, lossless, logging_level, integer, boolean, string
+    } type;
+
+    std::string name;
+    int int_value = 0;
+    std::string string_value;
+  };
+
+  std::vector<ParameterAssignment> parameter_assignments;
 };
 
 
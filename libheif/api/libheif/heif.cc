@@ -32,9 +32,11 @@
 #include "error.h"
 #include "bitstream.h"
 #include "init.h"
+#include "encoding_pipeline.h"
 #include "image-items/grid.h"
 #include "image-items/overlay.h"
 #include "image-items/tiled.h"
+#include "color-conversion/colorconversion.h"
 #include <set>
 #include <limits>
 
@@ -541,6 +543,107 @@ struct heif_error heif_context_set_security_limits(struct heif_context* ctx, con
 }
 
 
+static std::shared_ptr<ImageAllocator> create_image_allocator(const struct heif_image_allocator* allocator, void* userdata)
+{
+  if (allocator == nullptr) {
+    return nullptr;
+  }
+
+  return std::make_shared<CustomImageAllocator>(allocator, userdata);
+}
+
+
+static bool is_valid_image_allocator(const struct heif_image_allocator* allocator)
+{
+  return (allocator == nullptr ||
+          (allocator->version >= 1 &&
+           allocator->allocate != nullptr &&
+           allocator->release != nullptr));
+}
+
+
+struct heif_error heif_set_image_allocator(const struct heif_image_allocator* allocator, void* userdata)
+{
+  if (!is_valid_image_allocator(allocator)) {
+    return error_invalid_parameter_value;
+  }
+
+  set_global_image_allocator(create_image_allocator(allocator, userdata));
+
+  return heif_error_ok;
+}
+
+
+struct heif_error heif_context_set_image_allocator(struct heif_context* ctx, const struct heif_image_allocator* allocator, void* userdata)
+{
+  if (ctx == nullptr) {
+    return error_null_parameter;
+  }
+
+  if (!is_valid_image_allocator(allocator)) {
+    return error_invalid_parameter_value;
+  }
+
+  ctx->context->set_image_allocator(create_image_allocator(allocator, userdata));
+
+  return heif_error_ok;
+}
+
+
+void heif_set_image_buffer_pool_size(size_t max_cached_bytes)
+{
+  set_global_image_buffer_pool(max_cached_bytes);
+}
+
+
+void heif_context_set_image_buffer_pool_size(struct heif_context* ctx, size_t max_cached_bytes)
+{
+  if (ctx) {
+    ctx->context->set_image_buffer_pool(max_cached_bytes);
+  }
+}
+
+
+static const struct heif_error error_no_image_buffer_pool = {heif_error_Usage_error,
+                                                             heif_suberror_Unspecified,
+                                                             "Image buffer pool is not enabled"};
+
+
+struct heif_error heif_get_image_buffer_pool_statistics(struct heif_image_buffer_pool_statistics* out_stats)
+{
+  if (out_stats == nullptr) {
+    return error_null_parameter;
+  }
+
+  auto pool = get_global_image_buffer_pool();
+  if (!pool) {
+    return error_no_image_buffer_pool;
+  }
+
+  *out_stats = pool->get_statistics();
+
+  return heif_error_ok;
+}
+
+
+struct heif_error heif_context_get_image_buffer_pool_statistics(const struct heif_context* ctx,
+                                                                struct heif_image_buffer_pool_statistics* out_stats)
+{
+  if (ctx == nullptr || out_stats == nullptr) {
+    return error_null_parameter;
+  }
+
+  const auto& pool = ctx->context->get_image_buffer_pool();
+  if (!pool) {
+    return error_no_image_buffer_pool;
+  }
+
+  *out_stats = pool->get_statistics();
+
+  return heif_error_ok;
+}
+
+
 
 heif_context* heif_context_alloc()
 {
@@ -1314,7 +1417,7 @@ struct heif_error heif_image_handle_get_depth_image_handle(const struct heif_ima
 
 void fill_default_decoding_options(heif_decoding_options& options)
 {
-  options.version = 6;
+  options.version = 8;
 
   options.ignore_transformations = false;
 
@@ -1345,17 +1448,33 @@ void fill_default_decoding_options(heif_decoding_options& options)
   // version 6
 
   options.cancel_decoding = nullptr;
+
+  // version 7
+
+  options.decoder_parameters = nullptr;
+
+  // version 8
+
+  options.max_output_width = 0;
+  options.max_output_height = 0;
 }
 
 
 // overwrite the (possibly lower version) input options over the default options
-static heif_decoding_options normalize_options(const heif_decoding_options* input_options)
+heif_decoding_options normalize_options(const heif_decoding_options* input_options)
 {
   heif_decoding_options options{};
   fill_default_decoding_options(options);
 
   if (input_options) {
     switch (input_options->version) {
+      case 8:
+        options.max_output_width = input_options->max_output_width;
+        options.max_output_height = input_options->max_output_height;
+        // fallthrough
+      case 7:
+        options.decoder_parameters = input_options->decoder_parameters;
+        // fallthrough
       case 6:
         options.cancel_decoding = input_options->cancel_decoding;
         // fallthrough
@@ -1399,6 +1518,14 @@ void heif_color_conversion_options_set_defaults(struct heif_color_conversion_opt
 }
 
 
+void heif_get_color_conversion_cache_statistics(struct heif_color_conversion_cache_statistics* out_stats)
+{
+  if (out_stats) {
+    *out_stats = ColorConversionPipeline::get_cache_statistics();
+  }
+}
+
+
 heif_decoding_options* heif_decoding_options_alloc()
 {
   auto options = new heif_decoding_options;
@@ -1451,6 +1578,63 @@ struct heif_error heif_decode_image(const struct heif_image_handle* in_handle,
 }
 
 
+struct heif_error heif_decode_image_into(const struct heif_image_handle* in_handle,
+                                         struct heif_image** out_img,
+                                         enum heif_colorspace colorspace,
+                                         enum heif_chroma chroma,
+                                         const struct heif_decoding_options* input_options,
+                                         const struct heif_image_plane_buffer* plane_buffers,
+                                         int num_plane_buffers)
+{
+  if (out_img == nullptr || in_handle == nullptr) {
+    return error_null_parameter;
+  }
+
+  *out_img = nullptr;
+
+  if (num_plane_buffers < 0 || (num_plane_buffers > 0 && plane_buffers == nullptr)) {
+    return {heif_error_Usage_error,
+            heif_suberror_Invalid_parameter_value,
+            "Invalid plane buffers passed to heif_decode_image_into()"};
+  }
+
+  std::map<heif_channel, PlaneBuffer> buffers;
+  for (int i = 0; i < num_plane_buffers; i++) {
+    const heif_image_plane_buffer& buffer = plane_buffers[i];
+    if (buffer.data == nullptr) {
+      return error_null_parameter;
+    }
+
+    if (buffers.find(buffer.channel) != buffers.end()) {
+      return {heif_error_Usage_error,
+              heif_suberror_Invalid_parameter_value,
+              "More than one plane buffer for the same channel passed to heif_decode_image_into()"};
+    }
+
+    buffers[buffer.channel] = PlaneBuffer{buffer.data, buffer.stride, buffer.size};
+  }
+
+  heif_item_id id = in_handle->image->get_id();
+
+  heif_decoding_options dec_options = normalize_options(input_options);
+
+  Result<std::shared_ptr<HeifPixelImage>> decodingResult = in_handle->context->decode_image(id,
+                                                                                            colorspace,
+                                                                                            chroma,
+                                                                                            dec_options,
+                                                                                            false, 0, 0,
+                                                                                            &buffers);
+  if (decodingResult.error.error_code != heif_error_Ok) {
+    return decodingResult.error.error_struct(in_handle->image.get());
+  }
+
+  *out_img = new heif_image();
+  (*out_img)->image = std::move(decodingResult.value);
+
+  return Error::Ok.error_struct(in_handle->image.get());
+}
+
+
 struct heif_error heif_image_handle_decode_image_tile(const struct heif_image_handle* in_handle,
                                                       struct heif_image** out_img,
                                                       enum heif_colorspace colorspace,
@@ -1484,6 +1668,57 @@ struct heif_error heif_image_handle_decode_image_tile(const struct heif_image_ha
 }
 
 
+struct heif_error heif_image_handle_decode_region(const struct heif_image_handle* in_handle,
+                                                  struct heif_image** out_img,
+                                                  enum heif_colorspace colorspace,
+                                                  enum heif_chroma chroma,
+                                                  const struct heif_decoding_options* input_options,
+                                                  uint32_t x0, uint32_t y0, uint32_t width, uint32_t height)
+{
+  if (!in_handle || !out_img) {
+    return error_null_parameter;
+  }
+
+  *out_img = nullptr;
+
+  if (width == 0 || height == 0) {
+    return {heif_error_Usage_error,
+            heif_suberror_Invalid_parameter_value,
+            "Empty region passed to heif_image_handle_decode_region()"};
+  }
+
+  heif_item_id id = in_handle->image->get_id();
+
+  heif_decoding_options dec_options = normalize_options(input_options);
+
+  Result<std::shared_ptr<HeifPixelImage>> decodingResult = in_handle->context->decode_image_region(id,
+                                                                                                   colorspace,
+                                                                                                   chroma,
+                                                                                                   dec_options,
+                                                                                                   x0, y0, width, height);
+  if (decodingResult.error.error_code != heif_error_Ok) {
+    return decodingResult.error.error_struct(in_handle->image.get());
+  }
+
+  *out_img = new heif_image();
+  (*out_img)->image = std::move(decodingResult.value);
+
+  return Error::Ok.error_struct(in_handle->image.get());
+}
+
+
+void heif_image_handle_set_decoded_tile_cache_size(const struct heif_image_handle* handle, size_t max_bytes)
+{
+  if (handle) {
+    handle->image->get_decoded_tile_cache().set_max_bytes(max_bytes);
+
+    if (auto alpha = handle->image->get_alpha_channel()) {
+      alpha->get_decoded_tile_cache().set_max_bytes(max_bytes);
+    }
+  }
+}
+
+
 struct heif_error heif_image_create(int width, int height,
                                     heif_colorspace colorspace,
                                     heif_chroma chroma,
@@ -2586,7 +2821,7 @@ struct heif_error heif_register_decoder_plugin(const heif_decoder_plugin* decode
   if (!decoder_plugin) {
     return error_null_parameter;
   }
-  else if (decoder_plugin->plugin_api_version > 3) {
+  else if (decoder_plugin->plugin_api_version > 5) {
     return error_unsupported_plugin_version;
   }
 
@@ -2629,15 +2864,14 @@ void heif_context_reset(struct heif_context* ctx)
 static struct heif_error heif_file_writer_write(struct heif_context* ctx,
                                                 const void* data, size_t size, void* userdata)
 {
-  const char* filename = static_cast<const char*>(userdata);
+  auto* ostr = static_cast<std::ofstream*>(userdata);
+
+  ostr->write(static_cast<const char*>(data), size);
+  if (!*ostr) {
+    return Error(heif_error_Encoding_error,
+                 heif_suberror_Cannot_write_output_data).error_struct(ctx->context.get());
+  }
 
-#if defined(__MINGW32__) || defined(__MINGW64__) || defined(_MSC_VER)
-  std::ofstream ostr(HeifFile::convert_utf8_path_to_utf16(filename).c_str(), std::ios_base::binary);
-#else
-  std::ofstream ostr(filename, std::ios_base::binary);
-#endif
-  ostr.write(static_cast<const char*>(data), size);
-  // TODO: handle write errors
   return Error::Ok.error_struct(ctx->context.get());
 }
 
@@ -2645,10 +2879,17 @@ static struct heif_error heif_file_writer_write(struct heif_context* ctx,
 struct heif_error heif_context_write_to_file(struct heif_context* ctx,
                                              const char* filename)
 {
+  // The stream stays open, because the writer may be called several times.
+#if defined(__MINGW32__) || defined(__MINGW64__) || defined(_MSC_VER)
+  std::ofstream ostr(HeifFile::convert_utf8_path_to_utf16(filename).c_str(), std::ios_base::binary);
+#else
+  std::ofstream ostr(filename, std::ios_base::binary);
+#endif
+
   heif_writer writer;
   writer.writer_api_version = 1;
   writer.write = heif_file_writer_write;
-  return heif_context_write(ctx, &writer, (void*) filename);
+  return heif_context_write(ctx, &writer, &ostr);
 }
 
 
@@ -2665,6 +2906,13 @@ struct heif_error heif_context_write(struct heif_context* ctx,
     return err.error_struct(ctx->context.get());
   }
 
+  std::shared_ptr<HeifFile> file = ctx->context->get_heif_file();
+  if (file->get_write_mode() == FileLayout::WriteMode::Streaming) {
+    Error err(heif_error_Usage_error, heif_suberror_Unspecified,
+              "Use heif_context_finish_streaming_to_file() for files that are written while encoding");
+    return err.error_struct(ctx->context.get());
+  }
+
   StreamWriter swriter;
   ctx->context->write(swriter);
 
@@ -2673,9 +2921,55 @@ struct heif_error heif_context_write(struct heif_context* ctx,
   if (!writer_error.message) {
     return heif_error{heif_error_Usage_error, heif_suberror_Null_pointer_argument, "heif_writer callback returned a null error text"};
   }
-  else {
+  else if (writer_error.code != heif_error_Ok) {
     return writer_error;
   }
+
+  // --- copy the image data from the temporary file
+
+  Error err = file->write_item_data([&](const uint8_t* chunk, size_t size) {
+    writer_error = writer->write(ctx, chunk, size, userdata);
+    if (!writer_error.message) {
+      writer_error = heif_error{heif_error_Usage_error, heif_suberror_Null_pointer_argument, "heif_writer callback returned a null error text"};
+    }
+
+    return (writer_error.code == heif_error_Ok ? Error::Ok : Error(writer_error.code, writer_error.subcode));
+  });
+
+  if (writer_error.code != heif_error_Ok) {
+    return writer_error;
+  }
+
+  return err.error_struct(ctx->context.get());
+}
+
+
+struct heif_error heif_context_use_tmp_file_for_image_data(struct heif_context* ctx)
+{
+  Error err = ctx->context->get_heif_file()->set_write_mode(FileLayout::WriteMode::TmpFile);
+  return err.error_struct(ctx->context.get());
+}
+
+
+struct heif_error heif_context_start_streaming_to_file(struct heif_context* ctx,
+                                                       const char* filename,
+                                                       uint32_t reserved_header_size)
+{
+  if (!filename) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Null_pointer_argument).error_struct(ctx->context.get());
+  }
+
+  Error err = ctx->context->get_heif_file()->set_write_mode(FileLayout::WriteMode::Streaming, filename,
+                                                           reserved_header_size);
+  return err.error_struct(ctx->context.get());
+}
+
+
+struct heif_error heif_context_finish_streaming_to_file(struct heif_context* ctx)
+{
+  Error err = ctx->context->finish_streaming();
+  return err.error_struct(ctx->context.get());
 }
 
 
@@ -2799,6 +3093,18 @@ const char* heif_decoder_descriptor_get_id_name(const struct heif_decoder_descri
 }
 
 
+const struct heif_encoder_parameter* const* heif_decoder_descriptor_list_parameters(const struct heif_decoder_descriptor* descriptor)
+{
+  auto decoder = (heif_decoder_plugin*) descriptor;
+  if (decoder->plugin_api_version < 5 || decoder->list_parameters == nullptr) {
+    return nullptr;
+  }
+  else {
+    return decoder->list_parameters();
+  }
+}
+
+
 enum heif_compression_format
 heif_encoder_descriptor_get_compression_format(const struct heif_encoder_descriptor* descriptor)
 {
@@ -2926,7 +3232,12 @@ struct heif_error heif_encoder_set_lossy_quality(struct heif_encoder* encoder,
                  heif_suberror_Null_pointer_argument).error_struct(nullptr);
   }
 
-  return encoder->plugin->set_parameter_quality(encoder->encoder, quality);
+  struct heif_error err = encoder->plugin->set_parameter_quality(encoder->encoder, quality);
+  if (err.code == heif_error_Ok) {
+    encoder->parameter_assignments.push_back({heif_encoder::ParameterAssignment::Type::quality, {}, quality, {}});
+  }
+
+  return err;
 }
 
 
@@ -2937,7 +3248,12 @@ struct heif_error heif_encoder_set_lossless(struct heif_encoder* encoder, int en
                  heif_suberror_Null_pointer_argument).error_struct(nullptr);
   }
 
-  return encoder->plugin->set_parameter_lossless(encoder->encoder, enable);
+  struct heif_error err = encoder->plugin->set_parameter_lossless(encoder->encoder, enable);
+  if (err.code == heif_error_Ok) {
+    encoder->parameter_assignments.push_back({heif_encoder::ParameterAssignment::Type::lossless, {}, enable, {}});
+  }
+
+  return err;
 }
 
 
@@ -2949,7 +3265,12 @@ struct heif_error heif_encoder_set_logging_level(struct heif_encoder* encoder, i
   }
 
   if (encoder->plugin->set_parameter_logging_level) {
-    return encoder->plugin->set_parameter_logging_level(encoder->encoder, level);
+    struct heif_error err = encoder->plugin->set_parameter_logging_level(encoder->encoder, level);
+    if (err.code == heif_error_Ok) {
+      encoder->parameter_assignments.push_back({heif_encoder::ParameterAssignment::Type::logging_level, {}, level, {}});
+    }
+
+    return err;
   }
 
   return heif_error_success;
@@ -3019,7 +3340,12 @@ struct heif_error heif_encoder_set_parameter_integer(struct heif_encoder* encode
 
   // --- parameter is ok, pass it to the encoder plugin
 
-  return encoder->plugin->set_parameter_integer(encoder->encoder, parameter_name, value);
+  struct heif_error err = encoder->plugin->set_parameter_integer(encoder->encoder, parameter_name, value);
+  if (err.code == heif_error_Ok) {
+    encoder->parameter_assignments.push_back({heif_encoder::ParameterAssignment::Type::integer, parameter_name, value, {}});
+  }
+
+  return err;
 }
 
 struct heif_error heif_encoder_get_parameter_integer(struct heif_encoder* encoder,
@@ -3140,7 +3466,12 @@ struct heif_error heif_encoder_set_parameter_boolean(struct heif_encoder* encode
                                                      const char* parameter_name,
                                                      int value)
 {
-  return encoder->plugin->set_parameter_boolean(encoder->encoder, parameter_name, value);
+  struct heif_error err = encoder->plugin->set_parameter_boolean(encoder->encoder, parameter_name, value);
+  if (err.code == heif_error_Ok) {
+    encoder->parameter_assignments.push_back({heif_encoder::ParameterAssignment::Type::boolean, parameter_name, value, {}});
+  }
+
+  return err;
 }
 
 struct heif_error heif_encoder_get_parameter_boolean(struct heif_encoder* encoder,
@@ -3154,7 +3485,12 @@ struct heif_error heif_encoder_set_parameter_string(struct heif_encoder* encoder
                                                     const char* parameter_name,
                                                     const char* value)
 {
-  return encoder->plugin->set_parameter_string(encoder->encoder, parameter_name, value);
+  struct heif_error err = encoder->plugin->set_parameter_string(encoder->encoder, parameter_name, value);
+  if (err.code == heif_error_Ok) {
+    encoder->parameter_assignments.push_back({heif_encoder::ParameterAssignment::Type::string, parameter_name, 0, value});
+  }
+
+  return err;
 }
 
 struct heif_error heif_encoder_get_parameter_string(struct heif_encoder* encoder,
@@ -3323,7 +3659,7 @@ int heif_encoder_has_default(struct heif_encoder* encoder,
 
 void set_default_encoding_options(heif_encoding_options& options)
 {
-  options.version = 7;
+  options.version = 9;
 
   options.save_alpha_channel = true;
   options.macOS_compatibility_workaround = false;
@@ -3338,11 +3674,25 @@ void set_default_encoding_options(heif_encoding_options& options)
   options.color_conversion_options.only_use_preferred_chroma_algorithm = false;
 
   options.prefer_uncC_short_form = true;
+
+  options.grid_tile_width = 0;
+  options.grid_tile_height = 0;
+
+  options.thumbnail_bbox_size = 0;
+  options.save_thumbnail_alpha_channel = true;
 }
 
 static void copy_options(heif_encoding_options& options, const heif_encoding_options& input_options)
 {
   switch (input_options.version) {
+    case 9:
+      options.thumbnail_bbox_size = input_options.thumbnail_bbox_size;
+      options.save_thumbnail_alpha_channel = input_options.save_thumbnail_alpha_channel;
+      // fallthrough
+    case 8:
+      options.grid_tile_width = input_options.grid_tile_width;
+      options.grid_tile_height = input_options.grid_tile_height;
+      // fallthrough
     case 7:
       options.prefer_uncC_short_form = input_options.prefer_uncC_short_form;
       // fallthrough
@@ -3368,6 +3718,34 @@ static void copy_options(heif_encoding_options& options, const heif_encoding_opt
 }
 
 
+// Sets 'options' to the defaults overridden by 'input_options' (if given). When the input options
+// do not specify an output nclx profile, the profile of 'input_image' is written into 'nclx' and used.
+// 'nclx' has to stay valid as long as 'options' are used.
+static void set_encoding_options_for_image(heif_encoding_options& options,
+                                           heif_color_profile_nclx& nclx,
+                                           const heif_encoding_options* input_options,
+                                           const std::shared_ptr<HeifPixelImage>& input_image)
+{
+  set_default_encoding_options(options);
+
+  if (input_options) {
+    copy_options(options, *input_options);
+
+    if (options.output_nclx_profile == nullptr) {
+      auto input_nclx = input_image->get_color_profile_nclx();
+      if (input_nclx) {
+        options.output_nclx_profile = &nclx;
+        nclx.version = 1;
+        nclx.color_primaries = (enum heif_color_primaries) input_nclx->get_colour_primaries();
+        nclx.transfer_characteristics = (enum heif_transfer_characteristics) input_nclx->get_transfer_characteristics();
+        nclx.matrix_coefficients = (enum heif_matrix_coefficients) input_nclx->get_matrix_coefficients();
+        nclx.full_range_flag = input_nclx->get_full_range_flag();
+      }
+    }
+  }
+}
+
+
 heif_encoding_options* heif_encoding_options_alloc()
 {
   auto options = new heif_encoding_options;
@@ -3400,22 +3778,7 @@ struct heif_error heif_context_encode_image(struct heif_context* ctx,
 
   heif_encoding_options options;
   heif_color_profile_nclx nclx;
-  set_default_encoding_options(options);
-  if (input_options) {
-    copy_options(options, *input_options);
-
-    if (options.output_nclx_profile == nullptr) {
-      auto input_nclx = input_image->image->get_color_profile_nclx();
-      if (input_nclx) {
-        options.output_nclx_profile = &nclx;
-        nclx.version = 1;
-        nclx.color_primaries = (enum heif_color_primaries) input_nclx->get_colour_primaries();
-        nclx.transfer_characteristics = (enum heif_transfer_characteristics) input_nclx->get_transfer_characteristics();
-        nclx.matrix_coefficients = (enum heif_matrix_coefficients) input_nclx->get_matrix_coefficients();
-        nclx.full_range_flag = input_nclx->get_full_range_flag();
-      }
-    }
-  }
+  set_encoding_options_for_image(options, nclx, input_options, input_image->image);
 
   auto encodingResult = ctx->context->encode_image(input_image->image,
                                      encoder,
@@ -3443,10 +3806,75 @@ struct heif_error heif_context_encode_image(struct heif_context* ctx,
 }
 
 
+struct heif_error heif_context_encode_images(struct heif_context* ctx,
+                                             const struct heif_image* const* input_images,
+                                             int num_images,
+                                             struct heif_encoder* encoder,
+                                             const struct heif_encoding_options* input_options,
+                                             struct heif_image_handle** out_image_handles)
+{
+  if (!encoder || (!input_images && num_images > 0)) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Null_pointer_argument).error_struct(ctx->context.get());
+  }
+  else if (num_images < 0) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Invalid_parameter_value).error_struct(ctx->context.get());
+  }
+
+  if (out_image_handles) {
+    for (int i = 0; i < num_images; i++) {
+      out_image_handles[i] = nullptr;
+    }
+  }
+
+  // The nclx profiles have to stay at the same address, because the options point to them.
+  std::vector<heif_color_profile_nclx> nclx_profiles(num_images);
+  std::vector<EncodingPipeline::Input> inputs(num_images);
+
+  for (int i = 0; i < num_images; i++) {
+    if (!input_images[i]) {
+      return Error(heif_error_Usage_error,
+                   heif_suberror_Null_pointer_argument).error_struct(ctx->context.get());
+    }
+
+    EncodingPipeline::Input& input = inputs[i];
+    input.image = input_images[i]->image;
+    input.input_class = heif_image_input_class_normal;
+
+    set_encoding_options_for_image(input.options, nclx_profiles[i], input_options, input.image);
+  }
+
+  EncodingPipeline pipeline(ctx->context.get(), encoder);
+  auto encodingResult = pipeline.encode(inputs);
+  if (encodingResult.error != Error::Ok) {
+    return encodingResult.error.error_struct(ctx->context.get());
+  }
+
+  const std::vector<std::shared_ptr<ImageItem>>& images = *encodingResult;
+
+  // mark the first image as primary image
+
+  if (!images.empty() && ctx->context->is_primary_image_set() == false) {
+    ctx->context->set_primary_image(images[0]);
+  }
+
+  if (out_image_handles) {
+    for (size_t i = 0; i < images.size(); i++) {
+      out_image_handles[i] = new heif_image_handle;
+      out_image_handles[i]->image = images[i];
+      out_image_handles[i]->context = ctx->context;
+    }
+  }
+
+  return heif_error_success;
+}
+
+
 struct heif_error heif_context_encode_grid(struct heif_context* ctx,
                                            struct heif_image** tiles,
-                                           uint16_t columns,
                                            uint16_t rows,
+                                           uint16_t columns,
                                            struct heif_encoder* encoder,
                                            const struct heif_encoding_options* input_options,
                                            struct heif_image_handle** out_image_handle)
@@ -3460,25 +3888,9 @@ struct heif_error heif_context_encode_grid(struct heif_context* ctx,
                  heif_suberror_Invalid_parameter_value).error_struct(ctx->context.get());
   }
 
-  // TODO: Don't repeat this code from heif_context_encode_image()
   heif_encoding_options options;
   heif_color_profile_nclx nclx;
-  set_default_encoding_options(options);
-  if (input_options) {
-    copy_options(options, *input_options);
-
-    if (options.output_nclx_profile == nullptr) {
-      auto input_nclx = tiles[0]->image->get_color_profile_nclx();
-      if (input_nclx) {
-        options.output_nclx_profile = &nclx;
-        nclx.version = 1;
-        nclx.color_primaries = (enum heif_color_primaries) input_nclx->get_colour_primaries();
-        nclx.transfer_characteristics = (enum heif_transfer_characteristics) input_nclx->get_transfer_characteristics();
-        nclx.matrix_coefficients = (enum heif_matrix_coefficients) input_nclx->get_matrix_coefficients();
-        nclx.full_range_flag = input_nclx->get_full_range_flag();
-      }
-    }
-  }
+  set_encoding_options_for_image(options, nclx, input_options, tiles[0]->image);
 
   // Convert heif_images to a vector of HeifPixelImages
   std::vector<std::shared_ptr<HeifPixelImage>> pixel_tiles;
@@ -3488,11 +3900,17 @@ struct heif_error heif_context_encode_grid(struct heif_context* ctx,
 
   // Encode Grid
   std::shared_ptr<ImageItem> out_grid;
+  uint32_t tile_width = pixel_tiles[0]->get_width();
+  uint32_t tile_height = pixel_tiles[0]->get_height();
+
   auto addGridResult = ImageItem_Grid::add_and_encode_full_grid(ctx->context.get(),
                                                                 pixel_tiles,
                                                                 rows, columns,
+                                                                tile_width * columns,
+                                                                tile_height * rows,
                                                                 encoder,
-                                                                options);
+                                                                options,
+                                                                heif_image_input_class_normal);
   if (addGridResult.error) {
     return addGridResult.error.error_struct(ctx->context.get());
   }
@@ -3663,6 +4081,59 @@ struct heif_error heif_context_add_image_tile(struct heif_context* ctx,
 }
 
 
+struct heif_error heif_context_add_image_tile_rows(struct heif_context* ctx,
+                                                   struct heif_image_handle* tiled_image,
+                                                   uint32_t first_row, uint32_t num_rows,
+                                                   const struct heif_image* const* tiles,
+                                                   struct heif_encoder* encoder)
+{
+  if (!tiled_image || !tiles || !encoder) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Null_pointer_argument).error_struct(ctx->context.get());
+  }
+
+  heif_image_tiling tiling = tiled_image->image->get_heif_image_tiling();
+  if (first_row >= tiling.num_rows || num_rows > tiling.num_rows - first_row) {
+    return Error(heif_error_Usage_error,
+                 heif_suberror_Invalid_parameter_value,
+                 "Tile rows exceed the image size").error_struct(ctx->context.get());
+  }
+
+  std::vector<std::shared_ptr<HeifPixelImage>> pixel_tiles;
+  for (size_t i = 0; i < static_cast<size_t>(num_rows) * tiling.num_columns; i++) {
+    if (!tiles[i]) {
+      return Error(heif_error_Usage_error,
+                   heif_suberror_Null_pointer_argument).error_struct(ctx->context.get());
+    }
+
+    pixel_tiles.push_back(tiles[i]->image);
+  }
+
+  if (auto tili_image = std::dynamic_pointer_cast<ImageItem_Tiled>(tiled_image->image)) {
+    Error err = tili_image->add_image_tile_rows(first_row, num_rows, pixel_tiles, encoder);
+    return err.error_struct(ctx->context.get());
+  }
+  else if (auto grid_item = std::dynamic_pointer_cast<ImageItem_Grid>(tiled_image->image)) {
+    Error err = grid_item->add_image_tile_rows(tiled_image->image->get_id(), first_row, num_rows, pixel_tiles, encoder);
+    return err.error_struct(ctx->context.get());
+  }
+
+  // other tiled images are added tile by tile
+
+  for (size_t i = 0; i < pixel_tiles.size(); i++) {
+    uint32_t tile_x = static_cast<uint32_t>(i % tiling.num_columns);
+    uint32_t tile_y = first_row + static_cast<uint32_t>(i / tiling.num_columns);
+
+    heif_error err = heif_context_add_image_tile(ctx, tiled_image, tile_x, tile_y, tiles[i], encoder);
+    if (err.code) {
+      return err;
+    }
+  }
+
+  return heif_error_success;
+}
+
+
 struct heif_error heif_context_add_unci_image(struct heif_context* ctx,
                                               const struct heif_unci_image_parameters* parameters,
                                               const struct heif_encoding_options* encoding_options,
@@ -3846,3 +4317,27 @@ void heif_context_set_max_decoding_threads(struct heif_context* ctx, int max_thr
 {
   ctx->context->set_max_decoding_threads(max_threads);
 }
+
+
+void heif_context_set_max_encoding_threads(struct heif_context* ctx, int max_threads)
+{
+  ctx->context->set_max_encoding_threads(max_threads);
+}
+
+
+void heif_context_set_deferred_image_interpretation(struct heif_context* ctx, int enable)
+{
+  ctx->context->set_deferred_image_interpretation(enable != 0);
+}
+
+
+void heif_context_set_memory_mapped_file_reading(struct heif_context* ctx, int enable)
+{
+  ctx->context->set_memory_mapped_file_reading(enable != 0);
+}
+
+
+void heif_context_set_arena_allocation(struct heif_context* ctx, int enable)
+{
+  ctx->context->set_arena_allocation(enable != 0);
+}
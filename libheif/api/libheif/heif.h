@@ -54,6 +54,7 @@ extern "C" {
 //  1.16           5            6             1             1            1            1
 //  1.18           5            7             1             1            1            1
 //  1.19           6            7             2             1            1            1
+//  1.20           8            9             2             1            1            1
 
 #if defined(_MSC_VER) && !defined(LIBHEIF_STATIC_BUILD)
 #ifdef LIBHEIF_EXPORTS
@@ -1030,12 +1031,16 @@ struct heif_reader
   // to preload offset pointer tables.
   // Another difference to request_file_range() is that this call should be non-blocking.
   // If you preload any data, do this in a background thread.
+  // When decoding grid images or image regions, libheif announces the data of all required tiles through
+  // this function before decoding them. Nearby ranges are merged into one hint.
   void (*preload_range_hint)(uint64_t start_pos, uint64_t end_pos, void* userdata);
 
   // If libheif does not need access to a file range anymore, it may call this function to
   // give a hint to the reader that it may release the range from a cache.
   // If you do not maintain a file cache that wants to reduce its size dynamically, you do not
   // need to implement this function.
+  // preload_range_hint() and release_file_range() may be called from several decoding threads at the same time
+  // and concurrently with the other reader functions.
   void (*release_file_range)(uint64_t start_pos, uint64_t end_pos, void* userdata);
 
   // Release an error message that was returned by heif_reader in an earlier call.
@@ -1113,14 +1118,56 @@ void heif_context_debug_dump_boxes_to_file(struct heif_context* ctx, int fd);
 LIBHEIF_API
 void heif_context_set_maximum_image_size_limit(struct heif_context* ctx, int maximum_pixels);
 
+// Sets the size of the context's thread pool that is used to decode the tiles of 'grid' images
+// and the images of 'iovl' overlays. All images decoded through this context share the same pool.
 // If the maximum threads number is set to 0, the image tiles are decoded in the main thread.
 // This is different from setting it to 1, which will generate a single background thread to decode the tiles.
-// Note that this setting only affects libheif itself. The codecs itself may still use multi-threaded decoding.
+// Once this is set, it also limits the number of threads of the codecs that support it (tiles that are decoded
+// on the pool use a single codec thread). Otherwise, the codecs choose their number of threads themselves.
 // You can use it, for example, in cases where you are decoding several images in parallel anyway you thus want
 // to minimize parallelism in each decoder.
 LIBHEIF_API
 void heif_context_set_max_decoding_threads(struct heif_context* ctx, int max_threads);
 
+// Sets the number of tiles that heif_context_encode_grid() and heif_context_add_image_tile_rows() compress in parallel.
+// Each thread uses its own instance of the encoder plugin that is configured with the same parameters as the
+// encoder passed to these functions. The tiles are written in tile order, independent of the number of threads.
+// The default is 1, i.e. the tiles are encoded sequentially in the calling thread.
+// Note that many encoder plugins use several threads internally. Reduce their number of threads accordingly.
+LIBHEIF_API
+void heif_context_set_max_encoding_threads(struct heif_context* ctx, int max_threads);
+
+// When enabled, the interpretation of image items is deferred: reading a file only interprets the top-level images
+// and the items they depend on. All other image items (e.g. the tiles of a grid image) are interpreted when they
+// are accessed for the first time. Errors in these items are then reported when accessing them instead of when
+// reading the file.
+// This also makes the parsing of the item metadata lazy: the 'infe' boxes, 'iloc' and 'ipma' entries and the
+// properties are only indexed when the file is read and each of them is parsed when it is accessed for the first time.
+// Errors in these boxes are then also reported when accessing the item.
+// This has to be set before reading the file.
+LIBHEIF_API
+void heif_context_set_deferred_image_interpretation(struct heif_context* ctx, int enable);
+
+// When enabled, heif_context_read_from_file() maps the file into memory instead of reading it through a file stream.
+// This avoids copying the file data on POSIX systems. Where the file cannot be mapped (Windows, pipes, devices),
+// it is read through a file stream as usual. The default is disabled.
+// Warning: when the file is truncated by another process while it is mapped, accessing the missing part raises
+// SIGBUS, which terminates the process unless the application handles that signal. Only enable this for files
+// that are not modified while the heif_context is in use.
+// This has to be set before reading the file.
+LIBHEIF_API
+void heif_context_set_memory_mapped_file_reading(struct heif_context* ctx, int enable);
+
+// When enabled, the boxes that are parsed from the file and their entry tables are allocated from an arena
+// that belongs to the file instead of allocating each of them separately. This reduces the time spent in memory
+// allocation when the metadata of files with many items is read.
+// The arena is released at once when the heif_context and all objects that reference its boxes (e.g. image handles)
+// are released. Boxes that are removed or replaced while the context is in use are not released before that.
+// The default is disabled.
+// This has to be set before reading the file.
+LIBHEIF_API
+void heif_context_set_arena_allocation(struct heif_context* ctx, int enable);
+
 
 // --- security limits
 
@@ -1168,6 +1215,71 @@ LIBHEIF_API
 struct heif_error heif_context_set_security_limits(struct heif_context*, const struct heif_security_limits*);
 
 
+// ========================= image memory =========================
+
+// The memory for the pixel data of images can be supplied by the application.
+// The allocator functions may be called from several threads at the same time.
+
+struct heif_image_allocator
+{
+  // API version supported by this allocator (currently 1)
+  int version;
+
+  // --- version 1 functions ---
+
+  // Allocate 'size' bytes of memory. Return NULL if the memory cannot be allocated.
+  void* (* allocate)(void* userdata, size_t size);
+
+  // Release memory that was returned by 'allocate'. 'size' is the size that was requested.
+  void (* release)(void* userdata, void* mem, size_t size);
+
+  // version 2 functions will follow below ...
+};
+
+// Set the allocator for all images that are not decoded within a heif_context with its own allocator.
+// This includes images created with heif_image_create().
+// The allocator and 'userdata' must stay valid until all images allocated with it are released.
+// Pass NULL to switch back to the default allocator.
+LIBHEIF_API
+struct heif_error heif_set_image_allocator(const struct heif_image_allocator* allocator, void* userdata);
+
+// Set the allocator for the images decoded from this context. Pass NULL to use the global allocator.
+// Note that the images returned by decoder plugins are allocated with the global allocator. Only the
+// final images (e.g. after color conversion or assembling the tiles of a grid image) use this allocator.
+LIBHEIF_API
+struct heif_error heif_context_set_image_allocator(struct heif_context*, const struct heif_image_allocator* allocator, void* userdata);
+
+
+// A buffer pool keeps the memory of released images for reuse by the next images instead of
+// returning it to the allocator. This avoids the costs of repeatedly allocating (and page-faulting)
+// large image buffers when decoding many images of similar size.
+// The pool stores at most 'max_cached_bytes'. Setting it to 0 disables the pool and releases its memory
+// as soon as all images using it are released.
+
+LIBHEIF_API
+void heif_set_image_buffer_pool_size(size_t max_cached_bytes);
+
+LIBHEIF_API
+void heif_context_set_image_buffer_pool_size(struct heif_context*, size_t max_cached_bytes);
+
+struct heif_image_buffer_pool_statistics
+{
+  uint64_t hits;   // number of allocations that reused a buffer from the pool
+  uint64_t misses; // number of allocations that had to be passed to the allocator
+
+  uint64_t cached_bytes; // memory currently held by the pool
+  uint64_t num_cached_buffers;
+};
+
+// Returns heif_error_Usage_error if the buffer pool is not enabled.
+LIBHEIF_API
+struct heif_error heif_get_image_buffer_pool_statistics(struct heif_image_buffer_pool_statistics* out_stats);
+
+LIBHEIF_API
+struct heif_error heif_context_get_image_buffer_pool_statistics(const struct heif_context*,
+                                                                struct heif_image_buffer_pool_statistics* out_stats);
+
+
 // ========================= heif_image_handle =========================
 
 // An heif_image_handle is a handle to a logical image in the HEIF file.
@@ -1298,6 +1410,25 @@ struct heif_error heif_image_handle_decode_image_tile(const struct heif_image_ha
                                                       const struct heif_decoding_options* options,
                                                       uint32_t tile_x, uint32_t tile_y);
 
+// Decodes the rectangle [x0, x0+width) x [y0, y0+height) of the image.
+// For tiled images, only the tiles that intersect the region are decoded (in parallel, see heif_context_set_max_decoding_threads()).
+// The coordinates are given in the transformed image unless option->ignore_transformations is set.
+LIBHEIF_API
+struct heif_error heif_image_handle_decode_region(const struct heif_image_handle* in_handle,
+                                                  struct heif_image** out_img,
+                                                  enum heif_colorspace colorspace,
+                                                  enum heif_chroma chroma,
+                                                  const struct heif_decoding_options* options,
+                                                  uint32_t x0, uint32_t y0, uint32_t width, uint32_t height);
+
+// Keep up to 'max_bytes' of decoded tiles so that heif_image_handle_decode_region() does not decode
+// the same tiles again for overlapping regions. The least recently used tiles are dropped first.
+// The cache belongs to the image, i.e. it is shared by all handles to the same image.
+// Tiles are only reused for decodes with the same decoder_id and decoder_parameters.
+// It is disabled by default (max_bytes = 0). Changing the size drops all cached tiles.
+LIBHEIF_API
+void heif_image_handle_set_decoded_tile_cache_size(const struct heif_image_handle* handle, size_t max_bytes);
+
 
 // ------------------------- entity groups ------------------------
 
@@ -1735,6 +1866,20 @@ struct heif_color_conversion_options
 LIBHEIF_API
 void heif_color_conversion_options_set_defaults(struct heif_color_conversion_options*);
 
+// Conversion pipelines are cached by their input and output formats and the conversion options,
+// so that the search for the conversion steps only runs once for each combination.
+
+struct heif_color_conversion_cache_statistics
+{
+  uint64_t hits;   // number of conversions that used a cached pipeline
+  uint64_t misses; // number of conversions for which the pipeline had to be searched
+
+  uint64_t num_cached_pipelines;
+};
+
+LIBHEIF_API
+void heif_get_color_conversion_cache_statistics(struct heif_color_conversion_cache_statistics* out_stats);
+
 
 struct heif_decoding_options
 {
@@ -1779,6 +1924,30 @@ struct heif_decoding_options
   // version 6 options
 
   int (* cancel_decoding)(void* progress_user_data);
+
+  // version 7 options
+
+  // Parameters passed to the decoder plugin, given as a NULL-terminated list of name/value pairs,
+  // e.g. {"threads", "1", "apply-film-grain", "false", NULL}.
+  // Use heif_decoder_descriptor_list_parameters() to get the parameters supported by a decoder.
+  // Decoding fails with heif_suberror_Unsupported_parameter if the decoder does not know a parameter, and with
+  // heif_suberror_Invalid_parameter_value if a value is not valid for the parameter type or out of range.
+  // Boolean values are given as "true"/"false" or "1"/"0".
+  // Only "threads" and "downscale", which libheif also sets itself, are ignored by decoders that do not support them.
+  // Default: NULL (use the decoder defaults).
+  const char* const* decoder_parameters;
+
+  // version 8 options
+
+  // If non-zero, the decoded image is scaled down (keeping its aspect ratio) to fit into
+  // max_output_width x max_output_height. If only one of them is set, only this dimension is limited.
+  // libheif picks the cheapest way to get there: a thumbnail or pyramid layer that is large enough,
+  // decoding the tiles of a grid image at a reduced size, or a decoder that can decode at a reduced
+  // resolution (e.g. JPEG). The result is filtered with a box filter. Images are never scaled up.
+  // This is not applied when decoding single tiles or regions and cannot be used with heif_decode_image_into().
+  // Default: 0 (no limit).
+  uint32_t max_output_width;
+  uint32_t max_output_height;
 };
 
 
@@ -1805,6 +1974,39 @@ struct heif_error heif_decode_image(const struct heif_image_handle* in_handle,
                                     enum heif_chroma chroma,
                                     const struct heif_decoding_options* options);
 
+// Caller-owned memory for one plane of a decoded image.
+struct heif_image_plane_buffer
+{
+  enum heif_channel channel;
+  uint8_t* data;
+  size_t stride; // bytes per row
+  size_t size;   // total size of the buffer in bytes
+};
+
+/**
+ * Decode an image like heif_decode_image(), but write the image planes directly into caller-owned memory.
+ *
+ * Grid images that are requested in the colorspace/chroma of their tiles are assembled directly in the buffers,
+ * other images are written into the buffers by the final color conversion. Where this is not possible
+ * (e.g. because of image transformations), the plane is copied into the buffer at the end.
+ *
+ * The planes of the returned image point to the buffers, so these must stay valid until the image
+ * is released. heif_image_release() does not free the buffers.
+ * Planes for which no buffer is given are allocated by libheif as usual. Buffers for channels that
+ * the decoded image does not have are left untouched.
+ *
+ * @param plane_buffers array of 'num_plane_buffers' buffers, at most one per channel.
+ * @return heif_error_Usage_error if a buffer is too small for the decoded plane.
+ */
+LIBHEIF_API
+struct heif_error heif_decode_image_into(const struct heif_image_handle* in_handle,
+                                         struct heif_image** out_img,
+                                         enum heif_colorspace colorspace,
+                                         enum heif_chroma chroma,
+                                         const struct heif_decoding_options* options,
+                                         const struct heif_image_plane_buffer* plane_buffers,
+                                         int num_plane_buffers);
+
 // Get the colorspace format of the image.
 LIBHEIF_API
 enum heif_colorspace heif_image_get_colorspace(const struct heif_image*);
@@ -2051,11 +2253,31 @@ struct heif_writer
                               void* userdata);
 };
 
+// Note: after heif_context_use_tmp_file_for_image_data(), the writer's write() function is called several times.
+// The data has to be appended in the order of the calls.
 LIBHEIF_API
 struct heif_error heif_context_write(struct heif_context*,
                                      struct heif_writer* writer,
                                      void* userdata);
 
+// The compressed image data is kept in a temporary file instead of in memory until heif_context_write()
+// copies it into the output. Has to be called before any image is added to the context.
+LIBHEIF_API
+struct heif_error heif_context_use_tmp_file_for_image_data(struct heif_context*);
+
+// Creates the output file immediately and writes the compressed image data into it as soon as it has been encoded,
+// e.g. tile by tile. Only the 'meta' box is kept in memory. Has to be called before any image is added to the context.
+// The first 'reserved_header_size' bytes of the file are kept free for the 'ftyp' and 'meta' boxes (0: 64 KiB).
+// When the 'meta' box does not fit into this space, it is written to the end of the file instead.
+// The file is complete after heif_context_finish_streaming_to_file(). heif_context_write() cannot be used then.
+LIBHEIF_API
+struct heif_error heif_context_start_streaming_to_file(struct heif_context*,
+                                                       const char* filename,
+                                                       uint32_t reserved_header_size);
+
+LIBHEIF_API
+struct heif_error heif_context_finish_streaming_to_file(struct heif_context*);
+
 // Add a compatible brand that is now added automatically by libheif when encoding images (e.g. some application brands like 'geo1').
 LIBHEIF_API
 void heif_context_add_compatible_brand(struct heif_context* ctx,
@@ -2096,6 +2318,13 @@ const char* heif_decoder_descriptor_get_name(const struct heif_decoder_descripto
 LIBHEIF_API
 const char* heif_decoder_descriptor_get_id_name(const struct heif_decoder_descriptor*);
 
+// Return the parameters that can be passed to the decoder with heif_decoding_options.decoder_parameters.
+// The list is terminated with a NULL entry. Use the heif_encoder_parameter_*() functions to query the
+// parameter properties.
+// Returns NULL if the decoder has no parameters.
+LIBHEIF_API
+const struct heif_encoder_parameter* const* heif_decoder_descriptor_list_parameters(const struct heif_decoder_descriptor*);
+
 // DEPRECATED: use heif_get_encoder_descriptors() instead.
 // Get a list of available encoders. You can filter the encoders by compression format and name.
 // Use format_filter==heif_compression_undefined and name_filter==NULL as wildcards.
@@ -2370,6 +2599,27 @@ struct heif_encoding_options
 
   // Set this to true to use compressed form of uncC where possible.
   uint8_t prefer_uncC_short_form;
+
+  // version 8 options
+
+  // When both are set, heif_context_encode_image() splits images that are larger than this tile size into
+  // a 'grid' image with tiles of this size. The tiles are encoded in parallel (see heif_context_set_max_encoding_threads()).
+  // Tiles at the right and bottom border are padded with the border pixels.
+  // Use even sizes for images with subsampled chroma. A grid can have at most 256 rows and 256 columns.
+  // Default: 0 (no splitting)
+  uint32_t grid_tile_width;
+  uint32_t grid_tile_height;
+
+  // version 9 options
+
+  // When set, heif_context_encode_image() also encodes a thumbnail that fits into a square of this size
+  // and assigns it to the image (like heif_context_encode_thumbnail()). The thumbnail is scaled from the
+  // color converted image and the color, alpha and thumbnail images are compressed concurrently with
+  // separate encoder instances (see heif_context_set_max_encoding_threads()). Default: 0 (no thumbnail)
+  uint32_t thumbnail_bbox_size;
+
+  // Whether the thumbnail gets an alpha channel. Only used when 'save_alpha_channel' is also set. Default: true
+  uint8_t save_thumbnail_alpha_channel;
 };
 
 LIBHEIF_API
@@ -2391,6 +2641,20 @@ struct heif_error heif_context_encode_image(struct heif_context*,
                                             const struct heif_encoding_options* options,
                                             struct heif_image_handle** out_image_handle);
 
+// Compress several independent images into the same file, e.g. the frames of a burst or the layers of a pyramid.
+// The color conversion of the next images, the compression of the current ones (with up to
+// heif_context_set_max_encoding_threads() encoder instances) and adding the finished images to the
+// file overlap, while only a few images are kept in memory at any time.
+// The images are added in array order and the result is the same as calling heif_context_encode_image()
+// for each image. 'out_image_handles' may be NULL or an array of 'num_images' handles that have to be released.
+LIBHEIF_API
+struct heif_error heif_context_encode_images(struct heif_context*,
+                                             const struct heif_image* const* images,
+                                             int num_images,
+                                             struct heif_encoder* encoder,
+                                             const struct heif_encoding_options* options,
+                                             struct heif_image_handle** out_image_handles);
+
 /**
  * @brief Encodes an array of images into a grid.
  * 
@@ -2399,6 +2663,7 @@ struct heif_error heif_context_encode_image(struct heif_context*,
  * @param rows The number of rows in the grid.
  * @param columns The number of columns in the grid.
  * @param encoder Defines the encoder to use. See heif_context_get_encoder_for_format()
+ *                The tiles are compressed in parallel, see heif_context_set_max_encoding_threads().
  * @param input_options Optional, may be nullptr.
  * @param out_image_handle Returns a handle to the grid. The caller is responsible for freeing it.
  * @return Returns an error if ctx, tiles, or encoder is nullptr. If rows or columns is 0. 
@@ -2428,6 +2693,16 @@ struct heif_error heif_context_add_image_tile(struct heif_context* ctx,
                                               const struct heif_image* image,
                                               struct heif_encoder* encoder);
 
+// Adds 'num_rows' complete rows of tiles, starting at tile row 'first_row'.
+// 'tiles' is an array of num_rows * (number of tile columns) images in row-major order.
+// For 'grid' and 'tili' images, the tiles are compressed in parallel (see heif_context_set_max_encoding_threads()).
+LIBHEIF_API
+struct heif_error heif_context_add_image_tile_rows(struct heif_context* ctx,
+                                                   struct heif_image_handle* tiled_image,
+                                                   uint32_t first_row, uint32_t num_rows,
+                                                   const struct heif_image* const* tiles,
+                                                   struct heif_encoder* encoder);
+
 // offsets[] should either be NULL (all offsets==0) or an array of size 2*nImages with x;y offset pairs.
 // If background_rgba is NULL, the background is transparent.
 LIBHEIF_API
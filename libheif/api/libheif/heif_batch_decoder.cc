@@ -0,0 +1,195 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "heif_batch_decoder.h"
+#include "api_structs.h"
+#include "batch_decoder.h"
+#include "image_allocator.h"
+#include "init.h"
+
+#include <map>
+#include <memory>
+#include <utility>
+
+
+struct heif_batch_decoder
+{
+  std::unique_ptr<BatchDecoder> decoder;
+};
+
+
+static const struct heif_error error_null_parameter = {heif_error_Usage_error,
+                                                       heif_suberror_Null_pointer_argument,
+                                                       "NULL passed"};
+
+
+struct heif_batch_decoder* heif_batch_decoder_alloc(int num_threads,
+                                                    heif_batch_decode_callback callback, void* userdata)
+{
+  if (callback == nullptr) {
+    return nullptr;
+  }
+
+  load_plugins_if_not_initialized_yet();
+
+  auto job_finished = [callback, userdata](const Error& err, const BatchDecoder::Job& job,
+                                           std::shared_ptr<HeifPixelImage> image, HeifContext* ctx) {
+    heif_image* out_img = nullptr;
+    if (!err) {
+      out_img = new heif_image();
+      out_img->image = std::move(image);
+    }
+
+    callback(err.error_struct(ctx), out_img, job.userdata, userdata);
+  };
+
+  auto* decoder = new heif_batch_decoder;
+  decoder->decoder = std::make_unique<BatchDecoder>(num_threads, job_finished);
+
+  return decoder;
+}
+
+
+void heif_batch_decoder_free(struct heif_batch_decoder* decoder)
+{
+  delete decoder;
+}
+
+
+void heif_batch_decoder_set_image_buffer_pool_size(struct heif_batch_decoder* decoder, size_t max_cached_bytes)
+{
+  if (decoder) {
+    decoder->decoder->set_image_buffer_pool(max_cached_bytes);
+  }
+}
+
+
+struct heif_error heif_batch_decoder_get_image_buffer_pool_statistics(const struct heif_batch_decoder* decoder,
+                                                                      struct heif_image_buffer_pool_statistics* out_stats)
+{
+  if (decoder == nullptr || out_stats == nullptr) {
+    return error_null_parameter;
+  }
+
+  const auto& pool = decoder->decoder->get_image_buffer_pool();
+  if (!pool) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unspecified,
+            "Image buffer pool is not enabled"};
+  }
+
+  *out_stats = pool->get_statistics();
+
+  return heif_error_success;
+}
+
+
+static struct heif_error add_job(struct heif_batch_decoder* decoder, BatchDecoder::Job job,
+                                 const struct heif_batch_decode_job* params)
+{
+  if (params->version < 1) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unsupported_parameter,
+            "Unsupported heif_batch_decode_job version"};
+  }
+
+  if (params->num_plane_buffers < 0 || (params->num_plane_buffers > 0 && params->plane_buffers == nullptr)) {
+    return {heif_error_Usage_error,
+            heif_suberror_Invalid_parameter_value,
+            "Invalid plane buffers passed to batch decoder job"};
+  }
+
+  for (int i = 0; i < params->num_plane_buffers; i++) {
+    const heif_image_plane_buffer& buffer = params->plane_buffers[i];
+    if (buffer.data == nullptr) {
+      return error_null_parameter;
+    }
+
+    if (job.output_buffers.find(buffer.channel) != job.output_buffers.end()) {
+      return {heif_error_Usage_error,
+              heif_suberror_Invalid_parameter_value,
+              "More than one plane buffer for the same channel passed to batch decoder job"};
+    }
+
+    job.output_buffers[buffer.channel] = PlaneBuffer{buffer.data, buffer.stride, buffer.size};
+  }
+
+  job.item_id = params->item_id;
+  job.colorspace = params->colorspace;
+  job.chroma = params->chroma;
+  job.options = normalize_options(params->options);
+  job.userdata = params->userdata;
+
+  decoder->decoder->add_job(std::move(job));
+
+  return heif_error_success;
+}
+
+
+struct heif_error heif_batch_decoder_add_file(struct heif_batch_decoder* decoder, const char* filename,
+                                              const struct heif_batch_decode_job* params)
+{
+  if (decoder == nullptr || filename == nullptr || params == nullptr) {
+    return error_null_parameter;
+  }
+
+  BatchDecoder::Job job;
+  job.filename = filename;
+
+  return add_job(decoder, std::move(job), params);
+}
+
+
+struct heif_error heif_batch_decoder_add_memory(struct heif_batch_decoder* decoder, const void* data, size_t size,
+                                                const struct heif_batch_decode_job* params)
+{
+  if (decoder == nullptr || data == nullptr || params == nullptr) {
+    return error_null_parameter;
+  }
+
+  BatchDecoder::Job job;
+  job.reader = std::make_shared<StreamReader_memory>((const uint8_t*) data, size, false);
+
+  return add_job(decoder, std::move(job), params);
+}
+
+
+struct heif_error heif_batch_decoder_add_reader(struct heif_batch_decoder* decoder,
+                                                const struct heif_reader* reader, void* reader_userdata,
+                                                const struct heif_batch_decode_job* params)
+{
+  if (decoder == nullptr || reader == nullptr || params == nullptr) {
+    return error_null_parameter;
+  }
+
+  BatchDecoder::Job job;
+  job.reader = std::make_shared<StreamReader_CApi>(reader, reader_userdata);
+
+  return add_job(decoder, std::move(job), params);
+}
+
+
+void heif_batch_decoder_wait(struct heif_batch_decoder* decoder)
+{
+  if (decoder) {
+    decoder->decoder->wait();
+  }
+}
@@ -0,0 +1,111 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LIBHEIF_HEIF_BATCH_DECODER_H
+#define LIBHEIF_HEIF_BATCH_DECODER_H
+
+#include "libheif/heif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// A batch decoder decodes images from many files in parallel. Compared to decoding each file
+// with its own heif_context, the jobs share one thread pool, the decoder plugin instances and
+// an optional image buffer pool (see heif_batch_decoder_set_image_buffer_pool_size()).
+// Each job reads its file, decodes one image and passes it to the callback.
+
+struct heif_batch_decoder;
+
+// Called from the decoding threads, possibly for several jobs at the same time, when a job is finished.
+// On success, 'image' is the decoded image, which has to be released with heif_image_release().
+// On error, 'image' is NULL. The error message is only valid during the call.
+typedef void (* heif_batch_decode_callback)(struct heif_error err, struct heif_image* image,
+                                            void* job_userdata, void* userdata);
+
+// 'num_threads' == 0 decodes each job in the call that adds the job.
+LIBHEIF_API
+struct heif_batch_decoder* heif_batch_decoder_alloc(int num_threads,
+                                                    heif_batch_decode_callback callback, void* userdata);
+
+// Waits for all jobs to finish.
+LIBHEIF_API
+void heif_batch_decoder_free(struct heif_batch_decoder*);
+
+// Has to be set before adding jobs. 0 (the default) disables the pool.
+LIBHEIF_API
+void heif_batch_decoder_set_image_buffer_pool_size(struct heif_batch_decoder*, size_t max_cached_bytes);
+
+LIBHEIF_API
+struct heif_error heif_batch_decoder_get_image_buffer_pool_statistics(const struct heif_batch_decoder*,
+                                                                      struct heif_image_buffer_pool_statistics* out_stats);
+
+
+struct heif_batch_decode_job
+{
+  // version 1 options
+
+  int version; // set to 1
+
+  // The image to decode. 0 decodes the primary image.
+  heif_item_id item_id;
+
+  enum heif_colorspace colorspace;
+  enum heif_chroma chroma;
+
+  // May be NULL. The options are copied, but the callbacks and objects that they reference have to stay valid
+  // until the job is finished.
+  const struct heif_decoding_options* options;
+
+  // Optional caller-owned output memory, see heif_decode_image_into(). Has to stay valid until the image is released.
+  const struct heif_image_plane_buffer* plane_buffers;
+  int num_plane_buffers;
+
+  // Passed to the callback.
+  void* userdata;
+};
+
+// The file is opened by the decoding thread.
+LIBHEIF_API
+struct heif_error heif_batch_decoder_add_file(struct heif_batch_decoder*, const char* filename,
+                                              const struct heif_batch_decode_job* job);
+
+// The data is not copied and has to stay valid until the job is finished.
+LIBHEIF_API
+struct heif_error heif_batch_decoder_add_memory(struct heif_batch_decoder*, const void* data, size_t size,
+                                                const struct heif_batch_decode_job* job);
+
+// The reader is used from the decoding thread.
+LIBHEIF_API
+struct heif_error heif_batch_decoder_add_reader(struct heif_batch_decoder*,
+                                                const struct heif_reader* reader, void* reader_userdata,
+                                                const struct heif_batch_decode_job* job);
+
+// Blocks until all jobs added so far are finished. Must not be called from the callback.
+LIBHEIF_API
+void heif_batch_decoder_wait(struct heif_batch_decoder*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -42,6 +42,7 @@ extern "C" {
 //  1.8          1         2          2
 //  1.13         2         3          2
 //  1.15         3         3          2
+//  1.20         5         3          2
 
 
 // ====================================================================================================
@@ -101,16 +102,49 @@ struct heif_decoder_plugin
 
   */
 
-  // Reset decoder, such that we can feed in new data for another image.
-  // void (*reset_image)(void* decoder);
-
   // --- version 3 functions will follow below ... ---
 
   const char* id_name;
 
   // --- version 4 functions will follow below ... ---
+
+  // Reset the decoder such that new data for another image can be pushed into it.
+  // libheif keeps decoder instances of plugins that implement this function and reuses them for
+  // further images with the same codec configuration (e.g. the tiles of a grid image).
+  // May be NULL, in which case a new decoder instance is allocated for each image.
+  struct heif_error (* reset_decoder)(void* decoder);
+
+  // --- version 5 functions will follow below ... ---
+
+  // Parameters that control the decoding (e.g. the number of threads). They use the same descriptions
+  // as the encoder parameters. libheif sets them after creating a decoder and before pushing data into it.
+  // They are not set again when a decoder is reused after reset_decoder(), so reset_decoder() has to keep them.
+  // Decoders are only reused for images that are decoded with the same parameter values.
+  // All four functions may be NULL if the plugin has no parameters. The setters may also be NULL individually
+  // if the plugin has no parameters of that type.
+  // The list is terminated with a NULL entry and has to stay valid until the plugin is deinitialized.
+  const struct heif_encoder_parameter** (* list_parameters)();
+
+  struct heif_error (* set_parameter_integer)(void* decoder, const char* name, int value);
+
+  struct heif_error (* set_parameter_boolean)(void* decoder, const char* name, int value);
+
+  struct heif_error (* set_parameter_string)(void* decoder, const char* name, const char* value);
+
+  // --- version 6 functions will follow below ... ---
 };
 
+// Number of threads that the decoder may use for decoding a single image.
+// libheif only sets this when the maximum number of decoding threads of the context was set explicitly.
+// It is then 1 when images are already decoded in parallel (e.g. the tiles of a grid image)
+// and the maximum number of decoding threads otherwise. If it is not set, the decoder chooses the number itself.
+#define heif_decoder_parameter_name_threads "threads"
+
+// Decode the image at 1/N of its resolution, if the codec can do this cheaply (e.g. JPEG DCT scaling).
+// The decoded image is N times smaller (rounded up). Decoders that do not support the requested factor
+// may return a larger image. libheif sets this when a reduced output size is requested in the decoding options.
+#define heif_decoder_parameter_name_downscale "downscale"
+
 
 enum heif_encoded_data_type
 {
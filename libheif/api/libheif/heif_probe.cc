@@ -0,0 +1,116 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heif_probe.h"
+#include "probe.h"
+#include "file.h"
+
+#include <memory>
+
+
+static const struct heif_error heif_error_null_pointer_argument = {
+    heif_error_Usage_error,
+    heif_suberror_Null_pointer_argument,
+    "NULL argument passed"
+};
+
+
+// There is no context that could own the error messages, so they are kept per thread.
+static thread_local ErrorBuffer tl_probe_error_buffer;
+
+
+static struct heif_error probe_stream(const std::shared_ptr<StreamReader>& reader, struct heif_probe_result* out_result)
+{
+  heif_probe_result result;
+  Error err = probe_heif_file(reader, &result);
+  if (err) {
+    return err.error_struct(&tl_probe_error_buffer);
+  }
+
+  // There are only version 1 fields so far. Later versions must not write beyond the caller's struct version.
+  *out_result = result;
+
+  return heif_error_success;
+}
+
+
+static struct heif_error check_probe_result_version(const struct heif_probe_result* out_result)
+{
+  if (out_result->version < 1) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unsupported_parameter,
+            "Unsupported heif_probe_result version"};
+  }
+
+  return heif_error_success;
+}
+
+
+struct heif_error heif_probe_file(const char* filename, struct heif_probe_result* out_result)
+{
+  if (filename == nullptr || out_result == nullptr) {
+    return heif_error_null_pointer_argument;
+  }
+
+  heif_error err = check_probe_result_version(out_result);
+  if (err.code) {
+    return err;
+  }
+
+  auto readerResult = HeifFile::open_file_reader(filename);
+  if (readerResult.error) {
+    return readerResult.error.error_struct(&tl_probe_error_buffer);
+  }
+
+  return probe_stream(readerResult.value, out_result);
+}
+
+
+struct heif_error heif_probe_memory(const void* data, size_t size, struct heif_probe_result* out_result)
+{
+  if (data == nullptr || out_result == nullptr) {
+    return heif_error_null_pointer_argument;
+  }
+
+  heif_error err = check_probe_result_version(out_result);
+  if (err.code) {
+    return err;
+  }
+
+  auto reader = std::make_shared<StreamReader_memory>((const uint8_t*) data, size, false);
+  return probe_stream(reader, out_result);
+}
+
+
+struct heif_error heif_probe_reader(const struct heif_reader* reader, void* userdata,
+                                    struct heif_probe_result* out_result)
+{
+  if (reader == nullptr || out_result == nullptr) {
+    return heif_error_null_pointer_argument;
+  }
+
+  heif_error err = check_probe_result_version(out_result);
+  if (err.code) {
+    return err;
+  }
+
+  auto stream = std::make_shared<StreamReader_CApi>(reader, userdata);
+  return probe_stream(stream, out_result);
+}
@@ -0,0 +1,84 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_HEIF_PROBE_H
+#define LIBHEIF_HEIF_PROBE_H
+
+#include "libheif/heif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Basic information about the primary image of a file, read from the 'ftyp' and 'meta' boxes only.
+// Probing does not create a heif_context and does not interpret any other image items,
+// which makes it much faster than reading the file with heif_context_read_from_file()
+// when only the image size and type are needed.
+
+struct heif_probe_result
+{
+  // version 1 fields
+
+  int version; // set to 1
+
+  heif_brand2 main_brand;
+
+  heif_item_id primary_image_id;
+
+  // The item type of the primary image, e.g. 'hvc1', 'av01' or 'grid'.
+  uint32_t primary_item_type;
+
+  // The coding format of the primary image. For derived images ('grid', 'iden', 'iovl'),
+  // this is the format of the first image that they reference.
+  enum heif_compression_format compression_format;
+
+  // The size from the 'ispe' property, i.e. before any transformations (rotation, cropping) are applied.
+  uint32_t ispe_width;
+  uint32_t ispe_height;
+
+  // Bit depths from the 'pixi' property. -1 if the file has no 'pixi' property.
+  // The codec configuration is not parsed. Use heif_image_handle_get_luma_bits_per_pixel() in that case.
+  int luma_bits_per_pixel;
+  int chroma_bits_per_pixel;
+
+  int has_alpha_channel;
+  int has_depth_channel;
+};
+
+
+// The caller has to set 'out_result->version'. Only the fields of that version are filled in.
+// The message of a returned error stays valid until the next heif_probe_*() call in the same thread.
+
+LIBHEIF_API
+struct heif_error heif_probe_file(const char* filename, struct heif_probe_result* out_result);
+
+LIBHEIF_API
+struct heif_error heif_probe_memory(const void* data, size_t size, struct heif_probe_result* out_result);
+
+LIBHEIF_API
+struct heif_error heif_probe_reader(const struct heif_reader* reader, void* userdata,
+                                    struct heif_probe_result* out_result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "batch_decoder.h"
+#include "context.h"
+#include "file.h"
+#include "thread_pool.h"
+#include "image_allocator.h"
+#include "codecs/decoder.h"
+#include "image-items/image_item.h"
+
+#include <utility>
+
+
+BatchDecoder::BatchDecoder(int num_threads, Callback callback)
+    : m_callback(std::move(callback))
+{
+#if ENABLE_PARALLEL_TILE_DECODING
+  if (num_threads > 0) {
+    m_thread_pool = std::make_shared<ThreadPool>(num_threads);
+  }
+#else
+  (void) num_threads;
+#endif
+
+  m_decoder_instance_pool = std::make_shared<DecoderInstancePool>();
+  m_tasks = std::make_unique<TaskGroup>(m_thread_pool.get());
+}
+
+
+BatchDecoder::~BatchDecoder()
+{
+  wait();
+
+  // The tasks have to be gone before the pool that runs them.
+  m_tasks.reset();
+}
+
+
+void BatchDecoder::set_image_buffer_pool(size_t max_cached_bytes)
+{
+  if (max_cached_bytes == 0) {
+    m_image_buffer_pool.reset();
+  }
+  else {
+    m_image_buffer_pool = std::make_shared<PooledImageAllocator>(get_global_base_image_allocator(), max_cached_bytes);
+  }
+}
+
+
+void BatchDecoder::add_job(Job job)
+{
+  // The task never fails, because errors are passed to the callback and must not cancel the other jobs.
+  m_tasks->run([this, job = std::move(job)]() {
+    decode_job(job);
+    return Error::Ok;
+  });
+}
+
+
+void BatchDecoder::wait()
+{
+  m_tasks->wait();
+}
+
+
+void BatchDecoder::decode_job(const Job& job)
+{
+  auto ctx = std::make_shared<HeifContext>();
+  ctx->set_thread_pool(m_thread_pool);
+  ctx->set_decoder_instance_pool(m_decoder_instance_pool);
+  if (m_image_buffer_pool) {
+    ctx->set_image_allocator(m_image_buffer_pool);
+  }
+
+  // Only the decoded image and the items that it depends on are needed.
+  ctx->set_deferred_image_interpretation(true);
+
+  Error err;
+  if (job.reader) {
+    err = ctx->read(job.reader);
+  }
+  else {
+    err = ctx->read_from_file(job.filename.c_str());
+  }
+
+  if (err) {
+    m_callback(err, job, nullptr, ctx.get());
+    return;
+  }
+
+  std::shared_ptr<ImageItem> image;
+  if (job.item_id == 0) {
+    image = ctx->get_primary_image(true);
+  }
+  else {
+    image = ctx->get_image(job.item_id, true);
+  }
+
+  if (!image) {
+    m_callback(Error(heif_error_Usage_error,
+                     heif_suberror_Nonexisting_item_referenced),
+               job, nullptr, ctx.get());
+    return;
+  }
+
+  if (auto errImage = std::dynamic_pointer_cast<ImageItem_Error>(image)) {
+    m_callback(errImage->get_item_error(), job, nullptr, ctx.get());
+    return;
+  }
+
+  auto decodingResult = ctx->decode_image(image->get_id(), job.colorspace, job.chroma, job.options,
+                                          false, 0, 0,
+                                          job.output_buffers.empty() ? nullptr : &job.output_buffers);
+
+  m_callback(decodingResult.error, job, decodingResult.value, ctx.get());
+}
@@ -0,0 +1,107 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LIBHEIF_BATCH_DECODER_H
+#define LIBHEIF_BATCH_DECODER_H
+
+#include "error.h"
+#include "bitstream.h"
+#include "pixelimage.h"
+#include "libheif/heif.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+
+class ThreadPool;
+
+class TaskGroup;
+
+class DecoderInstancePool;
+
+class PooledImageAllocator;
+
+class HeifContext;
+
+
+// Decodes images from many files on one thread pool. All files are read into their own HeifContext,
+// but the contexts share the thread pool, the decoder plugin instances and the image buffer pool.
+// Each job runs as one task of the pool and the tiles of grid images are decoded as nested tasks.
+class BatchDecoder
+{
+public:
+  struct Job
+  {
+    // Either a file name or a reader.
+    std::string filename;
+    std::shared_ptr<StreamReader> reader;
+
+    heif_item_id item_id = 0; // 0: primary image
+    heif_colorspace colorspace = heif_colorspace_undefined;
+    heif_chroma chroma = heif_chroma_undefined;
+    heif_decoding_options options{};
+    std::map<heif_channel, PlaneBuffer> output_buffers;
+
+    void* userdata = nullptr;
+  };
+
+  // Called from the worker threads, possibly concurrently, when a job is finished.
+  // 'context' is only valid during the call (it holds the error message).
+  using Callback = std::function<void(const Error& err, const Job& job, std::shared_ptr<HeifPixelImage> image,
+                                      HeifContext* context)>;
+
+  // 'num_threads' == 0 decodes each job in add_job().
+  BatchDecoder(int num_threads, Callback callback);
+
+  // Waits for all jobs.
+  ~BatchDecoder();
+
+  BatchDecoder(const BatchDecoder&) = delete;
+
+  BatchDecoder& operator=(const BatchDecoder&) = delete;
+
+  // 'max_cached_bytes' == 0 disables the pool. Has to be set before adding jobs.
+  void set_image_buffer_pool(size_t max_cached_bytes);
+
+  const std::shared_ptr<PooledImageAllocator>& get_image_buffer_pool() const { return m_image_buffer_pool; }
+
+  DecoderInstancePool* get_decoder_instance_pool() const { return m_decoder_instance_pool.get(); }
+
+  void add_job(Job job);
+
+  // Blocks until all jobs that were added so far are finished.
+  void wait();
+
+private:
+  Callback m_callback;
+
+  std::shared_ptr<ThreadPool> m_thread_pool;
+  std::shared_ptr<DecoderInstancePool> m_decoder_instance_pool;
+  std::shared_ptr<PooledImageAllocator> m_image_buffer_pool;
+
+  std::unique_ptr<TaskGroup> m_tasks;
+
+  void decode_job(const Job& job);
+};
+
+#endif
@@ -25,11 +25,25 @@
 #include <cassert>
 #include <bit>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define MAX_UVLC_LEADING_ZEROS 20
 
 #define AVOID_FUZZER_FALSE_POSITIVE 0
 
 
+std::mutex& StreamReader::get_access_mutex()
+{
+  static std::mutex access_mutex;
+  return access_mutex;
+}
+
+
 StreamReader_istream::StreamReader_istream(std::unique_ptr<std::istream>&& istr)
     : m_istr(std::move(istr))
 {
@@ -123,6 +137,64 @@ bool StreamReader_memory::seek(uint64_t position)
   return true;
 }
 
+const uint8_t* StreamReader_memory::get_data_pointer(uint64_t position, uint64_t size) const
+{
+  if (position > m_length || size > m_length - position) {
+    return nullptr;
+  }
+
+  return m_data + position;
+}
+
+
+StreamReader_mmap::StreamReader_mmap(const uint8_t* data, size_t size)
+    : StreamReader_memory(data, size, false),
+      m_mapping(const_cast<uint8_t*>(data)),
+      m_mapping_size(size)
+{
+}
+
+StreamReader_mmap::~StreamReader_mmap()
+{
+#if !defined(_WIN32)
+  munmap(m_mapping, m_mapping_size);
+#endif
+}
+
+std::shared_ptr<StreamReader_mmap> StreamReader_mmap::map_file(const char* filename)
+{
+#if defined(_WIN32)
+  return nullptr;
+#else
+  int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  // Only map regular files. Pipes and devices are read through a stream.
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      !S_ISREG(file_stat.st_mode) ||
+      file_stat.st_size <= 0 ||
+      static_cast<uint64_t>(file_stat.st_size) > std::numeric_limits<size_t>::max()) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  auto size = static_cast<size_t>(file_stat.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // the mapping stays valid after closing the file
+  ::close(fd);
+
+  if (mapping == MAP_FAILED) {
+    return nullptr;
+  }
+
+  return std::shared_ptr<StreamReader_mmap>(new StreamReader_mmap(static_cast<const uint8_t*>(mapping), size));
+#endif
+}
+
 
 StreamReader_CApi::StreamReader_CApi(const heif_reader* func_table, void* userdata)
     : m_func_table(func_table), m_userdata(userdata)
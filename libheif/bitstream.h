@@ -28,6 +28,7 @@
 #include <string>
 #include <memory>
 #include <limits>
+#include <mutex>
 #include <istream>
 #include <string>
 #include <cassert>
@@ -36,6 +37,22 @@
 #include <algorithm>
 
 
+// View onto data that is owned by someone else, e.g. a StreamReader that holds the file in memory.
+struct DataSpan
+{
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+
+// Range of file positions [start, end).
+struct FileRange
+{
+  uint64_t start = 0;
+  uint64_t end = 0;
+};
+
+
 class StreamReader
 {
 public:
@@ -76,12 +93,20 @@ public:
 
   virtual void preload_range_hint(uint64_t start, uint64_t end_pos) { }
 
+  // If the reader holds the file in memory, returns a pointer to the data at 'position'. The data can be
+  // accessed without seek() and read() and stays valid as long as the reader exists.
+  // Returns nullptr if the data is not available in memory.
+  virtual const uint8_t* get_data_pointer(uint64_t position, uint64_t size) const { return nullptr; }
+
   Error get_error() const {
     return m_last_error;
   }
 
   void clear_last_error() { m_last_error = {}; }
 
+  // Serializes the reader accesses when several items are decoded concurrently.
+  static std::mutex& get_access_mutex();
+
 protected:
   Error m_last_error;
 };
@@ -140,6 +165,8 @@ public:
     return m_length;
   }
 
+  const uint8_t* get_data_pointer(uint64_t position, uint64_t size) const override;
+
 private:
   const uint8_t* m_data;
   uint64_t m_length;
@@ -150,6 +177,24 @@ private:
 };
 
 
+// Maps a file read-only into memory. Reads are served from the mapping without system calls.
+// Note that the process may receive SIGBUS when the file is truncated while it is mapped.
+class StreamReader_mmap : public StreamReader_memory
+{
+public:
+  // Returns nullptr if the file cannot be mapped (e.g. when it is no regular file or on unsupported platforms).
+  static std::shared_ptr<StreamReader_mmap> map_file(const char* filename);
+
+  ~StreamReader_mmap() override;
+
+private:
+  StreamReader_mmap(const uint8_t* data, size_t size);
+
+  void* m_mapping;
+  size_t m_mapping_size;
+};
+
+
 class StreamReader_CApi : public StreamReader
 {
 public:
@@ -211,13 +256,13 @@ public:
   }
 
   void release_range(uint64_t start, uint64_t end_pos) override {
-    if (m_func_table->reader_api_version >= 2) {
+    if (m_func_table->reader_api_version >= 2 && m_func_table->release_file_range) {
       m_func_table->release_file_range(start, end_pos, m_userdata);
     }
   }
 
   void preload_range_hint(uint64_t start, uint64_t end_pos) override {
-    if (m_func_table->reader_api_version >= 2) {
+    if (m_func_table->reader_api_version >= 2 && m_func_table->preload_range_hint) {
       m_func_table->preload_range_hint(start, end_pos, m_userdata);
     }
   }
@@ -477,7 +522,7 @@ public:
 
   void set_position_to_end() { m_position = m_data.size(); }
 
-  const std::vector<uint8_t> get_data() const { return m_data; }
+  const std::vector<uint8_t>& get_data() const { return m_data; }
 
 private:
   std::vector<uint8_t> m_data;
@@ -36,6 +36,7 @@
 #include <utility>
 #include <iostream>
 #include <algorithm>
+#include <functional>
 #include <cstring>
 #include <set>
 #include <cassert>
@@ -51,13 +52,6 @@
 #define M_PI 3.14159265358979323846
 #endif
 
-#if !defined(_WIN32)
-#include <unistd.h>
-#else
-#include <fcntl.h>
-#include <io.h>
-#endif
-
 
 Fraction::Fraction(int32_t num, int32_t den)
 {
@@ -439,6 +433,86 @@ Error FullBox::parse_full_box_header(BitstreamRange& range)
 }
 
 
+static thread_local BoxArena* current_box_arena = nullptr;
+
+
+BoxArena::Scope::Scope(BoxArena* arena)
+    : m_previous_arena(current_box_arena)
+{
+  current_box_arena = arena;
+}
+
+
+BoxArena::Scope::~Scope()
+{
+  current_box_arena = m_previous_arena;
+}
+
+
+BoxArena* BoxArena::current()
+{
+  return current_box_arena;
+}
+
+
+std::pmr::memory_resource* BoxArena::current_resource()
+{
+  if (current_box_arena) {
+    return current_box_arena;
+  }
+  else {
+    return std::pmr::get_default_resource();
+  }
+}
+
+
+void* BoxArena::do_allocate(size_t bytes, size_t alignment)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_resource.allocate(bytes, alignment);
+}
+
+
+// Allocator for std::allocate_shared(). Its copy in the control block keeps the arena alive as long as the box exists.
+template <typename T>
+class BoxArenaAllocator
+{
+public:
+  using value_type = T;
+
+  explicit BoxArenaAllocator(std::shared_ptr<BoxArena> arena) : m_arena(std::move(arena)) {}
+
+  template <typename U>
+  BoxArenaAllocator(const BoxArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+  T* allocate(size_t n) { return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T))); }
+
+  void deallocate(T* p, size_t n) { m_arena->deallocate(p, n * sizeof(T), alignof(T)); }
+
+  template <typename U>
+  bool operator==(const BoxArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+
+private:
+  template <typename U> friend class BoxArenaAllocator;
+
+  std::shared_ptr<BoxArena> m_arena;
+};
+
+
+// Allocates the box from the arena of the active BoxArena::Scope, if there is one.
+template <typename T, typename... Args>
+static std::shared_ptr<T> make_box(Args&&... args)
+{
+  if (BoxArena* arena = BoxArena::current()) {
+    return std::allocate_shared<T>(BoxArenaAllocator<T>(arena->shared_from_this()), std::forward<Args>(args)...);
+  }
+  else {
+    return std::make_shared<T>(std::forward<Args>(args)...);
+  }
+}
+
+
 Error Box::read(BitstreamRange& range, std::shared_ptr<Box>* result, const heif_security_limits* limits)
 {
   BoxHeader hdr;
@@ -457,274 +531,274 @@ Error Box::read(BitstreamRange& range, std::shared_ptr<Box>* result, const heif_
 
   switch (hdr.get_short_type()) {
     case fourcc("ftyp"):
-      box = std::make_shared<Box_ftyp>();
+      box = make_box<Box_ftyp>();
       break;
 
     case fourcc("free"):
-      box = std::make_shared<Box_free>();
+      box = make_box<Box_free>();
       break;
 
     case fourcc("meta"):
-      box = std::make_shared<Box_meta>();
+      box = make_box<Box_meta>();
       break;
 
     case fourcc("hdlr"):
-      box = std::make_shared<Box_hdlr>();
+      box = make_box<Box_hdlr>();
       break;
 
     case fourcc("pitm"):
-      box = std::make_shared<Box_pitm>();
+      box = make_box<Box_pitm>();
       break;
 
     case fourcc("iloc"):
-      box = std::make_shared<Box_iloc>();
+      box = make_box<Box_iloc>();
       break;
 
     case fourcc("iinf"):
-      box = std::make_shared<Box_iinf>();
+      box = make_box<Box_iinf>();
       break;
 
     case fourcc("infe"):
-      box = std::make_shared<Box_infe>();
+      box = make_box<Box_infe>();
       break;
 
     case fourcc("iprp"):
-      box = std::make_shared<Box_iprp>();
+      box = make_box<Box_iprp>();
       break;
 
     case fourcc("ipco"):
-      box = std::make_shared<Box_ipco>();
+      box = make_box<Box_ipco>();
       break;
 
     case fourcc("ipma"):
-      box = std::make_shared<Box_ipma>();
+      box = make_box<Box_ipma>();
       break;
 
     case fourcc("ispe"):
-      box = std::make_shared<Box_ispe>();
+      box = make_box<Box_ispe>();
       break;
 
     case fourcc("auxC"):
-      box = std::make_shared<Box_auxC>();
+      box = make_box<Box_auxC>();
       break;
 
     case fourcc("irot"):
-      box = std::make_shared<Box_irot>();
+      box = make_box<Box_irot>();
       break;
 
     case fourcc("imir"):
-      box = std::make_shared<Box_imir>();
+      box = make_box<Box_imir>();
       break;
 
     case fourcc("clap"):
-      box = std::make_shared<Box_clap>();
+      box = make_box<Box_clap>();
       break;
 
     case fourcc("iref"):
-      box = std::make_shared<Box_iref>();
+      box = make_box<Box_iref>();
       break;
 
     case fourcc("hvcC"):
-      box = std::make_shared<Box_hvcC>();
+      box = make_box<Box_hvcC>();
       break;
 
     case fourcc("av1C"):
-      box = std::make_shared<Box_av1C>();
+      box = make_box<Box_av1C>();
       break;
 
     case fourcc("vvcC"):
-      box = std::make_shared<Box_vvcC>();
+      box = make_box<Box_vvcC>();
       break;
 
     case fourcc("idat"):
-      box = std::make_shared<Box_idat>();
+      box = make_box<Box_idat>();
       break;
 
     case fourcc("grpl"):
-      box = std::make_shared<Box_grpl>();
+      box = make_box<Box_grpl>();
       break;
 
     case fourcc("pymd"):
-      box = std::make_shared<Box_pymd>();
+      box = make_box<Box_pymd>();
       break;
 
     case fourcc("altr"):
-      box = std::make_shared<Box_EntityToGroup>();
+      box = make_box<Box_EntityToGroup>();
       break;
 
     case fourcc("ster"):
-      box = std::make_shared<Box_ster>();
+      box = make_box<Box_ster>();
       break;
 
     case fourcc("dinf"):
-      box = std::make_shared<Box_dinf>();
+      box = make_box<Box_dinf>();
       break;
 
     case fourcc("dref"):
-      box = std::make_shared<Box_dref>();
+      box = make_box<Box_dref>();
       break;
 
     case fourcc("url "):
-      box = std::make_shared<Box_url>();
+      box = make_box<Box_url>();
       break;
 
     case fourcc("colr"):
-      box = std::make_shared<Box_colr>();
+      box = make_box<Box_colr>();
       break;
 
     case fourcc("pixi"):
-      box = std::make_shared<Box_pixi>();
+      box = make_box<Box_pixi>();
       break;
 
     case fourcc("pasp"):
-      box = std::make_shared<Box_pasp>();
+      box = make_box<Box_pasp>();
       break;
 
     case fourcc("lsel"):
-      box = std::make_shared<Box_lsel>();
+      box = make_box<Box_lsel>();
       break;
 
     case fourcc("a1op"):
-      box = std::make_shared<Box_a1op>();
+      box = make_box<Box_a1op>();
       break;
 
     case fourcc("a1lx"):
-      box = std::make_shared<Box_a1lx>();
+      box = make_box<Box_a1lx>();
       break;
 
     case fourcc("clli"):
-      box = std::make_shared<Box_clli>();
+      box = make_box<Box_clli>();
       break;
 
     case fourcc("mdcv"):
-      box = std::make_shared<Box_mdcv>();
+      box = make_box<Box_mdcv>();
       break;
 
     case fourcc("amve"):
-      box = std::make_shared<Box_amve>();
+      box = make_box<Box_amve>();
       break;
 
     case fourcc("cmin"):
-      box = std::make_shared<Box_cmin>();
+      box = make_box<Box_cmin>();
       break;
 
     case fourcc("cmex"):
-      box = std::make_shared<Box_cmex>();
+      box = make_box<Box_cmex>();
       break;
 
     case fourcc("udes"):
-      box = std::make_shared<Box_udes>();
+      box = make_box<Box_udes>();
       break;
 
     case fourcc("jpgC"):
-      box = std::make_shared<Box_jpgC>();
+      box = make_box<Box_jpgC>();
       break;
 
 #if WITH_UNCOMPRESSED_CODEC
     case fourcc("cmpd"):
-      box = std::make_shared<Box_cmpd>();
+      box = make_box<Box_cmpd>();
       break;
 
     case fourcc("uncC"):
-      box = std::make_shared<Box_uncC>();
+      box = make_box<Box_uncC>();
       break;
 
     case fourcc("cmpC"):
-      box = std::make_shared<Box_cmpC>();
+      box = make_box<Box_cmpC>();
       break;
 
     case fourcc("icef"):
-      box = std::make_shared<Box_icef>();
+      box = make_box<Box_icef>();
       break;
 
     case fourcc("cpat"):
-      box = std::make_shared<Box_cpat>();
+      box = make_box<Box_cpat>();
       break;
 #endif
 
     // --- JPEG 2000
       
     case fourcc("j2kH"):
-      box = std::make_shared<Box_j2kH>();
+      box = make_box<Box_j2kH>();
       break;
 
     case fourcc("cdef"):
-      box = std::make_shared<Box_cdef>();
+      box = make_box<Box_cdef>();
       break;
 
     case fourcc("cmap"):
-      box = std::make_shared<Box_cmap>();
+      box = make_box<Box_cmap>();
       break;
 
     case fourcc("pclr"):
-      box = std::make_shared<Box_pclr>();
+      box = make_box<Box_pclr>();
       break;
 
     case fourcc("j2kL"):
-      box = std::make_shared<Box_j2kL>();
+      box = make_box<Box_j2kL>();
       break;
 
 #if ENABLE_EXPERIMENTAL_FEATURS
       case fourcc("tilC"):
-      box = std::make_shared<Box_tilC>();
+      box = make_box<Box_tilC>();
       break;
 #endif
 
     // --- mski
       
     case fourcc("mskC"):
-      box = std::make_shared<Box_mskC>();
+      box = make_box<Box_mskC>();
       break;
 
 #if ENABLE_EXPERIMENTAL_FEATURS
       // --- TAI timestamps
 
     case fourcc("itai"):
-      box = std::make_shared<Box_itai>();
+      box = make_box<Box_itai>();
       break;
 
     case fourcc("taic"):
-      box = std::make_shared<Box_taic>();
+      box = make_box<Box_taic>();
       break;
 #endif
 
     // --- AVC (H.264)
 
     case fourcc("avcC"):
-      box = std::make_shared<Box_avcC>();
+      box = make_box<Box_avcC>();
       break;
 
 #if WITH_EXPERIMENTAL_FEATURES
     case fourcc("tilC"):
-      box = std::make_shared<Box_tilC>();
+      box = make_box<Box_tilC>();
       break;
 #endif
 
 #if ENABLE_EXPERIMENTAL_MINI_FORMAT
     case fourcc("mini"):
-      box = std::make_shared<Box_mini>();
+      box = make_box<Box_mini>();
       break;
 #endif
 
     case fourcc("mdat"):
       // avoid generating a 'Box_other'
-      box = std::make_shared<Box>();
+      box = make_box<Box>();
       break;
 
     case fourcc("uuid"):
       if (hdr.get_uuid_type() == std::vector<uint8_t>{0x22, 0xcc, 0x04, 0xc7, 0xd6, 0xd9, 0x4e, 0x07, 0x9d, 0x90, 0x4e, 0xb6, 0xec, 0xba, 0xf3, 0xa3}) {
-        box = std::make_shared<Box_cmin>();
+        box = make_box<Box_cmin>();
       }
       else if (hdr.get_uuid_type() == std::vector<uint8_t>{0x43, 0x63, 0xe9, 0x14, 0x5b, 0x7d, 0x4a, 0xab, 0x97, 0xae, 0xbe, 0xa6, 0x98, 0x03, 0xb4, 0x34}) {
-        box = std::make_shared<Box_cmex>();
+        box = make_box<Box_cmex>();
       }
       else {
-        box = std::make_shared<Box_other>(hdr.get_short_type());
+        box = make_box<Box_other>(hdr.get_short_type());
       }
       break;
 
     default:
-      box = std::make_shared<Box_other>(hdr.get_short_type());
+      box = make_box<Box_other>(hdr.get_short_type());
       break;
   }
 
@@ -802,7 +876,7 @@ Error Box::read(BitstreamRange& range, std::shared_ptr<Box>* result, const heif_
   else {
     parse_error_fatality fatality = box->get_parse_error_fatality();
 
-    box = std::make_shared<Box_Error>(box->get_short_type(), err, fatality);
+    box = make_box<Box_Error>(box->get_short_type(), err, fatality);
 
     // We return a Box_Error that represents the parse error.
     *result = std::move(box);
@@ -939,6 +1013,12 @@ Error Box::write_children(StreamWriter& writer) const
 
 
 std::string Box::dump_children(Indent& indent, bool with_index) const
+{
+  return dump_boxes(indent, m_children, with_index);
+}
+
+
+std::string Box::dump_boxes(Indent& indent, const std::vector<std::shared_ptr<Box>>& boxes, bool with_index)
 {
   std::ostringstream sstr;
 
@@ -946,7 +1026,7 @@ std::string Box::dump_children(Indent& indent, bool with_index) const
   int idx=1;
 
   indent++;
-  for (const auto& childBox : m_children) {
+  for (const auto& childBox : boxes) {
     if (first) {
       first = false;
     }
@@ -977,6 +1057,270 @@ void Box::derive_box_version_recursive()
 }
 
 
+// Reads a big-endian number of 'size' bytes and advances 'data'.
+static uint64_t read_big_endian(const uint8_t*& data, int size)
+{
+  uint64_t value = 0;
+  for (int i = 0; i < size; i++) {
+    value = (value << 8) | data[i];
+  }
+
+  data += size;
+  return value;
+}
+
+
+void ItemEntryIndex::sort()
+{
+  std::stable_sort(m_entries.begin(), m_entries.end(),
+                   [](const Entry& a, const Entry& b) { return a.item_ID < b.item_ID; });
+
+  // keep the first entry of each item
+  m_entries.erase(std::unique(m_entries.begin(), m_entries.end(),
+                              [](const Entry& a, const Entry& b) { return a.item_ID == b.item_ID; }),
+                  m_entries.end());
+}
+
+
+void ItemEntryIndex::insert(heif_item_id item_ID, size_t position)
+{
+  // new items usually have the largest ID
+  if (m_entries.empty() || m_entries.back().item_ID < item_ID) {
+    m_entries.push_back({item_ID, position});
+    return;
+  }
+
+  auto iter = std::lower_bound(m_entries.begin(), m_entries.end(), item_ID,
+                               [](const Entry& entry, heif_item_id id) { return entry.item_ID < id; });
+  if (iter != m_entries.end() && iter->item_ID == item_ID) {
+    return;
+  }
+
+  m_entries.insert(iter, {item_ID, position});
+}
+
+
+bool ItemEntryIndex::find(heif_item_id item_ID, size_t* out_position) const
+{
+  auto iter = std::lower_bound(m_entries.begin(), m_entries.end(), item_ID,
+                               [](const Entry& entry, heif_item_id id) { return entry.item_ID < id; });
+  if (iter == m_entries.end() || iter->item_ID != item_ID) {
+    return false;
+  }
+
+  *out_position = iter->position;
+  return true;
+}
+
+
+bool ItemEntryIndex::contains(heif_item_id item_ID) const
+{
+  size_t position;
+  return find(item_ID, &position);
+}
+
+
+std::vector<heif_item_id> ItemEntryIndex::get_item_IDs() const
+{
+  std::vector<heif_item_id> IDs;
+  IDs.reserve(m_entries.size());
+
+  for (const auto& entry : m_entries) {
+    IDs.push_back(entry.item_ID);
+  }
+
+  return IDs;
+}
+
+
+Error LazyBoxList::read(BitstreamRange& range, uint32_t max_number, const Box& container,
+                        const heif_security_limits* limits)
+{
+  clear();
+
+  m_data.resize(range.get_remaining_bytes());
+  if (!range.read(m_data.data(), m_data.size())) {
+    return range.get_error();
+  }
+
+  m_limits = *limits;
+
+  uint32_t max_children;
+  if (container.get_short_type() == fourcc("iinf")) {
+    max_children = limits->max_items;
+  }
+  else {
+    max_children = limits->max_children_per_box;
+  }
+
+  // --- split the data at the box headers, with the same checks as BoxHeader::parse_header() and Box::read()
+
+  size_t pos = 0;
+  while (pos < m_data.size() && m_entries.size() < max_number) {
+    if (max_children && m_entries.size() > max_children) {
+      std::stringstream sstr;
+      sstr << "Maximum number of child boxes (" << max_children << ") in '" << container.get_type_string() << "' box exceeded.";
+
+      return Error(heif_error_Memory_allocation_error,
+                   heif_suberror_Security_limit_exceeded,
+                   sstr.str());
+    }
+
+    size_t remaining = m_data.size() - pos;
+    if (remaining < 8) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_End_of_data);
+    }
+
+    const uint8_t* p = m_data.data() + pos;
+    uint64_t box_size = read_big_endian(p, 4);
+    auto type = static_cast<uint32_t>(read_big_endian(p, 4));
+    size_t header_size = 8;
+
+    if (box_size == 1) {
+      if (remaining < 16) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_End_of_data);
+      }
+
+      box_size = read_big_endian(p, 8);
+      header_size += 8;
+
+      if (box_size > (uint64_t) MAX_LARGE_BOX_SIZE) {
+        std::stringstream sstr;
+        sstr << "Box size " << box_size << " exceeds security limit.";
+
+        return Error(heif_error_Memory_allocation_error,
+                     heif_suberror_Security_limit_exceeded,
+                     sstr.str());
+      }
+    }
+
+    if (type == fourcc("uuid")) {
+      header_size += 16;
+
+      if (remaining < header_size) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_End_of_data);
+      }
+    }
+
+    if (box_size == 0) {
+      box_size = remaining;
+    }
+    else if (box_size < header_size) {
+      std::stringstream sstr;
+      sstr << "Box size (" << box_size << " bytes) smaller than header size ("
+           << header_size << " bytes)";
+
+      return {heif_error_Invalid_input,
+              heif_suberror_Invalid_box_size,
+              sstr.str()};
+    }
+    else if (box_size > remaining) {
+      return {heif_error_Invalid_input,
+              heif_suberror_Invalid_box_size};
+    }
+
+    m_entries.push_back({pos, static_cast<size_t>(box_size), header_size, type});
+    pos += static_cast<size_t>(box_size);
+  }
+
+  m_boxes.resize(m_entries.size());
+
+  return Error::Ok;
+}
+
+
+const uint8_t* LazyBoxList::get_box_payload(size_t index, size_t* out_size) const
+{
+  const Entry& entry = m_entries[index];
+
+  *out_size = entry.size - entry.header_size;
+  return m_data.data() + entry.start + entry.header_size;
+}
+
+
+std::shared_ptr<Box> LazyBoxList::parse_box(size_t index) const
+{
+  const Entry& entry = m_entries[index];
+
+  // The reader is only used while the box is parsed. Do not allocate it for each box.
+  StreamReader_memory reader(m_data.data() + entry.start, entry.size, false);
+  BitstreamRange range(std::shared_ptr<StreamReader>(std::shared_ptr<StreamReader>(), &reader), entry.size);
+
+  BoxArena::Scope arena_scope(m_arena);
+
+  std::shared_ptr<Box> box;
+  Error err = Box::read(range, &box, &m_limits);
+
+  // Box::read() returns a Box_Error if the box content cannot be parsed, but no box if the header is invalid.
+  if (!box) {
+    box = make_box<Box_Error>(entry.type, err, parse_error_fatality::fatal);
+  }
+
+  return box;
+}
+
+
+std::shared_ptr<Box> LazyBoxList::get_box(size_t index) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (!m_boxes[index]) {
+    m_boxes[index] = parse_box(index);
+  }
+
+  return m_boxes[index];
+}
+
+
+std::shared_ptr<Box> LazyBoxList::get_box_if_parsed(size_t index) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_boxes[index];
+}
+
+
+Error LazyBoxList::get_all_boxes(std::vector<std::shared_ptr<Box>>* out_boxes) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  out_boxes->clear();
+  out_boxes->reserve(m_entries.size());
+
+  Error first_error;
+
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    if (!m_boxes[i]) {
+      m_boxes[i] = parse_box(i);
+    }
+
+    if (auto error_box = std::dynamic_pointer_cast<Box_Error>(m_boxes[i])) {
+      if (!first_error && error_box->get_parse_error_fatality() == parse_error_fatality::fatal) {
+        first_error = error_box->get_error();
+      }
+    }
+
+    out_boxes->push_back(m_boxes[i]);
+  }
+
+  return first_error;
+}
+
+
+void LazyBoxList::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_data.clear();
+  m_data.shrink_to_fit();
+  m_entries.clear();
+  m_boxes.clear();
+}
+
+
 Error Box_other::parse(BitstreamRange& range, const heif_security_limits* limits)
 {
   if (has_fixed_box_size()) {
@@ -1345,13 +1689,16 @@ Error Box_iloc::parse(BitstreamRange& range, const heif_security_limits* limits)
 
   uint16_t values4 = range.read16();
 
-  int offset_size = (values4 >> 12) & 0xF;
-  int length_size = (values4 >> 8) & 0xF;
-  int base_offset_size = (values4 >> 4) & 0xF;
-  int index_size = 0;
+  // Only field sizes of 4 and 8 bytes are read. Fields with other sizes are skipped.
+  auto field_size = [](int size) { return (uint8_t) ((size == 4 || size == 8) ? size : 0); };
+
+  m_offset_size = field_size((values4 >> 12) & 0xF);
+  m_length_size = field_size((values4 >> 8) & 0xF);
+  m_base_offset_size = field_size((values4 >> 4) & 0xF);
+  m_index_size = 0;
 
   if (version == 1 || version == 2) {
-    index_size = (values4 & 0xF);
+    m_index_size = field_size(values4 & 0xF);
   }
 
   uint32_t item_count = 0;
@@ -1373,10 +1720,37 @@ Error Box_iloc::parse(BitstreamRange& range, const heif_security_limits* limits)
                  sstr.str());
   }
 
-  for (uint32_t i = 0; i < item_count; i++) {
-    Item item;
+  if (range.error()) {
+    return range.get_error();
+  }
 
-    if (range.eof()) {
+  // --- read the items in one block, but only decode them when they are accessed
+
+  m_item_data.resize(range.get_remaining_bytes());
+  if (!range.read(m_item_data.data(), m_item_data.size())) {
+    return range.get_error();
+  }
+
+  return index_items(item_count, limits);
+}
+
+
+Error Box_iloc::index_items(uint32_t item_count, const heif_security_limits* limits)
+{
+  const int version = get_version();
+  const int id_size = (version < 2) ? 2 : 4;
+  const size_t item_header_size = id_size + (version >= 1 ? 2 : 0) + 2 + m_base_offset_size;
+  const size_t extent_size = m_index_size + m_offset_size + m_length_size;
+  const size_t data_size = m_item_data.size();
+
+  m_items.clear();
+  m_item_index.clear();
+  m_item_index.reserve(item_count);
+
+  size_t pos = 0;
+
+  for (uint32_t i = 0; i < item_count; i++) {
+    if (pos == data_size) {
       std::stringstream sstr;
       sstr << "iloc box should contain " << item_count << " items, but we can only read " << i << " items.";
 
@@ -1385,30 +1759,16 @@ Error Box_iloc::parse(BitstreamRange& range, const heif_security_limits* limits)
               sstr.str()};
     }
 
-    if (version < 2) {
-      item.item_ID = range.read16();
-    }
-    else if (version == 2) {
-      item.item_ID = range.read32();
-    }
-
-    if (version >= 1) {
-      values4 = range.read16();
-      item.construction_method = (values4 & 0xF);
+    if (data_size - pos < item_header_size + 2) {
+      return {heif_error_Invalid_input,
+              heif_suberror_End_of_data};
     }
 
-    item.data_reference_index = range.read16();
-
-    item.base_offset = 0;
-    if (base_offset_size == 4) {
-      item.base_offset = range.read32();
-    }
-    else if (base_offset_size == 8) {
-      item.base_offset = ((uint64_t) range.read32()) << 32;
-      item.base_offset |= range.read32();
-    }
+    const uint8_t* p = m_item_data.data() + pos;
+    auto item_ID = static_cast<heif_item_id>(read_big_endian(p, id_size));
 
-    uint16_t extent_count = range.read16();
+    p = m_item_data.data() + pos + item_header_size;
+    auto extent_count = static_cast<uint16_t>(read_big_endian(p, 2));
 
     // Sanity check.
     auto max_iloc_extents = limits->max_iloc_extents_per_item;
@@ -1422,94 +1782,125 @@ Error Box_iloc::parse(BitstreamRange& range, const heif_security_limits* limits)
                    sstr.str());
     }
 
-    for (int e = 0; e < extent_count; e++) {
-      Extent extent;
+    size_t extents_start = pos + item_header_size + 2;
+    size_t extents_available = data_size - extents_start;
+
+    if (extent_count > 0 && extents_available == 0) {
+      std::stringstream sstr;
+      sstr << "iloc item should contain " << extent_count << " extents, but we can only read 0 extents.";
+
+      return {heif_error_Invalid_input,
+              heif_suberror_End_of_data,
+              sstr.str()};
+    }
 
-      if (range.eof()) {
+    if (extent_size > 0 && extent_count * extent_size > extents_available) {
+      if (extents_available % extent_size == 0) {
         std::stringstream sstr;
-        sstr << "iloc item should contain " << extent_count << " extents, but we can only read " << e << " extents.";
+        sstr << "iloc item should contain " << extent_count << " extents, but we can only read "
+             << extents_available / extent_size << " extents.";
 
         return {heif_error_Invalid_input,
                 heif_suberror_End_of_data,
                 sstr.str()};
       }
 
-      if ((version == 1 || version == 2) && index_size > 0) {
-        if (index_size == 4) {
-          extent.index = range.read32();
-        }
-        else if (index_size == 8) {
-          extent.index = ((uint64_t) range.read32()) << 32;
-          extent.index |= range.read32();
-        }
-      }
-
-      extent.offset = 0;
-      if (offset_size == 4) {
-        extent.offset = range.read32();
-      }
-      else if (offset_size == 8) {
-        extent.offset = ((uint64_t) range.read32()) << 32;
-        extent.offset |= range.read32();
-      }
+      return {heif_error_Invalid_input,
+              heif_suberror_End_of_data};
+    }
 
+    m_item_index.append(item_ID, pos);
 
-      extent.length = 0;
-      if (length_size == 4) {
-        extent.length = range.read32();
-      }
-      else if (length_size == 8) {
-        extent.length = ((uint64_t) range.read32()) << 32;
-        extent.length |= range.read32();
-      }
+    pos = extents_start + extent_count * extent_size;
+  }
 
-      item.extents.push_back(extent);
-    }
+  // drop unused data after the last item
+  m_item_data.resize(pos);
 
-    if (!range.error()) {
-      m_items.push_back(item);
-    }
-  }
+  m_item_index.sort();
+  m_items_decoded = false;
 
-  return range.get_error();
+  return Error::Ok;
 }
 
 
-Box_iloc::Box_iloc()
+Box_iloc::Item Box_iloc::decode_item(size_t offset, size_t* out_size) const
 {
-  set_short_type(fourcc("iloc"));
+  const int version = get_version();
+  const uint8_t* p = m_item_data.data() + offset;
 
-  set_use_tmp_file(false);
-}
+  Item item;
+  item.item_ID = static_cast<heif_item_id>(read_big_endian(p, (version < 2) ? 2 : 4));
 
+  if (version >= 1) {
+    item.construction_method = static_cast<uint8_t>(read_big_endian(p, 2) & 0xF);
+  }
 
-Box_iloc::~Box_iloc()
-{
-  if (m_use_tmpfile) {
-    unlink(m_tmp_filename);
+  item.data_reference_index = static_cast<uint16_t>(read_big_endian(p, 2));
+  item.base_offset = read_big_endian(p, m_base_offset_size);
+
+  auto extent_count = static_cast<uint16_t>(read_big_endian(p, 2));
+  item.extents.resize(extent_count);
+
+  for (Extent& extent : item.extents) {
+    extent.index = read_big_endian(p, m_index_size);
+    extent.offset = read_big_endian(p, m_offset_size);
+    extent.length = read_big_endian(p, m_length_size);
+  }
+
+  if (out_size) {
+    *out_size = p - (m_item_data.data() + offset);
   }
+
+  return item;
 }
 
 
-void Box_iloc::set_use_tmp_file(bool flag)
+std::vector<Box_iloc::Item> Box_iloc::get_decoded_items() const
 {
-  m_use_tmpfile = flag;
-  if (flag) {
-#if !defined(_WIN32)
-    strcpy(m_tmp_filename, "/tmp/libheif-XXXXXX");
-    m_tmpfile_fd = mkstemp(m_tmp_filename);
-#else
-    // TODO Currently unused code. Implement when needed.
-    assert(false);
-#  if 0
-    char tmpname[L_tmpnam_s];
-    // TODO: check return value (errno_t)
-    tmpnam_s(tmpname, L_tmpnam_s);
-    _sopen_s(&m_tmpfile_fd, tmpname, _O_CREAT | _O_TEMPORARY | _O_TRUNC | _O_RDWR, _SH_DENYRW, _S_IREAD | _S_IWRITE);
-#  endif
-#endif
+  if (m_items_decoded) {
+    return m_items;
   }
-}
+
+  std::vector<Item> items;
+
+  size_t pos = 0;
+  while (pos < m_item_data.size()) {
+    size_t size;
+    items.push_back(decode_item(pos, &size));
+    pos += size;
+  }
+
+  return items;
+}
+
+
+void Box_iloc::decode_all_items()
+{
+  if (m_items_decoded) {
+    return;
+  }
+
+  std::vector<Item> items = get_decoded_items();
+
+  m_item_index.clear();
+  m_item_data.clear();
+  m_item_data.shrink_to_fit();
+  m_items_decoded = true;
+
+  for (const Item& item : items) {
+    add_item(item);
+  }
+}
+
+
+Box_iloc::Box_iloc()
+{
+  set_short_type(fourcc("iloc"));
+}
+
+
+Box_iloc::~Box_iloc() = default;
 
 
 std::string Box_iloc::dump(Indent& indent) const
@@ -1517,7 +1908,7 @@ std::string Box_iloc::dump(Indent& indent) const
   std::ostringstream sstr;
   sstr << Box::dump(indent);
 
-  for (const Item& item : m_items) {
+  for (const Item& item : get_decoded_items()) {
     sstr << indent << "item ID: " << item.item_ID << "\n"
          << indent << "  construction method: " << ((int) item.construction_method) << "\n"
          << indent << "  data_reference_index: " << std::hex
@@ -1549,6 +1940,107 @@ Error Box_iloc::read_data(heif_item_id item,
 }
 
 
+const Box_iloc::Item* Box_iloc::find_item(heif_item_id item_ID, Item* decoded_item) const
+{
+  size_t position;
+  if (!m_item_index.find(item_ID, &position)) {
+    return nullptr;
+  }
+
+  if (m_items_decoded) {
+    return &m_items[position];
+  }
+
+  *decoded_item = decode_item(position);
+  return decoded_item;
+}
+
+
+void Box_iloc::add_item(const Item& item)
+{
+  // if an item ID appears twice, lookups return the first one
+  m_item_index.insert(item.item_ID, m_items.size());
+  m_items.push_back(item);
+}
+
+
+bool Box_iloc::get_data_spans(heif_item_id item_id,
+                              const std::shared_ptr<StreamReader>& istr,
+                              std::vector<DataSpan>* spans) const
+{
+  Item decoded_item;
+  const Item* item = find_item(item_id, &decoded_item);
+
+  if (!item || item->construction_method != 0) {
+    return false;
+  }
+
+  std::vector<DataSpan> item_spans;
+
+  for (const auto& extent : item->extents) {
+    if (extent.offset > MAX_FILE_POS ||
+        item->base_offset > MAX_FILE_POS ||
+        extent.length > MAX_FILE_POS) {
+      return false;
+    }
+
+    if (extent.length == 0) {
+      continue;
+    }
+
+    // Invalid extents are left to read_data(), which reports the error.
+    const uint8_t* data = istr->get_data_pointer(extent.offset + item->base_offset, extent.length);
+    if (!data) {
+      return false;
+    }
+
+    item_spans.push_back({data, static_cast<size_t>(extent.length)});
+  }
+
+  spans->insert(spans->end(), item_spans.begin(), item_spans.end());
+  return true;
+}
+
+
+bool Box_iloc::get_file_ranges(heif_item_id item_id,
+                               uint64_t offset, uint64_t size,
+                               std::vector<FileRange>* ranges) const
+{
+  Item decoded_item;
+  const Item* item = find_item(item_id, &decoded_item);
+
+  if (!item || item->construction_method != 0) {
+    return false;
+  }
+
+  for (const auto& extent : item->extents) {
+    if (extent.offset > MAX_FILE_POS ||
+        item->base_offset > MAX_FILE_POS ||
+        extent.length > MAX_FILE_POS) {
+      return false;
+    }
+
+    // skip to the requested offset, as in read_data()
+
+    uint64_t skip_len = std::min(offset, extent.length);
+    offset -= skip_len;
+
+    uint64_t range_len = std::min(extent.length - skip_len, size);
+
+    if (offset > 0 || range_len == 0) {
+      continue;
+    }
+
+    uint64_t start = extent.offset + item->base_offset + skip_len;
+    ranges->push_back({start, start + range_len});
+
+    size -= range_len;
+  }
+
+  return true;
+}
+
+
 Error Box_iloc::read_data(heif_item_id item_id,
                           const std::shared_ptr<StreamReader>& istr,
                           const std::shared_ptr<Box_idat>& idat,
@@ -1556,13 +2048,8 @@ Error Box_iloc::read_data(heif_item_id item_id,
                           uint64_t offset, uint64_t size,
                           const heif_security_limits* limits) const
 {
-  const Item* item = nullptr;
-  for (auto& i : m_items) {
-    if (i.item_ID == item_id) {
-      item = &i;
-      break;
-    }
-  }
+  Item decoded_item;
+  const Item* item = find_item(item_id, &decoded_item);
 
   if (!item) {
     std::stringstream sstr;
@@ -1574,9 +2061,13 @@ Error Box_iloc::read_data(heif_item_id item_id,
   }
 
 #if ENABLE_MULTITHREADING_SUPPORT
-  static std::mutex read_mutex;
+  std::mutex& read_mutex = StreamReader::get_access_mutex();
 
-  std::lock_guard<std::mutex> lock(read_mutex);
+  // Files in memory are read without changing the stream position and can be read concurrently.
+  std::unique_lock<std::mutex> lock(read_mutex, std::defer_lock);
+  if (item->construction_method != 0 || istr->get_data_pointer(0, 0) == nullptr) {
+    lock.lock();
+  }
 #endif
 
   bool limited_size = (size != std::numeric_limits<uint64_t>::max());
@@ -1661,24 +2152,28 @@ Error Box_iloc::read_data(heif_item_id item_id,
         return istr->get_error();
       }
 
-      // --- move file pointer to start of data
+      // --- read data
 
-      bool success = istr->seek(data_start_pos);
-      if (!success) {
-        return {heif_error_Invalid_input,
-                heif_suberror_Unspecified,
-                "Error setting input file position"};
+      if (const uint8_t* data = istr->get_data_pointer(data_start_pos, read_len)) {
+        dest->insert(dest->end(), data, data + read_len);
       }
+      else {
+        // --- move file pointer to start of data
 
+        bool success = istr->seek(data_start_pos);
+        if (!success) {
+          return {heif_error_Invalid_input,
+                  heif_suberror_Unspecified,
+                  "Error setting input file position"};
+        }
 
-      // --- read data
-
-      dest->resize(static_cast<size_t>(old_size + read_len));
-      success = istr->read((char*) dest->data() + old_size, static_cast<size_t>(read_len));
-      if (!success) {
-        return {heif_error_Invalid_input,
-                heif_suberror_Unspecified,
-                "Error reading input file"};
+        dest->resize(static_cast<size_t>(old_size + read_len));
+        success = istr->read((char*) dest->data() + old_size, static_cast<size_t>(read_len));
+        if (!success) {
+          return {heif_error_Invalid_input,
+                  heif_suberror_Unspecified,
+                  "Error reading input file"};
+        }
       }
 
       size -= read_len;
@@ -1722,23 +2217,20 @@ Error Box_iloc::append_data(heif_item_id item_ID,
                             const std::vector<uint8_t>& data,
                             uint8_t construction_method)
 {
+  decode_all_items();
+
   // check whether this item ID already exists
 
   size_t idx;
-  for (idx = 0; idx < m_items.size(); idx++) {
-    if (m_items[idx].item_ID == item_ID) {
-      break;
-    }
-  }
-
-  // item does not exist -> add a new one to the end
+  if (!m_item_index.find(item_ID, &idx)) {
+    // item does not exist -> add a new one to the end
 
-  if (idx == m_items.size()) {
     Item item;
     item.item_ID = item_ID;
     item.construction_method = construction_method;
 
-    m_items.push_back(item);
+    idx = m_items.size();
+    add_item(item);
   }
 
   if (m_items[idx].construction_method != construction_method) {
@@ -1748,30 +2240,22 @@ Error Box_iloc::append_data(heif_item_id item_ID,
   Extent extent;
   extent.length = data.size();
 
-  if (m_use_tmpfile && construction_method==0) {
-#if !defined(_WIN32)
-    ssize_t cnt = ::write(m_tmpfile_fd, data.data(), data.size());
-#else
-    // TODO Currently unused code. Implement when needed.
-    assert(false);
-#  if 0
-    int cnt = _write(m_tmpfile_fd, data.data(), data.size());
-#  else
-    int cnt = -1;
-#  endif
-#endif
-    if (cnt < 0) {
-      std::stringstream sstr;
-      sstr << "Could not write to tmp file: error " << errno;
-      return {heif_error_Encoding_error,
-              heif_suberror_Unspecified,
-              sstr.str()};
+  if (m_item_data_storage && construction_method == 0) {
+    auto positionResult = m_item_data_storage->append(data.data(), data.size());
+    if (positionResult.error) {
+      return positionResult.error;
     }
-    else if ((size_t)cnt != data.size()) {
-      return {heif_error_Encoding_error,
-              heif_suberror_Unspecified,
-              "Could not write to tmp file (storage full?)"};
+
+    // extend the last extent if the new data directly follows it
+    if (!m_items[idx].extents.empty()) {
+      Extent& e = m_items[idx].extents.back();
+      if (e.storage_position + e.length == *positionResult) {
+        e.length += data.size();
+        return Error::Ok;
+      }
     }
+
+    extent.storage_position = *positionResult;
   }
   else {
     if (!m_items[idx].extents.empty()) {
@@ -1804,28 +2288,35 @@ Error Box_iloc::replace_data(heif_item_id item_ID,
 {
   assert(construction_method == 0); // TODO
 
+  decode_all_items();
+
   // check whether this item ID already exists
 
   size_t idx;
-  for (idx = 0; idx < m_items.size(); idx++) {
-    if (m_items[idx].item_ID == item_ID) {
-      break;
-    }
-  }
-
-  assert(idx != m_items.size());
+  bool item_exists = m_item_index.find(item_ID, &idx);
+  assert(item_exists);
+  (void) item_exists;
 
   uint64_t data_start = 0;
   for (auto& extent : m_items[idx].extents) {
-    if (output_offset >= extent.data.size()) {
-      output_offset -= extent.data.size();
+    if (output_offset >= extent.length) {
+      output_offset -= extent.length;
     }
     else {
-      uint64_t write_n = std::min(extent.data.size() - output_offset,
+      uint64_t write_n = std::min(extent.length - output_offset,
                                   data.size() - data_start);
       assert(write_n > 0);
 
-      memcpy(extent.data.data() + output_offset, data.data() + data_start, write_n);
+      if (m_item_data_storage) {
+        Error err = m_item_data_storage->overwrite(extent.storage_position + output_offset,
+                                                   data.data() + data_start, write_n);
+        if (err) {
+          return err;
+        }
+      }
+      else {
+        memcpy(extent.data.data() + output_offset, data.data() + data_start, write_n);
+      }
 
       data_start += write_n;
       output_offset = 0;
@@ -1842,6 +2333,9 @@ Error Box_iloc::replace_data(heif_item_id item_ID,
 
 void Box_iloc::derive_box_version()
 {
+  // the field sizes of the parsed items are needed to decode them before they are changed below
+  decode_all_items();
+
   int min_version = m_user_defined_min_version;
 
   if (m_items.size() > 0xFFFF) {
@@ -1993,19 +2487,24 @@ Error Box_iloc::write_mdat_after_iloc(StreamWriter& writer)
 {
   // --- compute sum of all mdat data
 
-  size_t sum_mdat_size = 0;
+  uint64_t sum_mdat_size = 0;
 
-  for (const auto& item : m_items) {
-    if (item.construction_method == 0) {
-      for (const auto& extent : item.extents) {
-        sum_mdat_size += extent.length;
+  if (m_item_data_storage) {
+    sum_mdat_size = m_item_data_storage->get_size();
+  }
+  else {
+    for (const auto& item : m_items) {
+      if (item.construction_method == 0) {
+        for (const auto& extent : item.extents) {
+          sum_mdat_size += extent.length;
+        }
       }
     }
   }
 
   // --- write mdat box
 
-  if (sum_mdat_size <= 0xFFFFFFFF) {
+  if (sum_mdat_size <= 0xFFFFFFFF - 8) {
     writer.write32((uint32_t) (sum_mdat_size + 8));
     writer.write32(fourcc("mdat"));
   }
@@ -2017,8 +2516,9 @@ Error Box_iloc::write_mdat_after_iloc(StreamWriter& writer)
     writer.write64(sum_mdat_size+8+8);
   }
 
-  if (m_use_tmpfile) {
-    ::lseek(m_tmpfile_fd, 0, SEEK_SET);
+  if (m_item_data_storage) {
+    patch_item_data_offsets(writer, writer.get_position());
+    return Error::Ok;
   }
 
   for (auto& item : m_items) {
@@ -2027,38 +2527,7 @@ Error Box_iloc::write_mdat_after_iloc(StreamWriter& writer)
 
       for (auto& extent : item.extents) {
         extent.offset = writer.get_position() - item.base_offset;
-        //extent.length = extent.data.size();
-
-        if (m_use_tmpfile) {
-          std::vector<uint8_t> data(extent.length);
-#if !defined(_WIN32)
-          ssize_t cnt = ::read(m_tmpfile_fd, data.data(), extent.length);
-#else
-          // TODO Currently unused code. Implement when needed.
-          assert(false);
-# if 0
-          int cnt = _read(m_tmpfile_fd, data.data(), extent.length);
-# else
-          int cnt = -1;
-# endif
-#endif
-          if (cnt<0) {
-            std::stringstream sstr;
-            sstr << "Cannot read tmp data file, error " << errno;
-            return {heif_error_Encoding_error,
-                    heif_suberror_Unspecified,
-                    sstr.str()};
-          }
-          else if ((uint64_t)cnt != extent.length) {
-            return {heif_error_Encoding_error,
-                    heif_suberror_Unspecified,
-                    "Tmp data could not be read completely"};
-          }
-          writer.write(data);
-        }
-        else {
-          writer.write(extent.data);
-        }
+        writer.write(extent.data);
       }
     }
   }
@@ -2072,6 +2541,22 @@ Error Box_iloc::write_mdat_after_iloc(StreamWriter& writer)
 }
 
 
+void Box_iloc::patch_item_data_offsets(StreamWriter& writer, uint64_t payload_start)
+{
+  for (auto& item : m_items) {
+    if (item.construction_method == 0 && !item.extents.empty()) {
+      item.base_offset = payload_start + item.extents[0].storage_position;
+
+      for (auto& extent : item.extents) {
+        extent.offset = extent.storage_position - item.extents[0].storage_position;
+      }
+    }
+  }
+
+  patch_iloc_header(writer);
+}
+
+
 void Box_iloc::patch_iloc_header(StreamWriter& writer) const
 {
   size_t old_pos = writer.get_position();
@@ -2302,11 +2787,152 @@ Error Box_iinf::parse(BitstreamRange& range, const heif_security_limits* limits)
     item_count = range.read32();
   }
 
-  if (item_count == 0) {
+  if (item_count == 0 || range.error()) {
+    return range.get_error();
+  }
+
+
+  // --- split the data into the 'infe' boxes, but only parse them when they are accessed
+
+  Error err = m_lazy_children.read(range, item_count, *this, limits);
+  if (err) {
+    return err;
+  }
+
+  m_item_index.reserve(m_lazy_children.size());
+
+  for (size_t i = 0; i < m_lazy_children.size(); i++) {
+    if (m_lazy_children.get_box_type(i) != fourcc("infe")) {
+      continue;
+    }
+
+    // The item ID is at the start of all 'infe' versions that we support. Other versions are rejected when the box is parsed.
+    size_t size;
+    const uint8_t* payload = m_lazy_children.get_box_payload(i, &size);
+    uint8_t version = (size >= 4) ? payload[0] : 0;
+    size_t id_size = (version == 3) ? 4 : 2;
+
+    if (version > 3 || size < 4 + id_size) {
+      auto error_box = std::dynamic_pointer_cast<Box_Error>(m_lazy_children.get_box(i));
+      if (error_box && error_box->get_parse_error_fatality() == parse_error_fatality::fatal) {
+        return error_box->get_error();
+      }
+
+      continue;
+    }
+
+    const uint8_t* p = payload + 4;
+    m_item_index.append(static_cast<heif_item_id>(read_big_endian(p, (int) id_size)), i);
+  }
+
+  m_item_index.sort();
+
+  return Error::Ok;
+}
+
+
+std::shared_ptr<Box_infe> Box_iinf::get_infe_box(heif_item_id item_ID) const
+{
+  size_t index;
+  if (!m_item_index.find(item_ID, &index)) {
+    return nullptr;
+  }
+
+  if (m_lazy_children.empty()) {
+    return std::dynamic_pointer_cast<Box_infe>(m_children[index]);
+  }
+  else {
+    return std::dynamic_pointer_cast<Box_infe>(m_lazy_children.get_box(index));
+  }
+}
+
+
+uint32_t Box_iinf::get_item_type_4cc(heif_item_id item_ID) const
+{
+  size_t index;
+  if (!m_item_index.find(item_ID, &index)) {
+    return 0;
+  }
+
+  if (!m_lazy_children.empty() && !m_lazy_children.get_box_if_parsed(index)) {
+    size_t size;
+    const uint8_t* payload = m_lazy_children.get_box_payload(index, &size);
+    uint8_t version = payload[0];
+
+    // versions 0 and 1 do not have an item type
+    size_t type_offset = 4 + (version == 3 ? 4 : 2) + 2;
+    if (version < 2 || size < type_offset + 4) {
+      return 0;
+    }
+
+    const uint8_t* p = payload + type_offset;
+    return static_cast<uint32_t>(read_big_endian(p, 4));
+  }
+
+  auto infe = get_infe_box(item_ID);
+  return infe ? infe->get_item_type_4cc() : 0;
+}
+
+
+bool Box_iinf::is_hidden_item(heif_item_id item_ID) const
+{
+  size_t index;
+  if (!m_item_index.find(item_ID, &index)) {
+    return false;
+  }
+
+  if (!m_lazy_children.empty() && !m_lazy_children.get_box_if_parsed(index)) {
+    size_t size;
+    const uint8_t* payload = m_lazy_children.get_box_payload(index, &size);
+    uint8_t version = payload[0];
+    uint8_t flags_low_byte = payload[3];
+
+    return version >= 2 && (flags_low_byte & 1);
+  }
+
+  auto infe = get_infe_box(item_ID);
+  return infe && infe->is_hidden_item();
+}
+
+
+Error Box_iinf::parse_all_items()
+{
+  if (m_lazy_children.empty()) {
     return Error::Ok;
   }
 
-  return read_children(range, item_count, limits);
+  // The index positions stay the same, because all children are kept in their order.
+  Error err = m_lazy_children.get_all_boxes(&m_children);
+  m_lazy_children.clear();
+
+  return err;
+}
+
+
+std::vector<std::shared_ptr<Box>> Box_iinf::get_children() const
+{
+  if (m_lazy_children.empty()) {
+    return m_children;
+  }
+
+  // Boxes that cannot be parsed are returned as Box_Error.
+  std::vector<std::shared_ptr<Box>> children;
+  m_lazy_children.get_all_boxes(&children);
+  return children;
+}
+
+
+uint32_t Box_iinf::append_child_box(const std::shared_ptr<Box>& box)
+{
+  parse_all_items();
+
+  uint32_t index = Box::append_child_box(box);
+
+  if (auto infe = std::dynamic_pointer_cast<Box_infe>(box)) {
+    m_item_index.insert(infe->get_item_ID(), index);
+  }
+
+  return index;
 }
 
 
@@ -2315,7 +2941,7 @@ std::string Box_iinf::dump(Indent& indent) const
   std::ostringstream sstr;
   sstr << Box::dump(indent);
 
-  sstr << dump_children(indent);
+  sstr << dump_boxes(indent, get_children());
 
   return sstr.str();
 }
@@ -2331,6 +2957,8 @@ Error Box_iprp::parse(BitstreamRange& range, const heif_security_limits* limits)
 
 void Box_iinf::derive_box_version()
 {
+  parse_all_items();
+
   if (m_children.size() > 0xFFFF) {
     set_version(1);
   }
@@ -2346,14 +2974,20 @@ Error Box_iinf::write(StreamWriter& writer) const
 
   int nEntries_size = (get_version() > 0) ? 4 : 2;
 
-  writer.write(nEntries_size, m_children.size());
+  std::vector<std::shared_ptr<Box>> children = get_children();
 
+  writer.write(nEntries_size, children.size());
 
-  Error err = write_children(writer);
+  for (const auto& child : children) {
+    Error err = child->write(writer);
+    if (err) {
+      return err;
+    }
+  }
 
   prepend_header(writer, box_start);
 
-  return err;
+  return Error::Ok;
 }
 
 
@@ -2370,6 +3004,8 @@ std::string Box_iprp::dump(Indent& indent) const
 
 uint32_t Box_ipco::find_or_append_child_box(const std::shared_ptr<Box>& box)
 {
+  parse_all_properties();
+
   for (uint32_t i = 0; i < (uint32_t) m_children.size(); i++) {
     if (Box::equal(m_children[i], box)) {
       return i;
@@ -2379,11 +3015,82 @@ uint32_t Box_ipco::find_or_append_child_box(const std::shared_ptr<Box>& box)
 }
 
 
+uint32_t Box_ipco::append_child_box(const std::shared_ptr<Box>& box)
+{
+  parse_all_properties();
+
+  return Box::append_child_box(box);
+}
+
+
 Error Box_ipco::parse(BitstreamRange& range, const heif_security_limits* limits)
 {
   //parse_full_box_header(range);
 
-  return read_children(range, READ_CHILDREN_ALL, limits);
+  // --- split the data into the property boxes, but only parse them when they are accessed
+
+  return m_lazy_children.read(range, READ_CHILDREN_ALL, *this, limits);
+}
+
+
+size_t Box_ipco::get_number_of_properties() const
+{
+  return m_lazy_children.empty() ? m_children.size() : m_lazy_children.size();
+}
+
+
+std::shared_ptr<Box> Box_ipco::get_property(size_t index) const
+{
+  return m_lazy_children.empty() ? m_children[index] : m_lazy_children.get_box(index);
+}
+
+
+Error Box_ipco::parse_all_properties()
+{
+  if (m_lazy_children.empty()) {
+    return Error::Ok;
+  }
+
+  Error err = m_lazy_children.get_all_boxes(&m_children);
+  m_lazy_children.clear();
+
+  return err;
+}
+
+
+std::vector<std::shared_ptr<Box>> Box_ipco::get_children() const
+{
+  if (m_lazy_children.empty()) {
+    return m_children;
+  }
+
+  // Boxes that cannot be parsed are returned as Box_Error.
+  std::vector<std::shared_ptr<Box>> children;
+  m_lazy_children.get_all_boxes(&children);
+  return children;
+}
+
+
+void Box_ipco::derive_box_version()
+{
+  parse_all_properties();
+}
+
+
+Error Box_ipco::write(StreamWriter& writer) const
+{
+  size_t box_start = reserve_box_header_space(writer);
+
+  for (const auto& child : get_children()) {
+    Error err = child->write(writer);
+    if (err) {
+      return err;
+    }
+  }
+
+  prepend_header(writer, box_start);
+
+  return Error::Ok;
 }
 
 
@@ -2392,7 +3099,7 @@ std::string Box_ipco::dump(Indent& indent) const
   std::ostringstream sstr;
   sstr << Box::dump(indent);
 
-  sstr << dump_children(indent, true);
+  sstr << dump_boxes(indent, get_children(), true);
 
   return sstr.str();
 }
@@ -2803,8 +3510,8 @@ Error Box_ipco::get_properties_for_item_ID(uint32_t itemID,
                                            const std::shared_ptr<class Box_ipma>& ipma,
                                            std::vector<std::shared_ptr<Box>>& out_properties) const
 {
-  const std::vector<Box_ipma::PropertyAssociation>* property_assoc = ipma->get_properties_for_item_ID(itemID);
-  if (property_assoc == nullptr) {
+  std::optional<std::vector<Box_ipma::PropertyAssociation>> property_assoc = ipma->get_properties_for_item_ID(itemID);
+  if (!property_assoc) {
     std::stringstream sstr;
     sstr << "Item (ID=" << itemID << ") has no properties assigned to it in ipma box";
 
@@ -2813,9 +3520,9 @@ Error Box_ipco::get_properties_for_item_ID(uint32_t itemID,
                  sstr.str());
   }
 
-  const auto& allProperties = get_all_child_boxes();
+  size_t number_of_properties = get_number_of_properties();
   for (const Box_ipma::PropertyAssociation& assoc : *property_assoc) {
-    if (assoc.property_index > allProperties.size()) {
+    if (assoc.property_index > number_of_properties) {
       std::stringstream sstr;
       sstr << "Nonexisting property (index=" << assoc.property_index << ") for item "
            << " ID=" << itemID << " referenced in ipma box";
@@ -2826,7 +3533,7 @@ Error Box_ipco::get_properties_for_item_ID(uint32_t itemID,
     }
 
     if (assoc.property_index > 0) {
-      out_properties.push_back(allProperties[assoc.property_index - 1]);
+      out_properties.push_back(get_property(assoc.property_index - 1));
     }
   }
 
@@ -2838,19 +3545,19 @@ std::shared_ptr<Box> Box_ipco::get_property_for_item_ID(heif_item_id itemID,
                                                         const std::shared_ptr<class Box_ipma>& ipma,
                                                         uint32_t box_type) const
 {
-  const std::vector<Box_ipma::PropertyAssociation>* property_assoc = ipma->get_properties_for_item_ID(itemID);
-  if (property_assoc == nullptr) {
+  std::optional<std::vector<Box_ipma::PropertyAssociation>> property_assoc = ipma->get_properties_for_item_ID(itemID);
+  if (!property_assoc) {
     return nullptr;
   }
 
-  const auto& allProperties = get_all_child_boxes();
+  size_t number_of_properties = get_number_of_properties();
   for (const Box_ipma::PropertyAssociation& assoc : *property_assoc) {
-    if (assoc.property_index > allProperties.size() ||
+    if (assoc.property_index > number_of_properties ||
         assoc.property_index == 0) {
       return nullptr;
     }
 
-    const auto& property = allProperties[assoc.property_index - 1];
+    auto property = get_property(assoc.property_index - 1);
     if (property->get_short_type() == box_type) {
       return property;
     }
@@ -2864,11 +3571,12 @@ bool Box_ipco::is_property_essential_for_item(heif_item_id itemId,
                                               const std::shared_ptr<const class Box>& property,
                                               const std::shared_ptr<class Box_ipma>& ipma) const
 {
-  // find property index
+  // find property index (the property has been accessed before, thus it does not have to be parsed)
 
-  for (int i = 0; i < (int) m_children.size(); i++) {
-    if (m_children[i] == property) {
-      return ipma->is_property_essential_for_item(itemId, i + 1);
+  for (size_t i = 0; i < get_number_of_properties(); i++) {
+    auto candidate = m_lazy_children.empty() ? m_children[i] : m_lazy_children.get_box_if_parsed(i);
+    if (candidate == property) {
+      return ipma->is_property_essential_for_item(itemId, (int) i + 1);
     }
   }
 
@@ -2950,61 +3658,157 @@ Error Box_ipma::parse(BitstreamRange& range, const heif_security_limits* limits)
             sstr.str()};
   }
 
-  for (uint32_t i = 0; i < entry_cnt && !range.error() && !range.eof(); i++) {
-    Entry entry;
-    if (get_version() < 1) {
-      entry.item_ID = range.read16();
+  if (range.error()) {
+    return range.get_error();
+  }
+
+
+  // --- read the entries in one block and index them, but only decode them when they are accessed
+
+  m_entry_data.resize(range.get_remaining_bytes());
+  if (!range.read(m_entry_data.data(), m_entry_data.size())) {
+    return range.get_error();
+  }
+
+  const int id_size = (get_version() < 1) ? 2 : 4;
+  const int index_size = (get_flags() & 1) ? 2 : 1;
+  const size_t data_size = m_entry_data.size();
+
+  m_entries.clear();
+  m_entry_index.clear();
+  m_entry_index.reserve(entry_cnt);
+
+  size_t pos = 0;
+  for (uint32_t i = 0; i < entry_cnt && pos < data_size; i++) {
+    if (data_size - pos < (size_t) id_size + 1) {
+      return {heif_error_Invalid_input,
+              heif_suberror_End_of_data};
     }
-    else {
-      entry.item_ID = range.read32();
+
+    const uint8_t* p = m_entry_data.data() + pos;
+    auto item_ID = static_cast<heif_item_id>(read_big_endian(p, id_size));
+    auto assoc_cnt = static_cast<size_t>(read_big_endian(p, 1));
+
+    size_t entry_size = id_size + 1 + assoc_cnt * index_size;
+    if (data_size - pos < entry_size) {
+      return {heif_error_Invalid_input,
+              heif_suberror_End_of_data};
     }
 
-    int assoc_cnt = range.read8();
-    for (int k = 0; k < assoc_cnt; k++) {
-      PropertyAssociation association{};
+    m_entry_index.append(item_ID, pos);
+    pos += entry_size;
+  }
+
+  // drop unused data after the last entry
+  m_entry_data.resize(pos);
+
+  m_entry_index.sort();
+  m_entries_decoded = false;
+
+  return Error::Ok;
+}
 
-      uint16_t index;
-      if (get_flags() & 1) {
-        index = range.read16();
-        association.essential = !!(index & 0x8000);
-        association.property_index = (index & 0x7fff);
-      }
-      else {
-        index = range.read8();
-        association.essential = !!(index & 0x80);
-        association.property_index = (index & 0x7f);
-      }
 
-      entry.associations.push_back(association);
+Box_ipma::Entry Box_ipma::decode_entry(size_t offset, size_t* out_size) const
+{
+  const uint8_t* p = m_entry_data.data() + offset;
+
+  Entry entry;
+  entry.item_ID = static_cast<heif_item_id>(read_big_endian(p, (get_version() < 1) ? 2 : 4));
+
+  auto assoc_cnt = static_cast<size_t>(read_big_endian(p, 1));
+  entry.associations.resize(assoc_cnt);
+
+  for (PropertyAssociation& association : entry.associations) {
+    if (get_flags() & 1) {
+      auto index = static_cast<uint16_t>(read_big_endian(p, 2));
+      association.essential = !!(index & 0x8000);
+      association.property_index = (index & 0x7fff);
+    }
+    else {
+      auto index = static_cast<uint8_t>(read_big_endian(p, 1));
+      association.essential = !!(index & 0x80);
+      association.property_index = (index & 0x7f);
     }
+  }
 
-    m_entries.push_back(entry);
+  if (out_size) {
+    *out_size = p - (m_entry_data.data() + offset);
   }
 
-  return range.get_error();
+  return entry;
 }
 
 
-const std::vector<Box_ipma::PropertyAssociation>* Box_ipma::get_properties_for_item_ID(uint32_t itemID) const
+std::vector<Box_ipma::Entry> Box_ipma::get_decoded_entries() const
 {
-  for (const auto& entry : m_entries) {
-    if (entry.item_ID == itemID) {
-      return &entry.associations;
-    }
+  if (m_entries_decoded) {
+    return m_entries;
   }
 
-  return nullptr;
+  std::vector<Entry> entries;
+
+  size_t pos = 0;
+  while (pos < m_entry_data.size()) {
+    size_t size;
+    entries.push_back(decode_entry(pos, &size));
+    pos += size;
+  }
+
+  return entries;
+}
+
+
+void Box_ipma::decode_all_entries()
+{
+  if (m_entries_decoded) {
+    return;
+  }
+
+  std::vector<Entry> entries = get_decoded_entries();
+
+  m_entry_index.clear();
+  m_entry_data.clear();
+  m_entry_data.shrink_to_fit();
+  m_entries_decoded = true;
+
+  for (const Entry& entry : entries) {
+    add_entry(entry);
+  }
+}
+
+
+void Box_ipma::add_entry(const Entry& entry)
+{
+  // if an item appears twice, lookups return the first entry
+  m_entry_index.insert(entry.item_ID, m_entries.size());
+  m_entries.push_back(entry);
+}
+
+
+std::optional<std::vector<Box_ipma::PropertyAssociation>> Box_ipma::get_properties_for_item_ID(uint32_t itemID) const
+{
+  size_t position;
+  if (!m_entry_index.find(itemID, &position)) {
+    return std::nullopt;
+  }
+
+  if (m_entries_decoded) {
+    return m_entries[position].associations;
+  }
+  else {
+    return decode_entry(position).associations;
+  }
 }
 
 
 bool Box_ipma::is_property_essential_for_item(heif_item_id itemId, int propertyIndex) const
 {
-  for (const auto& entry : m_entries) {
-    if (entry.item_ID == itemId) {
-      for (const auto& assoc : entry.associations) {
-        if (assoc.property_index == propertyIndex) {
-          return assoc.essential;
-        }
+  auto associations = get_properties_for_item_ID(itemId);
+  if (associations) {
+    for (const auto& assoc : *associations) {
+      if (assoc.property_index == propertyIndex) {
+        return assoc.essential;
       }
     }
   }
@@ -3017,18 +3821,16 @@ bool Box_ipma::is_property_essential_for_item(heif_item_id itemId, int propertyI
 void Box_ipma::add_property_for_item_ID(heif_item_id itemID,
                                         PropertyAssociation assoc)
 {
-  size_t idx;
-  for (idx = 0; idx < m_entries.size(); idx++) {
-    if (m_entries[idx].item_ID == itemID) {
-      break;
-    }
-  }
+  decode_all_entries();
 
-  // if itemID does not exist, add a new entry
-  if (idx == m_entries.size()) {
+  size_t idx;
+  if (!m_entry_index.find(itemID, &idx)) {
+    // if itemID does not exist, add a new entry
     Entry entry;
     entry.item_ID = itemID;
-    m_entries.push_back(entry);
+
+    idx = m_entries.size();
+    add_entry(entry);
   }
 
   // If the property is already associated with the item, skip.
@@ -3050,7 +3852,7 @@ std::string Box_ipma::dump(Indent& indent) const
   std::ostringstream sstr;
   sstr << Box::dump(indent);
 
-  for (const Entry& entry : m_entries) {
+  for (const Entry& entry : get_decoded_entries()) {
     sstr << indent << "associations for item ID: " << entry.item_ID << "\n";
     indent++;
     for (const auto& assoc : entry.associations) {
@@ -3066,6 +3868,8 @@ std::string Box_ipma::dump(Indent& indent) const
 
 void Box_ipma::derive_box_version()
 {
+  decode_all_entries();
+
   int version = 0;
   bool large_property_indices = false;
 
@@ -3130,9 +3934,11 @@ Error Box_ipma::write(StreamWriter& writer) const
 
 void Box_ipma::insert_entries_from_other_ipma_box(const Box_ipma& b)
 {
-  m_entries.insert(m_entries.end(),
-                   b.m_entries.begin(),
-                   b.m_entries.end());
+  decode_all_entries();
+
+  for (const Entry& entry : b.get_decoded_entries()) {
+    add_entry(entry);
+  }
 }
 
 
@@ -3435,18 +4241,39 @@ Error Box_iref::parse(BitstreamRange& range, const heif_security_limits* limits)
     return unsupported_version_error("iref");
   }
 
-  while (!range.eof()) {
+  // --- read the references in one block, because files with many tiles have long reference lists
+
+  std::vector<uint8_t> data(range.get_remaining_bytes());
+  if (!range.read(data.data(), data.size())) {
+    return range.get_error();
+  }
+
+  const int id_size = (get_version() == 0) ? 2 : 4;
+
+  size_t pos = 0;
+  while (pos < data.size()) {
     Reference ref;
 
-    Error err = ref.header.parse_header(range);
+    // parse the header of the reference box with the usual checks
+    StreamReader_memory header_reader(data.data() + pos, data.size() - pos, false);
+    BitstreamRange header_range(std::shared_ptr<StreamReader>(std::shared_ptr<StreamReader>(), &header_reader), data.size() - pos);
+
+    Error err = ref.header.parse_header(header_range);
     if (err != Error::Ok) {
       return err;
     }
 
-    int read_len = (get_version() == 0) ? 16 : 32;
+    pos += ref.header.get_header_size();
+
+    if (data.size() - pos < (size_t) id_size + 2) {
+      return {heif_error_Invalid_input,
+              heif_suberror_End_of_data};
+    }
 
-    ref.from_item_ID = static_cast<uint32_t>(range.read_uint(read_len));
-    uint16_t nRefs = range.read16();
+    const uint8_t* p = data.data() + pos;
+    ref.from_item_ID = static_cast<uint32_t>(read_big_endian(p, id_size));
+    auto nRefs = static_cast<uint16_t>(read_big_endian(p, 2));
+    pos += id_size + 2;
 
     if (nRefs > limits->max_items) {
       std::stringstream sstr;
@@ -3457,20 +4284,24 @@ Error Box_iref::parse(BitstreamRange& range, const heif_security_limits* limits)
               sstr.str()};
     }
 
-    for (int i = 0; i < nRefs; i++) {
-      if (range.eof()) {
-        std::stringstream sstr;
-        sstr << "iref box should contain " << nRefs << " references, but we can only read " << i << " references.";
+    size_t available_refs = (data.size() - pos) / id_size;
+    if (nRefs > available_refs) {
+      std::stringstream sstr;
+      sstr << "iref box should contain " << nRefs << " references, but we can only read " << available_refs << " references.";
 
-        return {heif_error_Invalid_input,
-                heif_suberror_End_of_data,
-                sstr.str()};
-      }
+      return {heif_error_Invalid_input,
+              heif_suberror_End_of_data,
+              sstr.str()};
+    }
 
-      ref.to_item_ID.push_back(static_cast<uint32_t>(range.read_uint(read_len)));
+    ref.to_item_ID.resize(nRefs);
+    for (uint32_t& to_ID : ref.to_item_ID) {
+      to_ID = static_cast<uint32_t>(read_big_endian(p, id_size));
     }
 
-    m_references.push_back(ref);
+    pos += nRefs * id_size;
+
+    add_reference(ref);
   }
 
 
@@ -3539,16 +4370,19 @@ Error Box_iref::parse(BitstreamRange& range, const heif_security_limits* limits)
 Error Box_iref::check_for_double_references() const
 {
   for (const auto& ref : m_references) {
-    std::set<heif_item_id> to_ids;
-    for (const auto to_id : ref.to_item_ID) {
-      if (to_ids.find(to_id) == to_ids.end()) {
-        to_ids.insert(to_id);
-      }
-      else {
-        return {heif_error_Invalid_input,
-                heif_suberror_Unspecified,
-                "'iref' has double references"};
-      }
+    // Long reference lists (e.g. of grid tiles) are usually in ascending order and need no copy.
+    if (std::adjacent_find(ref.to_item_ID.begin(), ref.to_item_ID.end(),
+                           std::greater_equal<heif_item_id>()) == ref.to_item_ID.end()) {
+      continue;
+    }
+
+    std::vector<heif_item_id> to_ids = ref.to_item_ID;
+    std::sort(to_ids.begin(), to_ids.end());
+
+    if (std::adjacent_find(to_ids.begin(), to_ids.end()) != to_ids.end()) {
+      return {heif_error_Invalid_input,
+              heif_suberror_Unspecified,
+              "'iref' has double references"};
     }
   }
 
@@ -3628,26 +4462,60 @@ std::string Box_iref::dump(Indent& indent) const
 }
 
 
+void Box_iref::add_reference(const Reference& ref)
+{
+  size_t idx = m_references.size();
+  m_references.push_back(ref);
+
+  m_references_from[ref.from_item_ID].push_back(idx);
+
+  m_references_to_valid = false;
+}
+
+
 bool Box_iref::has_references(uint32_t itemID) const
 {
-  for (const Reference& ref : m_references) {
-    if (ref.from_item_ID == itemID) {
-      return true;
+  return m_references_from.find(itemID) != m_references_from.end();
+}
+
+
+std::vector<Box_iref::Reference> Box_iref::get_references_from(heif_item_id itemID) const
+{
+  std::vector<Reference> references;
+
+  auto iter = m_references_from.find(itemID);
+  if (iter != m_references_from.end()) {
+    for (size_t idx : iter->second) {
+      references.push_back(m_references[idx]);
     }
   }
 
-  return false;
+  return references;
 }
 
 
-std::vector<Box_iref::Reference> Box_iref::get_references_from(heif_item_id itemID) const
+std::vector<Box_iref::Reference> Box_iref::get_references_to(heif_item_id itemID) const
 {
-  std::vector<Reference> references;
+  std::lock_guard<std::mutex> lock(m_references_to_mutex);
+
+  if (!m_references_to_valid) {
+    m_references_to.clear();
 
-  for (const Reference& ref : m_references) {
-    if (ref.from_item_ID == itemID) {
-      references.push_back(ref);
+    for (size_t idx = 0; idx < m_references.size(); idx++) {
+      for (heif_item_id to_id : m_references[idx].to_item_ID) {
+        m_references_to.emplace_back(to_id, idx);
+      }
     }
+
+    std::sort(m_references_to.begin(), m_references_to.end());
+    m_references_to_valid = true;
+  }
+
+  std::vector<Reference> references;
+
+  auto iter = std::lower_bound(m_references_to.begin(), m_references_to.end(), std::make_pair(itemID, size_t(0)));
+  for (; iter != m_references_to.end() && iter->first == itemID; iter++) {
+    references.push_back(m_references[iter->second]);
   }
 
   return references;
@@ -3656,10 +4524,13 @@ std::vector<Box_iref::Reference> Box_iref::get_references_from(heif_item_id item
 
 std::vector<uint32_t> Box_iref::get_references(uint32_t itemID, uint32_t ref_type) const
 {
-  for (const Reference& ref : m_references) {
-    if (ref.from_item_ID == itemID &&
-        ref.header.get_short_type() == ref_type) {
-      return ref.to_item_ID;
+  auto iter = m_references_from.find(itemID);
+  if (iter != m_references_from.end()) {
+    for (size_t idx : iter->second) {
+      const Reference& ref = m_references[idx];
+      if (ref.header.get_short_type() == ref_type) {
+        return ref.to_item_ID;
+      }
     }
   }
 
@@ -3676,18 +4547,23 @@ void Box_iref::add_references(heif_item_id from_id, uint32_t type, const std::ve
 
   assert(to_ids.size() <= 0xFFFF);
 
-  m_references.push_back(ref);
+  add_reference(ref);
 }
 
 
 void Box_iref::overwrite_reference(heif_item_id from_id, uint32_t type, uint32_t reference_idx, heif_item_id to_item)
 {
-  for (auto& ref : m_references) {
-    if (ref.from_item_ID == from_id && ref.header.get_short_type() == type) {
-      assert(reference_idx < ref.to_item_ID.size());
+  auto iter = m_references_from.find(from_id);
+  if (iter != m_references_from.end()) {
+    for (size_t idx : iter->second) {
+      Reference& ref = m_references[idx];
+      if (ref.header.get_short_type() == type) {
+        assert(reference_idx < ref.to_item_ID.size());
 
-      ref.to_item_ID[reference_idx] = to_item;
-      return;
+        ref.to_item_ID[reference_idx] = to_item;
+        m_references_to_valid = false;
+        return;
+      }
     }
   }
 
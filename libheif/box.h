@@ -38,6 +38,9 @@
 #include <bitset>
 #include <utility>
 #include <optional>
+#include <unordered_map>
+#include <mutex>
+#include <memory_resource>
 
 #include "error.h"
 #include "logging.h"
@@ -225,7 +228,7 @@ public:
 
   const std::vector<std::shared_ptr<Box>>& get_all_child_boxes() const { return m_children; }
 
-  uint32_t append_child_box(const std::shared_ptr<Box>& box)
+  virtual uint32_t append_child_box(const std::shared_ptr<Box>& box)
   {
     m_children.push_back(box);
     return (int) m_children.size() - 1;
@@ -272,6 +275,8 @@ protected:
 
   std::string dump_children(Indent&, bool with_index = false) const;
 
+  static std::string dump_boxes(Indent&, const std::vector<std::shared_ptr<Box>>& boxes, bool with_index = false);
+
 
   // --- writing
 
@@ -371,6 +376,142 @@ protected:
   parse_error_fatality m_fatality;
 };
 
+// Memory for the boxes that are parsed from a file and for their entry tables.
+// Allocations are taken from a monotonic buffer and are only released at once when the arena is destroyed.
+// Each box that is allocated from the arena keeps it alive, so that boxes may outlive the HeifFile.
+// Allocation is thread-safe, because the boxes of a file may be parsed on first access from several threads.
+class BoxArena : public std::pmr::memory_resource,
+                 public std::enable_shared_from_this<BoxArena>
+{
+public:
+  // While a Scope is active, the boxes that Box::read() creates in this thread are allocated from 'arena'.
+  // 'arena' may be nullptr to allocate the boxes from the heap.
+  class Scope
+  {
+  public:
+    explicit Scope(BoxArena* arena);
+
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    BoxArena* m_previous_arena;
+  };
+
+  // Returns nullptr if there is no active Scope.
+  static BoxArena* current();
+
+  // The arena of the active Scope, or the default memory resource.
+  static std::pmr::memory_resource* current_resource();
+
+private:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+
+  void do_deallocate(void*, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+  std::mutex m_mutex;
+  std::pmr::monotonic_buffer_resource m_resource;
+};
+
+
+// Sorted map from item IDs to the position of their entry in a box that has an entry for each item.
+// It is much cheaper to build than a hash map with one node per item.
+// If an item ID appears several times, the first entry is kept.
+class ItemEntryIndex
+{
+public:
+  void clear() { m_entries.clear(); }
+
+  void reserve(size_t n) { m_entries.reserve(n); }
+
+  // Appends an entry without keeping the index sorted. sort() has to be called before the next lookup.
+  void append(heif_item_id item_ID, size_t position) { m_entries.push_back({item_ID, position}); }
+
+  void sort();
+
+  // Inserts an entry at its sorted position. Does nothing if there is already an entry for the item.
+  void insert(heif_item_id item_ID, size_t position);
+
+  // Returns false if there is no entry for the item.
+  bool find(heif_item_id item_ID, size_t* out_position) const;
+
+  bool contains(heif_item_id item_ID) const;
+
+  size_t size() const { return m_entries.size(); }
+
+  heif_item_id get_max_item_ID() const { return m_entries.empty() ? 0 : m_entries.back().item_ID; }
+
+  // in ascending order
+  std::vector<heif_item_id> get_item_IDs() const;
+
+private:
+  struct Entry
+  {
+    heif_item_id item_ID;
+    size_t position;
+  };
+
+  std::pmr::vector<Entry> m_entries{BoxArena::current_resource()};
+};
+
+
+// Child boxes that are kept in their encoded form until they are accessed for the first time.
+// This is used for the boxes that have a child box for each item or property ('iinf', 'ipco'),
+// such that opening a file does not parse the boxes of all items. Accessing the boxes is thread-safe.
+class LazyBoxList
+{
+public:
+  // Reads the rest of 'range' and splits it into at most 'max_number' boxes without parsing them.
+  Error read(BitstreamRange& range, uint32_t max_number, const Box& container, const heif_security_limits* limits);
+
+  bool empty() const { return m_entries.empty(); }
+
+  size_t size() const { return m_entries.size(); }
+
+  uint32_t get_box_type(size_t index) const { return m_entries[index].type; }
+
+  // Returns the box content after the box header.
+  const uint8_t* get_box_payload(size_t index, size_t* out_size) const;
+
+  // Parses the box when it is accessed for the first time. A box that cannot be parsed is returned as a Box_Error.
+  std::shared_ptr<Box> get_box(size_t index) const;
+
+  // Returns nullptr if the box has not been parsed yet.
+  std::shared_ptr<Box> get_box_if_parsed(size_t index) const;
+
+  // Parses all boxes that have not been accessed yet.
+  // Like Box::read_children(), this returns the error of the first box that cannot be parsed, unless it is not fatal.
+  Error get_all_boxes(std::vector<std::shared_ptr<Box>>* out_boxes) const;
+
+  void clear();
+
+private:
+  struct Entry
+  {
+    size_t start;
+    size_t size;
+    size_t header_size;
+    uint32_t type;
+  };
+
+  std::pmr::vector<uint8_t> m_data{BoxArena::current_resource()};
+  std::pmr::vector<Entry> m_entries{BoxArena::current_resource()};
+  heif_security_limits m_limits{};
+
+  // the boxes are parsed into the arena that was active when the list was read
+  BoxArena* m_arena = BoxArena::current();
+
+  mutable std::mutex m_mutex;
+  mutable std::pmr::vector<std::shared_ptr<Box>> m_boxes{BoxArena::current_resource()};
+
+  std::shared_ptr<Box> parse_box(size_t index) const;
+};
+
 
 
 
@@ -499,6 +640,22 @@ private:
 };
 
 
+// Keeps the 'mdat' payload outside of memory while a file is written (see FileLayout::WriteMode).
+// Positions are relative to the start of the 'mdat' payload.
+class ItemDataStorage
+{
+public:
+  virtual ~ItemDataStorage() = default;
+
+  // Returns the position of the appended data.
+  virtual Result<uint64_t> append(const uint8_t* data, size_t size) = 0;
+
+  virtual Error overwrite(uint64_t position, const uint8_t* data, size_t size) = 0;
+
+  virtual uint64_t get_size() const = 0;
+};
+
+
 class Box_iloc : public FullBox
 {
 public:
@@ -506,7 +663,11 @@ public:
 
   ~Box_iloc() override;
 
-  void set_use_tmp_file(bool flag);
+  // Item data that is added with construction method 0 is passed to this storage instead of keeping it in memory.
+  // Has to be set before any item data is added.
+  void set_item_data_storage(std::shared_ptr<ItemDataStorage> storage) { m_item_data_storage = std::move(storage); }
+
+  bool has_item_data_storage() const { return m_item_data_storage != nullptr; }
 
   std::string dump(Indent&) const override;
 
@@ -517,6 +678,7 @@ public:
     uint64_t length = 0;
 
     std::vector<uint8_t> data; // only used when writing data
+    uint64_t storage_position = 0; // only used when writing data to an ItemDataStorage
   };
 
   struct Item
@@ -529,7 +691,11 @@ public:
     std::vector<Extent> extents;
   };
 
-  const std::vector<Item>& get_items() const { return m_items; }
+  bool has_items() const { return m_item_index.size() > 0; }
+
+  // Returns nullptr if there is no item with this ID.
+  // Items of a parsed box are decoded into 'decoded_item' and a pointer to it is returned.
+  const Item* find_item(heif_item_id item_ID, Item* decoded_item) const;
 
   Error read_data(heif_item_id item,
                   const std::shared_ptr<StreamReader>& istr,
@@ -545,6 +711,20 @@ public:
                   uint64_t offset, uint64_t size,
                   const heif_security_limits* limits) const;
 
+  // Gets pointers to the item data in place instead of copying it. This is only possible when the
+  // reader holds the file in memory and the data is stored in the file (construction method 0).
+  // Returns false if the data is not directly accessible. 'spans' is then left unchanged and
+  // the data has to be read with read_data().
+  bool get_data_spans(heif_item_id item,
+                      const std::shared_ptr<StreamReader>& istr,
+                      std::vector<DataSpan>* spans) const;
+
+  // Appends the file ranges that hold the item data in [offset, offset+size). This is only possible
+  // for data that is stored in the file (construction method 0). Returns false otherwise.
+  bool get_file_ranges(heif_item_id item,
+                       uint64_t offset, uint64_t size,
+                       std::vector<FileRange>* ranges) const;
+
   void set_min_version(uint8_t min_version) { m_user_defined_min_version = min_version; }
 
   // append bitstream data that will be written later (after iloc box)
@@ -572,15 +752,36 @@ public:
 
   Error write(StreamWriter& writer) const override;
 
+  // With an ItemDataStorage, this only writes the 'mdat' header. The payload has to follow it.
   Error write_mdat_after_iloc(StreamWriter& writer);
 
-  void append_item(Item &item) { m_items.push_back(item); }
+  // Sets the offsets of the data in the ItemDataStorage, whose content starts at file position 'payload_start',
+  // and writes them into the iloc box that has been written to 'writer'.
+  void patch_item_data_offsets(StreamWriter& writer, uint64_t payload_start);
+
+  void append_item(Item &item) { add_item(item); }
 
 protected:
   Error parse(BitstreamRange& range, const heif_security_limits*) override;
 
 private:
   std::vector<Item> m_items;
+  ItemEntryIndex m_item_index; // item ID -> index into m_items, or offset into m_item_data if the items are not decoded
+
+  // The items of a parsed box are only decoded when they are accessed. They are decoded into m_items
+  // when the box is modified or written.
+  std::pmr::vector<uint8_t> m_item_data{BoxArena::current_resource()};
+  bool m_items_decoded = true;
+
+  void add_item(const Item& item);
+
+  Error index_items(uint32_t item_count, const heif_security_limits* limits);
+
+  Item decode_item(size_t offset, size_t* out_size = nullptr) const;
+
+  void decode_all_items();
+
+  std::vector<Item> get_decoded_items() const;
 
   mutable size_t m_iloc_box_start = 0;
   uint8_t m_user_defined_min_version = 0;
@@ -593,9 +794,7 @@ private:
 
   int m_idat_offset = 0; // only for writing: offset of next data array
 
-  bool m_use_tmpfile = false;
-  int m_tmpfile_fd = 0;
-  char m_tmp_filename[20];
+  std::shared_ptr<ItemDataStorage> m_item_data_storage;
 };
 
 
@@ -673,11 +872,38 @@ public:
 
   Error write(StreamWriter& writer) const override;
 
+  uint32_t append_child_box(const std::shared_ptr<Box>& box) override;
+
+  size_t get_number_of_items() const { return m_item_index.size(); }
+
+  // in ascending order
+  std::vector<heif_item_id> get_item_IDs() const { return m_item_index.get_item_IDs(); }
+
+  heif_item_id get_max_item_ID() const { return m_item_index.get_max_item_ID(); }
+
+  bool has_item(heif_item_id item_ID) const { return m_item_index.contains(item_ID); }
+
+  // The 'infe' box of a parsed file is parsed when it is accessed for the first time.
+  // Returns nullptr if the item does not exist or its 'infe' box cannot be parsed.
+  std::shared_ptr<Box_infe> get_infe_box(heif_item_id item_ID) const;
+
+  // These do not need to parse the 'infe' box.
+  uint32_t get_item_type_4cc(heif_item_id item_ID) const;
+
+  bool is_hidden_item(heif_item_id item_ID) const;
+
+  // Parses the 'infe' boxes that have not been accessed yet.
+  Error parse_all_items();
+
 protected:
   Error parse(BitstreamRange& range, const heif_security_limits*) override;
 
 private:
-  //std::vector< std::shared_ptr<Box_infe> > m_iteminfos;
+  ItemEntryIndex m_item_index; // item ID -> index into m_children, or into m_lazy_children while it is used
+
+  LazyBoxList m_lazy_children;
+
+  std::vector<std::shared_ptr<Box>> get_children() const;
 };
 
 
@@ -718,10 +944,30 @@ public:
                                       const std::shared_ptr<const class Box>& property,
                                       const std::shared_ptr<class Box_ipma>&) const;
 
+  uint32_t append_child_box(const std::shared_ptr<Box>& box) override;
+
+  size_t get_number_of_properties() const;
+
+  // The properties of a parsed file are parsed when they are accessed for the first time.
+  // 'index' starts at 0, while the property indices in 'ipma' start at 1.
+  std::shared_ptr<Box> get_property(size_t index) const;
+
+  // Parses the properties that have not been accessed yet.
+  Error parse_all_properties();
+
   std::string dump(Indent&) const override;
 
+  void derive_box_version() override;
+
+  Error write(StreamWriter& writer) const override;
+
 protected:
   Error parse(BitstreamRange& range, const heif_security_limits*) override;
+
+private:
+  LazyBoxList m_lazy_children;
+
+  std::vector<std::shared_ptr<Box>> get_children() const;
 };
 
 
@@ -776,7 +1022,8 @@ public:
     uint16_t property_index;
   };
 
-  const std::vector<PropertyAssociation>* get_properties_for_item_ID(heif_item_id itemID) const;
+  // Returns no value if the item has no entry.
+  std::optional<std::vector<PropertyAssociation>> get_properties_for_item_ID(heif_item_id itemID) const;
 
   bool is_property_essential_for_item(heif_item_id itemId, int propertyIndex) const;
 
@@ -799,6 +1046,20 @@ protected:
   };
 
   std::vector<Entry> m_entries;
+  ItemEntryIndex m_entry_index; // item ID -> index into m_entries, or offset into m_entry_data if the entries are not decoded
+
+  // The entries of a parsed box are only decoded when they are accessed. They are decoded into m_entries
+  // when the box is modified or written.
+  std::pmr::vector<uint8_t> m_entry_data{BoxArena::current_resource()};
+  bool m_entries_decoded = true;
+
+  void add_entry(const Entry& entry);
+
+  Entry decode_entry(size_t offset, size_t* out_size = nullptr) const;
+
+  void decode_all_entries();
+
+  std::vector<Entry> get_decoded_entries() const;
 };
 
 
@@ -955,6 +1216,9 @@ public:
 
   std::vector<Reference> get_references_from(heif_item_id itemID) const;
 
+  // All references that point to 'itemID', whatever their type.
+  std::vector<Reference> get_references_to(heif_item_id itemID) const;
+
   void add_references(heif_item_id from_id, uint32_t type, const std::vector<heif_item_id>& to_ids);
 
   void overwrite_reference(heif_item_id from_id, uint32_t type, uint32_t reference_idx, heif_item_id to_item);
@@ -970,6 +1234,16 @@ protected:
 
 private:
   std::vector<Reference> m_references;
+
+  // indices into m_references
+  std::unordered_map<heif_item_id, std::vector<size_t>> m_references_from;
+
+  // Sorted pairs of (to_item_ID, index into m_references). This is only built when it is needed.
+  mutable std::mutex m_references_to_mutex;
+  mutable std::pmr::vector<std::pair<heif_item_id, size_t>> m_references_to{BoxArena::current_resource()};
+  mutable bool m_references_to_valid = false;
+
+  void add_reference(const Reference& ref);
 };
 
 
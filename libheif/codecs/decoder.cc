@@ -20,6 +20,10 @@
 
 #include "codecs/decoder.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
 #include <utility>
 #include "error.h"
 #include "context.h"
@@ -98,6 +102,26 @@ Result<std::vector<uint8_t>> DataExtent::read_data(uint64_t offset, uint64_t siz
 }
 
 
+Result<std::vector<DataSpan>> DataExtent::get_data_spans() const
+{
+  std::vector<DataSpan> spans;
+
+  if (m_raw.empty() &&
+      m_source == Source::Image &&
+      m_file->get_data_spans_from_iloc(m_item_id, spans)) {
+    return spans;
+  }
+
+  Result<std::vector<uint8_t>*> dataResult = read_data();
+  if (dataResult.error) {
+    return dataResult.error;
+  }
+
+  spans.push_back({dataResult.value->data(), dataResult.value->size()});
+  return spans;
+}
+
+
 std::shared_ptr<Decoder> Decoder::alloc_for_infe_type(const HeifContext* ctx, heif_item_id id, uint32_t format_4cc)
 {
   switch (format_4cc) {
@@ -141,6 +165,410 @@ std::shared_ptr<Decoder> Decoder::alloc_for_infe_type(const HeifContext* ctx, he
 }
 
 
+DecoderInstancePool::~DecoderInstancePool()
+{
+  for (auto& idle : m_idle_instances) {
+    free_instances(std::get<0>(idle.first), idle.second);
+  }
+}
+
+
+void DecoderInstancePool::free_instances(const heif_decoder_plugin* plugin, std::vector<void*>& instances)
+{
+  for (void* decoder : instances) {
+    plugin->free_decoder(decoder);
+  }
+
+  instances.clear();
+}
+
+
+// Parameters that libheif sets itself. Decoders that do not support them ignore them.
+static bool is_optional_decoder_parameter(const std::string& name)
+{
+  return name == heif_decoder_parameter_name_threads ||
+         name == heif_decoder_parameter_name_downscale;
+}
+
+
+static Error invalid_parameter_value(const std::string& name, const std::string& value)
+{
+  return {heif_error_Usage_error,
+          heif_suberror_Invalid_parameter_value,
+          "Invalid value '" + value + "' for decoder parameter '" + name + "'"};
+}
+
+
+static Error unsupported_parameter(const std::string& name)
+{
+  return {heif_error_Usage_error,
+          heif_suberror_Unsupported_parameter,
+          "Decoder does not support the parameter '" + name + "'"};
+}
+
+
+// Values of the optional parameters are clamped to the range of the decoder instead of being rejected, because
+// libheif sets them without knowing the decoder (e.g. 'threads' to the maximum number of decoding threads).
+static Result<int> parse_integer_parameter(const heif_encoder_parameter* param, const std::string& value)
+{
+  const char* str = value.c_str();
+  char* end = nullptr;
+  errno = 0;
+  long v = strtol(str, &end, 10);
+
+  if (end == str || *end != 0 || errno == ERANGE ||
+      v < std::numeric_limits<int>::min() || v > std::numeric_limits<int>::max()) {
+    return invalid_parameter_value(param->name, value);
+  }
+
+  if (param->integer.have_minimum_maximum &&
+      (v < param->integer.minimum || v > param->integer.maximum)) {
+    if (!is_optional_decoder_parameter(param->name)) {
+      return invalid_parameter_value(param->name, value);
+    }
+
+    v = std::clamp(v, long{param->integer.minimum}, long{param->integer.maximum});
+  }
+
+  if (param->integer.num_valid_values > 0 &&
+      std::find(param->integer.valid_values,
+                param->integer.valid_values + param->integer.num_valid_values,
+                static_cast<int>(v)) == param->integer.valid_values + param->integer.num_valid_values) {
+    return invalid_parameter_value(param->name, value);
+  }
+
+  return static_cast<int>(v);
+}
+
+
+static Result<bool> parse_boolean_parameter(const heif_encoder_parameter* param, const std::string& value)
+{
+  if (value == "true" || value == "1") {
+    return true;
+  }
+  else if (value == "false" || value == "0") {
+    return false;
+  }
+
+  return invalid_parameter_value(param->name, value);
+}
+
+
+static Error check_string_parameter(const heif_encoder_parameter* param, const std::string& value)
+{
+  if (param->string.valid_values) {
+    for (const char* const* v = param->string.valid_values; *v; v++) {
+      if (value == *v) {
+        return Error::Ok;
+      }
+    }
+
+    return invalid_parameter_value(param->name, value);
+  }
+
+  return Error::Ok;
+}
+
+
+static Error set_decoder_parameter(const heif_decoder_plugin* plugin, void* decoder,
+                                   const heif_encoder_parameter* param, const std::string& value)
+{
+  struct heif_error err{};
+
+  switch (param->type) {
+    case heif_encoder_parameter_type_integer: {
+      auto intResult = parse_integer_parameter(param, value);
+      if (intResult.error) {
+        return intResult.error;
+      }
+
+      if (!plugin->set_parameter_integer) {
+        return unsupported_parameter(param->name);
+      }
+
+      err = plugin->set_parameter_integer(decoder, param->name, intResult.value);
+      break;
+    }
+
+    case heif_encoder_parameter_type_boolean: {
+      auto boolResult = parse_boolean_parameter(param, value);
+      if (boolResult.error) {
+        return boolResult.error;
+      }
+
+      if (!plugin->set_parameter_boolean) {
+        return unsupported_parameter(param->name);
+      }
+
+      err = plugin->set_parameter_boolean(decoder, param->name, boolResult.value);
+      break;
+    }
+
+    case heif_encoder_parameter_type_string: {
+      Error stringErr = check_string_parameter(param, value);
+      if (stringErr) {
+        return stringErr;
+      }
+
+      if (!plugin->set_parameter_string) {
+        return unsupported_parameter(param->name);
+      }
+
+      err = plugin->set_parameter_string(decoder, param->name, value.c_str());
+      break;
+    }
+  }
+
+  if (err.code != heif_error_Ok) {
+    return Error(err.code, err.subcode, err.message);
+  }
+
+  return Error::Ok;
+}
+
+
+static Error set_decoder_parameters(const heif_decoder_plugin* plugin, void* decoder,
+                                    const DecoderParameters& parameters)
+{
+  bool has_parameters = (plugin->plugin_api_version >= 5 && plugin->list_parameters);
+
+  for (const auto& [name, value] : parameters) {
+    const heif_encoder_parameter* param = nullptr;
+
+    if (has_parameters) {
+      for (const struct heif_encoder_parameter* const* params = plugin->list_parameters();
+           *params;
+           params++) {
+        if (name == (*params)->name) {
+          param = *params;
+          break;
+        }
+      }
+    }
+
+    if (!param) {
+      if (is_optional_decoder_parameter(name)) {
+        continue;
+      }
+
+      return unsupported_parameter(name);
+    }
+
+    Error err = set_decoder_parameter(plugin, decoder, param, value);
+    if (err) {
+      return err;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+static Result<void*> new_decoder_instance(const heif_decoder_plugin* plugin, const DecoderParameters& parameters)
+{
+  void* decoder;
+  struct heif_error err = plugin->new_decoder(&decoder);
+  if (err.code != heif_error_Ok) {
+    return Error(err.code, err.subcode, err.message);
+  }
+
+  Error paramErr = set_decoder_parameters(plugin, decoder, parameters);
+  if (paramErr) {
+    plugin->free_decoder(decoder);
+    return paramErr;
+  }
+
+  return decoder;
+}
+
+
+Result<void*> DecoderInstancePool::acquire(const heif_decoder_plugin* plugin, const std::vector<uint8_t>& configuration,
+                                           const DecoderParameters& parameters)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The idle decoder was created with the same parameters and reset_decoder() keeps them.
+    // They are not set again, because decoders may reject parameter changes after decoding started.
+
+    auto iter = m_idle_instances.find(Key{plugin, configuration, parameters});
+    if (iter != m_idle_instances.end() && !iter->second.empty()) {
+      void* decoder = iter->second.back();
+      iter->second.pop_back();
+      m_num_idle--;
+      m_num_reused++;
+
+      return decoder;
+    }
+
+    m_num_allocated++;
+  }
+
+  return new_decoder_instance(plugin, parameters);
+}
+
+
+void DecoderInstancePool::release(const heif_decoder_plugin* plugin, const std::vector<uint8_t>& configuration,
+                                  const DecoderParameters& parameters, void* decoder)
+{
+  bool can_reset = (plugin->plugin_api_version >= 4 && plugin->reset_decoder);
+
+  if (!can_reset || plugin->reset_decoder(decoder).code != heif_error_Ok) {
+    plugin->free_decoder(decoder);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_num_idle < m_max_idle) {
+      m_idle_instances[Key{plugin, configuration, parameters}].push_back(decoder);
+      m_num_idle++;
+      return;
+    }
+  }
+
+  plugin->free_decoder(decoder);
+}
+
+
+void DecoderInstancePool::set_max_idle_instances(size_t n)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_max_idle = n;
+
+  // drop idle decoders until we are within the new limit
+
+  for (auto& idle : m_idle_instances) {
+    while (m_num_idle > m_max_idle && !idle.second.empty()) {
+      std::get<0>(idle.first)->free_decoder(idle.second.back());
+      idle.second.pop_back();
+      m_num_idle--;
+    }
+  }
+}
+
+
+size_t DecoderInstancePool::get_number_of_idle_instances() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_num_idle;
+}
+
+
+uint64_t DecoderInstancePool::get_number_of_reused_instances() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_num_reused;
+}
+
+
+uint64_t DecoderInstancePool::get_number_of_allocated_instances() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_num_allocated;
+}
+
+
+Error Decoder::append_image_data(std::vector<uint8_t>& data) const
+{
+  Result<std::vector<DataSpan>> spansResult = m_data_extent.get_data_spans();
+  if (spansResult.error) {
+    return spansResult.error;
+  }
+
+  for (const DataSpan& span : spansResult.value) {
+    data.insert(data.end(), span.data, span.data + span.size);
+  }
+
+  return Error::Ok;
+}
+
+
+// Checks whether the data is a sequence of complete NAL units, each prefixed with a 4-byte size
+// as expected by the decoder plugins. Only then can it be pushed into the decoder on its own.
+static bool consists_of_whole_nal_units(const uint8_t* data, size_t size)
+{
+  size_t ptr = 0;
+  while (ptr < size) {
+    if (size - ptr < 4) {
+      return false;
+    }
+
+    uint32_t nal_size = ((static_cast<uint32_t>(data[ptr]) << 24) |
+                         (static_cast<uint32_t>(data[ptr + 1]) << 16) |
+                         (static_cast<uint32_t>(data[ptr + 2]) << 8) |
+                         (static_cast<uint32_t>(data[ptr + 3])));
+    ptr += 4;
+
+    if (nal_size > size - ptr) {
+      return false;
+    }
+
+    ptr += nal_size;
+  }
+
+  return true;
+}
+
+
+Error Decoder::push_compressed_data(const heif_decoder_plugin* plugin, void* decoder,
+                                    const std::vector<uint8_t>& configuration) const
+{
+  Result<std::vector<DataSpan>> spansResult = m_data_extent.get_data_spans();
+  if (spansResult.error) {
+    return spansResult.error;
+  }
+
+  std::vector<DataSpan> chunks;
+  if (!configuration.empty()) {
+    chunks.push_back({configuration.data(), configuration.size()});
+  }
+
+  for (const DataSpan& span : spansResult.value) {
+    if (span.size > 0) {
+      chunks.push_back(span);
+    }
+  }
+
+  // The NAL based decoders accept the NAL units in several push_data() calls, but the other
+  // decoders expect the whole frame at once. The same applies when the iloc extents split NAL units.
+
+  bool push_separately = (chunks.size() <= 1);
+
+  heif_compression_format format = get_compression_format();
+  if (!push_separately &&
+      (format == heif_compression_HEVC || format == heif_compression_AVC || format == heif_compression_VVC)) {
+    push_separately = std::all_of(chunks.begin(), chunks.end(), [](const DataSpan& chunk) {
+      return consists_of_whole_nal_units(chunk.data, chunk.size);
+    });
+  }
+
+  if (push_separately) {
+    for (const DataSpan& chunk : chunks) {
+      struct heif_error err = plugin->push_data(decoder, chunk.data, chunk.size);
+      if (err.code != heif_error_Ok) {
+        return Error(err.code, err.subcode, err.message);
+      }
+    }
+  }
+  else {
+    std::vector<uint8_t> data;
+    for (const DataSpan& chunk : chunks) {
+      data.insert(data.end(), chunk.data, chunk.data + chunk.size);
+    }
+
+    struct heif_error err = plugin->push_data(decoder, data.data(), data.size());
+    if (err.code != heif_error_Ok) {
+      return Error(err.code, err.subcode, err.message);
+    }
+  }
+
+  return Error::Ok;
+}
+
+
 Result<std::vector<uint8_t>> Decoder::get_compressed_data() const
 {
   // --- get the compressed image data
@@ -156,19 +584,19 @@ Result<std::vector<uint8_t>> Decoder::get_compressed_data() const
 
   // append image data
 
-  Result dataResult = m_data_extent.read_data();
-  if (dataResult.error) {
-    return dataResult.error;
+  Error err = append_image_data(data);
+  if (err) {
+    return err;
   }
 
-  data.insert(data.end(), dataResult.value->begin(), dataResult.value->end());
-
   return data;
 }
 
 
 Result<std::shared_ptr<HeifPixelImage>>
-Decoder::decode_single_frame_from_compressed_data(const struct heif_decoding_options& options)
+Decoder::decode_single_frame_from_compressed_data(const struct heif_decoding_options& options,
+                                                  DecoderInstancePool* instance_pool,
+                                                  const DecoderParameters& parameters)
 {
   const struct heif_decoder_plugin* decoder_plugin = get_decoder(get_compression_format(), options.decoder_id);
   if (!decoder_plugin) {
@@ -176,16 +604,44 @@ Decoder::decode_single_frame_from_compressed_data(const struct heif_decoding_opt
   }
 
 
+  // --- get the codec configuration, it also serves as key for reusing decoder instances
+
+  Result<std::vector<uint8_t>> confData = read_bitstream_configuration_data();
+  if (confData.error) {
+    return confData.error;
+  }
+
+  const std::vector<uint8_t>& configuration = confData.value;
+
+
   // --- decode image with the plugin
 
-  void* decoder;
-  struct heif_error err = decoder_plugin->new_decoder(&decoder);
-  if (err.code != heif_error_Ok) {
-    return Error(err.code, err.subcode, err.message);
+  Result<void*> decoderResult;
+  if (instance_pool) {
+    decoderResult = instance_pool->acquire(decoder_plugin, configuration, parameters);
+  }
+  else {
+    decoderResult = new_decoder_instance(decoder_plugin, parameters);
+  }
+
+  if (decoderResult.error) {
+    return decoderResult.error;
   }
 
-  // automatically delete decoder plugin when we leave the scope
-  std::unique_ptr<void, void (*)(void*)> decoderSmartPtr(decoder, decoder_plugin->free_decoder);
+  void* decoder = decoderResult.value;
+
+  // Automatically free the decoder (or return it to the pool) when we leave the scope.
+  // After a decoding error, we do not trust the decoder state anymore and always free it.
+  bool decoder_reusable = false;
+  auto release_decoder = [&](void* d) {
+    if (instance_pool && decoder_reusable) {
+      instance_pool->release(decoder_plugin, configuration, parameters, d);
+    }
+    else {
+      decoder_plugin->free_decoder(d);
+    }
+  };
+  std::unique_ptr<void, decltype(release_decoder)> decoderSmartPtr(decoder, release_decoder);
 
   if (decoder_plugin->plugin_api_version >= 2) {
     if (decoder_plugin->set_strict_decoding) {
@@ -193,19 +649,14 @@ Decoder::decode_single_frame_from_compressed_data(const struct heif_decoding_opt
     }
   }
 
-  auto dataResult = get_compressed_data();
-  if (dataResult.error) {
-    return dataResult.error;
-  }
-
-  err = decoder_plugin->push_data(decoder, dataResult.value.data(), dataResult.value.size());
-  if (err.code != heif_error_Ok) {
-    return Error(err.code, err.subcode, err.message);
+  Error pushErr = push_compressed_data(decoder_plugin, decoder, configuration);
+  if (pushErr) {
+    return pushErr;
   }
 
   heif_image* decoded_img = nullptr;
 
-  err = decoder_plugin->decode_image(decoder, &decoded_img);
+  struct heif_error err = decoder_plugin->decode_image(decoder, &decoded_img);
   if (err.code != heif_error_Ok) {
     return Error(err.code, err.subcode, err.message);
   }
@@ -215,6 +666,8 @@ Decoder::decode_single_frame_from_compressed_data(const struct heif_decoding_opt
     return Error(heif_error_Decoder_plugin_error, heif_suberror_Unspecified);
   }
 
+  decoder_reusable = true;
+
   // -- cleanup
 
   std::shared_ptr<HeifPixelImage> img = std::move(decoded_img->image);
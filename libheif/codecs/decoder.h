@@ -26,8 +26,11 @@
 #include "error.h"
 #include "file.h"
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 #include "image-items/hevc.h"
@@ -55,6 +58,67 @@ struct DataExtent
   Result<std::vector<uint8_t>*> read_data() const;
 
   Result<std::vector<uint8_t>> read_data(uint64_t offset, uint64_t size) const;
+
+  // Returns views onto the data. If the file is held in memory, these point into the file data.
+  // Otherwise, the data is read with read_data() and the span points to the cached copy.
+  // The spans stay valid as long as this DataExtent exists.
+  Result<std::vector<DataSpan>> get_data_spans() const;
+};
+
+
+// Parameters that are set on a decoder plugin instance before data is pushed into it.
+// The values are converted to the types declared by the plugin's list_parameters().
+// Setting a parameter that the plugin does not know fails with heif_suberror_Unsupported_parameter, and a value
+// that cannot be converted or is out of range fails with heif_suberror_Invalid_parameter_value.
+// The exceptions are 'threads' and 'downscale'. libheif sets these itself, so decoders that do not support them
+// ignore them, and out-of-range values are clamped to the range of the decoder.
+using DecoderParameters = std::map<std::string, std::string>;
+
+
+// Keeps decoder plugin instances after decoding an image so that they can be reused for further
+// images with the same codec configuration instead of allocating a new decoder (and all its
+// internal frame buffers) for each image. This is mainly useful for the tiles of grid images.
+// Only decoders of plugins that implement 'reset_decoder' are kept.
+class DecoderInstancePool
+{
+public:
+  DecoderInstancePool() = default;
+
+  ~DecoderInstancePool();
+
+  DecoderInstancePool(const DecoderInstancePool&) = delete;
+
+  DecoderInstancePool& operator=(const DecoderInstancePool&) = delete;
+
+  // Returns an idle decoder for this plugin, configuration and parameters or allocates a new one.
+  Result<void*> acquire(const heif_decoder_plugin* plugin, const std::vector<uint8_t>& configuration,
+                        const DecoderParameters& parameters);
+
+  // Resets the decoder and keeps it for reuse. If the decoder cannot be reset, it is freed.
+  void release(const heif_decoder_plugin* plugin, const std::vector<uint8_t>& configuration,
+               const DecoderParameters& parameters, void* decoder);
+
+  void set_max_idle_instances(size_t n);
+
+  size_t get_number_of_idle_instances() const;
+
+  // Number of acquire() calls that could reuse an idle decoder / had to allocate a new one.
+  uint64_t get_number_of_reused_instances() const;
+
+  uint64_t get_number_of_allocated_instances() const;
+
+private:
+  using Key = std::tuple<const heif_decoder_plugin*, std::vector<uint8_t>, DecoderParameters>;
+
+  mutable std::mutex m_mutex;
+  std::map<Key, std::vector<void*>> m_idle_instances;
+  size_t m_num_idle = 0;
+  size_t m_max_idle = 16;
+
+  uint64_t m_num_reused = 0;
+  uint64_t m_num_allocated = 0;
+
+  void free_instances(const heif_decoder_plugin* plugin, std::vector<void*>& instances);
 };
 
 
@@ -86,11 +150,21 @@ public:
 
   // --- decoding
 
+  // If 'instance_pool' is not NULL, the decoder plugin instance is taken from and returned to this pool.
   virtual Result<std::shared_ptr<HeifPixelImage>>
-  decode_single_frame_from_compressed_data(const struct heif_decoding_options& options);
+  decode_single_frame_from_compressed_data(const struct heif_decoding_options& options,
+                                           DecoderInstancePool* instance_pool = nullptr,
+                                           const DecoderParameters& parameters = {});
 
 private:
   DataExtent m_data_extent;
+
+  Error append_image_data(std::vector<uint8_t>& data) const;
+
+  // Passes the configuration data and the image data to the plugin. Where the plugin can take
+  // the data in several push_data() calls, the image data is pushed in place without copying.
+  Error push_compressed_data(const heif_decoder_plugin* plugin, void* decoder,
+                             const std::vector<uint8_t>& configuration) const;
 };
 
 #endif
@@ -56,13 +56,12 @@ std::shared_ptr<HeifPixelImage>
 Op_drop_alpha_plane::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                         const ColorState& input_state,
                                         const ColorState& target_state,
-                                        const heif_color_conversion_options& options) const
+                                        const heif_color_conversion_options& options,
+                                        const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   outimg->create(width, height,
                  input->get_colorspace(),
                  input->get_chroma_format());
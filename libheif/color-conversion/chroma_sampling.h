@@ -41,7 +41,8 @@ public:
   convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                      const ColorState& input_state,
                      const ColorState& target_state,
-                     const heif_color_conversion_options& options) const override;
+                     const heif_color_conversion_options& options,
+                     const std::shared_ptr<HeifPixelImage>& outimg) const override;
 };
 
 
@@ -58,7 +59,8 @@ public:
   convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                      const ColorState& input_state,
                      const ColorState& target_state,
-                     const heif_color_conversion_options& options) const override;
+                     const heif_color_conversion_options& options,
+                     const std::shared_ptr<HeifPixelImage>& outimg) const override;
 };
 
 
@@ -77,7 +79,11 @@ public:
   convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                      const ColorState& input_state,
                      const ColorState& target_state,
-                     const heif_color_conversion_options& options) const override;
+                     const heif_color_conversion_options& options,
+                     const std::shared_ptr<HeifPixelImage>& outimg) const override;
+
+  // one chroma row above and below
+  int get_strip_context_rows() const override { return 2; }
 };
 
 template <class Pixel>
@@ -93,7 +99,8 @@ public:
   convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                      const ColorState& input_state,
                      const ColorState& target_state,
-                     const heif_color_conversion_options& options) const override;
+                     const heif_color_conversion_options& options,
+                     const std::shared_ptr<HeifPixelImage>& outimg) const override;
 };
 
 #endif //LIBHEIF_CHROMA_SAMPLING_H
@@ -31,6 +31,9 @@
 #include <cmath>
 #include <limits>
 #include <string>
+#include <atomic>
+#include "image_allocator.h"
+#include "thread_pool.h"
 #include "rgb2yuv.h"
 #include "rgb2yuv_sharp.h"
 #include "yuv2rgb.h"
@@ -255,6 +258,70 @@ void ColorConversionPipeline::init_ops()
 void ColorConversionPipeline::release_ops()
 {
   m_operation_pool.clear();
+
+  // the cached pipelines reference the operations
+  clear_cache();
+}
+
+
+std::vector<ColorConversionPipeline::CacheEntry> ColorConversionPipeline::m_cache;
+uint64_t ColorConversionPipeline::m_cache_hits = 0;
+uint64_t ColorConversionPipeline::m_cache_misses = 0;
+
+static const size_t max_cached_pipelines = 32;
+
+#if ENABLE_MULTITHREADING_SUPPORT
+static std::mutex pipeline_cache_mutex;
+#endif
+
+
+// ColorState::operator==() ignores the nclx profile for non-YCbCr states, but the steps also
+// determine the nclx profile of the output image. Hence, cached pipelines must match exactly.
+static bool is_identical_color_state(const ColorState& a, const ColorState& b)
+{
+  return (a.colorspace == b.colorspace &&
+          a.chroma == b.chroma &&
+          a.has_alpha == b.has_alpha &&
+          a.bits_per_pixel == b.bits_per_pixel &&
+          a.nclx_profile.get_colour_primaries() == b.nclx_profile.get_colour_primaries() &&
+          a.nclx_profile.get_transfer_characteristics() == b.nclx_profile.get_transfer_characteristics() &&
+          a.nclx_profile.get_matrix_coefficients() == b.nclx_profile.get_matrix_coefficients() &&
+          a.nclx_profile.get_full_range_flag() == b.nclx_profile.get_full_range_flag());
+}
+
+
+static bool is_identical_options(const heif_color_conversion_options& a, const heif_color_conversion_options& b)
+{
+  return (a.preferred_chroma_downsampling_algorithm == b.preferred_chroma_downsampling_algorithm &&
+          a.preferred_chroma_upsampling_algorithm == b.preferred_chroma_upsampling_algorithm &&
+          a.only_use_preferred_chroma_algorithm == b.only_use_preferred_chroma_algorithm);
+}
+
+
+heif_color_conversion_cache_statistics ColorConversionPipeline::get_cache_statistics()
+{
+#if ENABLE_MULTITHREADING_SUPPORT
+  std::lock_guard<std::mutex> lock(pipeline_cache_mutex);
+#endif
+
+  heif_color_conversion_cache_statistics stats{};
+  stats.hits = m_cache_hits;
+  stats.misses = m_cache_misses;
+  stats.num_cached_pipelines = m_cache.size();
+
+  return stats;
+}
+
+
+void ColorConversionPipeline::clear_cache()
+{
+#if ENABLE_MULTITHREADING_SUPPORT
+  std::lock_guard<std::mutex> lock(pipeline_cache_mutex);
+#endif
+
+  m_cache.clear();
+  m_cache_hits = 0;
+  m_cache_misses = 0;
 }
 
 
@@ -277,6 +344,49 @@ bool ColorConversionPipeline::construct_pipeline(const ColorState& input_state,
 
   init_ops(); // to be sure these are initialized even without heif_init()
 
+  // --- look up the pipeline in the cache
+
+  {
+#if ENABLE_MULTITHREADING_SUPPORT
+    std::lock_guard<std::mutex> lock(pipeline_cache_mutex);
+#endif
+
+    for (const auto& entry : m_cache) {
+      if (is_identical_color_state(entry.input_state, input_state) &&
+          is_identical_color_state(entry.target_state, target_state) &&
+          is_identical_options(entry.options, options)) {
+        m_cache_hits++;
+        m_conversion_steps = entry.conversion_steps;
+        return entry.found;
+      }
+    }
+
+    m_cache_misses++;
+  }
+
+  bool found = search_pipeline(input_state, target_state, options);
+
+  {
+#if ENABLE_MULTITHREADING_SUPPORT
+    std::lock_guard<std::mutex> lock(pipeline_cache_mutex);
+#endif
+
+    if (m_cache.size() >= max_cached_pipelines) {
+      m_cache.erase(m_cache.begin());
+    }
+
+    m_cache.push_back({input_state, target_state, options, found, m_conversion_steps});
+  }
+
+  return found;
+}
+
+
+bool ColorConversionPipeline::search_pipeline(const ColorState& input_state,
+                                              const ColorState& target_state,
+                                              const heif_color_conversion_options& options)
+{
+
   std::vector<std::shared_ptr<ColorConversionOperation>>& ops = m_operation_pool;
 
   // --- Dijkstra search for the minimum-cost conversion pipeline
@@ -427,64 +537,355 @@ std::string ColorConversionPipeline::debug_dump_pipeline() const
 }
 
 
-std::shared_ptr<HeifPixelImage> ColorConversionPipeline::convert_image(const std::shared_ptr<HeifPixelImage>& input)
+static void pass_image_properties(const std::shared_ptr<const HeifPixelImage>& in,
+                                  const std::shared_ptr<HeifPixelImage>& out,
+                                  const ColorState& output_state)
+{
+  // --- pass the color profiles to the new image
+
+  auto output_nclx = std::make_shared<color_profile_nclx>(output_state.nclx_profile);
+  out->set_color_profile_nclx(output_nclx);
+  out->set_color_profile_icc(in->get_color_profile_icc());
+
+  out->set_premultiplied_alpha(in->is_premultiplied_alpha());
+
+  // pass through HDR information
+  if (in->has_clli()) {
+    out->set_clli(in->get_clli());
+  }
+
+  if (in->has_mdcv()) {
+    out->set_mdcv(in->get_mdcv());
+  }
+
+  if (in->has_nonsquare_pixel_ratio()) {
+    uint32_t h, v;
+    in->get_pixel_ratio(&h, &v);
+    out->set_pixel_ratio(h, v);
+  }
+
+  const auto& warnings = in->get_warnings();
+  for (const auto& warning : warnings) {
+    out->add_warning(warning);
+  }
+}
+
+
+static std::atomic<uint32_t> strip_height_setting{0};
+
+void ColorConversionPipeline::set_strip_height(uint32_t rows)
+{
+  strip_height_setting = rows;
+}
+
+
+static uint32_t get_strip_height(uint32_t image_width)
+{
+  uint32_t rows = strip_height_setting;
+  if (rows != 0) {
+    return (rows + 1) & ~1U;
+  }
+
+  // Keep an intermediate RRGGBBAA strip at about 1 MiB.
+  const uint32_t strip_bytes = 1024 * 1024;
+  const uint32_t min_rows = 16;
+
+  rows = strip_bytes / (std::max(image_width, 1U) * 8);
+  return std::max(rows, min_rows) & ~1U;
+}
+
+
+bool ColorConversionPipeline::is_worth_threading(uint32_t width, uint32_t height)
+{
+  // Below this size, starting the threads takes longer than the conversion itself.
+  const uint64_t min_pixels = 512 * 512;
+
+  return uint64_t{width} * height >= min_pixels && height > get_strip_height(width);
+}
+
+
+int ColorConversionPipeline::get_strip_context_rows() const
+{
+  int context_rows = 0;
+
+  for (const auto& step : m_conversion_steps) {
+    int rows = step.operation->get_strip_context_rows();
+    if (rows < 0) {
+      return -1;
+    }
+
+    // keep the strips aligned to the chroma subsampling
+    context_rows += (rows + 1) & ~1;
+  }
+
+  return context_rows;
+}
+
+
+std::shared_ptr<HeifPixelImage> ColorConversionPipeline::convert_image(const std::shared_ptr<HeifPixelImage>& input,
+                                                                       const std::map<heif_channel, PlaneBuffer>* output_buffers,
+                                                                       ThreadPool* thread_pool)
 {
+  // With several steps, run the whole pipeline on one strip after the other instead of
+  // creating full-size intermediate images. With several threads, also split single-step conversions
+  // into strips that are converted in parallel. Skip this if the strips would mostly consist of context rows.
+
+  int num_threads = (thread_pool ? thread_pool->get_num_threads() : 0);
+
+  if (m_conversion_steps.size() > 1 ||
+      (m_conversion_steps.size() == 1 && num_threads > 1)) {
+    uint32_t strip_height = get_strip_height(input->get_width());
+
+    // A single step does not profit from small strips. Only split the image for the threads.
+    if (m_conversion_steps.size() == 1 && strip_height_setting == 0) {
+      uint32_t rows_per_task = input->get_height() / (num_threads * 4);
+      strip_height = std::max(strip_height, (rows_per_task + 1) & ~1U);
+    }
+
+    int context_rows = get_strip_context_rows();
+
+    if (context_rows >= 0 &&
+        static_cast<uint32_t>(context_rows) * 2 < strip_height &&
+        input->get_height() > strip_height) {
+      return convert_image_in_strips(input, strip_height, output_buffers, thread_pool);
+    }
+  }
+
   std::shared_ptr<HeifPixelImage> in = input;
   std::shared_ptr<HeifPixelImage> out = in;
 
-  for (const auto& step : m_conversion_steps) {
+  for (size_t i = 0; i < m_conversion_steps.size(); i++) {
+    const auto& step = m_conversion_steps[i];
 
 #if DEBUG_ME
     std::cerr << "input spec: ";
     print_spec(std::cerr, in);
 #endif
 
-    out = step.operation->convert_colorspace(in, step.input_state, step.output_state, m_options);
+    auto outimg = std::make_shared<HeifPixelImage>();
+    outimg->set_allocator(in->get_allocator());
+    if (output_buffers && i == m_conversion_steps.size() - 1) {
+      outimg->set_plane_buffers(*output_buffers);
+    }
+
+    out = step.operation->convert_colorspace(in, step.input_state, step.output_state, m_options, outimg);
     if (!out) {
       return nullptr; // TODO: we should return a proper error
     }
 
-    // --- pass the color profiles to the new image
+    pass_image_properties(in, out, step.output_state);
 
-    auto output_nclx = std::make_shared<color_profile_nclx>(step.output_state.nclx_profile);
-    out->set_color_profile_nclx(output_nclx);
-    out->set_color_profile_icc(in->get_color_profile_icc());
+    in = out;
+  }
+
+  return out;
+}
 
-    out->set_premultiplied_alpha(in->is_premultiplied_alpha());
 
-    // pass through HDR information
-    if (in->has_clli()) {
-      out->set_clli(in->get_clli());
+// Creates an image of the given size with the same planes as 'strip'.
+static std::shared_ptr<HeifPixelImage> create_image_with_planes_of(const std::shared_ptr<const HeifPixelImage>& strip,
+                                                                   uint32_t width, uint32_t height,
+                                                                   const std::shared_ptr<ImageAllocator>& allocator,
+                                                                   const std::map<heif_channel, PlaneBuffer>* output_buffers)
+{
+  auto img = std::make_shared<HeifPixelImage>();
+  img->create(width, height, strip->get_colorspace(), strip->get_chroma_format());
+  img->set_allocator(allocator);
+  if (output_buffers) {
+    img->set_plane_buffers(*output_buffers);
+  }
+
+  for (heif_channel channel : strip->get_channel_set()) {
+    uint32_t w, h;
+    get_subsampled_size(width, height, channel, strip->get_chroma_format(), &w, &h);
+
+    bool success;
+    if (strip->get_datatype(channel) == heif_channel_datatype_unsigned_integer) {
+      success = img->add_plane(channel, w, h, strip->get_bits_per_pixel(channel));
+    }
+    else {
+      success = img->add_channel(channel, w, h, strip->get_datatype(channel), strip->get_bits_per_pixel(channel));
     }
 
-    if (in->has_mdcv()) {
-      out->set_mdcv(in->get_mdcv());
+    if (!success) {
+      return nullptr;
     }
+  }
+
+  return img;
+}
+
 
-    if (in->has_nonsquare_pixel_ratio()) {
-      uint32_t h, v;
-      in->get_pixel_ratio(&h, &v);
-      out->set_pixel_ratio(h, v);
+static void copy_planes(const std::shared_ptr<const HeifPixelImage>& src, const std::shared_ptr<HeifPixelImage>& dst)
+{
+  for (heif_channel channel : src->get_channel_set()) {
+    uint32_t src_stride, dst_stride;
+    const uint8_t* src_p = src->get_plane(channel, &src_stride);
+    uint8_t* dst_p = dst->get_plane(channel, &dst_stride);
+
+    if (src_p == dst_p) {
+      continue;
     }
 
-    const auto& warnings = in->get_warnings();
-    for (const auto& warning : warnings) {
-      out->add_warning(warning);
+    uint32_t bytes_per_row = src->get_width(channel) * (src->get_storage_bits_per_pixel(channel) / 8);
+
+    for (uint32_t y = 0; y < src->get_height(channel); y++) {
+      memcpy(dst_p + y * dst_stride, src_p + y * src_stride, bytes_per_row);
     }
+  }
+}
 
-    in = out;
+
+std::shared_ptr<HeifPixelImage>
+ColorConversionPipeline::convert_image_in_strips(const std::shared_ptr<HeifPixelImage>& input,
+                                                 uint32_t strip_height,
+                                                 const std::map<heif_channel, PlaneBuffer>* output_buffers,
+                                                 ThreadPool* thread_pool)
+{
+  const uint32_t height = input->get_height();
+  const size_t num_steps = m_conversion_steps.size();
+
+  // Each step converts the rows of the strip plus the context rows that the following steps still need.
+  // context_after[i] is the number of context rows above and below the strip at the input of step i.
+
+  std::vector<uint32_t> context_after(num_steps + 1, 0);
+  for (size_t i = num_steps; i > 0; i--) {
+    int rows = m_conversion_steps[i - 1].operation->get_strip_context_rows();
+    context_after[i - 1] = context_after[i] + ((rows + 1) & ~1U);
+  }
+
+  // The intermediate images of one strip are released before the next strip is converted,
+  // so that the next strip gets the same memory again.
+
+  auto strip_allocator = std::make_shared<PooledImageAllocator>(input->get_allocator(),
+                                                                std::numeric_limits<size_t>::max());
+
+  // The first strip creates the output image. The other strips are independent of each other
+  // and write into the output image concurrently.
+
+  std::shared_ptr<HeifPixelImage> out;
+  if (!convert_strip(input, 0, std::min(strip_height, height), context_after, strip_allocator, output_buffers, out)) {
+    return nullptr;
+  }
+
+  TaskGroup strip_tasks(thread_pool);
+
+  for (uint32_t y0 = strip_height; y0 < height; y0 += strip_height) {
+    uint32_t y1 = std::min(y0 + strip_height, height);
+
+    strip_tasks.run([this, &input, y0, y1, &context_after, &strip_allocator, &out]() -> Error {
+      std::shared_ptr<HeifPixelImage> strip_out = out;
+      if (!convert_strip(input, y0, y1, context_after, strip_allocator, nullptr, strip_out)) {
+        return {heif_error_Unsupported_feature, heif_suberror_Unsupported_color_conversion};
+      }
+
+      return Error::Ok;
+    });
+  }
+
+  if (strip_tasks.wait()) {
+    return nullptr;
   }
 
   return out;
 }
 
 
+bool ColorConversionPipeline::convert_strip(const std::shared_ptr<HeifPixelImage>& input,
+                                            uint32_t y0, uint32_t y1,
+                                            const std::vector<uint32_t>& context_after,
+                                            const std::shared_ptr<ImageAllocator>& strip_allocator,
+                                            const std::map<heif_channel, PlaneBuffer>* output_buffers,
+                                            std::shared_ptr<HeifPixelImage>& inout_output) const
+{
+  const uint32_t width = input->get_width();
+  const uint32_t height = input->get_height();
+  const size_t num_steps = m_conversion_steps.size();
+
+  std::shared_ptr<HeifPixelImage>& out = inout_output;
+
+  // rows [in_y0, in_y1) of the image are in the current intermediate image
+  uint32_t in_y0 = y0 - std::min(y0, context_after[0]);
+  uint32_t in_y1 = std::min(y1 + context_after[0], height);
+
+  std::shared_ptr<HeifPixelImage> in = input->create_row_strip_view(in_y0, in_y1 - in_y0);
+
+  // keeps the memory alive that the strip views refer to
+  std::vector<std::shared_ptr<HeifPixelImage>> strip_images;
+
+  for (size_t i = 0; i < num_steps; i++) {
+    const auto& step = m_conversion_steps[i];
+    bool last_step = (i == num_steps - 1);
+
+    auto outimg = std::make_shared<HeifPixelImage>();
+    outimg->set_allocator(strip_allocator);
+
+    // Write the last step directly into the output image. The first strip creates the output image.
+    std::shared_ptr<HeifPixelImage> output_strip;
+    if (last_step && out) {
+      output_strip = out->create_row_strip_view(y0, y1 - y0);
+
+      std::map<heif_channel, PlaneBuffer> strip_buffers;
+      for (heif_channel channel : output_strip->get_channel_set()) {
+        uint32_t stride;
+        uint8_t* mem = output_strip->get_plane(channel, &stride);
+
+        PlaneBuffer& buffer = strip_buffers[channel];
+        buffer.data = mem;
+        buffer.stride = stride;
+        buffer.size = static_cast<size_t>(stride) * output_strip->get_height(channel);
+      }
+
+      outimg->set_plane_buffers(strip_buffers);
+    }
+
+    auto result = step.operation->convert_colorspace(in, step.input_state, step.output_state, m_options, outimg);
+    if (!result) {
+      return false;
+    }
+
+    pass_image_properties(in, result, step.output_state);
+
+    // Drop the context rows that the following steps do not need.
+
+    uint32_t next_y0 = y0 - std::min(y0, context_after[i + 1]);
+    uint32_t next_y1 = std::min(y1 + context_after[i + 1], height);
+    if (next_y0 != in_y0 || next_y1 != in_y1) {
+      strip_images.push_back(result);
+      result = result->create_row_strip_view(next_y0 - in_y0, next_y1 - next_y0);
+    }
+
+    in = std::move(result);
+    in_y0 = next_y0;
+    in_y1 = next_y1;
+
+    if (last_step && !out) {
+      out = create_image_with_planes_of(in, width, height, input->get_allocator(), output_buffers);
+      if (!out) {
+        return false;
+      }
+
+      pass_image_properties(in, out, step.output_state);
+      copy_planes(in, out->create_row_strip_view(0, y1));
+    }
+    else if (last_step) {
+      // does nothing for the planes that were written into the output image directly
+      copy_planes(in, output_strip);
+    }
+  }
+
+  return true;
+}
+
+
 std::shared_ptr<HeifPixelImage> convert_colorspace(const std::shared_ptr<HeifPixelImage>& input,
                                                    heif_colorspace target_colorspace,
                                                    heif_chroma target_chroma,
                                                    const std::shared_ptr<const color_profile_nclx>& target_profile,
                                                    int output_bpp,
-                                                   const heif_color_conversion_options& options)
+                                                   const heif_color_conversion_options& options,
+                                                   const std::map<heif_channel, PlaneBuffer>* output_buffers,
+                                                   ThreadPool* thread_pool)
 {
   // --- check that input image is valid
 
@@ -591,7 +992,7 @@ std::shared_ptr<HeifPixelImage> convert_colorspace(const std::shared_ptr<HeifPix
     return input;
   }
   else {
-    return pipeline.convert_image(input);
+    return pipeline.convert_image(input, output_buffers, thread_pool);
   }
 }
 
@@ -27,6 +27,8 @@
 #include <utility>
 #include <vector>
 
+class ThreadPool;
+
 
 struct ColorState
 {
@@ -85,11 +87,20 @@ public:
                          const ColorState& target_state,
                          const heif_color_conversion_options& options) const = 0;
 
+  // Writes the converted image into 'outimg', which is an empty image provided by the caller.
+  // The caller may have set up 'outimg' to place its planes into specific memory.
+  // Returns 'outimg' or nullptr if the conversion failed.
   virtual std::shared_ptr<HeifPixelImage>
   convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                      const ColorState& input_state,
                      const ColorState& target_state,
-                     const heif_color_conversion_options& options) const = 0;
+                     const heif_color_conversion_options& options,
+                     const std::shared_ptr<HeifPixelImage>& outimg) const = 0;
+
+  // Number of rows above and below a horizontal strip of the input that the operation reads
+  // for converting the rows of the strip. Strips always start at even rows.
+  // Returns -1 if the operation can only convert the whole image at once.
+  virtual int get_strip_context_rows() const { return 0; }
 };
 
 
@@ -105,13 +116,45 @@ public:
                           const ColorState& target_state,
                           const heif_color_conversion_options& options);
 
-  std::shared_ptr<HeifPixelImage> convert_image(const std::shared_ptr<HeifPixelImage>& input);
+  // If 'output_buffers' is given, the last conversion step writes its output planes into these buffers.
+  // If 'thread_pool' is given, the strips of the image are converted in parallel.
+  std::shared_ptr<HeifPixelImage> convert_image(const std::shared_ptr<HeifPixelImage>& input,
+                                                const std::map<heif_channel, PlaneBuffer>* output_buffers = nullptr,
+                                                ThreadPool* thread_pool = nullptr);
 
   std::string debug_dump_pipeline() const;
 
+  // Pipelines with several steps are run on horizontal strips of the image, so that the intermediate
+  // images stay small enough for the CPU caches. 0 (the default) chooses the strip height from the image width.
+  // A height that is larger than the image disables the strip processing.
+  static void set_strip_height(uint32_t rows);
+
+  // Whether converting an image of this size on several threads can be faster than converting it in the calling thread.
+  static bool is_worth_threading(uint32_t width, uint32_t height);
+
+  static heif_color_conversion_cache_statistics get_cache_statistics();
+
+  static void clear_cache();
+
 private:
   static std::vector<std::shared_ptr<ColorConversionOperation>> m_operation_pool;
 
+  // Sum of the context rows of all steps, or -1 if the pipeline cannot run on strips.
+  int get_strip_context_rows() const;
+
+  std::shared_ptr<HeifPixelImage> convert_image_in_strips(const std::shared_ptr<HeifPixelImage>& input,
+                                                          uint32_t strip_height,
+                                                          const std::map<heif_channel, PlaneBuffer>* output_buffers,
+                                                          ThreadPool* thread_pool);
+
+  // Converts the image rows [y0, y1) into 'inout_output'. Creates the output image if 'inout_output' is null.
+  bool convert_strip(const std::shared_ptr<HeifPixelImage>& input,
+                     uint32_t y0, uint32_t y1,
+                     const std::vector<uint32_t>& context_after,
+                     const std::shared_ptr<ImageAllocator>& strip_allocator,
+                     const std::map<heif_channel, PlaneBuffer>* output_buffers,
+                     std::shared_ptr<HeifPixelImage>& inout_output) const;
+
   struct ConversionStep {
     std::shared_ptr<ColorConversionOperation> operation;
     ColorState input_state;
@@ -121,17 +164,40 @@ private:
   std::vector<ConversionStep> m_conversion_steps;
 
   heif_color_conversion_options m_options;
+
+  // Returns false if there is no conversion.
+  bool search_pipeline(const ColorState& input_state,
+                       const ColorState& target_state,
+                       const heif_color_conversion_options& options);
+
+  struct CacheEntry
+  {
+    ColorState input_state;
+    ColorState target_state;
+    heif_color_conversion_options options;
+
+    bool found;
+    std::vector<ConversionStep> conversion_steps;
+  };
+
+  static std::vector<CacheEntry> m_cache;
+  static uint64_t m_cache_hits;
+  static uint64_t m_cache_misses;
 };
 
 
 // If no conversion is required, the input is simply passed through without copy.
 // The input image is never modified by this function, but the input is still non-const because we may pass it through.
+// When 'output_buffers' are given, the output planes are written into them where they fit.
+// When a 'thread_pool' is given, the conversion runs on its threads.
 std::shared_ptr<HeifPixelImage> convert_colorspace(const std::shared_ptr<HeifPixelImage>& input,
                                                    heif_colorspace colorspace,
                                                    heif_chroma chroma,
                                                    const std::shared_ptr<const color_profile_nclx>& target_profile,
                                                    int output_bpp,
-                                                   const heif_color_conversion_options& options);
+                                                   const heif_color_conversion_options& options,
+                                                   const std::map<heif_channel, PlaneBuffer>* output_buffers = nullptr,
+                                                   ThreadPool* thread_pool = nullptr);
 
 std::shared_ptr<const HeifPixelImage> convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                                          heif_colorspace colorspace,
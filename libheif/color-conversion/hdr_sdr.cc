@@ -54,10 +54,9 @@ std::shared_ptr<HeifPixelImage>
 Op_to_hdr_planes::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                      const ColorState& input_state,
                                      const ColorState& target_state,
-                                     const heif_color_conversion_options& options) const
+                                     const heif_color_conversion_options& options,
+                                     const std::shared_ptr<HeifPixelImage>& outimg) const
 {
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   outimg->create(input->get_width(),
                  input->get_height(),
                  input->get_colorspace(),
@@ -141,11 +140,10 @@ std::shared_ptr<HeifPixelImage>
 Op_to_sdr_planes::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                      const ColorState& input_state,
                                      const ColorState& target_state,
-                                     const heif_color_conversion_options& options) const
+                                     const heif_color_conversion_options& options,
+                                     const std::shared_ptr<HeifPixelImage>& outimg) const
 {
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   outimg->create(input->get_width(),
                  input->get_height(),
                  input->get_colorspace(),
@@ -53,10 +53,9 @@ std::shared_ptr<HeifPixelImage>
 Op_mono_to_YCbCr420::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                         const ColorState& input_state,
                                         const ColorState& target_state,
-                                        const heif_color_conversion_options& options) const
+                                        const heif_color_conversion_options& options,
+                                        const std::shared_ptr<HeifPixelImage>& outimg) const
 {
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
@@ -204,7 +203,8 @@ std::shared_ptr<HeifPixelImage>
 Op_mono_to_RGB24_32::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                         const ColorState& input_state,
                                         const ColorState& target_state,
-                                        const heif_color_conversion_options& options) const
+                                        const heif_color_conversion_options& options,
+                                        const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
@@ -213,8 +213,6 @@ Op_mono_to_RGB24_32::convert_colorspace(const std::shared_ptr<const HeifPixelIma
     return nullptr;
   }
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   bool has_alpha = input->has_channel(heif_channel_Alpha);
 
   if (target_state.has_alpha) {
@@ -38,7 +38,8 @@ public:
   convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                      const ColorState& input_state,
                      const ColorState& target_state,
-                     const heif_color_conversion_options& options) const override;
+                     const heif_color_conversion_options& options,
+                     const std::shared_ptr<HeifPixelImage>& outimg) const override;
 };
 
 
@@ -54,7 +55,8 @@ public:
   convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                      const ColorState& input_state,
                      const ColorState& target_state,
-                     const heif_color_conversion_options& options) const override;
+                     const heif_color_conversion_options& options,
+                     const std::shared_ptr<HeifPixelImage>& outimg) const override;
 };
 
 #endif //LIBHEIF_COLORCONVERSION_MONOCHROME_H
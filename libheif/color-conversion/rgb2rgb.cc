@@ -67,7 +67,8 @@ std::shared_ptr<HeifPixelImage>
 Op_RGB_to_RGB24_32::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                        const ColorState& input_state,
                                        const ColorState& target_state,
-                                       const heif_color_conversion_options& options) const
+                                       const heif_color_conversion_options& options,
+                                       const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   bool has_alpha = input->has_channel(heif_channel_Alpha);
   bool want_alpha = target_state.has_alpha;
@@ -82,8 +83,6 @@ Op_RGB_to_RGB24_32::convert_colorspace(const std::shared_ptr<const HeifPixelImag
     return nullptr;
   }
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
@@ -190,7 +189,8 @@ std::shared_ptr<HeifPixelImage>
 Op_RGB_HDR_to_RRGGBBaa_BE::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                               const ColorState& input_state,
                                               const ColorState& target_state,
-                                              const heif_color_conversion_options& options) const
+                                              const heif_color_conversion_options& options,
+                                              const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   if (input->get_bits_per_pixel(heif_channel_R) <= 8 ||
       input->get_bits_per_pixel(heif_channel_G) <= 8 ||
@@ -214,8 +214,6 @@ Op_RGB_HDR_to_RRGGBBaa_BE::convert_colorspace(const std::shared_ptr<const HeifPi
   int bpp = input->get_bits_per_pixel(heif_channel_R);
   if (bpp <= 0) return nullptr;
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
@@ -324,7 +322,8 @@ std::shared_ptr<HeifPixelImage>
 Op_RGB_to_RRGGBBaa_BE::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                           const ColorState& input_state,
                                           const ColorState& target_state,
-                                          const heif_color_conversion_options& options) const
+                                          const heif_color_conversion_options& options,
+                                          const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   if (input->get_bits_per_pixel(heif_channel_R) != 8 ||
       input->get_bits_per_pixel(heif_channel_G) != 8 ||
@@ -341,8 +340,6 @@ Op_RGB_to_RRGGBBaa_BE::convert_colorspace(const std::shared_ptr<const HeifPixelI
     return nullptr;
   }
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
@@ -441,14 +438,13 @@ std::shared_ptr<HeifPixelImage>
 Op_RRGGBBaa_BE_to_RGB_HDR::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                               const ColorState& input_state,
                                               const ColorState& target_state,
-                                              const heif_color_conversion_options& options) const
+                                              const heif_color_conversion_options& options,
+                                              const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   bool has_alpha = (input->get_chroma_format() == heif_chroma_interleaved_RRGGBBAA_LE ||
                     input->get_chroma_format() == heif_chroma_interleaved_RRGGBBAA_BE);
   bool want_alpha = target_state.has_alpha;
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
   int bpp = input->get_bits_per_pixel(heif_channel_interleaved);
@@ -554,13 +550,12 @@ std::shared_ptr<HeifPixelImage>
 Op_RGB24_32_to_RGB::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                        const ColorState& input_state,
                                               const ColorState& target_state,
-                                              const heif_color_conversion_options& options) const
+                                              const heif_color_conversion_options& options,
+                                              const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   bool has_alpha = input->get_chroma_format() == heif_chroma_interleaved_RGBA;
   bool want_alpha = target_state.has_alpha;
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
@@ -680,10 +675,9 @@ std::shared_ptr<HeifPixelImage>
 Op_RRGGBBaa_swap_endianness::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                                 const ColorState& input_state,
                                                 const ColorState& target_state,
-                                                const heif_color_conversion_options& options) const
+                                                const heif_color_conversion_options& options,
+                                                const std::shared_ptr<HeifPixelImage>& outimg) const
 {
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
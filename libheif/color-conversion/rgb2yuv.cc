@@ -23,6 +23,7 @@
 #include <memory>
 #include <vector>
 #include "rgb2yuv.h"
+#include "rgb2yuv_simd.h"
 #include "nclx.h"
 #include "common_utils.h"
 
@@ -95,7 +96,8 @@ std::shared_ptr<HeifPixelImage>
 Op_RGB_to_YCbCr<Pixel>::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                            const ColorState& input_state,
                                            const ColorState& target_state,
-                                           const heif_color_conversion_options& options) const
+                                           const heif_color_conversion_options& options,
+                                           const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   bool hdr = !std::is_same<Pixel, uint8_t>::value;
 
@@ -117,8 +119,6 @@ Op_RGB_to_YCbCr<Pixel>::convert_colorspace(const std::shared_ptr<const HeifPixel
     return nullptr;
   }
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   outimg->create(width, height, heif_colorspace_YCbCr, chroma);
 
   uint32_t cwidth = (width + subH - 1) / subH;
@@ -181,10 +181,29 @@ Op_RGB_to_YCbCr<Pixel>::convert_colorspace(const std::shared_ptr<const HeifPixel
   coeffs = get_RGB_to_YCbCr_coefficients(target_state.nclx_profile.get_matrix_coefficients(),
                                          target_state.nclx_profile.get_colour_primaries());
 
+  // there are no SIMD kernels for the GBR pass-through
+  RGB_to_Y_row_kernel<Pixel> luma_kernel = nullptr;
+  RGB_to_CbCr420_row_kernel<Pixel> chroma_kernel = nullptr;
+  if (matrix_coeffs != 0) {
+    luma_kernel = get_RGB_to_Y_row_kernel<Pixel>();
+
+    if (subH == 2 && subV == 2) {
+      chroma_kernel = get_RGB_to_CbCr420_row_kernel<Pixel>();
+    }
+  }
+
+  const RGB_to_YCbCr_kernel_parameters kernel_params{coeffs, full_range_flag, bpp};
+
   uint32_t x, y;
 
   for (y = 0; y < height; y++) {
-    for (x = 0; x < width; x++) {
+    x = 0;
+    if (luma_kernel) {
+      x = luma_kernel(in_r + y * in_r_stride, in_g + y * in_g_stride, in_b + y * in_b_stride,
+                      out_y + y * out_y_stride, width, kernel_params);
+    }
+
+    for (; x < width; x++) {
       if (matrix_coeffs == 0) {
         if (full_range_flag) {
           out_y[y * out_y_stride + x] = in_g[y * in_g_stride + x];
@@ -212,7 +231,18 @@ Op_RGB_to_YCbCr<Pixel>::convert_colorspace(const std::shared_ptr<const HeifPixel
   }
 
   for (y = 0; y < height; y += subV) {
-    for (x = 0; x < width; x += subH) {
+    x = 0;
+    if (chroma_kernel) {
+      uint32_t y2 = (y + 1 < height) ? y + 1 : y;
+      const Pixel* const in0[3] = {in_r + y * in_r_stride, in_g + y * in_g_stride, in_b + y * in_b_stride};
+      const Pixel* const in1[3] = {in_r + y2 * in_r_stride, in_g + y2 * in_g_stride, in_b + y2 * in_b_stride};
+
+      x = chroma_kernel(in0, in1,
+                        out_cb + (y / 2) * out_cb_stride, out_cr + (y / 2) * out_cr_stride,
+                        width, kernel_params);
+    }
+
+    for (; x < width; x += subH) {
       if (matrix_coeffs == 0) {
         if (full_range_flag) {
           out_cb[(y / subV) * out_cb_stride + (x / subH)] = in_b[y * in_b_stride + x];
@@ -340,7 +370,8 @@ std::shared_ptr<HeifPixelImage>
 Op_RRGGBBxx_HDR_to_YCbCr420::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                                 const ColorState& input_state,
                                                 const ColorState& target_state,
-                                                const heif_color_conversion_options& options) const
+                                                const heif_color_conversion_options& options,
+                                                const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
@@ -350,8 +381,6 @@ Op_RRGGBBxx_HDR_to_YCbCr420::convert_colorspace(const std::shared_ptr<const Heif
   bool has_alpha = (input->get_chroma_format() == heif_chroma_interleaved_RRGGBBAA_BE ||
                     input->get_chroma_format() == heif_chroma_interleaved_RRGGBBAA_LE);
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   outimg->create(width, height, heif_colorspace_YCbCr, heif_chroma_420);
 
   int bytesPerPixel = has_alpha ? 8 : 6;
@@ -406,8 +435,19 @@ Op_RRGGBBxx_HDR_to_YCbCr420::convert_colorspace(const std::shared_ptr<const Heif
       target_state.nclx_profile.get_matrix_coefficients(),
       target_state.nclx_profile.get_colour_primaries());
 
+  RRGGBBaa_to_Y_row_kernel luma_kernel = get_RRGGBBaa_to_Y_row_kernel();
+  RRGGBBaa_to_CbCr420_row_kernel chroma_kernel = get_RRGGBBaa_to_CbCr420_row_kernel();
+  const RGB_to_YCbCr_kernel_parameters kernel_params{coeffs, full_range_flag, bpp};
+
   for (uint32_t y = 0; y < height; y++) {
-    for (uint32_t x = 0; x < width; x++) {
+    uint32_t x = 0;
+    if (luma_kernel) {
+      x = luma_kernel(in_p + y * in_p_stride, has_alpha, le == 1,
+                      out_y + y * out_y_stride, out_a ? out_a + y * out_a_stride : nullptr,
+                      width, kernel_params);
+    }
+
+    for (; x < width; x++) {
 
       const uint8_t* in = &in_p[y * in_p_stride + bytesPerPixel * x];
 
@@ -431,7 +471,15 @@ Op_RRGGBBxx_HDR_to_YCbCr420::convert_colorspace(const std::shared_ptr<const Heif
   }
 
   for (uint32_t y = 0; y < height; y += 2) {
-    for (uint32_t x = 0; x < width; x += 2) {
+    uint32_t x = 0;
+    if (chroma_kernel) {
+      uint32_t y2 = (y + 1 < height) ? y + 1 : y;
+      x = chroma_kernel(in_p + y * in_p_stride, in_p + y2 * in_p_stride, has_alpha, le == 1,
+                        out_cb + (y / 2) * out_cb_stride, out_cr + (y / 2) * out_cr_stride,
+                        width, kernel_params);
+    }
+
+    for (; x < width; x += 2) {
       const uint8_t* in = &in_p[y * in_p_stride + bytesPerPixel * x];
 
       float r = static_cast<float>((in[0 + le] << 8) | in[1 - le]);
@@ -546,13 +594,12 @@ std::shared_ptr<HeifPixelImage>
 Op_RGB24_32_to_YCbCr::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                          const ColorState& input_state,
                                          const ColorState& target_state,
-                                         const heif_color_conversion_options& options) const
+                                         const heif_color_conversion_options& options,
+                                         const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   auto chroma = target_state.chroma;
   uint8_t chromaSubH = chroma_h_subsampling(chroma);
   uint8_t chromaSubV = chroma_v_subsampling(chroma);
@@ -606,10 +653,18 @@ Op_RGB24_32_to_YCbCr::convert_colorspace(const std::shared_ptr<const HeifPixelIm
 
   int bytes_per_pixel = (has_alpha ? 4 : 3);
 
+  RGB24_32_to_Y_row_kernel luma_kernel = get_RGB24_32_to_Y_row_kernel();
+  const RGB_to_YCbCr_kernel_parameters kernel_params{coeffs, full_range_flag, 8};
+
   for (uint32_t y = 0; y < height; y++) {
-    const uint8_t* p = &in_p[y * in_stride];
+    uint32_t x = 0;
+    if (luma_kernel) {
+      x = luma_kernel(&in_p[y * in_stride], bytes_per_pixel, out_y + y * out_y_stride, width, kernel_params);
+    }
 
-    for (uint32_t x = 0; x < width; x++) {
+    const uint8_t* p = &in_p[y * in_stride + x * bytes_per_pixel];
+
+    for (; x < width; x++) {
       uint8_t r = p[0];
       uint8_t g = p[1];
       uint8_t b = p[2];
@@ -648,10 +703,19 @@ Op_RGB24_32_to_YCbCr::convert_colorspace(const std::shared_ptr<const HeifPixelIm
   else if (chromaSubH == 2 && chromaSubV == 2) {
     // chroma 4:2:0
 
+    RGB24_32_to_CbCr420_row_kernel chroma_kernel = get_RGB24_32_to_CbCr420_row_kernel();
+
     for (uint32_t y = 0; y < (height & ~1U); y += 2) {
-      const uint8_t* p = &in_p[y * in_stride];
+      uint32_t x = 0;
+      if (chroma_kernel) {
+        x = chroma_kernel(&in_p[y * in_stride], &in_p[(y + 1) * in_stride], bytes_per_pixel,
+                          out_cb + (y / 2) * out_cb_stride, out_cr + (y / 2) * out_cr_stride,
+                          width & ~1U, kernel_params);
+      }
+
+      const uint8_t* p = &in_p[y * in_stride + x * bytes_per_pixel];
 
-      for (uint32_t x = 0; x < (width & ~1U); x += 2) {
+      for (; x < (width & ~1U); x += 2) {
         uint8_t r = uint8_t((p[0] + p[bytes_per_pixel + 0] + p[in_stride + 0] + p[bytes_per_pixel + in_stride + 0]) / 4);
         uint8_t g = uint8_t((p[1] + p[bytes_per_pixel + 1] + p[in_stride + 1] + p[bytes_per_pixel + in_stride + 1]) / 4);
         uint8_t b = uint8_t((p[2] + p[bytes_per_pixel + 2] + p[in_stride + 2] + p[bytes_per_pixel + in_stride + 2]) / 4);
@@ -818,13 +882,12 @@ std::shared_ptr<HeifPixelImage>
 Op_RGB24_32_to_YCbCr444_GBR::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                                 const ColorState& input_state,
                                                 const ColorState& target_state,
-                                                const heif_color_conversion_options& options) const
+                                                const heif_color_conversion_options& options,
+                                                const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   outimg->create(width, height, heif_colorspace_YCbCr, heif_chroma_444);
 
   const bool has_alpha = (input->get_chroma_format() == heif_chroma_interleaved_32bit);
@@ -126,14 +126,13 @@ Op_Any_RGB_to_YCbCr_420_Sharp::convert_colorspace(
     const std::shared_ptr<const HeifPixelImage>& input,
     const ColorState& input_state,
     const ColorState& target_state,
-    const heif_color_conversion_options& options) const
+    const heif_color_conversion_options& options,
+    const std::shared_ptr<HeifPixelImage>& outimg) const
 {
 #ifdef HAVE_LIBSHARPYUV
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   heif_chroma input_chroma = input->get_chroma_format();
   heif_chroma output_chroma = target_state.chroma;
   assert(output_chroma == heif_chroma_420);  // Only 420 is supported by libsharpyuv.
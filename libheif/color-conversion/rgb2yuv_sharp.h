@@ -38,7 +38,11 @@ public:
   convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                      const ColorState& input_state,
                      const ColorState& target_state,
-                     const heif_color_conversion_options& options) const override;
+                     const heif_color_conversion_options& options,
+                     const std::shared_ptr<HeifPixelImage>& outimg) const override;
+
+  // libsharpyuv converts the whole image at once
+  int get_strip_context_rows() const override { return -1; }
 };
 
 
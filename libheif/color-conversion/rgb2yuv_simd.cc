@@ -0,0 +1,960 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rgb2yuv_simd.h"
+#include "cpu_features.h"
+
+#include <cstring>
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if HAVE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+
+#if HAVE_X86_SIMD
+
+// ---------------------------------------------------------------------------
+//   SSE4.1
+//
+// There are no AVX2 kernels. The conversions are dominated by the loads and the
+// deinterleaving, so CPUs with AVX2 use the SSE4.1 kernels.
+// ---------------------------------------------------------------------------
+
+// 'r * c[0] + g * c[1] + b * c[2]', evaluated in the same order as in the scalar code.
+LIBHEIF_TARGET_SSE41
+static inline __m128 weighted_sum_sse(__m128 r, __m128 g, __m128 b, const float c[3])
+{
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(c[0])),
+                               _mm_mul_ps(g, _mm_set1_ps(c[1]))),
+                    _mm_mul_ps(b, _mm_set1_ps(c[2])));
+}
+
+
+// Mirrors clip_f_u8() / clip_f_u16(): round by adding 0.5 and truncating, then clip to [0;maxval].
+LIBHEIF_TARGET_SSE41
+static inline __m128i clip_f_sse(__m128 v, int maxval)
+{
+  __m128i i = _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+  return _mm_max_epi32(_mm_min_epi32(i, _mm_set1_epi32(maxval)), _mm_setzero_si128());
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline void store_8_pixels_sse(uint8_t* out, __m128i lo, __m128i hi)
+{
+  _mm_storel_epi64((__m128i*) out, _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128()));
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline void store_8_pixels_sse(uint16_t* out, __m128i lo, __m128i hi)
+{
+  _mm_storeu_si128((__m128i*) out, _mm_packus_epi32(lo, hi));
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline void store_4_pixels_sse(uint8_t* out, __m128i v)
+{
+  int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(v, v), _mm_setzero_si128()));
+  memcpy(out, &packed, 4);
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline void store_4_pixels_sse(uint16_t* out, __m128i v)
+{
+  _mm_storel_epi64((__m128i*) out, _mm_packus_epi32(v, v));
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline void load_8_pixels_sse(const uint8_t* in, __m128i& lo, __m128i& hi)
+{
+  __m128i v = _mm_loadl_epi64((const __m128i*) in);
+  lo = _mm_cvtepu8_epi32(v);
+  hi = _mm_cvtepu8_epi32(_mm_srli_si128(v, 4));
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline void load_8_pixels_sse(const uint16_t* in, __m128i& lo, __m128i& hi)
+{
+  __m128i v = _mm_loadu_si128((const __m128i*) in);
+  lo = _mm_cvtepu16_epi32(v);
+  hi = _mm_cvtepu16_epi32(_mm_srli_si128(v, 8));
+}
+
+
+// Sums of horizontally adjacent pixels of two rows, i.e. the sums of the 2x2 blocks.
+LIBHEIF_TARGET_SSE41
+static inline __m128i sum_2x2_sse(__m128i row0_lo, __m128i row0_hi, __m128i row1_lo, __m128i row1_hi)
+{
+  return _mm_hadd_epi32(_mm_add_epi32(row0_lo, row1_lo), _mm_add_epi32(row0_hi, row1_hi));
+}
+
+
+// --- Op_RGB24_32_to_YCbCr
+
+LIBHEIF_TARGET_SSE41
+static inline __m128i RGB24_32_luma_sse(__m128 r, __m128 g, __m128 b, const RGB_to_YCbCr_kernel_parameters& params)
+{
+  __m128 v = weighted_sum_sse(r, g, b, params.coeffs.c[0]);
+
+  if (params.full_range) {
+    return clip_f_sse(v, 255);
+  }
+  else {
+    return _mm_add_epi32(clip_f_sse(_mm_mul_ps(v, _mm_set1_ps(0.85547f)), 219), _mm_set1_epi32(16));
+  }
+}
+
+
+// see set_chroma_pixels()
+LIBHEIF_TARGET_SSE41
+static inline __m128i RGB24_32_chroma_sse(__m128 r, __m128 g, __m128 b, const float c[3], bool full_range)
+{
+  __m128 v = weighted_sum_sse(r, g, b, c);
+
+  if (full_range) {
+    return clip_f_sse(_mm_add_ps(v, _mm_set1_ps(128.0f)), 255);
+  }
+  else {
+    return clip_f_sse(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(0.875f)), _mm_set1_ps(128.0f)), 255);
+  }
+}
+
+
+// Byte shuffles that extract the R, G, B components of 8 interleaved pixels into 32 bit lanes.
+// The first 4 pixels are taken from a load at offset 0, the next 4 pixels from a load at 'second_load_offset'.
+struct RGB24_32_shuffles_sse
+{
+  __m128i lo[3];
+  __m128i hi[3];
+  int second_load_offset;
+};
+
+
+LIBHEIF_TARGET_SSE41
+static inline __m128i byte_to_int32_shuffle_sse(int first, int step)
+{
+  return _mm_setr_epi8((char) first, -1, -1, -1,
+                       (char) (first + step), -1, -1, -1,
+                       (char) (first + 2 * step), -1, -1, -1,
+                       (char) (first + 3 * step), -1, -1, -1);
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline RGB24_32_shuffles_sse get_RGB24_32_shuffles_sse(int bytes_per_pixel)
+{
+  RGB24_32_shuffles_sse shuffles;
+
+  // For RGB24, the second load starts at byte 8 so that it does not read beyond the 8 pixels.
+  shuffles.second_load_offset = (bytes_per_pixel == 3) ? 8 : 16;
+  int pixel4_position = 4 * bytes_per_pixel - shuffles.second_load_offset;
+
+  for (int c = 0; c < 3; c++) {
+    shuffles.lo[c] = byte_to_int32_shuffle_sse(c, bytes_per_pixel);
+    shuffles.hi[c] = byte_to_int32_shuffle_sse(pixel4_position + c, bytes_per_pixel);
+  }
+
+  return shuffles;
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline void load_RGB24_32_8_pixels_sse(const uint8_t* in, const RGB24_32_shuffles_sse& shuffles,
+                                              __m128i lo[3], __m128i hi[3])
+{
+  __m128i v0 = _mm_loadu_si128((const __m128i*) in);
+  __m128i v1 = _mm_loadu_si128((const __m128i*) (in + shuffles.second_load_offset));
+
+  for (int c = 0; c < 3; c++) {
+    lo[c] = _mm_shuffle_epi8(v0, shuffles.lo[c]);
+    hi[c] = _mm_shuffle_epi8(v1, shuffles.hi[c]);
+  }
+}
+
+
+LIBHEIF_TARGET_SSE41
+static uint32_t RGB24_32_to_Y_row_sse41(const uint8_t* in, int bytes_per_pixel,
+                                        uint8_t* out_y, uint32_t width,
+                                        const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const RGB24_32_shuffles_sse shuffles = get_RGB24_32_shuffles_sse(bytes_per_pixel);
+
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m128i lo[3], hi[3];
+    load_RGB24_32_8_pixels_sse(in + bytes_per_pixel * x, shuffles, lo, hi);
+
+    store_8_pixels_sse(out_y + x,
+                       RGB24_32_luma_sse(_mm_cvtepi32_ps(lo[0]), _mm_cvtepi32_ps(lo[1]), _mm_cvtepi32_ps(lo[2]), params),
+                       RGB24_32_luma_sse(_mm_cvtepi32_ps(hi[0]), _mm_cvtepi32_ps(hi[1]), _mm_cvtepi32_ps(hi[2]), params));
+  }
+
+  return x;
+}
+
+
+LIBHEIF_TARGET_SSE41
+static uint32_t RGB24_32_to_CbCr420_row_sse41(const uint8_t* in0, const uint8_t* in1, int bytes_per_pixel,
+                                              uint8_t* out_cb, uint8_t* out_cr, uint32_t width,
+                                              const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const RGB24_32_shuffles_sse shuffles = get_RGB24_32_shuffles_sse(bytes_per_pixel);
+
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m128i row0_lo[3], row0_hi[3], row1_lo[3], row1_hi[3];
+    load_RGB24_32_8_pixels_sse(in0 + bytes_per_pixel * x, shuffles, row0_lo, row0_hi);
+    load_RGB24_32_8_pixels_sse(in1 + bytes_per_pixel * x, shuffles, row1_lo, row1_hi);
+
+    // integer average, as in the scalar code
+    __m128 rgb[3];
+    for (int c = 0; c < 3; c++) {
+      __m128i sum = sum_2x2_sse(row0_lo[c], row0_hi[c], row1_lo[c], row1_hi[c]);
+      rgb[c] = _mm_cvtepi32_ps(_mm_srli_epi32(sum, 2));
+    }
+
+    store_4_pixels_sse(out_cb + x / 2, RGB24_32_chroma_sse(rgb[0], rgb[1], rgb[2], params.coeffs.c[1], params.full_range));
+    store_4_pixels_sse(out_cr + x / 2, RGB24_32_chroma_sse(rgb[0], rgb[1], rgb[2], params.coeffs.c[2], params.full_range));
+  }
+
+  return x;
+}
+
+
+// --- Op_RGB_to_YCbCr<Pixel>
+
+LIBHEIF_TARGET_SSE41
+static inline __m128i RGB_luma_sse(__m128 r, __m128 g, __m128 b, const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+
+  __m128 v = weighted_sum_sse(r, g, b, params.coeffs.c[0]);
+
+  if (!params.full_range) {
+    v = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(v, _mm_set1_ps(219.0f)), _mm_set1_ps(1.0f / 256)),
+                   _mm_set1_ps(static_cast<float>(16 << (bpp - 8))));
+  }
+
+  return clip_f_sse(v, (1 << bpp) - 1);
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline __m128i RGB_chroma_sse(__m128 r, __m128 g, __m128 b, const float c[3],
+                                     const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+
+  __m128 v = weighted_sum_sse(r, g, b, c);
+
+  if (!params.full_range) {
+    v = _mm_mul_ps(_mm_mul_ps(v, _mm_set1_ps(224.0f)), _mm_set1_ps(1.0f / 256));
+  }
+
+  return clip_f_sse(_mm_add_ps(v, _mm_set1_ps(static_cast<float>(1 << (bpp - 1)))), (1 << bpp) - 1);
+}
+
+
+template<class Pixel>
+LIBHEIF_TARGET_SSE41
+static uint32_t RGB_to_Y_row_sse41(const Pixel* in_r, const Pixel* in_g, const Pixel* in_b,
+                                   Pixel* out_y, uint32_t width,
+                                   const RGB_to_YCbCr_kernel_parameters& params)
+{
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m128i r_lo, r_hi, g_lo, g_hi, b_lo, b_hi;
+    load_8_pixels_sse(in_r + x, r_lo, r_hi);
+    load_8_pixels_sse(in_g + x, g_lo, g_hi);
+    load_8_pixels_sse(in_b + x, b_lo, b_hi);
+
+    store_8_pixels_sse(out_y + x,
+                       RGB_luma_sse(_mm_cvtepi32_ps(r_lo), _mm_cvtepi32_ps(g_lo), _mm_cvtepi32_ps(b_lo), params),
+                       RGB_luma_sse(_mm_cvtepi32_ps(r_hi), _mm_cvtepi32_ps(g_hi), _mm_cvtepi32_ps(b_hi), params));
+  }
+
+  return x;
+}
+
+
+template<class Pixel>
+LIBHEIF_TARGET_SSE41
+static uint32_t RGB_to_CbCr420_row_sse41(const Pixel* const in0[3], const Pixel* const in1[3],
+                                         Pixel* out_cb, Pixel* out_cr, uint32_t width,
+                                         const RGB_to_YCbCr_kernel_parameters& params)
+{
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+
+    // floating point average, as in the scalar code
+    __m128 rgb[3];
+    for (int c = 0; c < 3; c++) {
+      __m128i row0_lo, row0_hi, row1_lo, row1_hi;
+      load_8_pixels_sse(in0[c] + x, row0_lo, row0_hi);
+      load_8_pixels_sse(in1[c] + x, row1_lo, row1_hi);
+
+      __m128i sum = sum_2x2_sse(row0_lo, row0_hi, row1_lo, row1_hi);
+      rgb[c] = _mm_mul_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(0.25f));
+    }
+
+    store_4_pixels_sse(out_cb + x / 2, RGB_chroma_sse(rgb[0], rgb[1], rgb[2], params.coeffs.c[1], params));
+    store_4_pixels_sse(out_cr + x / 2, RGB_chroma_sse(rgb[0], rgb[1], rgb[2], params.coeffs.c[2], params));
+  }
+
+  return x;
+}
+
+
+// --- Op_RRGGBBxx_HDR_to_YCbCr420
+
+LIBHEIF_TARGET_SSE41
+static inline __m128i RRGGBBaa_luma_sse(__m128 r, __m128 g, __m128 b, const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+
+  __m128 v = weighted_sum_sse(r, g, b, params.coeffs.c[0]);
+
+  if (!params.full_range) {
+    v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(0.85547f)), _mm_set1_ps(static_cast<float>(16 << (bpp - 8))));
+  }
+
+  return clip_f_sse(v, (1 << bpp) - 1);
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline __m128i RRGGBBaa_chroma_sse(__m128 r, __m128 g, __m128 b, const float c[3],
+                                          const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+
+  __m128 v = weighted_sum_sse(r, g, b, c);
+
+  if (!params.full_range) {
+    v = _mm_mul_ps(v, _mm_set1_ps(0.8750f));
+  }
+
+  return clip_f_sse(_mm_add_ps(_mm_set1_ps(static_cast<float>(1 << (bpp - 1))), v), (1 << bpp) - 1);
+}
+
+
+// Byte shuffles that extract one 16 bit component of two pixels into 32 bit lanes 0 and 1.
+struct RRGGBBaa_shuffles_sse
+{
+  __m128i component[4];
+};
+
+
+LIBHEIF_TARGET_SSE41
+static inline RRGGBBaa_shuffles_sse get_RRGGBBaa_shuffles_sse(int bytes_per_pixel, bool little_endian)
+{
+  RRGGBBaa_shuffles_sse shuffles;
+
+  int lsb = little_endian ? 0 : 1;
+  int msb = 1 - lsb;
+
+  for (int c = 0; c < 4; c++) {
+    int p0 = 2 * c;
+    int p1 = bytes_per_pixel + 2 * c;
+
+    shuffles.component[c] = _mm_setr_epi8((char) (p0 + lsb), (char) (p0 + msb), -1, -1,
+                                          (char) (p1 + lsb), (char) (p1 + msb), -1, -1,
+                                          -1, -1, -1, -1, -1, -1, -1, -1);
+  }
+
+  return shuffles;
+}
+
+
+// Loads the 16 bit components of 4 pixels into 32 bit lanes.
+// Reads 2 * bytes_per_pixel + 16 bytes.
+LIBHEIF_TARGET_SSE41
+static inline void load_RRGGBBaa_4_pixels_sse(const uint8_t* in, int bytes_per_pixel, int num_components,
+                                              const RRGGBBaa_shuffles_sse& shuffles, __m128i* components)
+{
+  __m128i v0 = _mm_loadu_si128((const __m128i*) in);
+  __m128i v1 = _mm_loadu_si128((const __m128i*) (in + 2 * bytes_per_pixel));
+
+  for (int c = 0; c < num_components; c++) {
+    components[c] = _mm_unpacklo_epi64(_mm_shuffle_epi8(v0, shuffles.component[c]),
+                                       _mm_shuffle_epi8(v1, shuffles.component[c]));
+  }
+}
+
+
+// Number of pixels that have to be available so that 8 pixels can be loaded without reading beyond the row.
+static inline uint32_t RRGGBBaa_8_pixels_load_width(bool has_alpha)
+{
+  return has_alpha ? 8 : 9;
+}
+
+
+LIBHEIF_TARGET_SSE41
+static uint32_t RRGGBBaa_to_Y_row_sse41(const uint8_t* in, bool has_alpha, bool little_endian,
+                                        uint16_t* out_y, uint16_t* out_a, uint32_t width,
+                                        const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bytes_per_pixel = has_alpha ? 8 : 6;
+  const int num_components = has_alpha ? 4 : 3;
+  const RRGGBBaa_shuffles_sse shuffles = get_RRGGBBaa_shuffles_sse(bytes_per_pixel, little_endian);
+  const uint32_t load_width = RRGGBBaa_8_pixels_load_width(has_alpha);
+
+  uint32_t x;
+  for (x = 0; x + load_width <= width; x += 8) {
+    __m128i lo[4], hi[4];
+    load_RRGGBBaa_4_pixels_sse(in + bytes_per_pixel * x, bytes_per_pixel, num_components, shuffles, lo);
+    load_RRGGBBaa_4_pixels_sse(in + bytes_per_pixel * (x + 4), bytes_per_pixel, num_components, shuffles, hi);
+
+    store_8_pixels_sse(out_y + x,
+                       RRGGBBaa_luma_sse(_mm_cvtepi32_ps(lo[0]), _mm_cvtepi32_ps(lo[1]), _mm_cvtepi32_ps(lo[2]), params),
+                       RRGGBBaa_luma_sse(_mm_cvtepi32_ps(hi[0]), _mm_cvtepi32_ps(hi[1]), _mm_cvtepi32_ps(hi[2]), params));
+
+    if (has_alpha) {
+      store_8_pixels_sse(out_a + x, lo[3], hi[3]);
+    }
+  }
+
+  return x;
+}
+
+
+LIBHEIF_TARGET_SSE41
+static uint32_t RRGGBBaa_to_CbCr420_row_sse41(const uint8_t* in0, const uint8_t* in1,
+                                              bool has_alpha, bool little_endian,
+                                              uint16_t* out_cb, uint16_t* out_cr, uint32_t width,
+                                              const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bytes_per_pixel = has_alpha ? 8 : 6;
+  const RRGGBBaa_shuffles_sse shuffles = get_RRGGBBaa_shuffles_sse(bytes_per_pixel, little_endian);
+  const uint32_t load_width = RRGGBBaa_8_pixels_load_width(has_alpha);
+
+  uint32_t x;
+  for (x = 0; x + load_width <= width; x += 8) {
+    __m128i row0_lo[3], row0_hi[3], row1_lo[3], row1_hi[3];
+    load_RRGGBBaa_4_pixels_sse(in0 + bytes_per_pixel * x, bytes_per_pixel, 3, shuffles, row0_lo);
+    load_RRGGBBaa_4_pixels_sse(in0 + bytes_per_pixel * (x + 4), bytes_per_pixel, 3, shuffles, row0_hi);
+    load_RRGGBBaa_4_pixels_sse(in1 + bytes_per_pixel * x, bytes_per_pixel, 3, shuffles, row1_lo);
+    load_RRGGBBaa_4_pixels_sse(in1 + bytes_per_pixel * (x + 4), bytes_per_pixel, 3, shuffles, row1_hi);
+
+    __m128 rgb[3];
+    for (int c = 0; c < 3; c++) {
+      __m128i sum = sum_2x2_sse(row0_lo[c], row0_hi[c], row1_lo[c], row1_hi[c]);
+      rgb[c] = _mm_mul_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(0.25f));
+    }
+
+    store_4_pixels_sse(out_cb + x / 2, RRGGBBaa_chroma_sse(rgb[0], rgb[1], rgb[2], params.coeffs.c[1], params));
+    store_4_pixels_sse(out_cr + x / 2, RRGGBBaa_chroma_sse(rgb[0], rgb[1], rgb[2], params.coeffs.c[2], params));
+  }
+
+  return x;
+}
+
+#endif
+
+
+#if HAVE_NEON_SIMD
+
+// ---------------------------------------------------------------------------
+//   NEON
+// ---------------------------------------------------------------------------
+
+static inline float32x4_t weighted_sum_neon(float32x4_t r, float32x4_t g, float32x4_t b, const float c[3])
+{
+  return vaddq_f32(vaddq_f32(vmulq_n_f32(r, c[0]), vmulq_n_f32(g, c[1])), vmulq_n_f32(b, c[2]));
+}
+
+
+static inline int32x4_t clip_f_neon(float32x4_t v, int maxval)
+{
+  int32x4_t i = vcvtq_s32_f32(vaddq_f32(v, vdupq_n_f32(0.5f)));
+  return vmaxq_s32(vminq_s32(i, vdupq_n_s32(maxval)), vdupq_n_s32(0));
+}
+
+
+static inline void widen_u16_neon(uint16x8_t v, uint32x4_t& lo, uint32x4_t& hi)
+{
+  lo = vmovl_u16(vget_low_u16(v));
+  hi = vmovl_u16(vget_high_u16(v));
+}
+
+
+static inline void load_8_pixels_neon(const uint8_t* in, uint32x4_t& lo, uint32x4_t& hi)
+{
+  widen_u16_neon(vmovl_u8(vld1_u8(in)), lo, hi);
+}
+
+
+static inline void load_8_pixels_neon(const uint16_t* in, uint32x4_t& lo, uint32x4_t& hi)
+{
+  widen_u16_neon(vld1q_u16(in), lo, hi);
+}
+
+
+static inline void store_8_pixels_neon(uint8_t* out, int32x4_t lo, int32x4_t hi)
+{
+  vst1_u8(out, vqmovun_s16(vcombine_s16(vmovn_s32(lo), vmovn_s32(hi))));
+}
+
+
+static inline void store_8_pixels_neon(uint16_t* out, int32x4_t lo, int32x4_t hi)
+{
+  vst1q_u16(out, vcombine_u16(vqmovun_s32(lo), vqmovun_s32(hi)));
+}
+
+
+static inline void store_4_pixels_neon(uint8_t* out, int32x4_t v)
+{
+  uint8x8_t packed = vqmovun_s16(vcombine_s16(vmovn_s32(v), vmovn_s32(v)));
+  uint32_t bytes = vget_lane_u32(vreinterpret_u32_u8(packed), 0);
+  memcpy(out, &bytes, 4);
+}
+
+
+static inline void store_4_pixels_neon(uint16_t* out, int32x4_t v)
+{
+  vst1_u16(out, vqmovun_s32(v));
+}
+
+
+static inline float32x4_t to_float_neon(uint32x4_t v)
+{
+  return vcvtq_f32_u32(v);
+}
+
+
+// --- Op_RGB24_32_to_YCbCr
+
+static inline int32x4_t RGB24_32_luma_neon(float32x4_t r, float32x4_t g, float32x4_t b,
+                                           const RGB_to_YCbCr_kernel_parameters& params)
+{
+  float32x4_t v = weighted_sum_neon(r, g, b, params.coeffs.c[0]);
+
+  if (params.full_range) {
+    return clip_f_neon(v, 255);
+  }
+  else {
+    return vaddq_s32(clip_f_neon(vmulq_n_f32(v, 0.85547f), 219), vdupq_n_s32(16));
+  }
+}
+
+
+static inline int32x4_t RGB24_32_chroma_neon(float32x4_t r, float32x4_t g, float32x4_t b, const float c[3], bool full_range)
+{
+  float32x4_t v = weighted_sum_neon(r, g, b, c);
+
+  if (full_range) {
+    return clip_f_neon(vaddq_f32(v, vdupq_n_f32(128.0f)), 255);
+  }
+  else {
+    return clip_f_neon(vaddq_f32(vmulq_n_f32(v, 0.875f), vdupq_n_f32(128.0f)), 255);
+  }
+}
+
+
+static inline void load_RGB24_32_8_pixels_neon(const uint8_t* in, int bytes_per_pixel, uint32x4_t lo[3], uint32x4_t hi[3])
+{
+  uint8x8_t rgb[3];
+
+  if (bytes_per_pixel == 3) {
+    uint8x8x3_t v = vld3_u8(in);
+    rgb[0] = v.val[0];
+    rgb[1] = v.val[1];
+    rgb[2] = v.val[2];
+  }
+  else {
+    uint8x8x4_t v = vld4_u8(in);
+    rgb[0] = v.val[0];
+    rgb[1] = v.val[1];
+    rgb[2] = v.val[2];
+  }
+
+  for (int c = 0; c < 3; c++) {
+    widen_u16_neon(vmovl_u8(rgb[c]), lo[c], hi[c]);
+  }
+}
+
+
+static uint32_t RGB24_32_to_Y_row_neon(const uint8_t* in, int bytes_per_pixel,
+                                       uint8_t* out_y, uint32_t width,
+                                       const RGB_to_YCbCr_kernel_parameters& params)
+{
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint32x4_t lo[3], hi[3];
+    load_RGB24_32_8_pixels_neon(in + bytes_per_pixel * x, bytes_per_pixel, lo, hi);
+
+    store_8_pixels_neon(out_y + x,
+                        RGB24_32_luma_neon(to_float_neon(lo[0]), to_float_neon(lo[1]), to_float_neon(lo[2]), params),
+                        RGB24_32_luma_neon(to_float_neon(hi[0]), to_float_neon(hi[1]), to_float_neon(hi[2]), params));
+  }
+
+  return x;
+}
+
+
+static uint32_t RGB24_32_to_CbCr420_row_neon(const uint8_t* in0, const uint8_t* in1, int bytes_per_pixel,
+                                             uint8_t* out_cb, uint8_t* out_cr, uint32_t width,
+                                             const RGB_to_YCbCr_kernel_parameters& params)
+{
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint32x4_t row0_lo[3], row0_hi[3], row1_lo[3], row1_hi[3];
+    load_RGB24_32_8_pixels_neon(in0 + bytes_per_pixel * x, bytes_per_pixel, row0_lo, row0_hi);
+    load_RGB24_32_8_pixels_neon(in1 + bytes_per_pixel * x, bytes_per_pixel, row1_lo, row1_hi);
+
+    float32x4_t rgb[3];
+    for (int c = 0; c < 3; c++) {
+      uint32x4_t sum = vpaddq_u32(vaddq_u32(row0_lo[c], row1_lo[c]), vaddq_u32(row0_hi[c], row1_hi[c]));
+      rgb[c] = to_float_neon(vshrq_n_u32(sum, 2));
+    }
+
+    store_4_pixels_neon(out_cb + x / 2, RGB24_32_chroma_neon(rgb[0], rgb[1], rgb[2], params.coeffs.c[1], params.full_range));
+    store_4_pixels_neon(out_cr + x / 2, RGB24_32_chroma_neon(rgb[0], rgb[1], rgb[2], params.coeffs.c[2], params.full_range));
+  }
+
+  return x;
+}
+
+
+// --- Op_RGB_to_YCbCr<Pixel>
+
+static inline int32x4_t RGB_luma_neon(float32x4_t r, float32x4_t g, float32x4_t b,
+                                      const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+
+  float32x4_t v = weighted_sum_neon(r, g, b, params.coeffs.c[0]);
+
+  if (!params.full_range) {
+    v = vaddq_f32(vmulq_n_f32(vmulq_n_f32(v, 219.0f), 1.0f / 256),
+                  vdupq_n_f32(static_cast<float>(16 << (bpp - 8))));
+  }
+
+  return clip_f_neon(v, (1 << bpp) - 1);
+}
+
+
+static inline int32x4_t RGB_chroma_neon(float32x4_t r, float32x4_t g, float32x4_t b, const float c[3],
+                                        const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+
+  float32x4_t v = weighted_sum_neon(r, g, b, c);
+
+  if (!params.full_range) {
+    v = vmulq_n_f32(vmulq_n_f32(v, 224.0f), 1.0f / 256);
+  }
+
+  return clip_f_neon(vaddq_f32(v, vdupq_n_f32(static_cast<float>(1 << (bpp - 1)))), (1 << bpp) - 1);
+}
+
+
+template<class Pixel>
+static uint32_t RGB_to_Y_row_neon(const Pixel* in_r, const Pixel* in_g, const Pixel* in_b,
+                                  Pixel* out_y, uint32_t width,
+                                  const RGB_to_YCbCr_kernel_parameters& params)
+{
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint32x4_t r_lo, r_hi, g_lo, g_hi, b_lo, b_hi;
+    load_8_pixels_neon(in_r + x, r_lo, r_hi);
+    load_8_pixels_neon(in_g + x, g_lo, g_hi);
+    load_8_pixels_neon(in_b + x, b_lo, b_hi);
+
+    store_8_pixels_neon(out_y + x,
+                        RGB_luma_neon(to_float_neon(r_lo), to_float_neon(g_lo), to_float_neon(b_lo), params),
+                        RGB_luma_neon(to_float_neon(r_hi), to_float_neon(g_hi), to_float_neon(b_hi), params));
+  }
+
+  return x;
+}
+
+
+template<class Pixel>
+static uint32_t RGB_to_CbCr420_row_neon(const Pixel* const in0[3], const Pixel* const in1[3],
+                                        Pixel* out_cb, Pixel* out_cr, uint32_t width,
+                                        const RGB_to_YCbCr_kernel_parameters& params)
+{
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    float32x4_t rgb[3];
+    for (int c = 0; c < 3; c++) {
+      uint32x4_t row0_lo, row0_hi, row1_lo, row1_hi;
+      load_8_pixels_neon(in0[c] + x, row0_lo, row0_hi);
+      load_8_pixels_neon(in1[c] + x, row1_lo, row1_hi);
+
+      uint32x4_t sum = vpaddq_u32(vaddq_u32(row0_lo, row1_lo), vaddq_u32(row0_hi, row1_hi));
+      rgb[c] = vmulq_n_f32(to_float_neon(sum), 0.25f);
+    }
+
+    store_4_pixels_neon(out_cb + x / 2, RGB_chroma_neon(rgb[0], rgb[1], rgb[2], params.coeffs.c[1], params));
+    store_4_pixels_neon(out_cr + x / 2, RGB_chroma_neon(rgb[0], rgb[1], rgb[2], params.coeffs.c[2], params));
+  }
+
+  return x;
+}
+
+
+// --- Op_RRGGBBxx_HDR_to_YCbCr420
+
+static inline int32x4_t RRGGBBaa_luma_neon(float32x4_t r, float32x4_t g, float32x4_t b,
+                                           const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+
+  float32x4_t v = weighted_sum_neon(r, g, b, params.coeffs.c[0]);
+
+  if (!params.full_range) {
+    v = vaddq_f32(vmulq_n_f32(v, 0.85547f), vdupq_n_f32(static_cast<float>(16 << (bpp - 8))));
+  }
+
+  return clip_f_neon(v, (1 << bpp) - 1);
+}
+
+
+static inline int32x4_t RRGGBBaa_chroma_neon(float32x4_t r, float32x4_t g, float32x4_t b, const float c[3],
+                                             const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+
+  float32x4_t v = weighted_sum_neon(r, g, b, c);
+
+  if (!params.full_range) {
+    v = vmulq_n_f32(v, 0.8750f);
+  }
+
+  return clip_f_neon(vaddq_f32(vdupq_n_f32(static_cast<float>(1 << (bpp - 1))), v), (1 << bpp) - 1);
+}
+
+
+// Loads the components of 8 pixels in native byte order.
+static inline void load_RRGGBBaa_8_pixels_neon(const uint8_t* in, bool has_alpha, bool little_endian, uint16x8_t components[4])
+{
+  const uint16_t* in16 = reinterpret_cast<const uint16_t*>(in);
+  int num_components;
+
+  if (has_alpha) {
+    uint16x8x4_t v = vld4q_u16(in16);
+    for (int c = 0; c < 4; c++) {
+      components[c] = v.val[c];
+    }
+    num_components = 4;
+  }
+  else {
+    uint16x8x3_t v = vld3q_u16(in16);
+    for (int c = 0; c < 3; c++) {
+      components[c] = v.val[c];
+    }
+    num_components = 3;
+  }
+
+  if (!little_endian) {
+    for (int c = 0; c < num_components; c++) {
+      components[c] = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(components[c])));
+    }
+  }
+}
+
+
+static uint32_t RRGGBBaa_to_Y_row_neon(const uint8_t* in, bool has_alpha, bool little_endian,
+                                       uint16_t* out_y, uint16_t* out_a, uint32_t width,
+                                       const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bytes_per_pixel = has_alpha ? 8 : 6;
+
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint16x8_t components[4];
+    load_RRGGBBaa_8_pixels_neon(in + bytes_per_pixel * x, has_alpha, little_endian, components);
+
+    uint32x4_t lo[3], hi[3];
+    for (int c = 0; c < 3; c++) {
+      widen_u16_neon(components[c], lo[c], hi[c]);
+    }
+
+    store_8_pixels_neon(out_y + x,
+                        RRGGBBaa_luma_neon(to_float_neon(lo[0]), to_float_neon(lo[1]), to_float_neon(lo[2]), params),
+                        RRGGBBaa_luma_neon(to_float_neon(hi[0]), to_float_neon(hi[1]), to_float_neon(hi[2]), params));
+
+    if (has_alpha) {
+      vst1q_u16(out_a + x, components[3]);
+    }
+  }
+
+  return x;
+}
+
+
+static uint32_t RRGGBBaa_to_CbCr420_row_neon(const uint8_t* in0, const uint8_t* in1,
+                                             bool has_alpha, bool little_endian,
+                                             uint16_t* out_cb, uint16_t* out_cr, uint32_t width,
+                                             const RGB_to_YCbCr_kernel_parameters& params)
+{
+  const int bytes_per_pixel = has_alpha ? 8 : 6;
+
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint16x8_t row0[4], row1[4];
+    load_RRGGBBaa_8_pixels_neon(in0 + bytes_per_pixel * x, has_alpha, little_endian, row0);
+    load_RRGGBBaa_8_pixels_neon(in1 + bytes_per_pixel * x, has_alpha, little_endian, row1);
+
+    float32x4_t rgb[3];
+    for (int c = 0; c < 3; c++) {
+      uint32x4_t row0_lo, row0_hi, row1_lo, row1_hi;
+      widen_u16_neon(row0[c], row0_lo, row0_hi);
+      widen_u16_neon(row1[c], row1_lo, row1_hi);
+
+      uint32x4_t sum = vpaddq_u32(vaddq_u32(row0_lo, row1_lo), vaddq_u32(row0_hi, row1_hi));
+      rgb[c] = vmulq_n_f32(to_float_neon(sum), 0.25f);
+    }
+
+    store_4_pixels_neon(out_cb + x / 2, RRGGBBaa_chroma_neon(rgb[0], rgb[1], rgb[2], params.coeffs.c[1], params));
+    store_4_pixels_neon(out_cr + x / 2, RRGGBBaa_chroma_neon(rgb[0], rgb[1], rgb[2], params.coeffs.c[2], params));
+  }
+
+  return x;
+}
+
+#endif
+
+
+RGB24_32_to_Y_row_kernel get_RGB24_32_to_Y_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+    case SimdLevel::SSE41:
+      return RGB24_32_to_Y_row_sse41;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return RGB24_32_to_Y_row_neon;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+
+RGB24_32_to_CbCr420_row_kernel get_RGB24_32_to_CbCr420_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+    case SimdLevel::SSE41:
+      return RGB24_32_to_CbCr420_row_sse41;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return RGB24_32_to_CbCr420_row_neon;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+
+template<class Pixel>
+RGB_to_Y_row_kernel<Pixel> get_RGB_to_Y_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+    case SimdLevel::SSE41:
+      return RGB_to_Y_row_sse41<Pixel>;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return RGB_to_Y_row_neon<Pixel>;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+template RGB_to_Y_row_kernel<uint8_t> get_RGB_to_Y_row_kernel<uint8_t>();
+template RGB_to_Y_row_kernel<uint16_t> get_RGB_to_Y_row_kernel<uint16_t>();
+
+
+template<class Pixel>
+RGB_to_CbCr420_row_kernel<Pixel> get_RGB_to_CbCr420_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+    case SimdLevel::SSE41:
+      return RGB_to_CbCr420_row_sse41<Pixel>;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return RGB_to_CbCr420_row_neon<Pixel>;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+template RGB_to_CbCr420_row_kernel<uint8_t> get_RGB_to_CbCr420_row_kernel<uint8_t>();
+template RGB_to_CbCr420_row_kernel<uint16_t> get_RGB_to_CbCr420_row_kernel<uint16_t>();
+
+
+RRGGBBaa_to_Y_row_kernel get_RRGGBBaa_to_Y_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+    case SimdLevel::SSE41:
+      return RRGGBBaa_to_Y_row_sse41;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return RRGGBBaa_to_Y_row_neon;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+
+RRGGBBaa_to_CbCr420_row_kernel get_RRGGBBaa_to_CbCr420_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+    case SimdLevel::SSE41:
+      return RRGGBBaa_to_CbCr420_row_sse41;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return RRGGBBaa_to_CbCr420_row_neon;
+#endif
+    default:
+      return nullptr;
+  }
+}
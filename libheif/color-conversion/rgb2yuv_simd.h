@@ -0,0 +1,102 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_COLORCONVERSION_RGB2YUV_SIMD_H
+#define LIBHEIF_COLORCONVERSION_RGB2YUV_SIMD_H
+
+#include <cstdint>
+#include "nclx.h"
+
+
+// Vectorized row kernels for the RGB -> YCbCr conversions in rgb2yuv.cc.
+//
+// As for the YCbCr -> RGB kernels, each kernel converts as many pixels from the start of a row
+// as fit into its vector width and returns the number of converted (luma) pixels.
+// The remaining pixels are converted by the scalar code.
+//
+// The kernels repeat the single precision operations of the scalar code in the same order.
+// Their results are bit-exact unless the compiler contracts the scalar code into fused multiply-adds.
+//
+// The 4:2:0 chroma kernels compute one chroma row from two luma rows, including the averaging
+// of the 2x2 RGB samples. For the last row of an image with odd height, both row pointers
+// point to the same row.
+
+struct RGB_to_YCbCr_kernel_parameters
+{
+  RGB_to_YCbCr_coefficients coeffs;
+  bool full_range;
+  int bits_per_pixel;
+};
+
+
+// Op_RGB24_32_to_YCbCr: interleaved 8 bit RGB or RGBA input ('bytes_per_pixel' == 3 or 4)
+
+typedef uint32_t (* RGB24_32_to_Y_row_kernel)(const uint8_t* in, int bytes_per_pixel,
+                                               uint8_t* out_y, uint32_t width,
+                                               const RGB_to_YCbCr_kernel_parameters& params);
+
+typedef uint32_t (* RGB24_32_to_CbCr420_row_kernel)(const uint8_t* in0, const uint8_t* in1, int bytes_per_pixel,
+                                                     uint8_t* out_cb, uint8_t* out_cr, uint32_t width,
+                                                     const RGB_to_YCbCr_kernel_parameters& params);
+
+
+// Op_RGB_to_YCbCr<Pixel>: planar input
+
+template<class Pixel>
+using RGB_to_Y_row_kernel = uint32_t (*)(const Pixel* in_r, const Pixel* in_g, const Pixel* in_b,
+                                         Pixel* out_y, uint32_t width,
+                                         const RGB_to_YCbCr_kernel_parameters& params);
+
+template<class Pixel>
+using RGB_to_CbCr420_row_kernel = uint32_t (*)(const Pixel* const in0[3], const Pixel* const in1[3],
+                                               Pixel* out_cb, Pixel* out_cr, uint32_t width,
+                                               const RGB_to_YCbCr_kernel_parameters& params);
+
+
+// Op_RRGGBBxx_HDR_to_YCbCr420: interleaved 16 bit RRGGBB or RRGGBBAA input.
+// With alpha, the alpha component is copied into 'out_a'.
+
+typedef uint32_t (* RRGGBBaa_to_Y_row_kernel)(const uint8_t* in, bool has_alpha, bool little_endian,
+                                               uint16_t* out_y, uint16_t* out_a, uint32_t width,
+                                               const RGB_to_YCbCr_kernel_parameters& params);
+
+typedef uint32_t (* RRGGBBaa_to_CbCr420_row_kernel)(const uint8_t* in0, const uint8_t* in1,
+                                                     bool has_alpha, bool little_endian,
+                                                     uint16_t* out_cb, uint16_t* out_cr, uint32_t width,
+                                                     const RGB_to_YCbCr_kernel_parameters& params);
+
+
+// These return nullptr if there is no kernel for the SIMD level of the CPU.
+
+RGB24_32_to_Y_row_kernel get_RGB24_32_to_Y_row_kernel();
+
+RGB24_32_to_CbCr420_row_kernel get_RGB24_32_to_CbCr420_row_kernel();
+
+template<class Pixel>
+RGB_to_Y_row_kernel<Pixel> get_RGB_to_Y_row_kernel();
+
+template<class Pixel>
+RGB_to_CbCr420_row_kernel<Pixel> get_RGB_to_CbCr420_row_kernel();
+
+RRGGBBaa_to_Y_row_kernel get_RRGGBBaa_to_Y_row_kernel();
+
+RRGGBBaa_to_CbCr420_row_kernel get_RRGGBBaa_to_CbCr420_row_kernel();
+
+#endif
@@ -21,6 +21,7 @@
 #include <cmath>
 #include <cstring>
 #include "yuv2rgb.h"
+#include "yuv2rgb_simd.h"
 #include "nclx.h"
 #include "common_utils.h"
 
@@ -86,7 +87,8 @@ std::shared_ptr<HeifPixelImage>
 Op_YCbCr_to_RGB<Pixel>::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                            const ColorState& input_state,
                                            const ColorState& target_state,
-                                           const heif_color_conversion_options& options) const
+                                           const heif_color_conversion_options& options,
+                                           const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   bool hdr = !std::is_same<Pixel, uint8_t>::value;
 
@@ -131,8 +133,6 @@ Op_YCbCr_to_RGB<Pixel>::convert_colorspace(const std::shared_ptr<const HeifPixel
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   outimg->create(width, height, heif_colorspace_RGB, heif_chroma_444);
 
   if (!outimg->add_plane(heif_channel_R, width, height, bpp_y) ||
@@ -312,7 +312,8 @@ std::shared_ptr<HeifPixelImage>
 Op_YCbCr420_to_RGB24::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                          const ColorState& input_state,
                                          const ColorState& target_state,
-                                         const heif_color_conversion_options& options) const
+                                         const heif_color_conversion_options& options,
+                                         const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   if (input->get_bits_per_pixel(heif_channel_Y) != 8 ||
       input->get_bits_per_pixel(heif_channel_Cb) != 8 ||
@@ -320,8 +321,6 @@ Op_YCbCr420_to_RGB24::convert_colorspace(const std::shared_ptr<const HeifPixelIm
     return nullptr;
   }
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
@@ -354,9 +353,22 @@ Op_YCbCr420_to_RGB24::convert_colorspace(const std::shared_ptr<const HeifPixelIm
   in_cr = input->get_plane(heif_channel_Cr, &in_cr_stride);
   out_p = outimg->get_plane(heif_channel_interleaved, &out_p_stride);
 
+  YCbCr420_to_RGB24_row_kernel row_kernel = get_YCbCr420_to_RGB24_row_kernel();
+  const YCbCr_to_RGB8_coefficients kernel_coeffs{r_cr, g_cb, g_cr, b_cb};
+
   uint32_t x, y;
   for (y = 0; y < height; y++) {
-    for (x = 0; x < width; x++) {
+    x = 0;
+
+    if (row_kernel) {
+      x = row_kernel(in_y + y * in_y_stride,
+                     in_cb + y / 2 * in_cb_stride,
+                     in_cr + y / 2 * in_cr_stride,
+                     out_p + y * out_p_stride,
+                     width, kernel_coeffs);
+    }
+
+    for (; x < width; x++) {
       int yv = (in_y[y * in_y_stride + x]);
       int cb = (in_cb[y / 2 * in_cb_stride + x / 2] - 128);
       int cr = (in_cr[y / 2 * in_cr_stride + x / 2] - 128);
@@ -422,7 +434,8 @@ std::shared_ptr<HeifPixelImage>
 Op_YCbCr420_to_RGB32::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                          const ColorState& input_state,
                                          const ColorState& target_state,
-                                         const heif_color_conversion_options& options) const
+                                         const heif_color_conversion_options& options,
+                                         const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   if (input->get_bits_per_pixel(heif_channel_Y) != 8 ||
       input->get_bits_per_pixel(heif_channel_Cb) != 8 ||
@@ -430,8 +443,6 @@ Op_YCbCr420_to_RGB32::convert_colorspace(const std::shared_ptr<const HeifPixelIm
     return nullptr;
   }
 
-  auto outimg = std::make_shared<HeifPixelImage>();
-
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
 
@@ -474,9 +485,23 @@ Op_YCbCr420_to_RGB32::convert_colorspace(const std::shared_ptr<const HeifPixelIm
 
   out_p = outimg->get_plane(heif_channel_interleaved, &out_p_stride);
 
+  YCbCr420_to_RGB32_row_kernel row_kernel = get_YCbCr420_to_RGB32_row_kernel();
+  const YCbCr_to_RGB8_coefficients kernel_coeffs{r_cr, g_cb, g_cr, b_cb};
+
   uint32_t x, y;
   for (y = 0; y < height; y++) {
-    for (x = 0; x < width; x++) {
+    x = 0;
+
+    if (row_kernel) {
+      x = row_kernel(in_y + y * in_y_stride,
+                     in_cb + y / 2 * in_cb_stride,
+                     in_cr + y / 2 * in_cr_stride,
+                     with_alpha ? in_a + y * in_a_stride : nullptr,
+                     out_p + y * out_p_stride,
+                     width, kernel_coeffs);
+    }
+
+    for (; x < width; x++) {
 
       int yv = (in_y[y * in_y_stride + x]);
       int cb = (in_cb[y / 2 * in_cb_stride + x / 2] - 128);
@@ -556,7 +581,8 @@ std::shared_ptr<HeifPixelImage>
 Op_YCbCr420_to_RRGGBBaa::convert_colorspace(const std::shared_ptr<const HeifPixelImage>& input,
                                             const ColorState& input_state,
                                             const ColorState& target_state,
-                                            const heif_color_conversion_options& options) const
+                                            const heif_color_conversion_options& options,
+                                            const std::shared_ptr<HeifPixelImage>& outimg) const
 {
   uint32_t width = input->get_width();
   uint32_t height = input->get_height();
@@ -567,7 +593,6 @@ Op_YCbCr420_to_RRGGBBaa::convert_colorspace(const std::shared_ptr<const HeifPixe
   int le = (target_state.chroma == heif_chroma_interleaved_RRGGBB_LE ||
             target_state.chroma == heif_chroma_interleaved_RRGGBBAA_LE) ? 1 : 0;
 
-  auto outimg = std::make_shared<HeifPixelImage>();
   outimg->create(width, height, heif_colorspace_RGB, target_state.chroma);
 
   int bytesPerPixel = has_alpha ? 8 : 6;
@@ -611,8 +636,22 @@ Op_YCbCr420_to_RRGGBBaa::convert_colorspace(const std::shared_ptr<const HeifPixe
 
   float limited_range_offset = static_cast<float>(16 << (bpp - 8));
 
+  YCbCr420_to_RRGGBBaa_row_kernel row_kernel = get_YCbCr420_to_RRGGBBaa_row_kernel();
+  const YCbCr_to_RGB16_parameters kernel_params{bpp, full_range_flag, le == 0, coeffs};
+
   for (uint32_t y = 0; y < height; y++) {
-    for (uint32_t x = 0; x < width; x++) {
+    uint32_t x = 0;
+
+    if (row_kernel) {
+      x = row_kernel(in_y + y * in_y_stride / 2,
+                     in_cb + y / 2 * in_cb_stride / 2,
+                     in_cr + y / 2 * in_cr_stride / 2,
+                     has_alpha ? in_a + y * in_a_stride / 2 : nullptr,
+                     out_p + y * out_p_stride,
+                     width, kernel_params);
+    }
+
+    for (; x < width; x++) {
 
       float y_ = in_y[y * in_y_stride / 2 + x];
       float cb = static_cast<float>(in_cb[y / 2 * in_cb_stride / 2 + x / 2] - (1 << (bpp - 1)));
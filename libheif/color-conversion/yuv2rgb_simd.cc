@@ -0,0 +1,745 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "yuv2rgb_simd.h"
+#include "cpu_features.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if HAVE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+
+#if HAVE_X86_SIMD
+
+// ---------------------------------------------------------------------------
+//   SSE4.1
+// ---------------------------------------------------------------------------
+
+// Two 16 bit coefficients for _mm_madd_epi16() on interleaved (cb,cr) pairs.
+static inline int32_t coefficient_pair(int cb_coeff, int cr_coeff)
+{
+  return static_cast<int32_t>((static_cast<uint32_t>(static_cast<uint16_t>(cr_coeff)) << 16) |
+                              static_cast<uint16_t>(cb_coeff));
+}
+
+
+// Stores four vectors that each have 12 valid bytes in their lower part as 48 consecutive bytes.
+LIBHEIF_TARGET_SSE41
+static inline void store_4x12_bytes_sse(uint8_t* out, __m128i p0, __m128i p1, __m128i p2, __m128i p3)
+{
+  _mm_storeu_si128((__m128i*) (out + 0), _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+  _mm_storeu_si128((__m128i*) (out + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+  _mm_storeu_si128((__m128i*) (out + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+
+// Computes (coeffs * (cb,cr) + 128) >> 8 for 8 chroma samples.
+LIBHEIF_TARGET_SSE41
+static inline __m128i chroma_term_sse(__m128i cbcr_lo, __m128i cbcr_hi, __m128i coeff_pair)
+{
+  const __m128i round = _mm_set1_epi32(128);
+
+  __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cbcr_lo, coeff_pair), round), 8);
+  __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cbcr_hi, coeff_pair), round), 8);
+  return _mm_packs_epi32(lo, hi);
+}
+
+
+// Converts 16 pixels to 8 bit R,G,B vectors.
+LIBHEIF_TARGET_SSE41
+static inline void YCbCr420_to_RGB8_16_pixels_sse(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                                  __m128i coeff_r, __m128i coeff_g, __m128i coeff_b,
+                                                  __m128i& r, __m128i& g, __m128i& b)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i offset = _mm_set1_epi16(128);
+
+  __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) in_cb), zero), offset);
+  __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) in_cr), zero), offset);
+
+  __m128i cbcr_lo = _mm_unpacklo_epi16(cb, cr);
+  __m128i cbcr_hi = _mm_unpackhi_epi16(cb, cr);
+
+  __m128i dr = chroma_term_sse(cbcr_lo, cbcr_hi, coeff_r);
+  __m128i dg = chroma_term_sse(cbcr_lo, cbcr_hi, coeff_g);
+  __m128i db = chroma_term_sse(cbcr_lo, cbcr_hi, coeff_b);
+
+  __m128i yv = _mm_loadu_si128((const __m128i*) in_y);
+  __m128i y_lo = _mm_unpacklo_epi8(yv, zero);
+  __m128i y_hi = _mm_unpackhi_epi8(yv, zero);
+
+  // each chroma sample covers two luma samples
+
+  r = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(dr, dr)),
+                       _mm_add_epi16(y_hi, _mm_unpackhi_epi16(dr, dr)));
+  g = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(dg, dg)),
+                       _mm_add_epi16(y_hi, _mm_unpackhi_epi16(dg, dg)));
+  b = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(db, db)),
+                       _mm_add_epi16(y_hi, _mm_unpackhi_epi16(db, db)));
+}
+
+
+LIBHEIF_TARGET_SSE41
+static inline void interleave_RGBA8_sse(__m128i r, __m128i g, __m128i b, __m128i a,
+                                        __m128i& p0, __m128i& p1, __m128i& p2, __m128i& p3)
+{
+  __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+  __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+  __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+  __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+
+  p0 = _mm_unpacklo_epi16(rg_lo, ba_lo);
+  p1 = _mm_unpackhi_epi16(rg_lo, ba_lo);
+  p2 = _mm_unpacklo_epi16(rg_hi, ba_hi);
+  p3 = _mm_unpackhi_epi16(rg_hi, ba_hi);
+}
+
+
+LIBHEIF_TARGET_SSE41
+static uint32_t YCbCr420_to_RGB24_row_sse41(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                            uint8_t* out, uint32_t width,
+                                            const YCbCr_to_RGB8_coefficients& coeffs)
+{
+  const __m128i coeff_r = _mm_set1_epi32(coefficient_pair(0, coeffs.r_cr));
+  const __m128i coeff_g = _mm_set1_epi32(coefficient_pair(coeffs.g_cb, coeffs.g_cr));
+  const __m128i coeff_b = _mm_set1_epi32(coefficient_pair(coeffs.b_cb, 0));
+
+  const __m128i rgba_to_rgb = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+  uint32_t x;
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m128i r, g, b;
+    YCbCr420_to_RGB8_16_pixels_sse(in_y + x, in_cb + x / 2, in_cr + x / 2, coeff_r, coeff_g, coeff_b, r, g, b);
+
+    __m128i p0, p1, p2, p3;
+    interleave_RGBA8_sse(r, g, b, _mm_setzero_si128(), p0, p1, p2, p3);
+
+    store_4x12_bytes_sse(out + 3 * x,
+                         _mm_shuffle_epi8(p0, rgba_to_rgb),
+                         _mm_shuffle_epi8(p1, rgba_to_rgb),
+                         _mm_shuffle_epi8(p2, rgba_to_rgb),
+                         _mm_shuffle_epi8(p3, rgba_to_rgb));
+  }
+
+  return x;
+}
+
+
+LIBHEIF_TARGET_SSE41
+static uint32_t YCbCr420_to_RGB32_row_sse41(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                            const uint8_t* in_a,
+                                            uint8_t* out, uint32_t width,
+                                            const YCbCr_to_RGB8_coefficients& coeffs)
+{
+  const __m128i coeff_r = _mm_set1_epi32(coefficient_pair(0, coeffs.r_cr));
+  const __m128i coeff_g = _mm_set1_epi32(coefficient_pair(coeffs.g_cb, coeffs.g_cr));
+  const __m128i coeff_b = _mm_set1_epi32(coefficient_pair(coeffs.b_cb, 0));
+
+  uint32_t x;
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m128i r, g, b;
+    YCbCr420_to_RGB8_16_pixels_sse(in_y + x, in_cb + x / 2, in_cr + x / 2, coeff_r, coeff_g, coeff_b, r, g, b);
+
+    __m128i a = in_a ? _mm_loadu_si128((const __m128i*) (in_a + x)) : _mm_set1_epi8(-1);
+
+    __m128i p0, p1, p2, p3;
+    interleave_RGBA8_sse(r, g, b, a, p0, p1, p2, p3);
+
+    _mm_storeu_si128((__m128i*) (out + 4 * x + 0), p0);
+    _mm_storeu_si128((__m128i*) (out + 4 * x + 16), p1);
+    _mm_storeu_si128((__m128i*) (out + 4 * x + 32), p2);
+    _mm_storeu_si128((__m128i*) (out + 4 * x + 48), p3);
+  }
+
+  return x;
+}
+
+
+// Mirrors clip_f_u16(): round by adding 0.5 and truncating, then clip to [0;maxval].
+LIBHEIF_TARGET_SSE41
+static inline __m128i clip_f_u16_sse(__m128 v, __m128i maxval)
+{
+  __m128i i = _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+  return _mm_max_epi32(_mm_min_epi32(i, maxval), _mm_setzero_si128());
+}
+
+
+// Stores 8 pixels of 16 bit R,G,B(,A) components in the byte order given by 'shuffle'.
+LIBHEIF_TARGET_SSE41
+static inline void store_RRGGBBaa_8_pixels_sse(uint8_t* out, __m128i r, __m128i g, __m128i b, const __m128i* a,
+                                               __m128i shuffle)
+{
+  __m128i rg_lo = _mm_unpacklo_epi16(r, g);
+  __m128i rg_hi = _mm_unpackhi_epi16(r, g);
+  __m128i ba_lo = _mm_unpacklo_epi16(b, a ? *a : _mm_setzero_si128());
+  __m128i ba_hi = _mm_unpackhi_epi16(b, a ? *a : _mm_setzero_si128());
+
+  __m128i p0 = _mm_shuffle_epi8(_mm_unpacklo_epi32(rg_lo, ba_lo), shuffle);
+  __m128i p1 = _mm_shuffle_epi8(_mm_unpackhi_epi32(rg_lo, ba_lo), shuffle);
+  __m128i p2 = _mm_shuffle_epi8(_mm_unpacklo_epi32(rg_hi, ba_hi), shuffle);
+  __m128i p3 = _mm_shuffle_epi8(_mm_unpackhi_epi32(rg_hi, ba_hi), shuffle);
+
+  if (a) {
+    _mm_storeu_si128((__m128i*) (out + 0), p0);
+    _mm_storeu_si128((__m128i*) (out + 16), p1);
+    _mm_storeu_si128((__m128i*) (out + 32), p2);
+    _mm_storeu_si128((__m128i*) (out + 48), p3);
+  }
+  else {
+    store_4x12_bytes_sse(out, p0, p1, p2, p3);
+  }
+}
+
+
+// Byte shuffle from native little endian RGBA (2 pixels of 4 x 16 bit) to the output format.
+LIBHEIF_TARGET_SSE41
+static inline __m128i RRGGBBaa_shuffle_sse(bool with_alpha, bool big_endian)
+{
+  if (with_alpha) {
+    return big_endian ?
+           _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14) :
+           _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  }
+  else {
+    return big_endian ?
+           _mm_setr_epi8(1, 0, 3, 2, 5, 4, 9, 8, 11, 10, 13, 12, -1, -1, -1, -1) :
+           _mm_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1);
+  }
+}
+
+
+LIBHEIF_TARGET_SSE41
+static uint32_t YCbCr420_to_RRGGBBaa_row_sse41(const uint16_t* in_y, const uint16_t* in_cb, const uint16_t* in_cr,
+                                               const uint16_t* in_a,
+                                               uint8_t* out, uint32_t width,
+                                               const YCbCr_to_RGB16_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+  const int bytes_per_pixel = in_a ? 8 : 6;
+
+  const __m128i maxval = _mm_set1_epi32((1 << bpp) - 1);
+  const __m128i chroma_offset = _mm_set1_epi32(1 << (bpp - 1));
+  const __m128 limited_range_offset = _mm_set1_ps(static_cast<float>(16 << (bpp - 8)));
+  const __m128 y_scale = _mm_set1_ps(1.1689f);
+  const __m128 c_scale = _mm_set1_ps(1.1429f);
+
+  const __m128 r_cr = _mm_set1_ps(params.coeffs.r_cr);
+  const __m128 g_cb = _mm_set1_ps(params.coeffs.g_cb);
+  const __m128 g_cr = _mm_set1_ps(params.coeffs.g_cr);
+  const __m128 b_cb = _mm_set1_ps(params.coeffs.b_cb);
+
+  const __m128i shuffle = RRGGBBaa_shuffle_sse(in_a != nullptr, params.big_endian);
+
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m128i yv = _mm_loadu_si128((const __m128i*) (in_y + x));
+    __m128 y_lo = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(yv));
+    __m128 y_hi = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(yv, 8)));
+
+    __m128 cb = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) (in_cb + x / 2))),
+                                              chroma_offset));
+    __m128 cr = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) (in_cr + x / 2))),
+                                              chroma_offset));
+
+    if (!params.full_range) {
+      y_lo = _mm_mul_ps(_mm_sub_ps(y_lo, limited_range_offset), y_scale);
+      y_hi = _mm_mul_ps(_mm_sub_ps(y_hi, limited_range_offset), y_scale);
+      cb = _mm_mul_ps(cb, c_scale);
+      cr = _mm_mul_ps(cr, c_scale);
+    }
+
+    __m128 dr = _mm_mul_ps(r_cr, cr);
+    __m128 dg_cb = _mm_mul_ps(g_cb, cb);
+    __m128 dg_cr = _mm_mul_ps(g_cr, cr);
+    __m128 db = _mm_mul_ps(b_cb, cb);
+
+    // same order of additions as in the scalar code
+
+    __m128i r = _mm_packus_epi32(clip_f_u16_sse(_mm_add_ps(y_lo, _mm_unpacklo_ps(dr, dr)), maxval),
+                                 clip_f_u16_sse(_mm_add_ps(y_hi, _mm_unpackhi_ps(dr, dr)), maxval));
+    __m128i g = _mm_packus_epi32(clip_f_u16_sse(_mm_add_ps(_mm_add_ps(y_lo, _mm_unpacklo_ps(dg_cb, dg_cb)),
+                                                           _mm_unpacklo_ps(dg_cr, dg_cr)), maxval),
+                                 clip_f_u16_sse(_mm_add_ps(_mm_add_ps(y_hi, _mm_unpackhi_ps(dg_cb, dg_cb)),
+                                                           _mm_unpackhi_ps(dg_cr, dg_cr)), maxval));
+    __m128i b = _mm_packus_epi32(clip_f_u16_sse(_mm_add_ps(y_lo, _mm_unpacklo_ps(db, db)), maxval),
+                                 clip_f_u16_sse(_mm_add_ps(y_hi, _mm_unpackhi_ps(db, db)), maxval));
+
+    if (in_a) {
+      __m128i a = _mm_loadu_si128((const __m128i*) (in_a + x));
+      store_RRGGBBaa_8_pixels_sse(out + bytes_per_pixel * x, r, g, b, &a, shuffle);
+    }
+    else {
+      store_RRGGBBaa_8_pixels_sse(out + bytes_per_pixel * x, r, g, b, nullptr, shuffle);
+    }
+  }
+
+  return x;
+}
+
+
+// ---------------------------------------------------------------------------
+//   AVX2
+// ---------------------------------------------------------------------------
+
+LIBHEIF_TARGET_AVX2
+static inline __m256i chroma_term_avx2(__m256i cbcr_lo, __m256i cbcr_hi, __m256i coeff_pair)
+{
+  const __m256i round = _mm256_set1_epi32(128);
+
+  __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cbcr_lo, coeff_pair), round), 8);
+  __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cbcr_hi, coeff_pair), round), 8);
+  return _mm256_packs_epi32(lo, hi);
+}
+
+
+// Converts 32 pixels to 8 bit R,G,B vectors.
+// All unpack and pack operations work within 128 bit lanes. Since the chroma terms, the luma
+// samples and the packed results are split into lanes the same way, the output is in pixel order.
+LIBHEIF_TARGET_AVX2
+static inline void YCbCr420_to_RGB8_32_pixels_avx2(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                                   __m256i coeff_r, __m256i coeff_g, __m256i coeff_b,
+                                                   __m256i& r, __m256i& g, __m256i& b)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i offset = _mm256_set1_epi16(128);
+
+  __m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) in_cb)), offset);
+  __m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) in_cr)), offset);
+
+  __m256i cbcr_lo = _mm256_unpacklo_epi16(cb, cr);
+  __m256i cbcr_hi = _mm256_unpackhi_epi16(cb, cr);
+
+  __m256i dr = chroma_term_avx2(cbcr_lo, cbcr_hi, coeff_r);
+  __m256i dg = chroma_term_avx2(cbcr_lo, cbcr_hi, coeff_g);
+  __m256i db = chroma_term_avx2(cbcr_lo, cbcr_hi, coeff_b);
+
+  __m256i yv = _mm256_loadu_si256((const __m256i*) in_y);
+  __m256i y_lo = _mm256_unpacklo_epi8(yv, zero);
+  __m256i y_hi = _mm256_unpackhi_epi8(yv, zero);
+
+  r = _mm256_packus_epi16(_mm256_add_epi16(y_lo, _mm256_unpacklo_epi16(dr, dr)),
+                          _mm256_add_epi16(y_hi, _mm256_unpackhi_epi16(dr, dr)));
+  g = _mm256_packus_epi16(_mm256_add_epi16(y_lo, _mm256_unpacklo_epi16(dg, dg)),
+                          _mm256_add_epi16(y_hi, _mm256_unpackhi_epi16(dg, dg)));
+  b = _mm256_packus_epi16(_mm256_add_epi16(y_lo, _mm256_unpacklo_epi16(db, db)),
+                          _mm256_add_epi16(y_hi, _mm256_unpackhi_epi16(db, db)));
+}
+
+
+// The results hold pixels [0-3|16-19], [4-7|20-23], [8-11|24-27], [12-15|28-31].
+LIBHEIF_TARGET_AVX2
+static inline void interleave_RGBA8_avx2(__m256i r, __m256i g, __m256i b, __m256i a,
+                                         __m256i& p0, __m256i& p1, __m256i& p2, __m256i& p3)
+{
+  __m256i rg_lo = _mm256_unpacklo_epi8(r, g);
+  __m256i rg_hi = _mm256_unpackhi_epi8(r, g);
+  __m256i ba_lo = _mm256_unpacklo_epi8(b, a);
+  __m256i ba_hi = _mm256_unpackhi_epi8(b, a);
+
+  p0 = _mm256_unpacklo_epi16(rg_lo, ba_lo);
+  p1 = _mm256_unpackhi_epi16(rg_lo, ba_lo);
+  p2 = _mm256_unpacklo_epi16(rg_hi, ba_hi);
+  p3 = _mm256_unpackhi_epi16(rg_hi, ba_hi);
+}
+
+
+LIBHEIF_TARGET_AVX2
+static uint32_t YCbCr420_to_RGB24_row_avx2(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                           uint8_t* out, uint32_t width,
+                                           const YCbCr_to_RGB8_coefficients& coeffs)
+{
+  const __m256i coeff_r = _mm256_set1_epi32(coefficient_pair(0, coeffs.r_cr));
+  const __m256i coeff_g = _mm256_set1_epi32(coefficient_pair(coeffs.g_cb, coeffs.g_cr));
+  const __m256i coeff_b = _mm256_set1_epi32(coefficient_pair(coeffs.b_cb, 0));
+
+  const __m256i rgba_to_rgb = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                               0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+  uint32_t x;
+  for (x = 0; x + 32 <= width; x += 32) {
+    __m256i r, g, b;
+    YCbCr420_to_RGB8_32_pixels_avx2(in_y + x, in_cb + x / 2, in_cr + x / 2, coeff_r, coeff_g, coeff_b, r, g, b);
+
+    __m256i p0, p1, p2, p3;
+    interleave_RGBA8_avx2(r, g, b, _mm256_setzero_si256(), p0, p1, p2, p3);
+
+    p0 = _mm256_shuffle_epi8(p0, rgba_to_rgb);
+    p1 = _mm256_shuffle_epi8(p1, rgba_to_rgb);
+    p2 = _mm256_shuffle_epi8(p2, rgba_to_rgb);
+    p3 = _mm256_shuffle_epi8(p3, rgba_to_rgb);
+
+    store_4x12_bytes_sse(out + 3 * x,
+                         _mm256_castsi256_si128(p0), _mm256_castsi256_si128(p1),
+                         _mm256_castsi256_si128(p2), _mm256_castsi256_si128(p3));
+    store_4x12_bytes_sse(out + 3 * x + 48,
+                         _mm256_extracti128_si256(p0, 1), _mm256_extracti128_si256(p1, 1),
+                         _mm256_extracti128_si256(p2, 1), _mm256_extracti128_si256(p3, 1));
+  }
+
+  return x;
+}
+
+
+LIBHEIF_TARGET_AVX2
+static uint32_t YCbCr420_to_RGB32_row_avx2(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                           const uint8_t* in_a,
+                                           uint8_t* out, uint32_t width,
+                                           const YCbCr_to_RGB8_coefficients& coeffs)
+{
+  const __m256i coeff_r = _mm256_set1_epi32(coefficient_pair(0, coeffs.r_cr));
+  const __m256i coeff_g = _mm256_set1_epi32(coefficient_pair(coeffs.g_cb, coeffs.g_cr));
+  const __m256i coeff_b = _mm256_set1_epi32(coefficient_pair(coeffs.b_cb, 0));
+
+  uint32_t x;
+  for (x = 0; x + 32 <= width; x += 32) {
+    __m256i r, g, b;
+    YCbCr420_to_RGB8_32_pixels_avx2(in_y + x, in_cb + x / 2, in_cr + x / 2, coeff_r, coeff_g, coeff_b, r, g, b);
+
+    __m256i a = in_a ? _mm256_loadu_si256((const __m256i*) (in_a + x)) : _mm256_set1_epi8(-1);
+
+    __m256i p0, p1, p2, p3;
+    interleave_RGBA8_avx2(r, g, b, a, p0, p1, p2, p3);
+
+    _mm256_storeu_si256((__m256i*) (out + 4 * x + 0), _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256((__m256i*) (out + 4 * x + 32), _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256((__m256i*) (out + 4 * x + 64), _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256((__m256i*) (out + 4 * x + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+  }
+
+  return x;
+}
+
+
+LIBHEIF_TARGET_AVX2
+static inline __m256i clip_f_u16_avx2(__m256 v, __m256i maxval)
+{
+  __m256i i = _mm256_cvttps_epi32(_mm256_add_ps(v, _mm256_set1_ps(0.5f)));
+  return _mm256_max_epi32(_mm256_min_epi32(i, maxval), _mm256_setzero_si256());
+}
+
+
+// Packs two vectors of 8 x 32 bit into 16 x 16 bit in pixel order.
+LIBHEIF_TARGET_AVX2
+static inline __m256i pack_u16_avx2(__m256i lo, __m256i hi)
+{
+  return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+}
+
+
+LIBHEIF_TARGET_AVX2
+static uint32_t YCbCr420_to_RRGGBBaa_row_avx2(const uint16_t* in_y, const uint16_t* in_cb, const uint16_t* in_cr,
+                                              const uint16_t* in_a,
+                                              uint8_t* out, uint32_t width,
+                                              const YCbCr_to_RGB16_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+  const int bytes_per_pixel = in_a ? 8 : 6;
+
+  const __m256i maxval = _mm256_set1_epi32((1 << bpp) - 1);
+  const __m256i chroma_offset = _mm256_set1_epi32(1 << (bpp - 1));
+  const __m256 limited_range_offset = _mm256_set1_ps(static_cast<float>(16 << (bpp - 8)));
+  const __m256 y_scale = _mm256_set1_ps(1.1689f);
+  const __m256 c_scale = _mm256_set1_ps(1.1429f);
+
+  const __m256 r_cr = _mm256_set1_ps(params.coeffs.r_cr);
+  const __m256 g_cb = _mm256_set1_ps(params.coeffs.g_cb);
+  const __m256 g_cr = _mm256_set1_ps(params.coeffs.g_cr);
+  const __m256 b_cb = _mm256_set1_ps(params.coeffs.b_cb);
+
+  const __m256i dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+  const __m256i dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+  const __m128i shuffle = RRGGBBaa_shuffle_sse(in_a != nullptr, params.big_endian);
+
+  uint32_t x;
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m256i yv = _mm256_loadu_si256((const __m256i*) (in_y + x));
+    __m256 y_lo = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(yv)));
+    __m256 y_hi = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(yv, 1)));
+
+    __m256 cb = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (in_cb + x / 2))),
+                                                    chroma_offset));
+    __m256 cr = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (in_cr + x / 2))),
+                                                    chroma_offset));
+
+    if (!params.full_range) {
+      y_lo = _mm256_mul_ps(_mm256_sub_ps(y_lo, limited_range_offset), y_scale);
+      y_hi = _mm256_mul_ps(_mm256_sub_ps(y_hi, limited_range_offset), y_scale);
+      cb = _mm256_mul_ps(cb, c_scale);
+      cr = _mm256_mul_ps(cr, c_scale);
+    }
+
+    __m256 dr = _mm256_mul_ps(r_cr, cr);
+    __m256 dg_cb = _mm256_mul_ps(g_cb, cb);
+    __m256 dg_cr = _mm256_mul_ps(g_cr, cr);
+    __m256 db = _mm256_mul_ps(b_cb, cb);
+
+    __m256i r = pack_u16_avx2(
+        clip_f_u16_avx2(_mm256_add_ps(y_lo, _mm256_permutevar8x32_ps(dr, dup_lo)), maxval),
+        clip_f_u16_avx2(_mm256_add_ps(y_hi, _mm256_permutevar8x32_ps(dr, dup_hi)), maxval));
+    __m256i g = pack_u16_avx2(
+        clip_f_u16_avx2(_mm256_add_ps(_mm256_add_ps(y_lo, _mm256_permutevar8x32_ps(dg_cb, dup_lo)),
+                                      _mm256_permutevar8x32_ps(dg_cr, dup_lo)), maxval),
+        clip_f_u16_avx2(_mm256_add_ps(_mm256_add_ps(y_hi, _mm256_permutevar8x32_ps(dg_cb, dup_hi)),
+                                      _mm256_permutevar8x32_ps(dg_cr, dup_hi)), maxval));
+    __m256i b = pack_u16_avx2(
+        clip_f_u16_avx2(_mm256_add_ps(y_lo, _mm256_permutevar8x32_ps(db, dup_lo)), maxval),
+        clip_f_u16_avx2(_mm256_add_ps(y_hi, _mm256_permutevar8x32_ps(db, dup_hi)), maxval));
+
+    uint8_t* out_x = out + bytes_per_pixel * x;
+
+    if (in_a) {
+      __m256i a = _mm256_loadu_si256((const __m256i*) (in_a + x));
+      __m128i a_lo = _mm256_castsi256_si128(a);
+      __m128i a_hi = _mm256_extracti128_si256(a, 1);
+
+      store_RRGGBBaa_8_pixels_sse(out_x, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g),
+                                  _mm256_castsi256_si128(b), &a_lo, shuffle);
+      store_RRGGBBaa_8_pixels_sse(out_x + 8 * bytes_per_pixel, _mm256_extracti128_si256(r, 1),
+                                  _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1), &a_hi, shuffle);
+    }
+    else {
+      store_RRGGBBaa_8_pixels_sse(out_x, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g),
+                                  _mm256_castsi256_si128(b), nullptr, shuffle);
+      store_RRGGBBaa_8_pixels_sse(out_x + 8 * bytes_per_pixel, _mm256_extracti128_si256(r, 1),
+                                  _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1), nullptr, shuffle);
+    }
+  }
+
+  return x;
+}
+
+#endif
+
+
+#if HAVE_NEON_SIMD
+
+// ---------------------------------------------------------------------------
+//   NEON
+// ---------------------------------------------------------------------------
+
+// Converts 16 pixels to 8 bit R,G,B vectors.
+static inline void YCbCr420_to_RGB8_16_pixels_neon(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                                   const YCbCr_to_RGB8_coefficients& coeffs,
+                                                   uint8x16_t& r, uint8x16_t& g, uint8x16_t& b)
+{
+  const uint8x8_t offset = vdup_n_u8(128);
+
+  int16x8_t cb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(in_cb), offset));
+  int16x8_t cr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(in_cr), offset));
+
+  int16x4_t cb_lo = vget_low_s16(cb), cb_hi = vget_high_s16(cb);
+  int16x4_t cr_lo = vget_low_s16(cr), cr_hi = vget_high_s16(cr);
+
+  // vrshrn computes (x + 128) >> 8
+
+  int16x8_t dr = vcombine_s16(vrshrn_n_s32(vmull_n_s16(cr_lo, (int16_t) coeffs.r_cr), 8),
+                              vrshrn_n_s32(vmull_n_s16(cr_hi, (int16_t) coeffs.r_cr), 8));
+  int16x8_t dg = vcombine_s16(vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(cb_lo, (int16_t) coeffs.g_cb), cr_lo, (int16_t) coeffs.g_cr), 8),
+                              vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(cb_hi, (int16_t) coeffs.g_cb), cr_hi, (int16_t) coeffs.g_cr), 8));
+  int16x8_t db = vcombine_s16(vrshrn_n_s32(vmull_n_s16(cb_lo, (int16_t) coeffs.b_cb), 8),
+                              vrshrn_n_s32(vmull_n_s16(cb_hi, (int16_t) coeffs.b_cb), 8));
+
+  uint8x16_t yv = vld1q_u8(in_y);
+  int16x8_t y_lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yv)));
+  int16x8_t y_hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yv)));
+
+  r = vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, vzip1q_s16(dr, dr))),
+                  vqmovun_s16(vaddq_s16(y_hi, vzip2q_s16(dr, dr))));
+  g = vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, vzip1q_s16(dg, dg))),
+                  vqmovun_s16(vaddq_s16(y_hi, vzip2q_s16(dg, dg))));
+  b = vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, vzip1q_s16(db, db))),
+                  vqmovun_s16(vaddq_s16(y_hi, vzip2q_s16(db, db))));
+}
+
+
+static uint32_t YCbCr420_to_RGB24_row_neon(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                           uint8_t* out, uint32_t width,
+                                           const YCbCr_to_RGB8_coefficients& coeffs)
+{
+  uint32_t x;
+  for (x = 0; x + 16 <= width; x += 16) {
+    uint8x16x3_t rgb;
+    YCbCr420_to_RGB8_16_pixels_neon(in_y + x, in_cb + x / 2, in_cr + x / 2, coeffs, rgb.val[0], rgb.val[1], rgb.val[2]);
+    vst3q_u8(out + 3 * x, rgb);
+  }
+
+  return x;
+}
+
+
+static uint32_t YCbCr420_to_RGB32_row_neon(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                           const uint8_t* in_a,
+                                           uint8_t* out, uint32_t width,
+                                           const YCbCr_to_RGB8_coefficients& coeffs)
+{
+  uint32_t x;
+  for (x = 0; x + 16 <= width; x += 16) {
+    uint8x16x4_t rgba;
+    YCbCr420_to_RGB8_16_pixels_neon(in_y + x, in_cb + x / 2, in_cr + x / 2, coeffs, rgba.val[0], rgba.val[1], rgba.val[2]);
+    rgba.val[3] = in_a ? vld1q_u8(in_a + x) : vdupq_n_u8(0xFF);
+    vst4q_u8(out + 4 * x, rgba);
+  }
+
+  return x;
+}
+
+
+static inline uint16x4_t clip_f_u16_neon(float32x4_t v, int32x4_t maxval)
+{
+  int32x4_t i = vcvtq_s32_f32(vaddq_f32(v, vdupq_n_f32(0.5f)));
+  return vqmovun_s32(vminq_s32(i, maxval));
+}
+
+
+static inline uint16x8_t swap_bytes_neon(uint16x8_t v)
+{
+  return vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v)));
+}
+
+
+static uint32_t YCbCr420_to_RRGGBBaa_row_neon(const uint16_t* in_y, const uint16_t* in_cb, const uint16_t* in_cr,
+                                              const uint16_t* in_a,
+                                              uint8_t* out, uint32_t width,
+                                              const YCbCr_to_RGB16_parameters& params)
+{
+  const int bpp = params.bits_per_pixel;
+  const int bytes_per_pixel = in_a ? 8 : 6;
+
+  const int32x4_t maxval = vdupq_n_s32((1 << bpp) - 1);
+  const int32x4_t chroma_offset = vdupq_n_s32(1 << (bpp - 1));
+  const float32x4_t limited_range_offset = vdupq_n_f32(static_cast<float>(16 << (bpp - 8)));
+
+  uint32_t x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint16x8_t yv = vld1q_u16(in_y + x);
+    float32x4_t y_lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(yv)));
+    float32x4_t y_hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(yv)));
+
+    float32x4_t cb = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(vld1_u16(in_cb + x / 2))), chroma_offset));
+    float32x4_t cr = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(vld1_u16(in_cr + x / 2))), chroma_offset));
+
+    if (!params.full_range) {
+      y_lo = vmulq_n_f32(vsubq_f32(y_lo, limited_range_offset), 1.1689f);
+      y_hi = vmulq_n_f32(vsubq_f32(y_hi, limited_range_offset), 1.1689f);
+      cb = vmulq_n_f32(cb, 1.1429f);
+      cr = vmulq_n_f32(cr, 1.1429f);
+    }
+
+    float32x4_t dr = vmulq_n_f32(cr, params.coeffs.r_cr);
+    float32x4_t dg_cb = vmulq_n_f32(cb, params.coeffs.g_cb);
+    float32x4_t dg_cr = vmulq_n_f32(cr, params.coeffs.g_cr);
+    float32x4_t db = vmulq_n_f32(cb, params.coeffs.b_cb);
+
+    uint16x8_t r = vcombine_u16(clip_f_u16_neon(vaddq_f32(y_lo, vzip1q_f32(dr, dr)), maxval),
+                                clip_f_u16_neon(vaddq_f32(y_hi, vzip2q_f32(dr, dr)), maxval));
+    uint16x8_t g = vcombine_u16(clip_f_u16_neon(vaddq_f32(vaddq_f32(y_lo, vzip1q_f32(dg_cb, dg_cb)), vzip1q_f32(dg_cr, dg_cr)), maxval),
+                                clip_f_u16_neon(vaddq_f32(vaddq_f32(y_hi, vzip2q_f32(dg_cb, dg_cb)), vzip2q_f32(dg_cr, dg_cr)), maxval));
+    uint16x8_t b = vcombine_u16(clip_f_u16_neon(vaddq_f32(y_lo, vzip1q_f32(db, db)), maxval),
+                                clip_f_u16_neon(vaddq_f32(y_hi, vzip2q_f32(db, db)), maxval));
+
+    if (params.big_endian) {
+      r = swap_bytes_neon(r);
+      g = swap_bytes_neon(g);
+      b = swap_bytes_neon(b);
+    }
+
+    uint16_t* out_x = reinterpret_cast<uint16_t*>(out + bytes_per_pixel * x);
+
+    if (in_a) {
+      uint16x8_t a = vld1q_u16(in_a + x);
+      if (params.big_endian) {
+        a = swap_bytes_neon(a);
+      }
+
+      uint16x8x4_t rgba{{r, g, b, a}};
+      vst4q_u16(out_x, rgba);
+    }
+    else {
+      uint16x8x3_t rgb{{r, g, b}};
+      vst3q_u16(out_x, rgb);
+    }
+  }
+
+  return x;
+}
+
+#endif
+
+
+YCbCr420_to_RGB24_row_kernel get_YCbCr420_to_RGB24_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+      return YCbCr420_to_RGB24_row_avx2;
+    case SimdLevel::SSE41:
+      return YCbCr420_to_RGB24_row_sse41;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return YCbCr420_to_RGB24_row_neon;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+
+YCbCr420_to_RGB32_row_kernel get_YCbCr420_to_RGB32_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+      return YCbCr420_to_RGB32_row_avx2;
+    case SimdLevel::SSE41:
+      return YCbCr420_to_RGB32_row_sse41;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return YCbCr420_to_RGB32_row_neon;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+
+YCbCr420_to_RRGGBBaa_row_kernel get_YCbCr420_to_RRGGBBaa_row_kernel()
+{
+  switch (get_simd_level()) {
+#if HAVE_X86_SIMD
+    case SimdLevel::AVX2:
+      return YCbCr420_to_RRGGBBaa_row_avx2;
+    case SimdLevel::SSE41:
+      return YCbCr420_to_RRGGBBaa_row_sse41;
+#endif
+#if HAVE_NEON_SIMD
+    case SimdLevel::NEON:
+      return YCbCr420_to_RRGGBBaa_row_neon;
+#endif
+    default:
+      return nullptr;
+  }
+}
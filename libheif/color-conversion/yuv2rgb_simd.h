@@ -0,0 +1,82 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_COLORCONVERSION_YUV2RGB_SIMD_H
+#define LIBHEIF_COLORCONVERSION_YUV2RGB_SIMD_H
+
+#include <cstdint>
+#include "nclx.h"
+
+
+// Vectorized row kernels for the 4:2:0 YCbCr -> RGB conversions in yuv2rgb.cc.
+//
+// Each kernel converts as many pixels from the start of a row as fit into its vector width
+// and returns the number of converted pixels. The remaining pixels at the end of the row have
+// to be converted by the scalar code, which also serves as the reference implementation.
+// The chroma pointers point to the chroma row that belongs to the luma row.
+
+
+// 8 bit: coefficients scaled by 256, exactly as in the scalar code. The kernels are bit-exact.
+struct YCbCr_to_RGB8_coefficients
+{
+  int r_cr;
+  int g_cb;
+  int g_cr;
+  int b_cb;
+};
+
+typedef uint32_t (* YCbCr420_to_RGB24_row_kernel)(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                                   uint8_t* out, uint32_t width,
+                                                   const YCbCr_to_RGB8_coefficients& coeffs);
+
+// 'in_a' may be nullptr, in which case alpha is set to 0xFF.
+typedef uint32_t (* YCbCr420_to_RGB32_row_kernel)(const uint8_t* in_y, const uint8_t* in_cb, const uint8_t* in_cr,
+                                                   const uint8_t* in_a,
+                                                   uint8_t* out, uint32_t width,
+                                                   const YCbCr_to_RGB8_coefficients& coeffs);
+
+
+// High bit depth: the same single precision arithmetic as the scalar code.
+// The results are bit-exact unless the compiler contracts the scalar code into fused multiply-adds.
+struct YCbCr_to_RGB16_parameters
+{
+  int bits_per_pixel;
+  bool full_range;
+  bool big_endian;
+
+  YCbCr_to_RGB_coefficients coeffs;
+};
+
+// 'in_a' may be nullptr, in which case the output has no alpha component (RRGGBB instead of RRGGBBAA).
+typedef uint32_t (* YCbCr420_to_RRGGBBaa_row_kernel)(const uint16_t* in_y, const uint16_t* in_cb, const uint16_t* in_cr,
+                                                      const uint16_t* in_a,
+                                                      uint8_t* out, uint32_t width,
+                                                      const YCbCr_to_RGB16_parameters& params);
+
+
+// These return nullptr if there is no kernel for the SIMD level of the CPU.
+
+YCbCr420_to_RGB24_row_kernel get_YCbCr420_to_RGB24_row_kernel();
+
+YCbCr420_to_RGB32_row_kernel get_YCbCr420_to_RGB32_row_kernel();
+
+YCbCr420_to_RRGGBBaa_row_kernel get_YCbCr420_to_RRGGBBaa_row_kernel();
+
+#endif
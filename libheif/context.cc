@@ -37,6 +37,9 @@
 #include <future>
 #endif
 
+#include "thread_pool.h"
+#include "codecs/decoder.h"
+
 #include "context.h"
 #include "file.h"
 #include "pixelimage.h"
@@ -93,14 +96,93 @@ struct heif_error heif_encoder::alloc()
 }
 
 
+Result<std::shared_ptr<heif_encoder>> heif_encoder::clone() const
+{
+  auto copy = std::make_shared<heif_encoder>(plugin);
+  struct heif_error err = copy->alloc();
+  if (err.code) {
+    return Error(err.code, err.subcode, err.message ? err.message : "");
+  }
+
+  for (const auto& param : parameter_assignments) {
+    switch (param.type) {
+      case ParameterAssignment::Type::quality:
+        err = plugin->set_parameter_quality(copy->encoder, param.int_value);
+        break;
+      case ParameterAssignment::Type::lossless:
+        err = plugin->set_parameter_lossless(copy->encoder, param.int_value);
+        break;
+      case ParameterAssignment::Type::logging_level:
+        err = plugin->set_parameter_logging_level(copy->encoder, param.int_value);
+        break;
+      case ParameterAssignment::Type::integer:
+        err = plugin->set_parameter_integer(copy->encoder, param.name.c_str(), param.int_value);
+        break;
+      case ParameterAssignment::Type::boolean:
+        err = plugin->set_parameter_boolean(copy->encoder, param.name.c_str(), param.int_value);
+        break;
+      case ParameterAssignment::Type::string:
+        err = plugin->set_parameter_string(copy->encoder, param.name.c_str(), param.string_value.c_str());
+        break;
+    }
+
+    if (err.code) {
+      return Error(err.code, err.subcode, err.message ? err.message : "");
+    }
+  }
+
+  copy->parameter_assignments = parameter_assignments;
+
+  return copy;
+}
+
+
 HeifContext::HeifContext()
 {
   m_limits = global_security_limits;
 
+  m_decoder_instance_pool = std::make_shared<DecoderInstancePool>();
+
   reset_to_empty_heif();
 }
 
 
+void HeifContext::set_image_allocator(std::shared_ptr<ImageAllocator> allocator)
+{
+  m_image_allocator = std::move(allocator);
+
+  if (m_image_buffer_pool) {
+    set_image_buffer_pool(m_image_buffer_pool->get_max_cached_bytes());
+  }
+}
+
+
+void HeifContext::set_image_buffer_pool(size_t max_cached_bytes)
+{
+  if (max_cached_bytes == 0) {
+    m_image_buffer_pool.reset();
+  }
+  else {
+    m_image_buffer_pool = std::make_shared<PooledImageAllocator>(m_image_allocator ? m_image_allocator : get_global_base_image_allocator(),
+                                                                 max_cached_bytes);
+  }
+}
+
+
+std::shared_ptr<ImageAllocator> HeifContext::get_image_allocator() const
+{
+  if (m_image_buffer_pool) {
+    return m_image_buffer_pool;
+  }
+  else if (m_image_allocator) {
+    return m_image_allocator;
+  }
+  else {
+    return get_global_image_allocator();
+  }
+}
+
+
 HeifContext::~HeifContext()
 {
   // Break circular references between Images (when a faulty input image has circular image references)
@@ -136,10 +218,126 @@ void HeifContext::set_security_limits(const heif_security_limits* limits)
 }
 
 
+void HeifContext::set_max_decoding_threads(int max_threads)
+{
+  // Decodes that are still running keep their reference to the old pool.
+  // It is destroyed after the lock is released, when the last of them has finished.
+  std::shared_ptr<ThreadPool> old_pool;
+
+  {
+#if ENABLE_PARALLEL_TILE_DECODING
+    std::lock_guard<std::mutex> lock(m_thread_pool_mutex);
+#endif
+
+    m_decoding_threads_set = true;
+
+    if (max_threads != m_max_decoding_threads) {
+      m_max_decoding_threads = max_threads;
+
+      // the pool will be recreated with the new size on next use
+      old_pool.swap(m_thread_pool);
+    }
+  }
+}
+
+
+std::map<std::string, std::string> HeifContext::get_decoder_parameters(const heif_decoding_options& options) const
+{
+  std::map<std::string, std::string> parameters;
+
+  // Without an explicit setting, the decoders choose their number of threads themselves.
+  if (m_decoding_threads_set) {
+    int num_threads = std::max(m_max_decoding_threads.load(), 1);
+
+#if ENABLE_PARALLEL_TILE_DECODING
+    {
+      std::lock_guard<std::mutex> lock(m_thread_pool_mutex);
+
+      if (m_thread_pool && m_thread_pool->is_worker_thread()) {
+        num_threads = 1;
+      }
+    }
+#endif
+
+    parameters[heif_decoder_parameter_name_threads] = std::to_string(num_threads);
+  }
+
+  if (options.decoder_parameters) {
+    for (const char* const* p = options.decoder_parameters; p[0] && p[1]; p += 2) {
+      parameters[p[0]] = p[1];
+    }
+  }
+
+  return parameters;
+}
+
+
+void HeifContext::set_thread_pool(std::shared_ptr<ThreadPool> pool)
+{
+  {
+#if ENABLE_PARALLEL_TILE_DECODING
+    std::lock_guard<std::mutex> lock(m_thread_pool_mutex);
+#endif
+
+    m_max_decoding_threads = pool ? pool->get_num_threads() : 0;
+    m_decoding_threads_set = true;
+    pool.swap(m_thread_pool);
+  }
+
+  // 'pool' now holds the previous pool, which is released outside of the lock
+}
+
+
+std::shared_ptr<ThreadPool> HeifContext::get_thread_pool() const
+{
+#if ENABLE_PARALLEL_TILE_DECODING
+  std::lock_guard<std::mutex> lock(m_thread_pool_mutex);
+
+  if (m_max_decoding_threads <= 0) {
+    return nullptr;
+  }
+
+  if (!m_thread_pool) {
+    m_thread_pool = std::make_shared<ThreadPool>(m_max_decoding_threads);
+  }
+
+  return m_thread_pool;
+#else
+  return nullptr;
+#endif
+}
+
+
+std::shared_ptr<ThreadPool> HeifContext::get_color_conversion_thread_pool(uint32_t width, uint32_t height) const
+{
+#if ENABLE_PARALLEL_TILE_DECODING
+  {
+    std::lock_guard<std::mutex> lock(m_thread_pool_mutex);
+
+    if (m_thread_pool) {
+      return m_thread_pool;
+    }
+  }
+
+  if (!ColorConversionPipeline::is_worth_threading(width, height)) {
+    return nullptr;
+  }
+
+  return get_thread_pool();
+#else
+  (void) width;
+  (void) height;
+  return nullptr;
+#endif
+}
+
+
 Error HeifContext::read(const std::shared_ptr<StreamReader>& reader)
 {
   m_heif_file = std::make_shared<HeifFile>();
   m_heif_file->set_security_limits(&m_limits);
+  m_heif_file->set_deferred_item_parsing(m_deferred_image_interpretation);
+  m_heif_file->set_arena_allocation(m_arena_allocation);
   Error err = m_heif_file->read(reader);
   if (err) {
     return err;
@@ -152,7 +350,9 @@ Error HeifContext::read_from_file(const char* input_filename)
 {
   m_heif_file = std::make_shared<HeifFile>();
   m_heif_file->set_security_limits(&m_limits);
-  Error err = m_heif_file->read_from_file(input_filename);
+  m_heif_file->set_deferred_item_parsing(m_deferred_image_interpretation);
+  m_heif_file->set_arena_allocation(m_arena_allocation);
+  Error err = m_heif_file->read_from_file(input_filename, m_memory_mapped_file_reading);
   if (err) {
     return err;
   }
@@ -164,6 +364,8 @@ Error HeifContext::read_from_memory(const void* data, size_t size, bool copy)
 {
   m_heif_file = std::make_shared<HeifFile>();
   m_heif_file->set_security_limits(&m_limits);
+  m_heif_file->set_deferred_item_parsing(m_deferred_image_interpretation);
+  m_heif_file->set_arena_allocation(m_arena_allocation);
   Error err = m_heif_file->read_from_memory(data, size, copy);
   if (err) {
     return err;
@@ -179,6 +381,7 @@ void HeifContext::reset_to_empty_heif()
   m_heif_file->new_empty_file();
 
   m_all_images.clear();
+  m_metadata_items.clear();
   m_top_level_images.clear();
   m_primary_image.reset();
 }
@@ -204,16 +407,34 @@ std::vector<std::shared_ptr<ImageItem>> HeifContext::get_top_level_images(bool r
 
 std::shared_ptr<ImageItem> HeifContext::get_image(heif_item_id id, bool return_error_images)
 {
-  auto iter = m_all_images.find(id);
-  if (iter == m_all_images.end()) {
+  std::shared_ptr<ImageItem> image;
+
+  if (m_deferred_image_interpretation) {
+#if ENABLE_PARALLEL_TILE_DECODING
+    std::lock_guard<std::recursive_mutex> lock(m_deferred_images_mutex);
+#endif
+
+    // errors while interpreting the image are kept in the returned ImageItem_Error
+    Error err;
+    image = find_referenced_image(id, err);
+  }
+  else {
+    // Without deferred interpretation, m_all_images does not change while images are decoded.
+    auto iter = m_all_images.find(id);
+    if (iter != m_all_images.end()) {
+      image = iter->second;
+    }
+  }
+
+  if (!image) {
     return nullptr;
   }
   else {
-    if (iter->second->get_item_error() && !return_error_images) {
+    if (image->get_item_error() && !return_error_images) {
       return nullptr;
     }
     else {
-      return iter->second;
+      return image;
     }
   }
 }
@@ -230,6 +451,16 @@ std::shared_ptr<ImageItem> HeifContext::get_primary_image(bool return_error_imag
 
 bool HeifContext::is_image(heif_item_id ID) const
 {
+  if (m_deferred_image_interpretation) {
+    // Other threads may add interpreted images to m_all_images while we look them up.
+#if ENABLE_PARALLEL_TILE_DECODING
+    std::lock_guard<std::recursive_mutex> lock(m_deferred_images_mutex);
+#endif
+
+    return (m_all_images.find(ID) != m_all_images.end() ||
+            is_uninterpreted_image(ID));
+  }
+
   return m_all_images.find(ID) != m_all_images.end();
 }
 
@@ -252,6 +483,33 @@ void HeifContext::add_region_referenced_mask_ref(heif_item_id region_item_id, he
 
 void HeifContext::write(StreamWriter& writer)
 {
+  prepare_for_write();
+
+  m_heif_file->write(writer);
+}
+
+
+Error HeifContext::finish_streaming()
+{
+  prepare_for_write();
+
+  return m_heif_file->finish_streaming();
+}
+
+
+void HeifContext::prepare_for_write()
+{
+  // --- all images have to be interpreted before they can be written
+
+  if (m_deferred_image_interpretation) {
+    for (heif_item_id id : m_heif_file->get_item_IDs()) {
+      if (is_uninterpreted_image(id)) {
+        Error err;
+        interpret_deferred_image(id, err);
+      }
+    }
+  }
+
   // --- serialize regions
 
   for (auto& image : m_all_images) {
@@ -274,10 +532,6 @@ void HeifContext::write(StreamWriter& writer)
   for (auto& img : m_all_images) {
     img.second->process_before_write();
   }
-
-  // --- write to file
-
-  m_heif_file->write(writer);
 }
 
 std::string HeifContext::debug_dump_boxes() const
@@ -321,9 +575,14 @@ void HeifContext::remove_top_level_image(const std::shared_ptr<ImageItem>& image
 Error HeifContext::interpret_heif_file()
 {
   m_all_images.clear();
+  m_metadata_items.clear();
   m_top_level_images.clear();
   m_primary_image.reset();
 
+  if (m_deferred_image_interpretation) {
+    return interpret_heif_file_deferred();
+  }
+
 
   // --- reference all non-hidden images
 
@@ -375,525 +634,901 @@ Error HeifContext::interpret_heif_file()
       continue;
     }
 
-    std::vector<std::shared_ptr<Box>> properties;
-
-    Error err = m_heif_file->get_properties(pair.first, properties);
+    Error err = interpret_image_properties(image);
     if (err) {
       return err;
     }
+  }
 
 
-    // --- are there any 'essential' properties that we did not parse?
+  // --- remove auxiliary from top-level images and assign to their respective image
 
-    for (const auto& prop : properties) {
-      if (std::dynamic_pointer_cast<Box_other>(prop) &&
-          get_heif_file()->get_ipco_box()->is_property_essential_for_item(pair.first, prop, get_heif_file()->get_ipma_box())) {
+  auto iref_box = m_heif_file->get_iref_box();
+  if (iref_box) {
+    // m_top_level_images.clear();
 
-        std::stringstream sstr;
-        sstr << "could not parse item property '" << prop->get_type_string() << "'";
-        return {heif_error_Unsupported_feature, heif_suberror_Unsupported_essential_property, sstr.str()};
+    for (auto& pair : m_all_images) {
+      Error err = interpret_image_references(pair.second);
+      if (err) {
+        return err;
       }
     }
+  }
 
 
-    // --- Are there any parse errors in optional properties? Attach the errors as warnings to the images.
-
-    bool ignore_nonfatal_parse_errors = false; // TODO: this should be a user option. Where should we put this (heif_decoding_options, or while creating the context) ?
+  // --- check that HEVC images have an hvcC property
 
-    for (const auto& prop : properties) {
-      if (auto errorbox = std::dynamic_pointer_cast<Box_Error>(prop)) {
-        parse_error_fatality fatality = errorbox->get_parse_error_fatality();
+  for (auto& pair : m_all_images) {
+    auto& image = pair.second;
 
-        if (fatality == parse_error_fatality::optional ||
-            (fatality == parse_error_fatality::ignorable && ignore_nonfatal_parse_errors)) {
-          image->add_decoding_warning(errorbox->get_error());
-        }
-        else {
-          return errorbox->get_error();
-        }
-      }
+    if (image->get_item_error()) {
+      continue;
     }
 
-
-    // --- extract image resolution
-
-    bool ispe_read = false;
-    for (const auto& prop : properties) {
-      auto ispe = std::dynamic_pointer_cast<Box_ispe>(prop);
-      if (ispe) {
-        uint32_t width = ispe->get_width();
-        uint32_t height = ispe->get_height();
-
-        uint32_t max_width_height = static_cast<uint32_t>(std::numeric_limits<int>::max());
-        if (width >= max_width_height || height >= max_width_height) {
-          std::stringstream sstr;
-          sstr << "Image size " << width << "x" << height << " exceeds the maximum image size "
-                << get_security_limits()->max_image_size_pixels << "\n";
-
-          return Error(heif_error_Memory_allocation_error,
-                        heif_suberror_Security_limit_exceeded,
-                        sstr.str());
-        }
-
-        image->set_resolution(width, height);
-        ispe_read = true;
-      }
+    Error err = check_codec_configuration(image);
+    if (err) {
+      return err;
     }
+  }
 
-    if (!ispe_read) {
-      return Error(heif_error_Invalid_input,
-                   heif_suberror_No_ispe_property,
-                   "Image has no 'ispe' property");
-    }
 
-    for (const auto& prop : properties) {
-      auto colr = std::dynamic_pointer_cast<Box_colr>(prop);
-      if (colr) {
-        auto profile = colr->get_color_profile();
-        image->set_color_profile(profile);
-        continue;
-      }
+  // --- assign color profile from grid tiles to main image when main image has no profile assigned
 
-      auto cmin = std::dynamic_pointer_cast<Box_cmin>(prop);
-      if (cmin) {
-        image->set_intrinsic_matrix(cmin->get_intrinsic_matrix());
-      }
+  for (auto& pair : m_all_images) {
+    auto& image = pair.second;
 
-      auto cmex = std::dynamic_pointer_cast<Box_cmex>(prop);
-      if (cmex) {
-        image->set_extrinsic_matrix(cmex->get_extrinsic_matrix());
-      }
+    if (image->get_item_error()) {
+      continue;
     }
 
-
-    for (const auto& prop : properties) {
-      auto clap = std::dynamic_pointer_cast<Box_clap>(prop);
-      if (clap) {
-        image->set_resolution(clap->get_width_rounded(),
-                              clap->get_height_rounded());
-
-        if (image->has_intrinsic_matrix()) {
-          image->get_intrinsic_matrix().apply_clap(clap.get(), image->get_width(), image->get_height());
-        }
-      }
-
-      auto imir = std::dynamic_pointer_cast<Box_imir>(prop);
-      if (imir) {
-        image->get_intrinsic_matrix().apply_imir(imir.get(), image->get_width(), image->get_height());
-      }
-
-      auto irot = std::dynamic_pointer_cast<Box_irot>(prop);
-      if (irot) {
-        if (irot->get_rotation_ccw() == 90 ||
-            irot->get_rotation_ccw() == 270) {
-          // swap width and height
-          image->set_resolution(image->get_height(),
-                                image->get_width());
-        }
-
-        // TODO: apply irot to camera extrinsic matrix
-      }
+    if (!iref_box) {
+      break;
     }
+
+    inherit_color_profile_from_grid_tile(image);
   }
 
 
-  // --- remove auxiliary from top-level images and assign to their respective image
+  // --- read metadata and assign to image
 
-  auto iref_box = m_heif_file->get_iref_box();
-  if (iref_box) {
-    // m_top_level_images.clear();
+  for (heif_item_id id : image_IDs) {
+    uint32_t item_type = m_heif_file->get_item_type_4cc(id);
+    std::string content_type = m_heif_file->get_content_type(id);
 
-    for (auto& pair : m_all_images) {
-      auto& image = pair.second;
+    // 'rgan': skip region annotations, handled next
+    // 'iden': iden images are no metadata
+    if (item_type_is_image(item_type, content_type) || item_type == fourcc("rgan")) {
+      continue;
+    }
 
-      std::vector<Box_iref::Reference> references = iref_box->get_references_from(image->get_id());
+    auto metadataResult = read_metadata_item(id);
+    if (metadataResult.error) {
+      return metadataResult.error;
+    }
 
-      for (const Box_iref::Reference& ref : references) {
-        uint32_t type = ref.header.get_short_type();
+    std::shared_ptr<ImageMetadata> metadata = metadataResult.value;
+    if (!metadata) {
+      // anything else is probably something that we don't understand yet
+      continue;
+    }
 
-        if (type == fourcc("thmb")) {
-          // --- this is a thumbnail image, attach to the main image
 
-          std::vector<heif_item_id> refs = ref.to_item_ID;
-          for (heif_item_id ref: refs) {
-            image->set_is_thumbnail();
+    // --- assign metadata to the image
 
-            auto master_iter = m_all_images.find(ref);
-            if (master_iter == m_all_images.end()) {
-              return Error(heif_error_Invalid_input,
-                          heif_suberror_Nonexisting_item_referenced,
-                          "Thumbnail references a non-existing image");
-            }
+    if (iref_box) {
+      std::vector<Box_iref::Reference> references = iref_box->get_references_from(id);
+      for (const auto& ref : references) {
+        if (ref.header.get_short_type() == fourcc("cdsc")) {
+          std::vector<uint32_t> refs = ref.to_item_ID;
 
-            if (master_iter->second->is_thumbnail()) {
-              return Error(heif_error_Invalid_input,
-                          heif_suberror_Nonexisting_item_referenced,
-                          "Thumbnail references another thumbnail");
-            }
+          for(uint32_t ref: refs) {
+            uint32_t exif_image_id = ref;
+            auto img_iter = m_all_images.find(exif_image_id);
+            if (img_iter == m_all_images.end()) {
+              if (!m_heif_file->has_item_with_id(exif_image_id)) {
+                return Error(heif_error_Invalid_input,
+                             heif_suberror_Nonexisting_item_referenced,
+                             "Metadata assigned to non-existing image");
+              }
 
-            if (image.get() == master_iter->second.get()) {
-              return Error(heif_error_Invalid_input,
-                          heif_suberror_Nonexisting_item_referenced,
-                          "Recursive thumbnail image detected");
+              continue;
             }
-            master_iter->second->add_thumbnail(image);
+            img_iter->second->add_metadata(metadata);
           }
-          remove_top_level_image(image);
         }
-        else if (type == fourcc("auxl")) {
-
-          // --- this is an auxiliary image
-          //     check whether it is an alpha channel and attach to the main image if yes
-
-          std::shared_ptr<Box_auxC> auxC_property = m_heif_file->get_property<Box_auxC>(image->get_id());
-          if (!auxC_property) {
-            std::stringstream sstr;
-            sstr << "No auxC property for image " << image->get_id();
+        else if (ref.header.get_short_type() == fourcc("prem")) {
+          uint32_t color_image_id = ref.from_item_ID;
+          auto img_iter = m_all_images.find(color_image_id);
+          if (img_iter == m_all_images.end()) {
             return Error(heif_error_Invalid_input,
-                         heif_suberror_Auxiliary_image_type_unspecified,
-                         sstr.str());
+                         heif_suberror_Nonexisting_item_referenced,
+                         "`prem` link assigned to non-existing image");
           }
 
-          std::vector<heif_item_id> refs = ref.to_item_ID;
-
-          // alpha channel
-
-          if (auxC_property->get_aux_type() == "urn:mpeg:avc:2015:auxid:1" ||   // HEIF (avc)
-              auxC_property->get_aux_type() == "urn:mpeg:hevc:2015:auxid:1" ||  // HEIF (h265)
-              auxC_property->get_aux_type() == "urn:mpeg:mpegB:cicp:systems:auxiliary:alpha") { // MIAF
-
-            for (heif_item_id ref: refs) {
-              auto master_iter = m_all_images.find(ref);
-              if (master_iter == m_all_images.end()) {
-
-                if (!m_heif_file->has_item_with_id(ref)) {
-                  return Error(heif_error_Invalid_input,
-                               heif_suberror_Nonexisting_item_referenced,
-                               "Non-existing alpha image referenced");
-                }
+          img_iter->second->set_is_premultiplied_alpha(true);;
+        }
+      }
+    }
+  }
 
-                continue;
-              }
+  // --- read region item and assign to image(s)
 
-              auto master_img = master_iter->second;
+  for (heif_item_id id : image_IDs) {
+    uint32_t item_type = m_heif_file->get_item_type_4cc(id);
+    if (item_type != fourcc("rgan")) {
+      continue;
+    }
 
-              if (image.get() == master_img.get()) {
-                return Error(heif_error_Invalid_input,
-                            heif_suberror_Nonexisting_item_referenced,
-                            "Recursive alpha image detected");
-              }
-
-              image->set_is_alpha_channel();
-              master_img->set_alpha_channel(image);
+    std::shared_ptr<RegionItem> region_item = std::make_shared<RegionItem>();
+    region_item->item_id = id;
+    std::vector<uint8_t> region_data;
+    Error err = m_heif_file->get_uncompressed_item_data(id, &region_data);
+    if (err) {
+      return err;
+    }
+    region_item->parse(region_data);
+    if (iref_box) {
+      std::vector<Box_iref::Reference> references = iref_box->get_references_from(id);
+      for (const auto& ref : references) {
+        if (ref.header.get_short_type() == fourcc("cdsc")) {
+          std::vector<uint32_t> refs = ref.to_item_ID;
+          for (uint32_t ref : refs) {
+            uint32_t image_id = ref;
+            auto img_iter = m_all_images.find(image_id);
+            if (img_iter == m_all_images.end()) {
+              return Error(heif_error_Invalid_input,
+                           heif_suberror_Nonexisting_item_referenced,
+                           "Region item assigned to non-existing image");
             }
+            img_iter->second->add_region_item_id(id);
+            m_region_items.push_back(region_item);
           }
+        }
 
+        /* When the geometry 'mask' of a region is represented by a mask stored in
+        * another image item the image item containing the mask shall be identified
+        * by an item reference of type 'mask' from the region item to the image item
+        * containing the mask. */
+        if (ref.header.get_short_type() == fourcc("mask")) {
+          err = assign_region_mask_images(region_item, ref.to_item_ID);
+          if (err) {
+            return err;
+          }
+        }
+      }
+    }
+  }
 
-          // depth channel
+  return Error::Ok;
+}
 
-          if (auxC_property->get_aux_type() == "urn:mpeg:hevc:2015:auxid:2" || // HEIF
-              auxC_property->get_aux_type() == "urn:mpeg:mpegB:cicp:systems:auxiliary:depth") { // AVIF
-            image->set_is_depth_channel();
 
-            for (heif_item_id ref: refs) {
-              auto master_iter = m_all_images.find(ref);
-              if (master_iter == m_all_images.end()) {
+Error HeifContext::interpret_image_properties(const std::shared_ptr<ImageItem>& image)
+{
+  heif_item_id id = image->get_id();
 
-                if (!m_heif_file->has_item_with_id(ref)) {
-                  return Error(heif_error_Invalid_input,
-                               heif_suberror_Nonexisting_item_referenced,
-                               "Non-existing depth image referenced");
-                }
+  std::vector<std::shared_ptr<Box>> properties;
 
-                continue;
-              }
-              if (image.get() == master_iter->second.get()) {
-                return Error(heif_error_Invalid_input,
-                            heif_suberror_Nonexisting_item_referenced,
-                            "Recursive depth image detected");
-              }
-              master_iter->second->set_depth_channel(image);
+  Error err = m_heif_file->get_properties(id, properties);
+  if (err) {
+    return err;
+  }
 
-              const auto& subtypes = auxC_property->get_subtypes();
 
-              std::vector<std::shared_ptr<SEIMessage>> sei_messages;
-              Error err = decode_hevc_aux_sei_messages(subtypes, sei_messages);
-              if (err) {
-                return err;
-              }
+  // --- are there any 'essential' properties that we did not parse?
 
-              for (auto& msg : sei_messages) {
-                auto depth_msg = std::dynamic_pointer_cast<SEIMessage_depth_representation_info>(msg);
-                if (depth_msg) {
-                  image->set_depth_representation_info(*depth_msg);
-                }
-              }
+  for (const auto& prop : properties) {
+    if (std::dynamic_pointer_cast<Box_other>(prop) &&
+        get_heif_file()->get_ipco_box()->is_property_essential_for_item(id, prop, get_heif_file()->get_ipma_box())) {
+
+      std::stringstream sstr;
+      sstr << "could not parse item property '" << prop->get_type_string() << "'";
+      return {heif_error_Unsupported_feature, heif_suberror_Unsupported_essential_property, sstr.str()};
+    }
+  }
+
+
+  // --- Are there any parse errors in optional properties? Attach the errors as warnings to the images.
+
+  bool ignore_nonfatal_parse_errors = false; // TODO: this should be a user option. Where should we put this (heif_decoding_options, or while creating the context) ?
+
+  for (const auto& prop : properties) {
+    if (auto errorbox = std::dynamic_pointer_cast<Box_Error>(prop)) {
+      parse_error_fatality fatality = errorbox->get_parse_error_fatality();
+
+      if (fatality == parse_error_fatality::optional ||
+          (fatality == parse_error_fatality::ignorable && ignore_nonfatal_parse_errors)) {
+        image->add_decoding_warning(errorbox->get_error());
+      }
+      else {
+        return errorbox->get_error();
+      }
+    }
+  }
+
+
+  // --- extract image resolution
+
+  bool ispe_read = false;
+  for (const auto& prop : properties) {
+    auto ispe = std::dynamic_pointer_cast<Box_ispe>(prop);
+    if (ispe) {
+      uint32_t width = ispe->get_width();
+      uint32_t height = ispe->get_height();
+
+      uint32_t max_width_height = static_cast<uint32_t>(std::numeric_limits<int>::max());
+      if (width >= max_width_height || height >= max_width_height) {
+        std::stringstream sstr;
+        sstr << "Image size " << width << "x" << height << " exceeds the maximum image size "
+              << get_security_limits()->max_image_size_pixels << "\n";
+
+        return Error(heif_error_Memory_allocation_error,
+                      heif_suberror_Security_limit_exceeded,
+                      sstr.str());
+      }
+
+      image->set_resolution(width, height);
+      ispe_read = true;
+    }
+  }
+
+  if (!ispe_read) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_No_ispe_property,
+                 "Image has no 'ispe' property");
+  }
+
+  for (const auto& prop : properties) {
+    auto colr = std::dynamic_pointer_cast<Box_colr>(prop);
+    if (colr) {
+      auto profile = colr->get_color_profile();
+      image->set_color_profile(profile);
+      continue;
+    }
+
+    auto cmin = std::dynamic_pointer_cast<Box_cmin>(prop);
+    if (cmin) {
+      image->set_intrinsic_matrix(cmin->get_intrinsic_matrix());
+    }
+
+    auto cmex = std::dynamic_pointer_cast<Box_cmex>(prop);
+    if (cmex) {
+      image->set_extrinsic_matrix(cmex->get_extrinsic_matrix());
+    }
+  }
+
+
+  for (const auto& prop : properties) {
+    auto clap = std::dynamic_pointer_cast<Box_clap>(prop);
+    if (clap) {
+      image->set_resolution(clap->get_width_rounded(),
+                            clap->get_height_rounded());
+
+      if (image->has_intrinsic_matrix()) {
+        image->get_intrinsic_matrix().apply_clap(clap.get(), image->get_width(), image->get_height());
+      }
+    }
+
+    auto imir = std::dynamic_pointer_cast<Box_imir>(prop);
+    if (imir) {
+      image->get_intrinsic_matrix().apply_imir(imir.get(), image->get_width(), image->get_height());
+    }
+
+    auto irot = std::dynamic_pointer_cast<Box_irot>(prop);
+    if (irot) {
+      if (irot->get_rotation_ccw() == 90 ||
+          irot->get_rotation_ccw() == 270) {
+        // swap width and height
+        image->set_resolution(image->get_height(),
+                              image->get_width());
+      }
+
+      // TODO: apply irot to camera extrinsic matrix
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+std::shared_ptr<ImageItem> HeifContext::find_referenced_image(heif_item_id id, Error& out_error)
+{
+  out_error = Error::Ok;
+
+  auto iter = m_all_images.find(id);
+  if (iter != m_all_images.end()) {
+    return iter->second;
+  }
+
+  if (m_deferred_image_interpretation && is_uninterpreted_image(id)) {
+    return interpret_deferred_image(id, out_error);
+  }
+
+  return nullptr;
+}
+
+
+Error HeifContext::interpret_image_references(const std::shared_ptr<ImageItem>& image)
+{
+  auto iref_box = m_heif_file->get_iref_box();
+  if (!iref_box) {
+    return Error::Ok;
+  }
+
+  std::vector<Box_iref::Reference> references = iref_box->get_references_from(image->get_id());
+
+  for (const Box_iref::Reference& ref : references) {
+    uint32_t type = ref.header.get_short_type();
+
+    if (type == fourcc("thmb")) {
+      // --- this is a thumbnail image, attach to the main image
+
+      std::vector<heif_item_id> refs = ref.to_item_ID;
+      for (heif_item_id ref: refs) {
+        image->set_is_thumbnail();
+
+        Error err;
+        auto master_img = find_referenced_image(ref, err);
+        if (err) {
+          return err;
+        }
+
+        if (!master_img) {
+          return Error(heif_error_Invalid_input,
+                      heif_suberror_Nonexisting_item_referenced,
+                      "Thumbnail references a non-existing image");
+        }
+
+        if (master_img->is_thumbnail()) {
+          return Error(heif_error_Invalid_input,
+                      heif_suberror_Nonexisting_item_referenced,
+                      "Thumbnail references another thumbnail");
+        }
+
+        if (image.get() == master_img.get()) {
+          return Error(heif_error_Invalid_input,
+                      heif_suberror_Nonexisting_item_referenced,
+                      "Recursive thumbnail image detected");
+        }
+        master_img->add_thumbnail(image);
+      }
+      remove_top_level_image(image);
+    }
+    else if (type == fourcc("auxl")) {
+
+      // --- this is an auxiliary image
+      //     check whether it is an alpha channel and attach to the main image if yes
+
+      std::shared_ptr<Box_auxC> auxC_property = m_heif_file->get_property<Box_auxC>(image->get_id());
+      if (!auxC_property) {
+        std::stringstream sstr;
+        sstr << "No auxC property for image " << image->get_id();
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Auxiliary_image_type_unspecified,
+                     sstr.str());
+      }
+
+      std::vector<heif_item_id> refs = ref.to_item_ID;
+
+      // alpha channel
+
+      if (auxC_property->get_aux_type() == "urn:mpeg:avc:2015:auxid:1" ||   // HEIF (avc)
+          auxC_property->get_aux_type() == "urn:mpeg:hevc:2015:auxid:1" ||  // HEIF (h265)
+          auxC_property->get_aux_type() == "urn:mpeg:mpegB:cicp:systems:auxiliary:alpha") { // MIAF
+
+        for (heif_item_id ref: refs) {
+          Error err;
+          auto master_img = find_referenced_image(ref, err);
+          if (err) {
+            return err;
+          }
+
+          if (!master_img) {
+
+            if (!m_heif_file->has_item_with_id(ref)) {
+              return Error(heif_error_Invalid_input,
+                           heif_suberror_Nonexisting_item_referenced,
+                           "Non-existing alpha image referenced");
             }
+
+            continue;
           }
 
+          if (image.get() == master_img.get()) {
+            return Error(heif_error_Invalid_input,
+                        heif_suberror_Nonexisting_item_referenced,
+                        "Recursive alpha image detected");
+          }
 
-          // --- generic aux image
+          image->set_is_alpha_channel();
+          master_img->set_alpha_channel(image);
+        }
+      }
 
-          image->set_is_aux_image(auxC_property->get_aux_type());
 
-          for (heif_item_id ref: refs) {
-            auto master_iter = m_all_images.find(ref);
-            if (master_iter == m_all_images.end()) {
+      // depth channel
 
-              if (!m_heif_file->has_item_with_id(ref)) {
-                return Error(heif_error_Invalid_input,
-                             heif_suberror_Nonexisting_item_referenced,
-                             "Non-existing aux image referenced");
-              }
+      if (auxC_property->get_aux_type() == "urn:mpeg:hevc:2015:auxid:2" || // HEIF
+          auxC_property->get_aux_type() == "urn:mpeg:mpegB:cicp:systems:auxiliary:depth") { // AVIF
+        image->set_is_depth_channel();
 
-              continue;
-            }
-            if (image.get() == master_iter->second.get()) {
+        for (heif_item_id ref: refs) {
+          Error err;
+          auto master_img = find_referenced_image(ref, err);
+          if (err) {
+            return err;
+          }
+
+          if (!master_img) {
+
+            if (!m_heif_file->has_item_with_id(ref)) {
               return Error(heif_error_Invalid_input,
-                          heif_suberror_Nonexisting_item_referenced,
-                          "Recursive aux image detected");
+                           heif_suberror_Nonexisting_item_referenced,
+                           "Non-existing depth image referenced");
+            }
+
+            continue;
+          }
+          if (image.get() == master_img.get()) {
+            return Error(heif_error_Invalid_input,
+                        heif_suberror_Nonexisting_item_referenced,
+                        "Recursive depth image detected");
+          }
+          master_img->set_depth_channel(image);
+
+          const auto& subtypes = auxC_property->get_subtypes();
+
+          std::vector<std::shared_ptr<SEIMessage>> sei_messages;
+          err = decode_hevc_aux_sei_messages(subtypes, sei_messages);
+          if (err) {
+            return err;
+          }
+
+          for (auto& msg : sei_messages) {
+            auto depth_msg = std::dynamic_pointer_cast<SEIMessage_depth_representation_info>(msg);
+            if (depth_msg) {
+              image->set_depth_representation_info(*depth_msg);
             }
+          }
+        }
+      }
+
+
+      // --- generic aux image
 
-            master_iter->second->add_aux_image(image);
+      image->set_is_aux_image(auxC_property->get_aux_type());
 
-            remove_top_level_image(image);
+      for (heif_item_id ref: refs) {
+        Error err;
+        auto master_img = find_referenced_image(ref, err);
+        if (err) {
+          return err;
+        }
+
+        if (!master_img) {
+
+          if (!m_heif_file->has_item_with_id(ref)) {
+            return Error(heif_error_Invalid_input,
+                         heif_suberror_Nonexisting_item_referenced,
+                         "Non-existing aux image referenced");
           }
+
+          continue;
+        }
+        if (image.get() == master_img.get()) {
+          return Error(heif_error_Invalid_input,
+                      heif_suberror_Nonexisting_item_referenced,
+                      "Recursive aux image detected");
         }
-        else {
-          // 'image' is a normal image, keep it as a top-level image
+
+        master_img->add_aux_image(image);
+
+        remove_top_level_image(image);
+      }
+    }
+    else {
+      // 'image' is a normal image, keep it as a top-level image
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Error HeifContext::check_codec_configuration(const std::shared_ptr<ImageItem>& image) const
+{
+  std::shared_ptr<Box_infe> infe = m_heif_file->get_infe_box(image->get_id());
+  if (infe->get_item_type_4cc() == fourcc("hvc1")) {
+
+    auto ipma = m_heif_file->get_ipma_box();
+    auto ipco = m_heif_file->get_ipco_box();
+
+    if (!ipco->get_property_for_item_ID(image->get_id(), ipma, fourcc("hvcC"))) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_No_hvcC_box,
+                   "No hvcC property in hvc1 type image");
+    }
+  }
+  if (infe->get_item_type_4cc() == fourcc("vvc1")) {
+
+    auto ipma = m_heif_file->get_ipma_box();
+    auto ipco = m_heif_file->get_ipco_box();
+
+    if (!ipco->get_property_for_item_ID(image->get_id(), ipma, fourcc("vvcC"))) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_No_vvcC_box,
+                   "No vvcC property in vvc1 type image");
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+void HeifContext::inherit_color_profile_from_grid_tile(const std::shared_ptr<ImageItem>& image)
+{
+  auto iref_box = m_heif_file->get_iref_box();
+  if (!iref_box) {
+    return;
+  }
+
+  auto infe_box = m_heif_file->get_infe_box(image->get_id());
+  if (!infe_box) {
+    return;
+  }
+
+  if (infe_box->get_item_type_4cc() == fourcc("grid")) {
+    std::vector<heif_item_id> image_references = iref_box->get_references(image->get_id(), fourcc("dimg"));
+
+    if (image_references.empty()) {
+      return; // TODO: can this every happen?
+    }
+
+    auto tileId = image_references.front();
+
+    Error err;
+    auto tile_img = find_referenced_image(tileId, err);
+    if (!tile_img || tile_img->get_item_error()) {
+      return; // invalid grid entry
+    }
+
+    if (image->get_color_profile_icc() == nullptr && tile_img->get_color_profile_icc()) {
+      image->set_color_profile(tile_img->get_color_profile_icc());
+    }
+
+    if (image->get_color_profile_nclx() == nullptr && tile_img->get_color_profile_nclx()) {
+      image->set_color_profile(tile_img->get_color_profile_nclx());
+    }
+  }
+}
+
+
+Result<std::shared_ptr<ImageMetadata>> HeifContext::read_metadata_item(heif_item_id id)
+{
+  auto iter = m_metadata_items.find(id);
+  if (iter != m_metadata_items.end()) {
+    return iter->second;
+  }
+
+  uint32_t item_type = m_heif_file->get_item_type_4cc(id);
+
+  // we now assign all kinds of metadata to the image, not only 'Exif' and 'XMP'
+
+  std::shared_ptr<ImageMetadata> metadata = std::make_shared<ImageMetadata>();
+  metadata->item_id = id;
+  metadata->item_type = fourcc_to_string(item_type);
+  metadata->content_type = m_heif_file->get_content_type(id);
+  metadata->item_uri_type = m_heif_file->get_item_uri_type(id);
+
+  Error err = m_heif_file->get_uncompressed_item_data(id, &(metadata->m_data));
+  if (err) {
+    if (item_type == fourcc("Exif") || item_type == fourcc("mime")) {
+      // these item types should have data
+      return err;
+    }
+    else {
+      metadata.reset();
+    }
+  }
+
+  m_metadata_items[id] = metadata;
+
+  return metadata;
+}
+
+
+Error HeifContext::assign_region_mask_images(const std::shared_ptr<RegionItem>& region_item,
+                                             const std::vector<heif_item_id>& refs)
+{
+  size_t mask_index = 0;
+  for (int j = 0; j < region_item->get_number_of_regions(); j++) {
+    if (region_item->get_regions()[j]->getRegionType() == heif_region_type_referenced_mask) {
+      std::shared_ptr<RegionGeometry_ReferencedMask> mask_geometry = std::dynamic_pointer_cast<RegionGeometry_ReferencedMask>(region_item->get_regions()[j]);
+
+      if (mask_index >= refs.size()) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Unspecified,
+                     "Region mask reference with non-existing mask image reference");
+      }
+
+      uint32_t mask_image_id = refs[mask_index];
+      if (!is_image(mask_image_id)) {
+        return Error(heif_error_Invalid_input,
+                     heif_suberror_Unspecified,
+                     "Region mask referenced item is not an image");
+      }
+
+      auto mask_image = get_image(mask_image_id, true);
+      if (auto error = mask_image->get_item_error()) {
+        return error;
+      }
+
+      mask_geometry->referenced_item = mask_image_id;
+      if (mask_geometry->width == 0) {
+        mask_geometry->width = mask_image->get_ispe_width();
+      }
+      if (mask_geometry->height == 0) {
+        mask_geometry->height = mask_image->get_ispe_height();
+      }
+      mask_index += 1;
+      remove_top_level_image(mask_image);
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Result<std::shared_ptr<RegionItem>> HeifContext::read_region_item(heif_item_id id)
+{
+  if (auto region_item = get_region_item(id)) {
+    return region_item;
+  }
+
+  std::shared_ptr<RegionItem> region_item = std::make_shared<RegionItem>();
+  region_item->item_id = id;
+  std::vector<uint8_t> region_data;
+  Error err = m_heif_file->get_uncompressed_item_data(id, &region_data);
+  if (err) {
+    return err;
+  }
+  region_item->parse(region_data);
+
+  auto iref_box = m_heif_file->get_iref_box();
+  if (iref_box) {
+    std::vector<Box_iref::Reference> references = iref_box->get_references_from(id);
+    for (const auto& ref : references) {
+      if (ref.header.get_short_type() == fourcc("mask")) {
+        err = assign_region_mask_images(region_item, ref.to_item_ID);
+        if (err) {
+          return err;
         }
       }
     }
   }
 
+  m_region_items.push_back(region_item);
+
+  return region_item;
+}
+
+
+bool HeifContext::is_uninterpreted_image(heif_item_id id) const
+{
+  if (m_all_images.find(id) != m_all_images.end()) {
+    return false;
+  }
+
+  uint32_t item_type = m_heif_file->get_item_type_4cc(id);
+  if (item_type == 0) {
+    return false;
+  }
+
+  // the content type is only needed for 'mime' items and would parse the 'infe' box
+  std::string content_type;
+  if (item_type == fourcc("mime")) {
+    content_type = m_heif_file->get_content_type(id);
+  }
+
+  return item_type_is_image(item_type, content_type);
+}
+
+
+bool HeifContext::is_deferred_top_level_image(heif_item_id id) const
+{
+  if (m_heif_file->is_hidden_item(id)) {
+    return false;
+  }
+
+  if (m_all_images.find(id) == m_all_images.end() &&
+      !is_uninterpreted_image(id)) {
+    return false;
+  }
 
-  // --- check that HEVC images have an hvcC property
+  auto iref_box = m_heif_file->get_iref_box();
+  if (!iref_box) {
+    return true;
+  }
 
-  for (auto& pair : m_all_images) {
-    auto& image = pair.second;
+  // thumbnails and auxiliary images are attached to their master image
 
-    if (image->get_item_error()) {
-      continue;
+  for (const auto& ref : iref_box->get_references_from(id)) {
+    uint32_t type = ref.header.get_short_type();
+    if (type == fourcc("thmb")) {
+      return false;
     }
 
-    std::shared_ptr<Box_infe> infe = m_heif_file->get_infe_box(image->get_id());
-    if (infe->get_item_type_4cc() == fourcc("hvc1")) {
-
-      auto ipma = m_heif_file->get_ipma_box();
-      auto ipco = m_heif_file->get_ipco_box();
-
-      if (!ipco->get_property_for_item_ID(image->get_id(), ipma, fourcc("hvcC"))) {
-        return Error(heif_error_Invalid_input,
-                     heif_suberror_No_hvcC_box,
-                     "No hvcC property in hvc1 type image");
+    if (type == fourcc("auxl")) {
+      for (heif_item_id master_id : ref.to_item_ID) {
+        if (m_all_images.find(master_id) != m_all_images.end() ||
+            is_uninterpreted_image(master_id)) {
+          return false;
+        }
       }
     }
-    if (infe->get_item_type_4cc() == fourcc("vvc1")) {
+  }
 
-      auto ipma = m_heif_file->get_ipma_box();
-      auto ipco = m_heif_file->get_ipco_box();
+  // region masks are no top-level images
 
-      if (!ipco->get_property_for_item_ID(image->get_id(), ipma, fourcc("vvcC"))) {
-        return Error(heif_error_Invalid_input,
-                     heif_suberror_No_vvcC_box,
-                     "No vvcC property in vvc1 type image");
-      }
+  for (const auto& ref : iref_box->get_references_to(id)) {
+    if (ref.header.get_short_type() == fourcc("mask") &&
+        m_heif_file->get_item_type_4cc(ref.from_item_ID) == fourcc("rgan")) {
+      return false;
     }
   }
 
+  return true;
+}
 
-  // --- assign color profile from grid tiles to main image when main image has no profile assigned
 
-  for (auto& pair : m_all_images) {
-    auto& image = pair.second;
-    auto id = pair.first;
+Error HeifContext::interpret_heif_file_deferred()
+{
+  std::vector<heif_item_id> image_IDs = m_heif_file->get_item_IDs();
 
-    if (image->get_item_error()) {
+  // --- interpret the top-level images and all items they depend on
+
+  for (heif_item_id id : image_IDs) {
+    if (!is_deferred_top_level_image(id)) {
       continue;
     }
 
-    auto infe_box = m_heif_file->get_infe_box(id);
-    if (!infe_box) {
-      continue;
+    Error err;
+    auto image = find_referenced_image(id, err);
+    if (err) {
+      return err;
     }
 
-    if (!iref_box) {
-      break;
+    if (id == m_heif_file->get_primary_image_ID()) {
+      image->set_primary(true);
+      m_primary_image = image;
     }
 
-    if (infe_box->get_item_type_4cc() == fourcc("grid")) {
-      std::vector<heif_item_id> image_references = iref_box->get_references(id, fourcc("dimg"));
+    m_top_level_images.push_back(image);
+  }
 
-      if (image_references.empty()) {
-        continue; // TODO: can this every happen?
-      }
+  if (!m_primary_image) {
+    return Error(heif_error_Invalid_input,
+                 heif_suberror_Nonexisting_item_referenced,
+                 "'pitm' box references an unsupported or non-existing image");
+  }
 
-      auto tileId = image_references.front();
+  return Error::Ok;
+}
 
-      auto iter = m_all_images.find(tileId);
-      if (iter == m_all_images.end()) {
-        continue; // invalid grid entry
-      }
 
-      auto tile_img = iter->second;
-      if (image->get_color_profile_icc() == nullptr && tile_img->get_color_profile_icc()) {
-        image->set_color_profile(tile_img->get_color_profile_icc());
-      }
+std::shared_ptr<ImageItem> HeifContext::interpret_deferred_image(heif_item_id id, Error& out_error)
+{
+  out_error = Error::Ok;
 
-      if (image->get_color_profile_nclx() == nullptr && tile_img->get_color_profile_nclx()) {
-        image->set_color_profile(tile_img->get_color_profile_nclx());
-      }
-    }
+  auto interpreted_iter = m_all_images.find(id);
+  if (interpreted_iter != m_all_images.end()) {
+    return interpreted_iter->second;
   }
 
+  auto infe_box = m_heif_file->get_infe_box(id);
+  if (!infe_box) {
+    if (m_heif_file->has_item_with_id(id)) {
+      std::stringstream sstr;
+      sstr << "The 'infe' box of item " << id << " cannot be parsed";
+      out_error = Error(heif_error_Invalid_input,
+                        heif_suberror_No_infe_box,
+                        sstr.str());
+    }
 
-  // --- read metadata and assign to image
+    return nullptr;
+  }
 
-  for (heif_item_id id : image_IDs) {
-    uint32_t item_type = m_heif_file->get_item_type_4cc(id);
-    std::string content_type = m_heif_file->get_content_type(id);
+  std::shared_ptr<ImageItem> image = ImageItem::alloc_for_infe_box(this, infe_box);
+  if (!image) {
+    // It is no image item.
+    return nullptr;
+  }
 
-    // 'rgan': skip region annotations, handled next
-    // 'iden': iden images are no metadata
-    if (item_type_is_image(item_type, content_type) || item_type == fourcc("rgan")) {
-      continue;
-    }
+  // Insert the item into the interpreted images before interpreting it, such that references back
+  // to this image do not interpret it again.
 
-    std::string item_uri_type = m_heif_file->get_item_uri_type(id);
+  m_all_images.insert(std::make_pair(id, image));
 
-    // we now assign all kinds of metadata to the image, not only 'Exif' and 'XMP'
+  if (image->get_item_error()) {
+    return image;
+  }
 
-    std::shared_ptr<ImageMetadata> metadata = std::make_shared<ImageMetadata>();
-    metadata->item_id = id;
-    metadata->item_type = fourcc_to_string(item_type);
-    metadata->content_type = content_type;
-    metadata->item_uri_type = std::move(item_uri_type);
+  Error err = interpret_image_item(image);
+  if (err) {
+    // keep the error so that it is reported whenever the image is accessed
+    auto error_image = std::make_shared<ImageItem_Error>(image->get_infe_type(), id, err);
+    m_all_images[id] = error_image;
 
-    Error err = m_heif_file->get_uncompressed_item_data(id, &(metadata->m_data));
-    if (err) {
-      if (item_type == fourcc("Exif") || item_type == fourcc("mime")) {
-        // these item types should have data
-        return err;
-      }
-      else {
-        // anything else is probably something that we don't understand yet
-        continue;
-      }
-    }
+    out_error = err;
+    return error_image;
+  }
 
+  return image;
+}
 
-    // --- assign metadata to the image
 
-    if (iref_box) {
-      std::vector<Box_iref::Reference> references = iref_box->get_references_from(id);
-      for (const auto& ref : references) {
-        if (ref.header.get_short_type() == fourcc("cdsc")) {
-          std::vector<uint32_t> refs = ref.to_item_ID;
+Error HeifContext::interpret_image_item(const std::shared_ptr<ImageItem>& image)
+{
+  Error err = image->on_load_file();
+  if (err) {
+    return err;
+  }
 
-          for(uint32_t ref: refs) {
-            uint32_t exif_image_id = ref;
-            auto img_iter = m_all_images.find(exif_image_id);
-            if (img_iter == m_all_images.end()) {
-              if (!m_heif_file->has_item_with_id(exif_image_id)) {
-                return Error(heif_error_Invalid_input,
-                             heif_suberror_Nonexisting_item_referenced,
-                             "Metadata assigned to non-existing image");
-              }
+  err = interpret_image_properties(image);
+  if (err) {
+    return err;
+  }
 
-              continue;
-            }
-            img_iter->second->add_metadata(metadata);
-          }
-        }
-        else if (ref.header.get_short_type() == fourcc("prem")) {
-          uint32_t color_image_id = ref.from_item_ID;
-          auto img_iter = m_all_images.find(color_image_id);
-          if (img_iter == m_all_images.end()) {
-            return Error(heif_error_Invalid_input,
-                         heif_suberror_Nonexisting_item_referenced,
-                         "`prem` link assigned to non-existing image");
-          }
+  err = check_codec_configuration(image);
+  if (err) {
+    return err;
+  }
 
-          img_iter->second->set_is_premultiplied_alpha(true);;
-        }
-      }
-    }
+  err = interpret_image_references(image);
+  if (err) {
+    return err;
   }
 
-  // --- read region item and assign to image(s)
+  inherit_color_profile_from_grid_tile(image);
 
-  for (heif_item_id id : image_IDs) {
-    uint32_t item_type = m_heif_file->get_item_type_4cc(id);
-    if (item_type != fourcc("rgan")) {
-      continue;
-    }
 
-    std::shared_ptr<RegionItem> region_item = std::make_shared<RegionItem>();
-    region_item->item_id = id;
-    std::vector<uint8_t> region_data;
-    Error err = m_heif_file->get_uncompressed_item_data(id, &region_data);
-    if (err) {
-      return err;
-    }
-    region_item->parse(region_data);
-    if (iref_box) {
-      std::vector<Box_iref::Reference> references = iref_box->get_references_from(id);
-      for (const auto& ref : references) {
-        if (ref.header.get_short_type() == fourcc("cdsc")) {
-          std::vector<uint32_t> refs = ref.to_item_ID;
-          for (uint32_t ref : refs) {
-            uint32_t image_id = ref;
-            auto img_iter = m_all_images.find(image_id);
-            if (img_iter == m_all_images.end()) {
-              return Error(heif_error_Invalid_input,
-                           heif_suberror_Nonexisting_item_referenced,
-                           "Region item assigned to non-existing image");
-            }
-            img_iter->second->add_region_item_id(id);
-            m_region_items.push_back(region_item);
-          }
-        }
+  // --- load the items that reference this image: thumbnails, auxiliary images, metadata and regions
 
-        /* When the geometry 'mask' of a region is represented by a mask stored in
-        * another image item the image item containing the mask shall be identified
-        * by an item reference of type 'mask' from the region item to the image item
-        * containing the mask. */
-        if (ref.header.get_short_type() == fourcc("mask")) {
-          std::vector<uint32_t> refs = ref.to_item_ID;
-          size_t mask_index = 0;
-          for (int j = 0; j < region_item->get_number_of_regions(); j++) {
-            if (region_item->get_regions()[j]->getRegionType() == heif_region_type_referenced_mask) {
-              std::shared_ptr<RegionGeometry_ReferencedMask> mask_geometry = std::dynamic_pointer_cast<RegionGeometry_ReferencedMask>(region_item->get_regions()[j]);
+  auto iref_box = m_heif_file->get_iref_box();
+  if (!iref_box) {
+    return Error::Ok;
+  }
 
-              if (mask_index >= refs.size()) {
-                return Error(heif_error_Invalid_input,
-                             heif_suberror_Unspecified,
-                             "Region mask reference with non-existing mask image reference");
-              }
+  for (const auto& ref : iref_box->get_references_to(image->get_id())) {
+    uint32_t type = ref.header.get_short_type();
+    heif_item_id from_id = ref.from_item_ID;
 
-              uint32_t mask_image_id = refs[mask_index];
-              if (!is_image(mask_image_id)) {
-                return Error(heif_error_Invalid_input,
-                             heif_suberror_Unspecified,
-                             "Region mask referenced item is not an image");
-              }
+    if (type == fourcc("thmb") || type == fourcc("auxl")) {
+      // the referencing image attaches itself to this image while it is interpreted
+      find_referenced_image(from_id, err);
+      if (err) {
+        return err;
+      }
+    }
+    else if (type == fourcc("cdsc")) {
+      uint32_t item_type = m_heif_file->get_item_type_4cc(from_id);
 
-              auto mask_image = get_image(mask_image_id, true);
-              if (auto error = mask_image->get_item_error()) {
-                return error;
-              }
+      if (item_type == fourcc("rgan")) {
+        auto regionResult = read_region_item(from_id);
+        if (regionResult.error) {
+          return regionResult.error;
+        }
 
-              mask_geometry->referenced_item = mask_image_id;
-              if (mask_geometry->width == 0) {
-                mask_geometry->width = mask_image->get_ispe_width();
-              }
-              if (mask_geometry->height == 0) {
-                mask_geometry->height = mask_image->get_ispe_height();
-              }
-              mask_index += 1;
-              remove_top_level_image(mask_image);
-            }
-          }
+        image->add_region_item_id(from_id);
+      }
+      else if (!item_type_is_image(item_type, m_heif_file->get_content_type(from_id))) {
+        auto metadataResult = read_metadata_item(from_id);
+        if (metadataResult.error) {
+          return metadataResult.error;
+        }
+
+        if (metadataResult.value) {
+          image->add_metadata(metadataResult.value);
         }
       }
     }
@@ -905,13 +1540,11 @@ Error HeifContext::interpret_heif_file()
 
 bool HeifContext::has_alpha(heif_item_id ID) const
 {
-  auto imgIter = m_all_images.find(ID);
-  if (imgIter == m_all_images.end()) {
+  auto img = get_image(ID, true);
+  if (!img) {
     return false;
   }
 
-  auto img = imgIter->second;
-
   // --- has the image an auxiliary alpha image?
 
   if (img->get_alpha_channel() != nullptr) {
@@ -976,13 +1609,11 @@ bool HeifContext::has_alpha(heif_item_id ID) const
     bool has_alpha = false;
 
     for (heif_item_id tile_id : image_references) {
-      auto iter = m_all_images.find(tile_id);
-      if (iter == m_all_images.end()) {
+      const std::shared_ptr<const ImageItem> tileImg = get_image(tile_id, true);
+      if (!tileImg) {
         return false;
       }
 
-      const std::shared_ptr<ImageItem> tileImg = iter->second;
-
       has_alpha |= tileImg->get_alpha_channel() != nullptr;
     }
 
@@ -1008,49 +1639,241 @@ Error HeifContext::get_id_of_non_virtual_child_image(heif_item_id id, heif_item_
                    "Derived image does not reference any other image items");
     }
 
-    std::vector<heif_item_id> image_references = iref_box->get_references(id, fourcc("dimg"));
+    std::vector<heif_item_id> image_references = iref_box->get_references(id, fourcc("dimg"));
+
+    // TODO: check whether this really can be recursive (e.g. overlay of grid images)
+
+    if (image_references.empty() || image_references[0] == id) {
+      return Error(heif_error_Invalid_input,
+                   heif_suberror_No_item_data,
+                   "Derived image does not reference any other image items");
+    }
+    else {
+      return get_id_of_non_virtual_child_image(image_references[0], out);
+    }
+  }
+  else {
+    out = id;
+    return Error::Ok;
+  }
+}
+
+
+Result<std::shared_ptr<HeifPixelImage>> HeifContext::decode_image(heif_item_id ID,
+                                                                  heif_colorspace out_colorspace,
+                                                                  heif_chroma out_chroma,
+                                                                  const struct heif_decoding_options& options,
+                                                                  bool decode_only_tile, uint32_t tx, uint32_t ty,
+                                                                  const std::map<heif_channel, PlaneBuffer>* output_buffers) const
+{
+  std::shared_ptr<const ImageItem> imgitem = get_image(ID, true);
+
+  // Note: this may happen, for example when an 'iden' image references a non-existing image item.
+  if (imgitem == nullptr) {
+    return Error(heif_error_Invalid_input, heif_suberror_Nonexisting_item_referenced);
+  }
+
+
+  if (!decode_only_tile && (options.max_output_width != 0 || options.max_output_height != 0)) {
+    if (output_buffers) {
+      return Error{heif_error_Usage_error,
+                   heif_suberror_Invalid_parameter_value,
+                   "A maximum output size cannot be used when decoding into plane buffers"};
+    }
+
+    auto decodingResult = decode_image_downscaled(imgitem, options);
+    if (decodingResult.error) {
+      return decodingResult.error;
+    }
+
+    return convert_decoded_image(decodingResult.value, imgitem, out_colorspace, out_chroma, options, nullptr);
+  }
+
+  OutputPlaneBuffers image_output_buffers;
+  if (output_buffers) {
+    image_output_buffers.colorspace = out_colorspace;
+    image_output_buffers.chroma = out_chroma;
+    image_output_buffers.planes = *output_buffers;
+  }
+
+  auto decodingResult = imgitem->decode_image(options, decode_only_tile, tx, ty,
+                                              output_buffers ? &image_output_buffers : nullptr);
+  if (decodingResult.error) {
+    return decodingResult.error;
+  }
+
+  return convert_decoded_image(decodingResult.value, imgitem, out_colorspace, out_chroma, options, output_buffers);
+}
+
+
+// Largest size with the aspect ratio of w x h that fits into max_w x max_h (0 = no limit), but not larger than w x h.
+static void fit_into_maximum_size(uint32_t w, uint32_t h, uint32_t max_w, uint32_t max_h,
+                                  uint32_t& out_w, uint32_t& out_h)
+{
+  out_w = w;
+  out_h = h;
+
+  if (max_w != 0 && out_w > max_w) {
+    out_h = std::max(static_cast<uint32_t>((uint64_t{h} * max_w + w / 2) / w), 1U);
+    out_w = max_w;
+  }
+
+  if (max_h != 0 && out_h > max_h) {
+    out_w = std::max(static_cast<uint32_t>((uint64_t{w} * max_h + h / 2) / h), 1U);
+    out_h = max_h;
+  }
+}
+
+
+Result<std::shared_ptr<HeifPixelImage>> HeifContext::decode_image_downscaled(const std::shared_ptr<const ImageItem>& imgitem,
+                                                                             const struct heif_decoding_options& options) const
+{
+  // size of the decoded image
+  auto output_size = [&options](const std::shared_ptr<const ImageItem>& item, uint32_t& w, uint32_t& h) {
+    if (options.ignore_transformations) {
+      w = item->get_ispe_width();
+      h = item->get_ispe_height();
+    }
+    else {
+      w = item->get_width();
+      h = item->get_height();
+    }
+  };
+
+  uint32_t full_width, full_height;
+  output_size(imgitem, full_width, full_height);
+
+  uint32_t target_width = 0, target_height = 0;
+  if (full_width != 0 && full_height != 0) {
+    fit_into_maximum_size(full_width, full_height, options.max_output_width, options.max_output_height,
+                          target_width, target_height);
+  }
+
+  Result<std::shared_ptr<HeifPixelImage>> decodingResult;
+
+  if (target_width == 0 || (target_width == full_width && target_height == full_height)) {
+    // size unknown or no downscaling needed
+    decodingResult = imgitem->decode_image(options, false, 0, 0);
+  }
+  else {
+    // --- find the smallest thumbnail or pyramid layer that is at least as large as the output
+
+    std::vector<std::shared_ptr<const ImageItem>> candidates;
+    for (const auto& thumbnail : imgitem->get_thumbnails()) {
+      candidates.push_back(thumbnail);
+    }
+
+    if (auto grpl = m_heif_file->get_grpl_box()) {
+      for (const auto& group : grpl->get_all_child_boxes()) {
+        auto pymd = std::dynamic_pointer_cast<Box_pymd>(group);
+        if (!pymd) {
+          continue;
+        }
+
+        const auto& layer_ids = pymd->get_item_ids();
+        if (std::find(layer_ids.begin(), layer_ids.end(), imgitem->get_id()) == layer_ids.end()) {
+          continue;
+        }
+
+        for (heif_item_id layer_id : layer_ids) {
+          if (layer_id != imgitem->get_id()) {
+            candidates.push_back(get_image(layer_id, false));
+          }
+        }
+      }
+    }
+
+    bool need_alpha = has_alpha(imgitem->get_id());
+
+    std::shared_ptr<const ImageItem> source;
+    uint64_t source_pixels = uint64_t{full_width} * full_height;
+
+    for (const auto& candidate : candidates) {
+      if (!candidate || candidate->get_item_error()) {
+        continue;
+      }
 
-    // TODO: check whether this really can be recursive (e.g. overlay of grid images)
+      if (need_alpha && !has_alpha(candidate->get_id())) {
+        continue;
+      }
 
-    if (image_references.empty() || image_references[0] == id) {
-      return Error(heif_error_Invalid_input,
-                   heif_suberror_No_item_data,
-                   "Derived image does not reference any other image items");
+      uint32_t w, h;
+      output_size(candidate, w, h);
+
+      if (w >= target_width && h >= target_height && uint64_t{w} * h < source_pixels) {
+        source = candidate;
+        source_pixels = uint64_t{w} * h;
+      }
+    }
+
+    if (source) {
+      decodingResult = source->decode_image(options, false, 0, 0);
     }
     else {
-      return get_id_of_non_virtual_child_image(image_references[0], out);
+      // --- decode the image itself at a reduced resolution (if the image type or codec supports this)
+
+      uint32_t factor = std::min(full_width / target_width, full_height / target_height);
+      decodingResult = imgitem->decode_image_downscaled(options, factor);
     }
   }
-  else {
-    out = id;
-    return Error::Ok;
+
+  if (decodingResult.error) {
+    return decodingResult.error;
+  }
+
+  std::shared_ptr<HeifPixelImage> img = decodingResult.value;
+
+  // --- scale to the exact output size
+
+  uint32_t out_width, out_height;
+  fit_into_maximum_size(img->get_width(), img->get_height(), options.max_output_width, options.max_output_height,
+                        out_width, out_height);
+
+  if (out_width != img->get_width() || out_height != img->get_height()) {
+    std::shared_ptr<HeifPixelImage> scaled_img;
+    Error err = img->scale_area_average(scaled_img, out_width, out_height);
+    if (err) {
+      return err;
+    }
+
+    scaled_img->add_warnings(img->get_warnings());
+    img = std::move(scaled_img);
   }
+
+  return img;
 }
 
 
-Result<std::shared_ptr<HeifPixelImage>> HeifContext::decode_image(heif_item_id ID,
-                                                                  heif_colorspace out_colorspace,
-                                                                  heif_chroma out_chroma,
-                                                                  const struct heif_decoding_options& options,
-                                                                  bool decode_only_tile, uint32_t tx, uint32_t ty) const
+Result<std::shared_ptr<HeifPixelImage>> HeifContext::decode_image_region(heif_item_id ID,
+                                                                         heif_colorspace out_colorspace,
+                                                                         heif_chroma out_chroma,
+                                                                         const struct heif_decoding_options& options,
+                                                                         uint32_t x0, uint32_t y0, uint32_t width, uint32_t height) const
 {
-  std::shared_ptr<ImageItem> imgitem;
-  if (m_all_images.find(ID) != m_all_images.end()) {
-    imgitem = m_all_images.find(ID)->second;
-  }
+  std::shared_ptr<const ImageItem> imgitem = get_image(ID, true);
 
-  // Note: this may happen, for example when an 'iden' image references a non-existing image item.
   if (imgitem == nullptr) {
     return Error(heif_error_Invalid_input, heif_suberror_Nonexisting_item_referenced);
   }
 
-
-  auto decodingResult = imgitem->decode_image(options, decode_only_tile, tx, ty);
+  auto decodingResult = imgitem->decode_image_region(options, x0, y0, width, height);
   if (decodingResult.error) {
     return decodingResult.error;
   }
 
-  std::shared_ptr<HeifPixelImage> img = decodingResult.value;
+  return convert_decoded_image(decodingResult.value, imgitem, out_colorspace, out_chroma, options, nullptr);
+}
+
+
+Result<std::shared_ptr<HeifPixelImage>> HeifContext::convert_decoded_image(std::shared_ptr<HeifPixelImage> img,
+                                                                           const std::shared_ptr<const ImageItem>& imgitem,
+                                                                           heif_colorspace out_colorspace,
+                                                                           heif_chroma out_chroma,
+                                                                           const struct heif_decoding_options& options,
+                                                                           const std::map<heif_channel, PlaneBuffer>* output_buffers) const
+{
+  // the images created by the color conversion use the context's allocator
+  img->set_allocator(get_image_allocator());
 
 
   // --- convert to output chroma format
@@ -1069,12 +1892,25 @@ Result<std::shared_ptr<HeifPixelImage>> HeifContext::decode_image(heif_item_id I
   // TODO: check BPP changed
   if (different_chroma || different_colorspace) {
 
-    img = convert_colorspace(img, target_colorspace, target_chroma, nullptr, bpp, options.color_conversion_options);
+    img = convert_colorspace(img, target_colorspace, target_chroma, nullptr, bpp, options.color_conversion_options,
+                             output_buffers,
+                             get_color_conversion_thread_pool(img->get_width(), img->get_height()).get());
     if (!img) {
       return Error(heif_error_Unsupported_feature, heif_suberror_Unsupported_color_conversion);
     }
   }
 
+  // --- copy the planes that could not be decoded in-place into the caller's buffers
+
+  if (output_buffers) {
+    img->set_plane_buffers(*output_buffers);
+
+    Error err = img->move_planes_into_plane_buffers();
+    if (err) {
+      return err;
+    }
+  }
+
   img->add_warnings(imgitem->get_decoding_warnings());
 
   return img;
@@ -1113,6 +1949,225 @@ Result<std::shared_ptr<ImageItem>> HeifContext::encode_image(const std::shared_p
                                 struct heif_encoder* encoder,
                                 const struct heif_encoding_options& in_options,
                                 enum heif_image_input_class input_class)
+{
+  if (is_encoded_as_grid(*pixel_image, in_options)) {
+    return encode_image_as_grid(pixel_image, encoder, in_options, input_class);
+  }
+
+  CompressedImage compressed;
+  Error err = prepare_image_for_compression(pixel_image, encoder, in_options, input_class, compressed);
+  if (err) {
+    return err;
+  }
+
+  // The color image, its alpha channel and the thumbnail (with its alpha) are compressed concurrently.
+
+  std::vector<CompressedImage*> images{&compressed};
+  for (size_t i = 0; i < images.size(); i++) {
+    if (images[i]->alpha) {
+      images.push_back(images[i]->alpha.get());
+    }
+    if (images[i]->thumbnail) {
+      images.push_back(images[i]->thumbnail.get());
+    }
+  }
+
+  err = run_encoding_tasks(images.size(), encoder,
+                           [&images, this](size_t idx, struct heif_encoder* instance) {
+                             return compress_prepared_image(instance, *images[idx], false);
+                           });
+  if (err) {
+    return err;
+  }
+
+  return add_compressed_image(compressed, encoder->plugin->compression_format);
+}
+
+
+bool HeifContext::is_encoded_as_grid(const HeifPixelImage& image, const struct heif_encoding_options& options)
+{
+  return (options.grid_tile_width != 0 && options.grid_tile_height != 0 &&
+          (image.get_width() > options.grid_tile_width ||
+           image.get_height() > options.grid_tile_height));
+}
+
+
+// Cuts the image into tiles in row-major order. Tiles at the right and bottom border are padded to the full tile size.
+static Result<std::vector<std::shared_ptr<HeifPixelImage>>> split_into_tiles(const std::shared_ptr<HeifPixelImage>& image,
+                                                                             uint32_t tile_width, uint32_t tile_height)
+{
+  uint32_t width = image->get_width();
+  uint32_t height = image->get_height();
+
+  std::vector<std::shared_ptr<HeifPixelImage>> tiles;
+
+  for (uint32_t y0 = 0; y0 < height; y0 += tile_height) {
+    for (uint32_t x0 = 0; x0 < width; x0 += tile_width) {
+      uint32_t x1 = std::min(x0 + tile_width, width) - 1;
+      uint32_t y1 = std::min(y0 + tile_height, height) - 1;
+
+      auto cropResult = image->crop(x0, x1, y0, y1);
+      if (cropResult.error) {
+        return cropResult.error;
+      }
+
+      std::shared_ptr<HeifPixelImage> tile = *cropResult;
+
+      if (tile->get_width() != tile_width || tile->get_height() != tile_height) {
+        if (!tile->extend_padding_to_size(tile_width, tile_height, true)) {
+          return Error(heif_error_Memory_allocation_error, heif_suberror_Unspecified);
+        }
+      }
+
+      tiles.push_back(tile);
+    }
+  }
+
+  return tiles;
+}
+
+
+Result<std::shared_ptr<ImageItem>> HeifContext::encode_image_as_grid(const std::shared_ptr<HeifPixelImage>& pixel_image,
+                                                                     struct heif_encoder* encoder,
+                                                                     const struct heif_encoding_options& options,
+                                                                     enum heif_image_input_class input_class)
+{
+  uint32_t tile_width = options.grid_tile_width;
+  uint32_t tile_height = options.grid_tile_height;
+
+  uint32_t columns = (pixel_image->get_width() + tile_width - 1) / tile_width;
+  uint32_t rows = (pixel_image->get_height() + tile_height - 1) / tile_height;
+
+  // The 'grid' box stores the number of rows and columns in 8 bits each.
+  if (columns > 256 || rows > 256) {
+    return Error{heif_error_Usage_error,
+                 heif_suberror_Invalid_parameter_value,
+                 "Grid tile size is too small for the image size (maximum: 256 x 256 tiles)"};
+  }
+
+  heif_chroma chroma = pixel_image->get_chroma_format();
+  if (((chroma == heif_chroma_420 || chroma == heif_chroma_422) && tile_width % 2 != 0) ||
+      (chroma == heif_chroma_420 && tile_height % 2 != 0)) {
+    return Error{heif_error_Usage_error,
+                 heif_suberror_Invalid_parameter_value,
+                 "Grid tile size must be a multiple of the chroma subsampling"};
+  }
+
+  // --- Codecs that cannot store the alpha channel in the image get a second grid with the alpha tiles.
+
+  auto codec_item = ImageItem::alloc_for_compression_format(this, encoder->plugin->compression_format);
+  bool separate_alpha_grid = (options.save_alpha_channel &&
+                              pixel_image->has_alpha() &&
+                              codec_item->get_auxC_alpha_channel_type() != nullptr);
+
+  heif_encoding_options tile_options = options;
+  tile_options.thumbnail_bbox_size = 0;
+  if (separate_alpha_grid) {
+    tile_options.save_alpha_channel = false;
+  }
+
+  auto tilesResult = split_into_tiles(pixel_image, tile_width, tile_height);
+  if (tilesResult.error) {
+    return tilesResult.error;
+  }
+
+  auto gridResult = ImageItem_Grid::add_and_encode_full_grid(this, *tilesResult,
+                                                             static_cast<uint16_t>(rows), static_cast<uint16_t>(columns),
+                                                             pixel_image->get_width(), pixel_image->get_height(),
+                                                             encoder, tile_options, input_class);
+  if (gridResult.error) {
+    return gridResult.error;
+  }
+
+  std::shared_ptr<ImageItem_Grid> grid_item = *gridResult;
+
+
+  // --- encode the alpha channel as a grid with the same layout
+
+  if (separate_alpha_grid) {
+    std::shared_ptr<HeifPixelImage> alpha_source = pixel_image;
+
+    // create_alpha_image_from_image_alpha_channel() cannot extract the alpha from high bit-depth interleaved images
+    if (chroma == heif_chroma_interleaved_RRGGBBAA_BE || chroma == heif_chroma_interleaved_RRGGBBAA_LE) {
+      int bpp = pixel_image->get_bits_per_pixel(heif_channel_interleaved);
+      alpha_source = convert_colorspace(pixel_image, heif_colorspace_RGB, heif_chroma_444, nullptr, bpp,
+                                        options.color_conversion_options, nullptr,
+                                        get_color_conversion_thread_pool(pixel_image->get_width(),
+                                                                         pixel_image->get_height()).get());
+      if (!alpha_source) {
+        return Error(heif_error_Unsupported_feature, heif_suberror_Unsupported_color_conversion);
+      }
+    }
+
+    std::shared_ptr<HeifPixelImage> alpha_image = create_alpha_image_from_image_alpha_channel(alpha_source);
+
+    auto alphaTilesResult = split_into_tiles(alpha_image, tile_width, tile_height);
+    if (alphaTilesResult.error) {
+      return alphaTilesResult.error;
+    }
+
+    auto alphaGridResult = ImageItem_Grid::add_and_encode_full_grid(this, *alphaTilesResult,
+                                                                    static_cast<uint16_t>(rows), static_cast<uint16_t>(columns),
+                                                                    pixel_image->get_width(), pixel_image->get_height(),
+                                                                    encoder, tile_options, heif_image_input_class_alpha);
+    if (alphaGridResult.error) {
+      return alphaGridResult.error;
+    }
+
+    std::shared_ptr<ImageItem_Grid> alpha_grid_item = *alphaGridResult;
+
+    m_heif_file->add_iref_reference(alpha_grid_item->get_id(), fourcc("auxl"), {grid_item->get_id()});
+    m_heif_file->set_auxC_property(alpha_grid_item->get_id(), codec_item->get_auxC_alpha_channel_type());
+
+    if (pixel_image->is_premultiplied_alpha()) {
+      m_heif_file->add_iref_reference(grid_item->get_id(), fourcc("prem"), {alpha_grid_item->get_id()});
+    }
+  }
+
+
+  // --- the thumbnail is not a grid and is scaled from the input image
+
+  if (options.thumbnail_bbox_size > 0 && input_class == heif_image_input_class_normal) {
+    heif_encoding_options thumbnail_options = options;
+    thumbnail_options.grid_tile_width = 0;
+    thumbnail_options.grid_tile_height = 0;
+    thumbnail_options.save_alpha_channel = (options.save_alpha_channel && options.save_thumbnail_alpha_channel);
+
+    auto thumbnailResult = encode_thumbnail(pixel_image, encoder, thumbnail_options,
+                                            static_cast<int>(options.thumbnail_bbox_size));
+    if (thumbnailResult.error) {
+      return thumbnailResult.error;
+    }
+
+    if (*thumbnailResult) {
+      assign_thumbnail(grid_item, *thumbnailResult);
+    }
+  }
+
+  return std::shared_ptr<ImageItem>(grid_item);
+}
+
+
+Error HeifContext::compress_image(const std::shared_ptr<HeifPixelImage>& pixel_image,
+                                  struct heif_encoder* encoder,
+                                  const struct heif_encoding_options& options,
+                                  enum heif_image_input_class input_class,
+                                  CompressedImage& out_image)
+{
+  Error err = prepare_image_for_compression(pixel_image, encoder, options, input_class, out_image);
+  if (err) {
+    return err;
+  }
+
+  return compress_prepared_image(encoder, out_image);
+}
+
+
+Error HeifContext::prepare_image_for_compression(const std::shared_ptr<HeifPixelImage>& pixel_image,
+                                                 struct heif_encoder* encoder,
+                                                 const struct heif_encoding_options& in_options,
+                                                 enum heif_image_input_class input_class,
+                                                 CompressedImage& out_image)
 {
   std::shared_ptr<ImageItem> output_image_item = ImageItem::alloc_for_compression_format(this, encoder->plugin->compression_format);
 
@@ -1156,15 +2211,16 @@ Result<std::shared_ptr<ImageItem>> HeifContext::encode_image(const std::shared_p
 
   std::shared_ptr<HeifPixelImage> colorConvertedImage = srcImageResult.value;
 
+  output_image_item->set_size(colorConvertedImage->get_width(), colorConvertedImage->get_height());
 
-  Error err = output_image_item->encode_to_item(this,
-                                                colorConvertedImage,
-                                                encoder, options, input_class);
-  if (err) {
-    return err;
-  }
-
-  insert_image_item(output_image_item->get_id(), output_image_item);
+  out_image.item = output_image_item;
+  out_image.image = colorConvertedImage;
+  out_image.coded_data = ImageItem::CodedImageData{};
+  out_image.options = options;
+  out_image.input_class = input_class;
+  out_image.premultiplied_alpha = pixel_image->is_premultiplied_alpha();
+  out_image.alpha.reset();
+  out_image.thumbnail.reset();
 
 
   // --- if there is an alpha channel, add it as an additional image
@@ -1179,33 +2235,200 @@ Result<std::shared_ptr<ImageItem>> HeifContext::encode_image(const std::shared_p
     std::shared_ptr<HeifPixelImage> alpha_image;
     alpha_image = create_alpha_image_from_image_alpha_channel(colorConvertedImage);
 
+    out_image.alpha = std::make_shared<CompressedImage>();
+    Error err = prepare_image_for_compression(alpha_image, encoder, options,
+                                              heif_image_input_class_alpha, *out_image.alpha);
+    if (err) {
+      return err;
+    }
+  }
+
+
+  // --- scale the thumbnail from the converted image, so that it does not have to be converted again
+
+  uint32_t thumb_width, thumb_height;
+
+  if (input_class == heif_image_input_class_normal &&
+      options.thumbnail_bbox_size > 0 &&
+      get_thumbnail_size(colorConvertedImage->get_width(), colorConvertedImage->get_height(),
+                         options.thumbnail_bbox_size, thumb_width, thumb_height)) {
+    // Averaging avoids the aliasing of nearest-neighbor sampling at the large downscaling factors of thumbnails.
+    // scale_area_average() keeps the color profiles and the alpha premultiplication.
+    std::shared_ptr<HeifPixelImage> thumbnail_image;
+    Error err = colorConvertedImage->scale_area_average(thumbnail_image, thumb_width, thumb_height);
+    if (err.error_code == heif_error_Unsupported_feature) {
+      // e.g. floating point samples
+      err = colorConvertedImage->scale_nearest_neighbor(thumbnail_image, thumb_width, thumb_height);
+      if (!err) {
+        thumbnail_image->set_color_profile_nclx(colorConvertedImage->get_color_profile_nclx());
+        thumbnail_image->set_color_profile_icc(colorConvertedImage->get_color_profile_icc());
+        thumbnail_image->set_premultiplied_alpha(colorConvertedImage->is_premultiplied_alpha());
+      }
+    }
+    if (err) {
+      return err;
+    }
+
+    heif_encoding_options thumbnail_options = options;
+    thumbnail_options.thumbnail_bbox_size = 0;
+    thumbnail_options.save_alpha_channel = (options.save_alpha_channel && options.save_thumbnail_alpha_channel);
+
+    out_image.thumbnail = std::make_shared<CompressedImage>();
+    err = prepare_image_for_compression(thumbnail_image, encoder, thumbnail_options,
+                                        heif_image_input_class_thumbnail, *out_image.thumbnail);
+    if (err) {
+      return err;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Error HeifContext::compress_prepared_image(struct heif_encoder* encoder, CompressedImage& image,
+                                           bool include_alpha_and_thumbnail)
+{
+  Result<ImageItem::CodedImageData> codingResult = image.item->encode_to_bitstream_and_boxes(image.image, encoder,
+                                                                                             image.options,
+                                                                                             image.input_class);
+  if (codingResult.error) {
+    return codingResult.error;
+  }
+
+  image.coded_data = std::move(codingResult.value);
+
+  if (include_alpha_and_thumbnail) {
+    if (image.alpha) {
+      Error err = compress_prepared_image(encoder, *image.alpha);
+      if (err) {
+        return err;
+      }
+    }
+
+    if (image.thumbnail) {
+      return compress_prepared_image(encoder, *image.thumbnail);
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Result<std::shared_ptr<ImageItem>> HeifContext::add_compressed_image(const CompressedImage& image,
+                                                                     heif_compression_format compression_format)
+{
+  std::shared_ptr<ImageItem> output_image_item = image.item;
+
+  Error err = output_image_item->add_coded_image_to_file(this, image.image, image.coded_data,
+                                                         compression_format, image.options);
+  if (err) {
+    return err;
+  }
+
+  insert_image_item(output_image_item->get_id(), output_image_item);
+
 
-    // --- encode the alpha image
+  // --- add the alpha image and connect it to the main image
 
-    auto alphaEncodingResult = encode_image(alpha_image, encoder, options,
-                         heif_image_input_class_alpha);
-    if (alphaEncodingResult.error) {
-      return alphaEncodingResult.error;
+  if (image.alpha) {
+    auto alphaResult = add_compressed_image(*image.alpha, compression_format);
+    if (alphaResult.error) {
+      return alphaResult.error;
     }
 
-    std::shared_ptr<ImageItem> heif_alpha_image = *alphaEncodingResult;
+    std::shared_ptr<ImageItem> heif_alpha_image = *alphaResult;
 
     m_heif_file->add_iref_reference(heif_alpha_image->get_id(), fourcc("auxl"), {output_image_item->get_id()});
     m_heif_file->set_auxC_property(heif_alpha_image->get_id(), output_image_item->get_auxC_alpha_channel_type());
 
-    if (pixel_image->is_premultiplied_alpha()) {
+    if (image.premultiplied_alpha) {
       m_heif_file->add_iref_reference(output_image_item->get_id(), fourcc("prem"), {heif_alpha_image->get_id()});
     }
   }
 
 
-  m_heif_file->set_brand(encoder->plugin->compression_format,
+  // --- add the thumbnail (with its own alpha image)
+
+  if (image.thumbnail) {
+    auto thumbnailResult = add_compressed_image(*image.thumbnail, compression_format);
+    if (thumbnailResult.error) {
+      return thumbnailResult.error;
+    }
+
+    assign_thumbnail(output_image_item, *thumbnailResult);
+  }
+
+
+  m_heif_file->set_brand(compression_format,
                          output_image_item->is_miaf_compatible());
 
   return output_image_item;
 }
 
 
+Error HeifContext::run_encoding_tasks(size_t num_tasks, struct heif_encoder* encoder,
+                                      const std::function<Error(size_t idx, struct heif_encoder* encoder)>& task)
+{
+  size_t num_threads = std::min(static_cast<size_t>(std::max(m_max_encoding_threads, 1)), num_tasks);
+
+#if ENABLE_MULTITHREADING_SUPPORT
+  if (num_threads > 1) {
+    // One encoder instance per thread. The instances are taken from the idle list when a task starts.
+    // Since there are never more tasks running than threads, the list cannot run empty.
+
+    std::vector<std::shared_ptr<heif_encoder>> encoder_clones;
+    std::vector<struct heif_encoder*> idle_encoders{encoder};
+    std::mutex idle_encoders_mutex;
+
+    for (size_t i = 1; i < num_threads; i++) {
+      auto cloneResult = encoder->clone();
+      if (cloneResult.error) {
+        return cloneResult.error;
+      }
+
+      encoder_clones.push_back(*cloneResult);
+      idle_encoders.push_back(encoder_clones.back().get());
+    }
+
+    ThreadPool pool(static_cast<int>(num_threads));
+    TaskGroup tasks(&pool);
+
+    for (size_t i = 0; i < num_tasks; i++) {
+      tasks.run([&task, &idle_encoders, &idle_encoders_mutex, i]() -> Error {
+        struct heif_encoder* instance;
+        {
+          std::lock_guard<std::mutex> lock(idle_encoders_mutex);
+          assert(!idle_encoders.empty());
+          instance = idle_encoders.back();
+          idle_encoders.pop_back();
+        }
+
+        Error err = task(i, instance);
+
+        {
+          std::lock_guard<std::mutex> lock(idle_encoders_mutex);
+          idle_encoders.push_back(instance);
+        }
+
+        return err;
+      });
+    }
+
+    return tasks.wait();
+  }
+#endif
+
+  for (size_t i = 0; i < num_tasks; i++) {
+    Error err = task(i, encoder);
+    if (err) {
+      return err;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
 void HeifContext::set_primary_image(const std::shared_ptr<ImageItem>& image)
 {
   // update heif context
@@ -1234,36 +2457,44 @@ Error HeifContext::assign_thumbnail(const std::shared_ptr<ImageItem>& master_ima
 }
 
 
-Result<std::shared_ptr<ImageItem>> HeifContext::encode_thumbnail(const std::shared_ptr<HeifPixelImage>& image,
-                                                                 struct heif_encoder* encoder,
-                                                                 const struct heif_encoding_options& options,
-                                                                 int bbox_size)
+bool HeifContext::get_thumbnail_size(uint32_t width, uint32_t height, uint32_t bbox_size,
+                                     uint32_t& thumb_width, uint32_t& thumb_height)
 {
-  int orig_width = image->get_width();
-  int orig_height = image->get_height();
-
-  int thumb_width, thumb_height;
-
-  if (orig_width <= bbox_size && orig_height <= bbox_size) {
-    // original image is smaller than thumbnail size -> do not encode any thumbnail
-
-    return Error::Ok;
+  if (width <= bbox_size && height <= bbox_size) {
+    return false;
   }
-  else if (orig_width > orig_height) {
-    thumb_height = orig_height * bbox_size / orig_width;
+  else if (width > height) {
+    thumb_height = static_cast<uint32_t>(uint64_t{height} * bbox_size / width);
     thumb_width = bbox_size;
   }
   else {
-    thumb_width = orig_width * bbox_size / orig_height;
+    thumb_width = static_cast<uint32_t>(uint64_t{width} * bbox_size / height);
     thumb_height = bbox_size;
   }
 
-
   // round size to even width and height
 
-  thumb_width &= ~1;
-  thumb_height &= ~1;
+  thumb_width &= ~1U;
+  thumb_height &= ~1U;
+
+  return true;
+}
+
+
+Result<std::shared_ptr<ImageItem>> HeifContext::encode_thumbnail(const std::shared_ptr<HeifPixelImage>& image,
+                                                                 struct heif_encoder* encoder,
+                                                                 const struct heif_encoding_options& options,
+                                                                 int bbox_size)
+{
+  uint32_t thumb_width, thumb_height;
+
+  if (bbox_size <= 0 ||
+      !get_thumbnail_size(image->get_width(), image->get_height(), static_cast<uint32_t>(bbox_size),
+                          thumb_width, thumb_height)) {
+    // original image is smaller than thumbnail size -> do not encode any thumbnail
 
+    return Error::Ok;
+  }
 
   std::shared_ptr<HeifPixelImage> thumbnail_image;
   Error error = image->scale_nearest_neighbor(thumbnail_image, thumb_width, thumb_height);
@@ -1271,8 +2502,11 @@ Result<std::shared_ptr<ImageItem>> HeifContext::encode_thumbnail(const std::shar
     return error;
   }
 
+  heif_encoding_options thumbnail_options = options;
+  thumbnail_options.thumbnail_bbox_size = 0;
+
   auto encodingResult = encode_image(thumbnail_image,
-                       encoder, options,
+                       encoder, thumbnail_options,
                        heif_image_input_class_thumbnail);
   if (encodingResult.error) {
     return encodingResult.error;
@@ -21,6 +21,8 @@
 #ifndef LIBHEIF_CONTEXT_H
 #define LIBHEIF_CONTEXT_H
 
+#include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -38,15 +40,34 @@
 #include "box.h" // only for color_profile, TODO: maybe move the color_profiles to its own header
 
 #include "region.h"
+#include "image-items/image_item.h"
+
+#if ENABLE_PARALLEL_TILE_DECODING
+
+#include <mutex>
+
+#endif
+
+class ImageMetadata;
 
 class HeifFile;
 
 class HeifPixelImage;
 
+struct PlaneBuffer;
+
 class StreamWriter;
 
 class ImageItem;
 
+class ThreadPool;
+
+class DecoderInstancePool;
+
+class ImageAllocator;
+
+class PooledImageAllocator;
+
 
 // This is a higher-level view than HeifFile.
 // Images are grouped logically into main images and their thumbnails.
@@ -58,10 +79,73 @@ public:
 
   ~HeifContext();
 
-  void set_max_decoding_threads(int max_threads) { m_max_decoding_threads = max_threads; }
+  void set_max_decoding_threads(int max_threads);
 
   int get_max_decoding_threads() const { return m_max_decoding_threads; }
 
+  // The pool is shared by all tiles and images decoded through this context and sized to
+  // the maximum number of decoding threads. Returns NULL if decoding runs in the calling thread.
+  // Callers keep the returned reference while they use the pool, because the context may
+  // switch to a new pool when the number of decoding threads is changed.
+  std::shared_ptr<ThreadPool> get_thread_pool() const;
+
+  // The thread pool for converting the colorspace of an image of the given size.
+  // Returns the pool if it exists already. Otherwise, it is only created for images that are large enough
+  // to profit from it, so that decoding a single small image does not start any threads.
+  std::shared_ptr<ThreadPool> get_color_conversion_thread_pool(uint32_t width, uint32_t height) const;
+
+  // Use a thread pool that is shared with other contexts instead of creating an own one.
+  // The maximum number of decoding threads is set to the size of the pool.
+  void set_thread_pool(std::shared_ptr<ThreadPool> pool);
+
+  // Parameters for the decoder plugins (see DecoderParameters) for an image that is decoded in the calling thread.
+  // The number of threads is only passed when the maximum number of decoding threads was set explicitly.
+  // Images that are decoded on the thread pool already run in parallel and their decoder uses a single thread.
+  // Otherwise, the decoder may use up to the maximum number of decoding threads.
+  // Parameters given in 'options.decoder_parameters' take precedence.
+  std::map<std::string, std::string> get_decoder_parameters(const heif_decoding_options& options) const;
+
+  // Idle decoder plugin instances that are reused for decoding further images (e.g. grid tiles).
+  // The pool may be shared between several contexts.
+  DecoderInstancePool* get_decoder_instance_pool() const { return m_decoder_instance_pool.get(); }
+
+  // Maximum number of images (e.g. grid tiles) that are compressed concurrently by run_encoding_tasks().
+  void set_max_encoding_threads(int max_threads) { m_max_encoding_threads = max_threads; }
+
+  int get_max_encoding_threads() const { return m_max_encoding_threads; }
+
+  // Runs 'task' for the indices 0..num_tasks-1 with up to get_max_encoding_threads() tasks in parallel.
+  // Each concurrently running task gets its own instance of the encoder plugin, configured like 'encoder'.
+  // The tasks may finish in any order and must not modify the file. Returns the error of the first failed task.
+  Error run_encoding_tasks(size_t num_tasks, struct heif_encoder* encoder,
+                           const std::function<Error(size_t idx, struct heif_encoder* encoder)>& task);
+
+  void set_decoder_instance_pool(std::shared_ptr<DecoderInstancePool> pool) { m_decoder_instance_pool = std::move(pool); }
+
+  // Allocator for the images that are created by this context. nullptr selects the global allocator.
+  void set_image_allocator(std::shared_ptr<ImageAllocator> allocator);
+
+  // Pool for the buffers of this context's images. 'max_cached_bytes' == 0 disables the pool.
+  void set_image_buffer_pool(size_t max_cached_bytes);
+
+  std::shared_ptr<ImageAllocator> get_image_allocator() const;
+
+  // Returns nullptr if the context has no buffer pool.
+  const std::shared_ptr<PooledImageAllocator>& get_image_buffer_pool() const { return m_image_buffer_pool; }
+
+  // Interpret image items when they are accessed for the first time instead of all of them when the file is read.
+  // Only the top-level images and the items they depend on are interpreted while reading.
+  // Has to be set before reading the file.
+  void set_deferred_image_interpretation(bool flag) { m_deferred_image_interpretation = flag; }
+
+  bool get_deferred_image_interpretation() const { return m_deferred_image_interpretation; }
+
+  // Let read_from_file() memory-map the file instead of reading it through a file stream.
+  void set_memory_mapped_file_reading(bool flag) { m_memory_mapped_file_reading = flag; }
+
+  // Let the HeifFile allocate the parsed boxes from an arena.
+  void set_arena_allocation(bool flag) { m_arena_allocation = flag; }
+
   void set_security_limits(const heif_security_limits* limits);
 
   [[nodiscard]] heif_security_limits* get_security_limits() { return &m_limits; }
@@ -102,7 +186,15 @@ public:
                                                        heif_colorspace out_colorspace,
                                                        heif_chroma out_chroma,
                                                        const struct heif_decoding_options& options,
-                                                       bool decode_only_tile, uint32_t tx, uint32_t ty) const;
+                                                       bool decode_only_tile, uint32_t tx, uint32_t ty,
+                                                       const std::map<heif_channel, PlaneBuffer>* output_buffers = nullptr) const;
+
+  // The region is given in the coordinates of the decoded image (see ImageItem::decode_image_region()).
+  Result<std::shared_ptr<HeifPixelImage>> decode_image_region(heif_item_id ID,
+                                                              heif_colorspace out_colorspace,
+                                                              heif_chroma out_chroma,
+                                                              const struct heif_decoding_options& options,
+                                                              uint32_t x0, uint32_t y0, uint32_t width, uint32_t height) const;
 
   Error get_id_of_non_virtual_child_image(heif_item_id in, heif_item_id& out) const;
 
@@ -111,8 +203,12 @@ public:
 
   // === writing ===
 
+  // In FileLayout::WriteMode::TmpFile, the 'mdat' payload has to be appended with HeifFile::write_item_data().
   void write(StreamWriter& writer);
 
+  // Completes the output file in FileLayout::WriteMode::Streaming.
+  Error finish_streaming();
+
   // Create all boxes necessary for an empty HEIF file.
   // Note that this is no valid HEIF file, since some boxes (e.g. pitm) are generated, but
   // contain no valid data yet.
@@ -123,6 +219,55 @@ public:
                                                   const struct heif_encoding_options& options,
                                                   enum heif_image_input_class input_class);
 
+  // Splits the image into a 'grid' of tiles of size options.grid_tile_width x options.grid_tile_height.
+  // This is called by encode_image() for images that are larger than this tile size.
+  Result<std::shared_ptr<ImageItem>> encode_image_as_grid(const std::shared_ptr<HeifPixelImage>& image,
+                                                          struct heif_encoder* encoder,
+                                                          const struct heif_encoding_options& options,
+                                                          enum heif_image_input_class input_class);
+
+  // An image (and its alpha channel) that has been compressed by compress_image(), but not been added to the file yet.
+  struct CompressedImage
+  {
+    std::shared_ptr<ImageItem> item;
+    std::shared_ptr<HeifPixelImage> image; // the color converted input image
+    ImageItem::CodedImageData coded_data;
+    heif_encoding_options options;
+    heif_image_input_class input_class = heif_image_input_class_normal;
+    bool premultiplied_alpha = false;
+
+    std::shared_ptr<CompressedImage> alpha;
+    std::shared_ptr<CompressedImage> thumbnail; // see heif_encoding_options::thumbnail_bbox_size
+  };
+
+  // encode_image() is compress_image() followed by add_compressed_image().
+  // compress_image() does not modify the file and can run concurrently for different encoder instances.
+  Error compress_image(const std::shared_ptr<HeifPixelImage>& image,
+                       struct heif_encoder* encoder,
+                       const struct heif_encoding_options& options,
+                       enum heif_image_input_class input_class,
+                       CompressedImage& out_image);
+
+  // compress_image() is split into these two steps, so that the color conversion of the next image
+  // can run while the current image is being compressed (see EncodingPipeline).
+  // prepare_image_for_compression() converts the image into the colorspace of the codec and prepares its alpha
+  // channel and thumbnail images.
+  Error prepare_image_for_compression(const std::shared_ptr<HeifPixelImage>& image,
+                                      struct heif_encoder* encoder,
+                                      const struct heif_encoding_options& options,
+                                      enum heif_image_input_class input_class,
+                                      CompressedImage& out_image);
+
+  // Fills 'image.coded_data' (and that of its alpha channel and thumbnail).
+  Error compress_prepared_image(struct heif_encoder* encoder, CompressedImage& image,
+                                bool include_alpha_and_thumbnail = true);
+
+  // Whether encode_image() splits this image into a grid of tiles.
+  static bool is_encoded_as_grid(const HeifPixelImage& image, const struct heif_encoding_options& options);
+
+  Result<std::shared_ptr<ImageItem>> add_compressed_image(const CompressedImage& image,
+                                                          heif_compression_format compression_format);
+
   void set_primary_image(const std::shared_ptr<ImageItem>& image);
 
   bool is_primary_image_set() const { return m_primary_image != nullptr; }
@@ -130,6 +275,10 @@ public:
   Error assign_thumbnail(const std::shared_ptr<ImageItem>& master_image,
                          const std::shared_ptr<ImageItem>& thumbnail_image);
 
+  // Size of a thumbnail that fits into a square of 'bbox_size'. Returns false if the image is not larger than that.
+  static bool get_thumbnail_size(uint32_t width, uint32_t height, uint32_t bbox_size,
+                                 uint32_t& thumb_width, uint32_t& thumb_height);
+
   Result<std::shared_ptr<ImageItem>> encode_thumbnail(const std::shared_ptr<HeifPixelImage>& image,
                                                       struct heif_encoder* encoder,
                                                       const struct heif_encoding_options& options,
@@ -169,6 +318,20 @@ public:
   void add_region_referenced_mask_ref(heif_item_id region_item_id, heif_item_id mask_item_id);
 
 private:
+  // Adds the data that is generated at write time (e.g. regions) to the file.
+  void prepare_for_write();
+
+  // Decodes the image scaled down to fit into options.max_output_width x options.max_output_height.
+  Result<std::shared_ptr<HeifPixelImage>> decode_image_downscaled(const std::shared_ptr<const ImageItem>& imgitem,
+                                                                  const struct heif_decoding_options& options) const;
+
+  Result<std::shared_ptr<HeifPixelImage>> convert_decoded_image(std::shared_ptr<HeifPixelImage> img,
+                                                                const std::shared_ptr<const ImageItem>& imgitem,
+                                                                heif_colorspace out_colorspace,
+                                                                heif_chroma out_chroma,
+                                                                const struct heif_decoding_options& options,
+                                                                const std::map<heif_channel, PlaneBuffer>* output_buffers) const;
+
   std::map<heif_item_id, std::shared_ptr<ImageItem>> m_all_images;
 
   // We store this in a vector because we need stable indices for the C API.
@@ -179,14 +342,70 @@ private:
 
   std::shared_ptr<HeifFile> m_heif_file;
 
-  int m_max_decoding_threads = 4;
+  std::atomic<int> m_max_decoding_threads{4};
+  std::atomic<bool> m_decoding_threads_set{false}; // whether the decoder plugins get a number of threads
+  int m_max_encoding_threads = 1;
+
+#if ENABLE_PARALLEL_TILE_DECODING
+  mutable std::mutex m_thread_pool_mutex;
+#endif
+
+  mutable std::shared_ptr<ThreadPool> m_thread_pool; // created on first use
+
+  std::shared_ptr<DecoderInstancePool> m_decoder_instance_pool;
+
+  std::shared_ptr<ImageAllocator> m_image_allocator; // nullptr: global allocator
+  std::shared_ptr<PooledImageAllocator> m_image_buffer_pool;
 
   heif_security_limits m_limits;
 
   std::vector<std::shared_ptr<RegionItem>> m_region_items;
 
+  bool m_deferred_image_interpretation = false;
+  bool m_memory_mapped_file_reading = false;
+  bool m_arena_allocation = false;
+
+  std::map<heif_item_id, std::shared_ptr<ImageMetadata>> m_metadata_items; // nullptr: unsupported metadata item
+
+#if ENABLE_PARALLEL_TILE_DECODING
+  mutable std::recursive_mutex m_deferred_images_mutex;
+#endif
+
   Error interpret_heif_file();
 
+  Error interpret_heif_file_deferred();
+
+  bool is_deferred_top_level_image(heif_item_id id) const;
+
+  // Image items that have not been interpreted yet (deferred image interpretation only).
+  // They are allocated when they are interpreted, such that opening a file does not touch all items.
+  bool is_uninterpreted_image(heif_item_id id) const;
+
+  // Returns the image with the given ID. With deferred image interpretation, the image is interpreted if this did not happen yet.
+  std::shared_ptr<ImageItem> find_referenced_image(heif_item_id id, Error& out_error);
+
+  // Interprets an image that was deferred. If this fails, the image is replaced by an ImageItem_Error.
+  std::shared_ptr<ImageItem> interpret_deferred_image(heif_item_id id, Error& out_error);
+
+  Error interpret_image_item(const std::shared_ptr<ImageItem>& image);
+
+  Error interpret_image_properties(const std::shared_ptr<ImageItem>& image);
+
+  // Attaches thumbnails and auxiliary images to their master image.
+  Error interpret_image_references(const std::shared_ptr<ImageItem>& image);
+
+  Error check_codec_configuration(const std::shared_ptr<ImageItem>& image) const;
+
+  void inherit_color_profile_from_grid_tile(const std::shared_ptr<ImageItem>& image);
+
+  // Returns nullptr if the item has no data that we can use.
+  Result<std::shared_ptr<ImageMetadata>> read_metadata_item(heif_item_id id);
+
+  Result<std::shared_ptr<RegionItem>> read_region_item(heif_item_id id);
+
+  Error assign_region_mask_images(const std::shared_ptr<RegionItem>& region_item,
+                                  const std::vector<heif_item_id>& mask_refs);
+
   void remove_top_level_image(const std::shared_ptr<ImageItem>& image);
 };
 
@@ -0,0 +1,135 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cpu_features.h"
+
+#include <atomic>
+
+#if HAVE_X86_SIMD && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+
+#if HAVE_X86_SIMD && defined(_MSC_VER) && !defined(__clang__)
+
+static SimdLevel detect_x86_simd_level()
+{
+  int info[4];
+
+  __cpuid(info, 0);
+  int max_leaf = info[0];
+  if (max_leaf < 1) {
+    return SimdLevel::None;
+  }
+
+  __cpuid(info, 1);
+  bool has_sse41 = (info[2] & (1 << 19)) != 0;
+  bool has_osxsave = (info[2] & (1 << 27)) != 0;
+  bool has_avx = (info[2] & (1 << 28)) != 0;
+
+  if (!has_sse41) {
+    return SimdLevel::None;
+  }
+
+  // AVX2 also requires that the OS saves the YMM registers on context switches.
+
+  if (max_leaf >= 7 && has_osxsave && has_avx &&
+      (_xgetbv(0) & 0x6) == 0x6) {
+    __cpuidex(info, 7, 0);
+    if (info[1] & (1 << 5)) {
+      return SimdLevel::AVX2;
+    }
+  }
+
+  return SimdLevel::SSE41;
+}
+
+#elif HAVE_X86_SIMD
+
+static SimdLevel detect_x86_simd_level()
+{
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SimdLevel::SSE41;
+  }
+
+  return SimdLevel::None;
+}
+
+#endif
+
+
+static SimdLevel detect_simd_level()
+{
+#if HAVE_X86_SIMD
+  return detect_x86_simd_level();
+#elif HAVE_NEON_SIMD
+  return SimdLevel::NEON;
+#else
+  return SimdLevel::None;
+#endif
+}
+
+
+static std::atomic<SimdLevel> max_simd_level{SimdLevel::NEON};
+
+
+SimdLevel get_simd_level()
+{
+  static const SimdLevel detected_level = detect_simd_level();
+
+  SimdLevel max_level = max_simd_level.load(std::memory_order_relaxed);
+
+  if (detected_level == SimdLevel::NEON) {
+    return (max_level == SimdLevel::None) ? SimdLevel::None : SimdLevel::NEON;
+  }
+  else {
+    return (static_cast<int>(max_level) < static_cast<int>(detected_level)) ? max_level : detected_level;
+  }
+}
+
+
+void set_max_simd_level(SimdLevel level)
+{
+  max_simd_level.store(level, std::memory_order_relaxed);
+}
+
+
+const char* get_simd_level_name(SimdLevel level)
+{
+  switch (level) {
+    case SimdLevel::None:
+      return "none";
+    case SimdLevel::SSE41:
+      return "SSE4.1";
+    case SimdLevel::AVX2:
+      return "AVX2";
+    case SimdLevel::NEON:
+      return "NEON";
+  }
+
+  return "unknown";
+}
@@ -0,0 +1,64 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_CPU_FEATURES_H
+#define LIBHEIF_CPU_FEATURES_H
+
+// Architectures for which SIMD kernels are compiled.
+// On x86, the kernels are compiled with per-function target attributes, so that
+// the library itself does not require any instruction set beyond the baseline.
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || (defined(_M_IX86) && !defined(_M_ARM64EC))
+#define HAVE_X86_SIMD 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define HAVE_NEON_SIMD 1
+#endif
+
+#if HAVE_X86_SIMD && (defined(__GNUC__) || defined(__clang__))
+#define LIBHEIF_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define LIBHEIF_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LIBHEIF_TARGET_SSE41
+#define LIBHEIF_TARGET_AVX2
+#endif
+
+
+enum class SimdLevel
+{
+  None,
+  SSE41,
+  AVX2,
+  NEON
+};
+
+
+// Returns the best instruction set extension that is supported by the CPU,
+// limited by set_max_simd_level().
+SimdLevel get_simd_level();
+
+// Limits the SIMD kernels that are used. This is mainly intended for comparing
+// the SIMD kernels against the scalar reference implementation.
+void set_max_simd_level(SimdLevel level);
+
+const char* get_simd_level_name(SimdLevel level);
+
+#endif
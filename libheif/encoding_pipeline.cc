@@ -0,0 +1,262 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "encoding_pipeline.h"
+#include "context.h"
+#include "libheif/api_structs.h"
+#include "image-items/image_item.h"
+
+#if ENABLE_MULTITHREADING_SUPPORT
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#endif
+
+
+EncodingPipeline::EncodingPipeline(HeifContext* ctx, struct heif_encoder* encoder)
+    : m_context(ctx), m_encoder(encoder)
+{
+}
+
+
+Result<std::vector<std::shared_ptr<ImageItem>>> EncodingPipeline::encode(const std::vector<Input>& inputs)
+{
+#if ENABLE_MULTITHREADING_SUPPORT
+  if (inputs.size() > 1) {
+    return encode_pipelined(inputs);
+  }
+#endif
+
+  std::vector<std::shared_ptr<ImageItem>> items;
+
+  for (const auto& input : inputs) {
+    auto itemResult = m_context->encode_image(input.image, m_encoder, input.options, input.input_class);
+    if (itemResult.error) {
+      return itemResult.error;
+    }
+
+    items.push_back(*itemResult);
+  }
+
+  return items;
+}
+
+
+#if ENABLE_MULTITHREADING_SUPPORT
+
+Result<std::vector<std::shared_ptr<ImageItem>>> EncodingPipeline::encode_pipelined(const std::vector<Input>& inputs)
+{
+  const size_t num_images = inputs.size();
+  const size_t num_encoder_threads = std::min(static_cast<size_t>(std::max(m_context->get_max_encoding_threads(), 1)),
+                                              num_images);
+  const size_t max_in_flight = (m_max_images_in_flight > 0 ? m_max_images_in_flight : num_encoder_threads + 2);
+
+  // The compression threads work with clones of the encoder. The original instance is used by the
+  // conversion stage (for querying the input colorspace) and is not compressing images concurrently.
+
+  std::vector<std::shared_ptr<heif_encoder>> encoders;
+  for (size_t i = 0; i < num_encoder_threads; i++) {
+    auto cloneResult = m_encoder->clone();
+    if (cloneResult.error) {
+      return cloneResult.error;
+    }
+
+    encoders.push_back(*cloneResult);
+  }
+
+  enum class State
+  {
+    waiting, prepared, compressed
+  };
+
+  struct Slot
+  {
+    State state = State::waiting;
+    bool encode_as_grid = false; // grid images are completely encoded by the last stage
+    HeifContext::CompressedImage image;
+  };
+
+  std::vector<Slot> slots(num_images);
+  std::deque<size_t> prepared_images;
+  size_t num_added = 0;
+  bool conversion_done = false;
+  Error first_error;
+  bool failed = false;
+
+  std::mutex mutex;
+  std::condition_variable state_changed;
+
+  // Has to be called with the mutex held.
+  auto set_failed = [&](const Error& err) {
+    if (!failed) {
+      failed = true;
+      first_error = err;
+    }
+
+    state_changed.notify_all();
+  };
+
+  ThreadPool pool(static_cast<int>(num_encoder_threads + 1));
+  TaskGroup tasks(&pool);
+
+  // --- stage 1: color conversion
+
+  tasks.run([&]() -> Error {
+    for (size_t i = 0; i < num_images; i++) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        state_changed.wait(lock, [&]() { return failed || i < num_added + max_in_flight; });
+        if (failed) {
+          break;
+        }
+      }
+
+      const Input& input = inputs[i];
+      Slot& slot = slots[i];
+
+      Error err;
+      if (HeifContext::is_encoded_as_grid(*input.image, input.options)) {
+        slot.encode_as_grid = true;
+      }
+      else {
+        err = m_context->prepare_image_for_compression(input.image, m_encoder, input.options, input.input_class,
+                                                       slot.image);
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (err) {
+        set_failed(err);
+        break;
+      }
+
+      if (slot.encode_as_grid) {
+        slot.state = State::compressed;
+      }
+      else {
+        slot.state = State::prepared;
+        prepared_images.push_back(i);
+      }
+
+      state_changed.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    conversion_done = true;
+    state_changed.notify_all();
+
+    return Error::Ok;
+  });
+
+  // --- stage 2: compression
+
+  for (const auto& encoder : encoders) {
+    tasks.run([&, encoder = encoder.get()]() -> Error {
+      for (;;) {
+        size_t i;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          state_changed.wait(lock, [&]() { return failed || !prepared_images.empty() || conversion_done; });
+          if (failed || prepared_images.empty()) {
+            break;
+          }
+
+          i = prepared_images.front();
+          prepared_images.pop_front();
+        }
+
+        Error err = m_context->compress_prepared_image(encoder, slots[i].image);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (err) {
+          set_failed(err);
+          break;
+        }
+
+        slots[i].state = State::compressed;
+        state_changed.notify_all();
+      }
+
+      return Error::Ok;
+    });
+  }
+
+  // --- stage 3: add the images to the file in input order
+
+  std::vector<std::shared_ptr<ImageItem>> items;
+  std::shared_ptr<heif_encoder> grid_encoder;
+
+  for (size_t i = 0; i < num_images; i++) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      state_changed.wait(lock, [&]() { return failed || slots[i].state == State::compressed; });
+      if (failed) {
+        break;
+      }
+    }
+
+    Result<std::shared_ptr<ImageItem>> itemResult;
+    if (slots[i].encode_as_grid) {
+      // The original encoder may be queried by the conversion stage at the same time.
+      if (!grid_encoder) {
+        auto cloneResult = m_encoder->clone();
+        if (cloneResult.error) {
+          itemResult = cloneResult.error;
+        }
+        else {
+          grid_encoder = *cloneResult;
+        }
+      }
+
+      if (grid_encoder) {
+        itemResult = m_context->encode_image(inputs[i].image, grid_encoder.get(), inputs[i].options,
+                                             inputs[i].input_class);
+      }
+    }
+    else {
+      itemResult = m_context->add_compressed_image(slots[i].image, m_encoder->plugin->compression_format);
+    }
+
+    // release the coded data
+    slots[i].image = HeifContext::CompressedImage{};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (itemResult.error) {
+      set_failed(itemResult.error);
+      break;
+    }
+
+    items.push_back(*itemResult);
+    num_added++;
+    state_changed.notify_all();
+  }
+
+  tasks.wait();
+
+  if (failed) {
+    return first_error;
+  }
+
+  return items;
+}
+
+#endif
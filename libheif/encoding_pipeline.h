@@ -0,0 +1,71 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_ENCODING_PIPELINE_H
+#define LIBHEIF_ENCODING_PIPELINE_H
+
+#include "error.h"
+#include "pixelimage.h"
+#include "libheif/heif.h"
+#include "libheif/heif_plugin.h"
+
+#include <memory>
+#include <vector>
+
+
+class HeifContext;
+
+class ImageItem;
+
+
+// Encodes a sequence of images into the same file (e.g. the frames of a burst or the layers of a pyramid).
+// Each image passes through three stages that run concurrently for consecutive images:
+//   1. color conversion (one thread),
+//   2. compression (up to HeifContext::get_max_encoding_threads() threads, each with its own encoder instance),
+//   3. adding the compressed image to the file (the calling thread, in input order).
+// Only a limited number of images is between stage 1 and stage 3 at any time, so that the memory use
+// does not grow with the number of images.
+class EncodingPipeline
+{
+public:
+  struct Input
+  {
+    std::shared_ptr<HeifPixelImage> image;
+    heif_encoding_options options{};
+    heif_image_input_class input_class = heif_image_input_class_normal;
+  };
+
+  EncodingPipeline(HeifContext* ctx, struct heif_encoder* encoder);
+
+  // 0 (default): two more than the number of compression threads.
+  void set_max_images_in_flight(size_t max_images) { m_max_images_in_flight = max_images; }
+
+  // Returns the added items in input order. Stops at the first error.
+  Result<std::vector<std::shared_ptr<ImageItem>>> encode(const std::vector<Input>& inputs);
+
+private:
+  HeifContext* m_context;
+  struct heif_encoder* m_encoder;
+  size_t m_max_images_in_flight = 0;
+
+  Result<std::vector<std::shared_ptr<ImageItem>>> encode_pipelined(const std::vector<Input>& inputs);
+};
+
+#endif
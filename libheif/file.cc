@@ -64,42 +64,68 @@ HeifFile::HeifFile()
 
 HeifFile::~HeifFile() = default;
 
-std::vector<heif_item_id> HeifFile::get_item_IDs() const
+int HeifFile::get_num_images() const
 {
-  std::vector<heif_item_id> IDs;
+  return m_iinf_box ? static_cast<int>(m_iinf_box->get_number_of_items()) : 0;
+}
+
+
+size_t HeifFile::get_number_of_items() const
+{
+  return m_iinf_box ? m_iinf_box->get_number_of_items() : 0;
+}
+
 
-  for (const auto& infe : m_infe_boxes) {
-    IDs.push_back(infe.second->get_item_ID());
+std::vector<heif_item_id> HeifFile::get_item_IDs() const
+{
+  if (!m_iinf_box) {
+    return {};
   }
 
-  return IDs;
+  return m_iinf_box->get_item_IDs();
 }
 
 
 std::shared_ptr<const Box_infe> HeifFile::get_infe_box(heif_item_id ID) const
 {
-  auto iter = m_infe_boxes.find(ID);
-  if (iter == m_infe_boxes.end()) {
+  if (!m_iinf_box) {
     return nullptr;
   }
 
-  return iter->second;
+  return m_iinf_box->get_infe_box(ID);
 }
 
 
 std::shared_ptr<Box_infe> HeifFile::get_infe_box(heif_item_id ID)
 {
-  auto iter = m_infe_boxes.find(ID);
-  if (iter == m_infe_boxes.end()) {
+  if (!m_iinf_box) {
     return nullptr;
   }
 
-  return iter->second;
+  return m_iinf_box->get_infe_box(ID);
 }
 
 
-Error HeifFile::read_from_file(const char* input_filename)
+Error HeifFile::read_from_file(const char* input_filename, bool memory_mapped)
 {
+  auto readerResult = open_file_reader(input_filename, memory_mapped);
+  if (readerResult.error) {
+    return readerResult.error;
+  }
+
+  return read(readerResult.value);
+}
+
+
+Result<std::shared_ptr<StreamReader>> HeifFile::open_file_reader(const char* input_filename, bool memory_mapped)
+{
+  // Use a memory mapping if requested, falling back to a file stream where this is not possible.
+  if (memory_mapped) {
+    if (auto mapped_file = StreamReader_mmap::map_file(input_filename)) {
+      return std::shared_ptr<StreamReader>(mapped_file);
+    }
+  }
+
 #if defined(__MINGW32__) || defined(__MINGW64__) || defined(_MSC_VER)
   auto input_stream_istr = std::unique_ptr<std::istream>(new std::ifstream(convert_utf8_path_to_utf16(input_filename).c_str(), std::ios_base::binary));
 #else
@@ -111,8 +137,7 @@ Error HeifFile::read_from_file(const char* input_filename)
     return Error(heif_error_Input_does_not_exist, heif_suberror_Unspecified, sstr.str());
   }
 
-  auto input_stream = std::make_shared<StreamReader_istream>(std::move(input_stream_istr));
-  return read(input_stream);
+  return std::shared_ptr<StreamReader>(std::make_shared<StreamReader_istream>(std::move(input_stream_istr)));
 }
 
 
@@ -130,10 +155,20 @@ Error HeifFile::read(const std::shared_ptr<StreamReader>& reader)
 
   m_input_stream = reader;
 
+  if (m_arena_allocation) {
+    m_box_arena = std::make_shared<BoxArena>();
+  }
+
   Error err;
-  err = m_file_layout->read(reader, m_limits);
-  if (err) {
-    return err;
+
+  {
+    // Boxes that are parsed later on first access use the same arena.
+    BoxArena::Scope arena_scope(m_box_arena.get());
+
+    err = m_file_layout->read(reader, m_limits);
+    if (err) {
+      return err;
+    }
   }
 
   Error error = parse_heif_file();
@@ -167,8 +202,6 @@ void HeifFile::new_empty_file()
   m_iprp_box->append_child_box(m_ipco_box);
   m_iprp_box->append_child_box(m_ipma_box);
 
-  m_infe_boxes.clear();
-
   m_top_level_boxes.push_back(m_ftyp_box);
   m_top_level_boxes.push_back(m_meta_box);
 #if ENABLE_EXPERIMENTAL_MINI_FORMAT
@@ -265,6 +298,61 @@ void HeifFile::write(StreamWriter& writer)
 }
 
 
+Error HeifFile::set_write_mode(FileLayout::WriteMode mode, const std::string& output_filename,
+                               uint32_t reserved_header_size)
+{
+  if (m_iloc_box->has_items()) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unspecified,
+            "The write mode has to be set before adding items"};
+  }
+
+  Error err = m_file_layout->set_write_mode(mode, output_filename, reserved_header_size);
+  if (err) {
+    return err;
+  }
+
+  m_iloc_box->set_item_data_storage(m_file_layout->get_item_data_storage());
+
+  return Error::Ok;
+}
+
+
+Error HeifFile::write_item_data(const std::function<Error(const uint8_t* data, size_t size)>& write) const
+{
+  return m_file_layout->copy_item_data(write);
+}
+
+
+Error HeifFile::finish_streaming()
+{
+  if (get_write_mode() != FileLayout::WriteMode::Streaming) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unspecified,
+            "File is not written in streaming mode"};
+  }
+
+  // The 'ftyp' box is always at the start of the file, the other boxes may be placed after the 'mdat' box.
+
+  StreamWriter ftyp_writer;
+  StreamWriter meta_writer;
+
+  for (auto& box : m_top_level_boxes) {
+#if ENABLE_EXPERIMENTAL_MINI_FORMAT
+    if (box == nullptr) {
+      continue;
+    }
+#endif
+    box->derive_box_version_recursive();
+    box->write(box == m_ftyp_box ? ftyp_writer : meta_writer);
+  }
+
+  m_iloc_box->patch_item_data_offsets(meta_writer, m_file_layout->get_item_data_start());
+
+  return m_file_layout->finish_streaming(ftyp_writer, meta_writer);
+}
+
+
 std::string HeifFile::debug_dump_boxes() const
 {
   std::stringstream sstr;
@@ -407,7 +495,8 @@ Error HeifFile::parse_heif_file()
                    sstr.str());
     }
     primary_infe_box->set_item_type_4cc(infe_type);
-    m_infe_boxes.insert(std::make_pair(1, primary_infe_box));
+    m_iinf_box = std::make_shared<Box_iinf>();
+    m_iinf_box->append_child_box(primary_infe_box);
 
     if (m_mini_box->get_alpha_item_data_size() != 0) {
       std::shared_ptr<Box_infe> alpha_infe_box = std::make_shared<Box_infe>();
@@ -415,7 +504,7 @@ Error HeifFile::parse_heif_file()
       alpha_infe_box->set_flags(1);
       alpha_infe_box->set_item_ID(2);
       alpha_infe_box->set_item_type_4cc(infe_type);
-      m_infe_boxes.insert(std::make_pair(2, alpha_infe_box));
+      m_iinf_box->append_child_box(alpha_infe_box);
     }
 
     if (m_mini_box->get_exif_flag()) {
@@ -424,7 +513,7 @@ Error HeifFile::parse_heif_file()
       exif_infe_box->set_flags(1);
       exif_infe_box->set_item_ID(6);
       exif_infe_box->set_item_type_4cc(fourcc("Exif"));
-      m_infe_boxes.insert(std::make_pair(6, exif_infe_box));
+      m_iinf_box->append_child_box(exif_infe_box);
     }
 
     if (m_mini_box->get_xmp_flag()) {
@@ -434,7 +523,7 @@ Error HeifFile::parse_heif_file()
       xmp_infe_box->set_item_ID(7);
       xmp_infe_box->set_item_type_4cc(fourcc("mime"));
       xmp_infe_box->set_content_type("application/rdf+xml");
-      m_infe_boxes.insert(std::make_pair(7, xmp_infe_box));
+      m_iinf_box->append_child_box(xmp_infe_box);
     }
 
     m_ipco_box = std::make_shared<Box_ipco>();
@@ -726,17 +815,19 @@ Error HeifFile::parse_heif_file()
   m_grpl_box = m_meta_box->get_child_box<Box_grpl>();
 
 
-  // --- build list of images
-
-  std::vector<std::shared_ptr<Box_infe>> infe_boxes = m_iinf_box->get_child_boxes<Box_infe>();
+  // --- The 'infe' boxes and properties are indexed and parsed when they are accessed for the first time.
+  //     Parse them now, unless this is deferred until the images are interpreted.
 
-  for (auto& infe_box : infe_boxes) {
-    if (!infe_box) {
-      return Error(heif_error_Invalid_input,
-                   heif_suberror_No_infe_box);
+  if (!m_deferred_item_parsing) {
+    Error err = m_iinf_box->parse_all_items();
+    if (err) {
+      return err;
     }
 
-    m_infe_boxes.insert(std::make_pair(infe_box->get_item_ID(), infe_box));
+    err = m_ipco_box->parse_all_properties();
+    if (err) {
+      return err;
+    }
   }
 
   return Error::Ok;
@@ -763,6 +854,11 @@ Error HeifFile::check_for_ref_cycle_recursion(heif_item_id ID,
 
   std::vector<heif_item_id> image_references = iref_box->get_references(ID, fourcc("dimg"));
   for (heif_item_id reference_idx : image_references) {
+    // Items without references (e.g. grid tiles) can only close a cycle if they are one of the parent items.
+    if (!iref_box->has_references(reference_idx) && parent_items.find(reference_idx) == parent_items.end()) {
+      continue;
+    }
+
     Error error = check_for_ref_cycle_recursion(reference_idx, iref_box, parent_items);
     if (error) {
       return error;
@@ -776,26 +872,29 @@ Error HeifFile::check_for_ref_cycle_recursion(heif_item_id ID,
 
 bool HeifFile::image_exists(heif_item_id ID) const
 {
-  auto image_iter = m_infe_boxes.find(ID);
-  return image_iter != m_infe_boxes.end();
+  return m_iinf_box && m_iinf_box->has_item(ID);
 }
 
 
 bool HeifFile::has_item_with_id(heif_item_id ID) const
 {
-  auto infe_box = get_infe_box(ID);
-  return infe_box != nullptr;
+  return m_iinf_box && m_iinf_box->has_item(ID);
 }
 
 
 uint32_t HeifFile::get_item_type_4cc(heif_item_id ID) const
 {
-  auto infe_box = get_infe_box(ID);
-  if (!infe_box) {
+  if (!m_iinf_box) {
     return 0;
   }
 
-  return infe_box->get_item_type_4cc();
+  return m_iinf_box->get_item_type_4cc(ID);
+}
+
+
+bool HeifFile::is_hidden_item(heif_item_id ID) const
+{
+  return m_iinf_box && m_iinf_box->is_hidden_item(ID);
 }
 
 
@@ -931,14 +1030,8 @@ Error HeifFile::get_uncompressed_item_data(heif_item_id ID, std::vector<uint8_t>
 
 Error HeifFile::append_data_from_iloc(heif_item_id ID, std::vector<uint8_t>& out_data, uint64_t offset, uint64_t size) const
 {
-  const auto& items = m_iloc_box->get_items();
-  const Box_iloc::Item* item = nullptr;
-  for (const auto& i : items) {
-    if (i.item_ID == ID) {
-      item = &i;
-      break;
-    }
-  }
+  Box_iloc::Item decoded_item;
+  const Box_iloc::Item* item = m_iloc_box->find_item(ID, &decoded_item);
   if (!item) {
     std::stringstream sstr;
     sstr << "Item with ID " << ID << " has no compressed data";
@@ -952,6 +1045,27 @@ Error HeifFile::append_data_from_iloc(heif_item_id ID, std::vector<uint8_t>& out
 }
 
 
+bool HeifFile::get_data_spans_from_iloc(heif_item_id ID, std::vector<DataSpan>& spans) const
+{
+  if (!m_iloc_box) {
+    return false;
+  }
+
+  return m_iloc_box->get_data_spans(ID, m_input_stream, &spans);
+}
+
+
+bool HeifFile::get_file_ranges_from_iloc(heif_item_id ID, std::vector<FileRange>& ranges,
+                                         uint64_t offset, uint64_t size) const
+{
+  if (!m_iloc_box) {
+    return false;
+  }
+
+  return m_iloc_box->get_file_ranges(ID, offset, size, &ranges);
+}
+
+
 Error HeifFile::get_item_data(heif_item_id ID, std::vector<uint8_t>* out_data, heif_metadata_compression* out_compression) const
 {
   Error error;
@@ -1045,13 +1159,7 @@ Error HeifFile::get_item_data(heif_item_id ID, std::vector<uint8_t>* out_data, h
 // TODO: we should use a acquire() / release() approach here so that we can get multiple IDs before actually creating infe boxes
 heif_item_id HeifFile::get_unused_item_id() const
 {
-  heif_item_id max_id = 0;
-
-  // TODO: replace with better algorithm and data-structure
-
-  for (const auto& infe : m_infe_boxes) {
-    max_id = std::max(max_id, infe.second->get_item_ID());
-  }
+  heif_item_id max_id = m_iinf_box->get_max_item_ID();
 
   assert(max_id != 0xFFFFFFFF);
 
@@ -1075,7 +1183,6 @@ std::shared_ptr<Box_infe> HeifFile::add_new_infe_box(uint32_t item_type)
   infe->set_hidden_item(false);
   infe->set_item_type_4cc(item_type);
 
-  m_infe_boxes[id] = infe;
   m_iinf_box->append_child_box(infe);
 
   return infe;
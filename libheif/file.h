@@ -29,6 +29,7 @@
 #include "codecs/uncompressed/unc_boxes.h"
 #include "file_layout.h"
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -60,9 +61,20 @@ public:
   // You have to make sure that the pointer points to a valid object as long as the HeifFile is used.
   void set_security_limits(const heif_security_limits* limits) { m_limits = limits; }
 
+  // Only index the 'infe' boxes and properties when reading the file and parse them on first access.
+  // Parsing errors are then reported when the item is accessed instead of when the file is read.
+  void set_deferred_item_parsing(bool flag) { m_deferred_item_parsing = flag; }
+
+  // Allocate the boxes that are read from the file from an arena instead of allocating each of them on the heap.
+  void set_arena_allocation(bool flag) { m_arena_allocation = flag; }
+
   Error read(const std::shared_ptr<StreamReader>& reader);
 
-  Error read_from_file(const char* input_filename);
+  Error read_from_file(const char* input_filename, bool memory_mapped = false);
+
+  // If 'memory_mapped' is set, the file is memory-mapped if possible, with a fallback to a file stream.
+  // Otherwise, it is always read through a file stream.
+  static Result<std::shared_ptr<StreamReader>> open_file_reader(const char* input_filename, bool memory_mapped = false);
 
   Error read_from_memory(const void* data, size_t size, bool copy);
 
@@ -72,13 +84,26 @@ public:
 
   void set_brand(heif_compression_format format, bool miaf_compatible);
 
+  // See FileLayout::set_write_mode(). Has to be called before any item data is added.
+  Error set_write_mode(FileLayout::WriteMode mode, const std::string& output_filename = {},
+                       uint32_t reserved_header_size = 0);
+
+  FileLayout::WriteMode get_write_mode() const { return m_file_layout->get_write_mode(); }
+
+  // In FileLayout::WriteMode::TmpFile, this writes everything up to the 'mdat' payload,
+  // which has to be appended with write_item_data().
   void write(StreamWriter& writer);
 
-  int get_num_images() const { return static_cast<int>(m_infe_boxes.size()); }
+  Error write_item_data(const std::function<Error(const uint8_t* data, size_t size)>& write) const;
+
+  // Completes the output file in FileLayout::WriteMode::Streaming.
+  Error finish_streaming();
+
+  int get_num_images() const;
 
   heif_item_id get_primary_image_ID() const { return m_pitm_box->get_item_ID(); }
 
-  size_t get_number_of_items() const { return m_infe_boxes.size(); }
+  size_t get_number_of_items() const;
 
   std::vector<heif_item_id> get_item_IDs() const;
 
@@ -88,6 +113,8 @@ public:
 
   uint32_t get_item_type_4cc(heif_item_id ID) const;
 
+  bool is_hidden_item(heif_item_id ID) const;
+
   std::string get_content_type(heif_item_id ID) const;
 
   std::string get_item_uri_type(heif_item_id ID) const;
@@ -100,6 +127,15 @@ public:
     return append_data_from_iloc(ID, out_data, 0, std::numeric_limits<uint64_t>::max());
   }
 
+  // Appends views onto the item data without copying it if the file is held in memory.
+  // Returns false if this is not possible and the data has to be read with append_data_from_iloc().
+  bool get_data_spans_from_iloc(heif_item_id ID, std::vector<DataSpan>& spans) const;
+
+  // Appends the file ranges that hold the item data in [offset, offset+size).
+  // Returns false if the item data is not stored in the file.
+  bool get_file_ranges_from_iloc(heif_item_id ID, std::vector<FileRange>& ranges,
+                                 uint64_t offset = 0, uint64_t size = std::numeric_limits<uint64_t>::max()) const;
+
   Error get_item_data(heif_item_id ID, std::vector<uint8_t> *out_data, heif_metadata_compression* out_compression) const;
 
   std::shared_ptr<Box_ftyp> get_ftyp_box() { return m_ftyp_box; }
@@ -226,10 +262,13 @@ private:
 
   std::shared_ptr<Box_iprp> m_iprp_box;
 
-  std::map<heif_item_id, std::shared_ptr<Box_infe> > m_infe_boxes;
-
   const heif_security_limits* m_limits = nullptr;
 
+  bool m_deferred_item_parsing = false;
+
+  bool m_arena_allocation = false;
+  std::shared_ptr<BoxArena> m_box_arena;
+
   Error parse_heif_file();
 
   Error check_for_ref_cycle(heif_item_id ID,
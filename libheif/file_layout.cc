@@ -19,6 +19,159 @@
  */
 
 #include "file_layout.h"
+#include "file.h"
+
+#include <algorithm>
+#include <cstdio>
+
+
+// Item data in a file that is opened for reading and writing. The data starts at file position 'data_start'.
+class FileItemDataStorage : public ItemDataStorage
+{
+public:
+  FileItemDataStorage(FILE* fp, uint64_t data_start) : m_fp(fp), m_data_start(data_start), m_file_position(data_start) {}
+
+  ~FileItemDataStorage() override
+  {
+    if (m_fp) {
+      fclose(m_fp);
+    }
+  }
+
+  Result<uint64_t> append(const uint8_t* data, size_t size) override
+  {
+    uint64_t position = m_size;
+
+    Error err = write_at(m_data_start + position, data, size);
+    if (err) {
+      return err;
+    }
+
+    m_size += size;
+    return position;
+  }
+
+  Error overwrite(uint64_t position, const uint8_t* data, size_t size) override
+  {
+    if (position > m_size || size > m_size - position) {
+      return {heif_error_Usage_error,
+              heif_suberror_Unspecified,
+              "Overwritten item data exceeds the stored data"};
+    }
+
+    return write_at(m_data_start + position, data, size);
+  }
+
+  uint64_t get_size() const override { return m_size; }
+
+  uint64_t get_data_start() const { return m_data_start; }
+
+  Error write_at(uint64_t file_position, const uint8_t* data, size_t size);
+
+  Error read_at(uint64_t file_position, uint8_t* data, size_t size);
+
+  Error close();
+
+private:
+  FILE* m_fp;
+  uint64_t m_data_start;
+  uint64_t m_size = 0;
+  uint64_t m_file_position; // avoids seeking for consecutive writes
+
+  Error seek(uint64_t file_position);
+};
+
+
+Error FileItemDataStorage::seek(uint64_t file_position)
+{
+  if (file_position == m_file_position) {
+    return Error::Ok;
+  }
+
+#if defined(_WIN32)
+  int result = _fseeki64(m_fp, static_cast<__int64>(file_position), SEEK_SET);
+#else
+  int result = fseeko(m_fp, static_cast<off_t>(file_position), SEEK_SET);
+#endif
+
+  if (result != 0) {
+    return {heif_error_Encoding_error,
+            heif_suberror_Cannot_write_output_data,
+            "Cannot set file position of item data file"};
+  }
+
+  m_file_position = file_position;
+  return Error::Ok;
+}
+
+
+Error FileItemDataStorage::write_at(uint64_t file_position, const uint8_t* data, size_t size)
+{
+  if (!m_fp) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unspecified,
+            "Item data file is already closed"};
+  }
+
+  Error err = seek(file_position);
+  if (err) {
+    return err;
+  }
+
+  if (size > 0 && fwrite(data, 1, size, m_fp) != size) {
+    // the file position is undefined now
+    m_file_position = UINT64_MAX;
+
+    return {heif_error_Encoding_error,
+            heif_suberror_Cannot_write_output_data,
+            "Cannot write item data (storage full?)"};
+  }
+
+  m_file_position += size;
+  return Error::Ok;
+}
+
+
+Error FileItemDataStorage::read_at(uint64_t file_position, uint8_t* data, size_t size)
+{
+  // Always seek, because the C library requires a positioning call between writing and reading.
+  m_file_position = UINT64_MAX;
+
+  Error err = seek(file_position);
+  if (err) {
+    return err;
+  }
+
+  if (fread(data, 1, size, m_fp) != size) {
+    m_file_position = UINT64_MAX;
+
+    return {heif_error_Encoding_error,
+            heif_suberror_Unspecified,
+            "Cannot read back item data"};
+  }
+
+  m_file_position += size;
+  return Error::Ok;
+}
+
+
+Error FileItemDataStorage::close()
+{
+  if (!m_fp) {
+    return Error::Ok;
+  }
+
+  int result = fclose(m_fp);
+  m_fp = nullptr;
+
+  if (result != 0) {
+    return {heif_error_Encoding_error,
+            heif_suberror_Cannot_write_output_data,
+            "Cannot write item data file"};
+  }
+
+  return Error::Ok;
+}
 
 
 FileLayout::FileLayout()
@@ -27,12 +180,14 @@ FileLayout::FileLayout()
   ftyp->set_output_position(0);
   m_boxes.push_back(ftyp);
 
-  // TODO: these variables are not used yet
-  (void)m_writeMode;
+  // TODO: this variable is not used yet
   (void)m_file_size;
 }
 
 
+FileLayout::~FileLayout() = default;
+
+
 Error FileLayout::read(const std::shared_ptr<StreamReader>& stream, const heif_security_limits* limits)
 {
   m_boxes.clear();
@@ -199,13 +354,177 @@ Error FileLayout::read(const std::shared_ptr<StreamReader>& stream, const heif_s
 }
 
 
-void FileLayout::set_write_mode(WriteMode writeMode, const std::shared_ptr<StreamWriter>& writer)
+static const uint32_t DEFAULT_RESERVED_HEADER_SIZE = 64 * 1024;
+
+static const uint32_t MDAT_HEADER_SIZE = 16; // always with 64-bit size, since the final size is not known
+
+
+Error FileLayout::set_write_mode(WriteMode writeMode, const std::string& output_filename, uint32_t reserved_header_size)
+{
+  if (m_item_data_storage) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unspecified,
+            "The write mode cannot be changed anymore"};
+  }
+
+  m_writeMode = writeMode;
+
+  switch (writeMode) {
+    case WriteMode::Floating:
+      break;
+
+    case WriteMode::TmpFile: {
+      // The file is deleted automatically when it is closed.
+      FILE* fp = std::tmpfile();
+      if (!fp) {
+        return {heif_error_Encoding_error,
+                heif_suberror_Cannot_write_output_data,
+                "Cannot create temporary file"};
+      }
+
+      m_item_data_storage = std::make_shared<FileItemDataStorage>(fp, 0);
+      break;
+    }
+
+    case WriteMode::Streaming: {
+      if (reserved_header_size == 0) {
+        reserved_header_size = DEFAULT_RESERVED_HEADER_SIZE;
+      }
+
+#if defined(__MINGW32__) || defined(__MINGW64__) || defined(_MSC_VER)
+      FILE* fp = _wfopen(HeifFile::convert_utf8_path_to_utf16(output_filename).c_str(), L"w+b");
+#else
+      FILE* fp = fopen(output_filename.c_str(), "w+b");
+#endif
+      if (!fp) {
+        return {heif_error_Encoding_error,
+                heif_suberror_Cannot_write_output_data,
+                "Cannot create output file"};
+      }
+
+      m_reserved_header_size = reserved_header_size;
+      m_item_data_storage = std::make_shared<FileItemDataStorage>(fp, uint64_t{reserved_header_size} + MDAT_HEADER_SIZE);
+
+      // Fill the reserved space with zeros (it will become a 'free' box) and write a preliminary 'mdat' header.
+
+      std::vector<uint8_t> header(reserved_header_size + MDAT_HEADER_SIZE);
+      StreamWriter mdat_header;
+      mdat_header.write32(1);
+      mdat_header.write32(fourcc("mdat"));
+      mdat_header.write64(MDAT_HEADER_SIZE);
+      std::copy(mdat_header.get_data().begin(), mdat_header.get_data().end(), header.begin() + reserved_header_size);
+
+      Error err = m_item_data_storage->write_at(0, header.data(), header.size());
+      if (err) {
+        return err;
+      }
+      break;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+std::shared_ptr<ItemDataStorage> FileLayout::get_item_data_storage() const
 {
+  return m_item_data_storage;
+}
 
+
+uint64_t FileLayout::get_item_data_start() const
+{
+  return m_item_data_storage ? m_item_data_storage->get_data_start() : 0;
 }
 
 
-Error FileLayout::write(std::shared_ptr<StreamWriter>& stream)
+Error FileLayout::copy_item_data(const std::function<Error(const uint8_t* data, size_t size)>& write) const
 {
+  if (!m_item_data_storage) {
+    return Error::Ok;
+  }
+
+  const uint64_t chunk_size = 1024 * 1024;
+  std::vector<uint8_t> buffer;
+
+  uint64_t size = m_item_data_storage->get_size();
+  for (uint64_t pos = 0; pos < size; pos += chunk_size) {
+    auto n = static_cast<size_t>(std::min(chunk_size, size - pos));
+    buffer.resize(n);
+
+    Error err = m_item_data_storage->read_at(m_item_data_storage->get_data_start() + pos, buffer.data(), n);
+    if (err) {
+      return err;
+    }
+
+    err = write(buffer.data(), n);
+    if (err) {
+      return err;
+    }
+  }
+
   return Error::Ok;
 }
+
+
+Error FileLayout::finish_streaming(const StreamWriter& ftyp, const StreamWriter& meta)
+{
+  if (m_writeMode != WriteMode::Streaming || !m_item_data_storage) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unspecified,
+            "File is not written in streaming mode"};
+  }
+
+  // A remaining gap must be large enough for a 'free' box header.
+  auto fits_into_reserved_space = [this](uint64_t size) {
+    return size == m_reserved_header_size || size + 8 <= m_reserved_header_size;
+  };
+
+  const auto& ftyp_data = ftyp.get_data();
+  const auto& meta_data = meta.get_data();
+
+  bool meta_in_header = fits_into_reserved_space(ftyp_data.size() + meta_data.size());
+  if (!meta_in_header && !fits_into_reserved_space(ftyp_data.size())) {
+    return {heif_error_Usage_error,
+            heif_suberror_Unspecified,
+            "Reserved header space is too small for the 'ftyp' box"};
+  }
+
+  uint64_t mdat_end = m_item_data_storage->get_data_start() + m_item_data_storage->get_size();
+
+  Error err;
+  if (!meta_in_header) {
+    err = m_item_data_storage->write_at(mdat_end, meta_data.data(), meta_data.size());
+    if (err) {
+      return err;
+    }
+  }
+
+  StreamWriter header;
+  header.write(ftyp_data);
+  if (meta_in_header) {
+    header.write(meta_data);
+  }
+
+  if (header.data_size() < m_reserved_header_size) {
+    header.write32(static_cast<uint32_t>(m_reserved_header_size - header.data_size()));
+    header.write32(fourcc("free"));
+  }
+
+  err = m_item_data_storage->write_at(0, header.get_data().data(), header.data_size());
+  if (err) {
+    return err;
+  }
+
+  // --- patch the 'mdat' size
+
+  StreamWriter mdat_size;
+  mdat_size.write64(mdat_end - m_reserved_header_size);
+  err = m_item_data_storage->write_at(m_reserved_header_size + 8, mdat_size.get_data().data(), mdat_size.data_size());
+  if (err) {
+    return err;
+  }
+
+  // The storage stays set, so that no further data can be added.
+  return m_item_data_storage->close();
+}
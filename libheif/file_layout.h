@@ -27,10 +27,16 @@
 #if ENABLE_EXPERIMENTAL_MINI_FORMAT
 #include "mini.h"
 #endif
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 
+class FileItemDataStorage;
+
+
 class FileLayout
 {
 public:
@@ -43,13 +49,29 @@ public:
   // Generate a file in WriteMode::Floating
   FileLayout();
 
+  ~FileLayout();
+
   Error read(const std::shared_ptr<StreamReader>& stream, const heif_security_limits* limits);
 
-  // For WriteMode::Streaming, writer cannot be null.
-  void set_write_mode(WriteMode writeMode, const std::shared_ptr<StreamWriter>& writer = nullptr);
+  // Has to be set before any item data is written. get_item_data_storage() then returns the storage for the 'mdat' payload.
+  // For WriteMode::Streaming, 'output_filename' is created immediately. Its first 'reserved_header_size' bytes are kept
+  // free for the 'ftyp' and 'meta' boxes, followed by the 'mdat' box. If the boxes do not fit into the reserved space
+  // at the end, the 'meta' box is appended after the 'mdat' box.
+  Error set_write_mode(WriteMode writeMode, const std::string& output_filename = {}, uint32_t reserved_header_size = 0);
+
+  WriteMode get_write_mode() const { return m_writeMode; }
 
-  // For WriteMode::Streaming, stream must be null.
-  Error write(std::shared_ptr<StreamWriter>& stream);
+  // nullptr in WriteMode::Floating
+  std::shared_ptr<ItemDataStorage> get_item_data_storage() const;
+
+  // WriteMode::Streaming: file position of the 'mdat' payload.
+  uint64_t get_item_data_start() const;
+
+  // WriteMode::TmpFile: passes the content of the temporary file to 'write' in chunks.
+  Error copy_item_data(const std::function<Error(const uint8_t* data, size_t size)>& write) const;
+
+  // WriteMode::Streaming: writes the boxes that precede and follow the 'mdat' box and closes the file.
+  Error finish_streaming(const StreamWriter& ftyp, const StreamWriter& meta);
 
 
   // --- access to boxes
@@ -82,7 +104,9 @@ private:
   uint64_t m_max_length = 0; // Length seen so far. It can grow over time.
 
   std::shared_ptr<StreamReader> m_stream_reader;
-  std::shared_ptr<StreamWriter> m_stream_writer;
+
+  std::shared_ptr<FileItemDataStorage> m_item_data_storage;
+  uint32_t m_reserved_header_size = 0;
 
   static const uint64_t INITIAL_FTYP_REQUEST = 1024; // should be enough to read ftyp and next box header
   static const uint16_t MAXIMUM_BOX_HEADER_SIZE = 32;
@@ -22,12 +22,12 @@
 #include "context.h"
 #include "file.h"
 #include <cstring>
-#include <deque>
-#include <future>
 #include <set>
 #include <algorithm>
 #include <libheif/api_structs.h>
 #include "security_limits.h"
+#include "thread_pool.h"
+#include "range_prefetch.h"
 
 
 Error ImageGrid::parse(const std::vector<uint8_t>& data)
@@ -221,12 +221,28 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_compressed_image(
     return decode_grid_tile(options, tile_x0, tile_y0);
   }
   else {
-    return decode_full_grid_image(options);
+    return decode_full_grid_image(options, nullptr);
   }
 }
 
 
-Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_full_grid_image(const heif_decoding_options& options) const
+Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_compressed_image_into(const struct heif_decoding_options& options,
+                                                                                     const OutputPlaneBuffers& output_buffers) const
+{
+  return decode_full_grid_image(options, &output_buffers);
+}
+
+
+Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_compressed_image_downscaled(const struct heif_decoding_options& options,
+                                                                                           uint32_t factor) const
+{
+  return decode_full_grid_image(options, nullptr, factor);
+}
+
+
+Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_full_grid_image(const heif_decoding_options& options,
+                                                                               const OutputPlaneBuffers* output_buffers,
+                                                                               uint32_t downscale_factor) const
 {
   std::shared_ptr<HeifPixelImage> img; // the decoded image
 
@@ -261,38 +277,26 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_full_grid_image(c
   uint32_t y0 = 0;
   int reference_idx = 0;
 
-#if ENABLE_PARALLEL_TILE_DECODING
   // remember which tile to put where into the image
   struct tile_data
   {
     heif_item_id tileID;
     uint32_t x_origin, y_origin;
+    std::vector<FileRange> file_ranges;
   };
 
-  std::deque<tile_data> tiles;
-  if (get_context()->get_max_decoding_threads() > 0)
-    tiles.resize(static_cast<size_t>(grid.get_rows()) * static_cast<size_t>(grid.get_columns()));
-
-  std::deque<std::future<Error> > errs;
-#endif
+  std::vector<tile_data> tiles;
+  tiles.reserve(static_cast<size_t>(grid.get_rows()) * static_cast<size_t>(grid.get_columns()));
 
   uint32_t tile_width = 0;
   uint32_t tile_height = 0;
 
-  if (options.start_progress) {
-    options.start_progress(heif_progress_step_total, grid.get_rows() * grid.get_columns(), options.progress_user_data);
-  }
-  if (options.on_progress) {
-    options.on_progress(heif_progress_step_total, 0, options.progress_user_data);
-  }
-
-  int progress_counter = 0;
-  bool cancelled = false;
+  RangePrefetcher prefetcher(get_file()->get_reader());
 
-  for (uint32_t y = 0; y < grid.get_rows() && !cancelled; y++) {
+  for (uint32_t y = 0; y < grid.get_rows(); y++) {
     uint32_t x0 = 0;
 
-    for (uint32_t x = 0; x < grid.get_columns() && !cancelled; x++) {
+    for (uint32_t x = 0; x < grid.get_columns(); x++) {
 
       heif_item_id tileID = image_references[reference_idx];
 
@@ -331,26 +335,19 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_full_grid_image(c
                      "Grid tiles have different sizes"};
       }
 
-#if ENABLE_PARALLEL_TILE_DECODING
-      if (get_context()->get_max_decoding_threads() > 0)
-        tiles[x + y * grid.get_columns()] = tile_data{tileID, x0, y0};
-      else
-#else
-        if (1)
-#endif
-      {
-        if (options.cancel_decoding) {
-          if (options.cancel_decoding(options.progress_user_data)) {
-            cancelled = true;
-          }
-        }
+      tile_data tile{tileID, x0, y0, {}};
 
-        err = decode_and_paste_tile_image(tileID, x0, y0, img, options, progress_counter);
+      if (prefetcher.is_enabled()) {
+        err = tileImg->get_file_ranges_of_tile(0, 0, tile.file_ranges);
         if (err) {
           return err;
         }
+
+        prefetcher.add_ranges(tile.file_ranges);
       }
 
+      tiles.push_back(std::move(tile));
+
       x0 += src_width;
 
       reference_idx++;
@@ -359,62 +356,77 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_full_grid_image(c
     y0 += tile_height;
   }
 
-#if ENABLE_PARALLEL_TILE_DECODING
-  if (get_context()->get_max_decoding_threads() > 0) {
-    // Process all tiles in a set of background threads.
-    // Do not start more than the maximum number of threads.
 
-    while (!tiles.empty() && !cancelled) {
+  // --- when decoding at a reduced resolution, scale all tiles to the same size and place them on a smaller canvas
 
-      // If maximum number of threads running, wait until first thread finishes
+  TileDownscaling downscaling;
+  downscaling.canvas_width = w;
+  downscaling.canvas_height = h;
 
-      if (errs.size() >= (size_t) get_context()->get_max_decoding_threads()) {
-        Error e = errs.front().get();
-        if (e) {
-          return e;
-        }
+  if (downscale_factor > 1 && tile_width > 0 && tile_height > 0) {
+    downscaling.factor = downscale_factor;
 
-        errs.pop_front();
-      }
+    // Use even tile sizes so that the tile positions are aligned with subsampled chroma.
+    downscaling.tile_width = ((tile_width + downscale_factor - 1) / downscale_factor + 1) & ~1U;
+    downscaling.tile_height = ((tile_height + downscale_factor - 1) / downscale_factor + 1) & ~1U;
 
+    if (downscaling.tile_width < tile_width && downscaling.tile_height < tile_height) {
+      downscaling.canvas_width = static_cast<uint32_t>((uint64_t{w} * downscaling.tile_width + tile_width - 1) / tile_width);
+      downscaling.canvas_height = static_cast<uint32_t>((uint64_t{h} * downscaling.tile_height + tile_height - 1) / tile_height);
 
-      if (options.cancel_decoding) {
-        if (options.cancel_decoding(options.progress_user_data)) {
-          cancelled = true;
-        }
+      for (tile_data& tile : tiles) {
+        tile.x_origin = tile.x_origin / tile_width * downscaling.tile_width;
+        tile.y_origin = tile.y_origin / tile_height * downscaling.tile_height;
       }
+    }
+    else {
+      downscaling = {};
+      downscaling.canvas_width = w;
+      downscaling.canvas_height = h;
+    }
+  }
 
+  if (options.start_progress) {
+    options.start_progress(heif_progress_step_total, grid.get_rows() * grid.get_columns(), options.progress_user_data);
+  }
+  if (options.on_progress) {
+    options.on_progress(heif_progress_step_total, 0, options.progress_user_data);
+  }
 
-      // Start a new decoding thread
+  int progress_counter = 0;
 
-      tile_data data = tiles.front();
-      tiles.pop_front();
+  // Let the reader load the data of all tiles in a few large requests while the first tiles are decoded.
+  prefetcher.issue_preload_hints();
 
-      errs.push_back(std::async(std::launch::async,
-                                &ImageItem_Grid::decode_and_paste_tile_image, this,
-                                data.tileID, data.x_origin, data.y_origin, std::ref(img), options,
-                                std::ref(progress_counter)));
-    }
+  // Decode the tiles on the context's thread pool (or sequentially in this thread if there is none).
+  // Tiles may finish in any order. The first failing tile stops all tiles that did not start yet.
 
-    // check for decoding errors in remaining tiles
+  std::shared_ptr<ThreadPool> thread_pool = get_context()->get_thread_pool();
+  TaskGroup tile_tasks(thread_pool.get());
 
-    while (!errs.empty()) {
-      Error e = errs.front().get();
-      if (e) {
-        return e;
+  for (const tile_data& tile : tiles) {
+    tile_tasks.run([this, &tile, &img, &options, &progress_counter, &prefetcher, output_buffers, &downscaling]() -> Error {
+      if (options.cancel_decoding && options.cancel_decoding(options.progress_user_data)) {
+        return Error{heif_error_Canceled, heif_suberror_Unspecified, "Decoding the image was canceled"};
       }
 
-      errs.pop_front();
-    }
+      Error tile_err = decode_and_paste_tile_image(tile.tileID, tile.x_origin, tile.y_origin, img, options, progress_counter,
+                                                   output_buffers, downscaling);
+
+      prefetcher.release_ranges(tile.file_ranges);
+
+      return tile_err;
+    });
   }
-#endif
+
+  err = tile_tasks.wait();
 
   if (options.end_progress) {
     options.end_progress(heif_progress_step_total, options.progress_user_data);
   }
 
-  if (cancelled) {
-    return Error{heif_error_Canceled, heif_suberror_Unspecified, "Decoding the image was canceled"};
+  if (err) {
+    return err;
   }
 
   return img;
@@ -423,7 +435,9 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_full_grid_image(c
 Error ImageItem_Grid::decode_and_paste_tile_image(heif_item_id tileID, uint32_t x0, uint32_t y0,
                                                   std::shared_ptr<HeifPixelImage>& inout_image,
                                                   const heif_decoding_options& options,
-                                                  int& progress_counter) const
+                                                  int& progress_counter,
+                                                  const OutputPlaneBuffers* output_buffers,
+                                                  const TileDownscaling& downscaling) const
 {
   std::shared_ptr<HeifPixelImage> tile_img;
 
@@ -433,41 +447,78 @@ Error ImageItem_Grid::decode_and_paste_tile_image(heif_item_id tileID, uint32_t
     return error;
   }
 
-  auto decodeResult = tileItem->decode_image(options, false, 0, 0);
+  Result<std::shared_ptr<HeifPixelImage>> decodeResult;
+  if (downscaling.factor > 1) {
+    decodeResult = tileItem->decode_image_downscaled(options, downscaling.factor);
+  }
+  else {
+    decodeResult = tileItem->decode_image(options, false, 0, 0);
+  }
+
   if (decodeResult.error) {
     return decodeResult.error;
   }
 
   tile_img = decodeResult.value;
 
-  uint32_t w = get_grid_spec().get_width();
-  uint32_t h = get_grid_spec().get_height();
+  if (downscaling.factor > 1 &&
+      (tile_img->get_width() != downscaling.tile_width || tile_img->get_height() != downscaling.tile_height)) {
+    std::shared_ptr<HeifPixelImage> scaled_tile;
+    Error err = tile_img->scale_area_average(scaled_tile, downscaling.tile_width, downscaling.tile_height);
+    if (err) {
+      return err;
+    }
+
+    tile_img = std::move(scaled_tile);
+  }
+
+  uint32_t w = downscaling.canvas_width;
+  uint32_t h = downscaling.canvas_height;
 
   // --- generate the image canvas for combining all the tiles
 
-  if (!inout_image) { // this if avoids that we normally have to lock a mutex
+  // The canvas is created by the first tile that finishes decoding. It is only published
+  // after it is complete, because the other tiles paste into it without further locking.
+
+  std::shared_ptr<HeifPixelImage> canvas;
+  {
     static std::mutex createImageMutex;
     std::lock_guard<std::mutex> lock(createImageMutex);
 
     if (!inout_image) {
-      inout_image = std::make_shared<HeifPixelImage>();
-      inout_image->create_clone_image_at_new_size(tile_img, w, h);
+      auto new_canvas = std::make_shared<HeifPixelImage>();
+      new_canvas->set_allocator(get_context()->get_image_allocator());
+
+      // Paste the tiles directly into the caller's memory if the image is requested in the tile format.
+      // Otherwise, the buffers are filled by the final color conversion.
+
+      if (output_buffers &&
+          (output_buffers->colorspace == heif_colorspace_undefined || output_buffers->colorspace == tile_img->get_colorspace()) &&
+          (output_buffers->chroma == heif_chroma_undefined || output_buffers->chroma == tile_img->get_chroma_format())) {
+        new_canvas->set_plane_buffers(output_buffers->planes);
+      }
+
+      new_canvas->create_clone_image_at_new_size(tile_img, w, h);
 
       // Fill alpha plane with opaque in case not all tiles have alpha planes
 
-      if (inout_image->has_channel(heif_channel_Alpha)) {
-        uint16_t alpha_bpp = inout_image->get_bits_per_pixel(heif_channel_Alpha);
+      if (new_canvas->has_channel(heif_channel_Alpha)) {
+        uint16_t alpha_bpp = new_canvas->get_bits_per_pixel(heif_channel_Alpha);
         assert(alpha_bpp <= 16);
 
         auto alpha_default_value = static_cast<uint16_t>((1UL << alpha_bpp) - 1UL);
-        inout_image->fill_plane(heif_channel_Alpha, alpha_default_value);
+        new_canvas->fill_plane(heif_channel_Alpha, alpha_default_value);
       }
+
+      inout_image = new_canvas;
     }
+
+    canvas = inout_image;
   }
 
   // --- copy tile into output image
 
-  heif_chroma chroma = inout_image->get_chroma_format();
+  heif_chroma chroma = canvas->get_chroma_format();
 
   if (chroma != tile_img->get_chroma_format()) {
     return {heif_error_Invalid_input,
@@ -476,7 +527,7 @@ Error ImageItem_Grid::decode_and_paste_tile_image(heif_item_id tileID, uint32_t
   }
 
 
-  inout_image->copy_image_to(tile_img, x0, y0);
+  canvas->copy_image_to(tile_img, x0, y0);
 
   if (options.on_progress) {
     static std::mutex progressMutex;
@@ -501,7 +552,24 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem_Grid::decode_grid_tile(const h
     return error;
   }
 
-  return tile_item->decode_compressed_image(options, true, tx, ty);
+  // The tile item is a complete image by itself, the tile position only refers to the grid.
+  return tile_item->decode_compressed_image(options, false, 0, 0);
+}
+
+
+Error ImageItem_Grid::get_file_ranges_of_tile(uint32_t tile_x, uint32_t tile_y, std::vector<FileRange>& ranges) const
+{
+  uint32_t idx = tile_y * m_grid_spec.get_columns() + tile_x;
+  if (idx >= m_grid_tile_ids.size()) {
+    return Error::Ok;
+  }
+
+  std::shared_ptr<const ImageItem> tile_item = get_context()->get_image(m_grid_tile_ids[idx], true);
+  if (!tile_item) {
+    return Error::Ok;
+  }
+
+  return tile_item->get_file_ranges_of_tile(0, 0, ranges);
 }
 
 
@@ -662,17 +730,72 @@ Error ImageItem_Grid::add_image_tile(heif_item_id grid_id, uint32_t tile_x, uint
                                      const std::shared_ptr<HeifPixelImage>& image,
                                      struct heif_encoder* encoder)
 {
-  auto encoding_options = get_encoding_options();
-
-  auto encodingResult = get_context()->encode_image(image,
+  HeifContext::CompressedImage compressed;
+  Error err = get_context()->compress_image(image,
                                             encoder,
-                                            *encoding_options,
-                                            heif_image_input_class_normal);
-  if (encodingResult.error != Error::Ok) {
-    return encodingResult.error;
+                                            *get_encoding_options(),
+                                            heif_image_input_class_normal,
+                                            compressed);
+  if (err) {
+    return err;
   }
 
-  std::shared_ptr<ImageItem> encoded_image = *encodingResult;
+  return add_compressed_tile(grid_id, tile_x, tile_y, compressed, encoder->plugin->compression_format);
+}
+
+
+Error ImageItem_Grid::add_image_tile_rows(heif_item_id grid_id, uint32_t first_row, uint32_t num_rows,
+                                          const std::vector<std::shared_ptr<HeifPixelImage>>& tiles,
+                                          struct heif_encoder* encoder)
+{
+  heif_image_tiling tiling = get_heif_image_tiling();
+  if (first_row + num_rows > tiling.num_rows ||
+      tiles.size() != static_cast<size_t>(num_rows) * tiling.num_columns) {
+    return {heif_error_Usage_error,
+            heif_suberror_Invalid_parameter_value,
+            "Tile rows exceed the grid size or the number of tiles does not match the number of rows"};
+  }
+
+  std::vector<HeifContext::CompressedImage> compressed(tiles.size());
+
+  Error err = get_context()->run_encoding_tasks(tiles.size(), encoder,
+                                                [&](size_t idx, heif_encoder* tile_encoder) {
+                                                  return get_context()->compress_image(tiles[idx],
+                                                                                       tile_encoder,
+                                                                                       *get_encoding_options(),
+                                                                                       heif_image_input_class_normal,
+                                                                                       compressed[idx]);
+                                                });
+  if (err) {
+    return err;
+  }
+
+  // add the tiles in the tile order, independent of the order in which they were compressed
+
+  for (size_t i = 0; i < compressed.size(); i++) {
+    uint32_t tile_x = static_cast<uint32_t>(i % tiling.num_columns);
+    uint32_t tile_y = first_row + static_cast<uint32_t>(i / tiling.num_columns);
+
+    err = add_compressed_tile(grid_id, tile_x, tile_y, compressed[i], encoder->plugin->compression_format);
+    if (err) {
+      return err;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Error ImageItem_Grid::add_compressed_tile(heif_item_id grid_id, uint32_t tile_x, uint32_t tile_y,
+                                          const HeifContext::CompressedImage& tile,
+                                          heif_compression_format compression_format)
+{
+  auto addResult = get_context()->add_compressed_image(tile, compression_format);
+  if (addResult.error) {
+    return addResult.error;
+  }
+
+  std::shared_ptr<ImageItem> encoded_image = *addResult;
 
   auto file = get_file();
   file->get_infe_box(encoded_image->get_id())->set_hidden_item(true); // grid tiles are hidden items
@@ -695,8 +818,11 @@ Result<std::shared_ptr<ImageItem_Grid>> ImageItem_Grid::add_and_encode_full_grid
                                                                                  const std::vector<std::shared_ptr<HeifPixelImage>>& tiles,
                                                                                  uint16_t rows,
                                                                                  uint16_t columns,
+                                                                                 uint32_t output_width,
+                                                                                 uint32_t output_height,
                                                                                  struct heif_encoder* encoder,
-                                                                                 const struct heif_encoding_options& options)
+                                                                                 const struct heif_encoding_options& options,
+                                                                                 enum heif_image_input_class input_class)
 {
   std::shared_ptr<ImageItem_Grid> griditem;
 
@@ -704,27 +830,40 @@ Result<std::shared_ptr<ImageItem_Grid>> ImageItem_Grid::add_and_encode_full_grid
 
   ImageGrid grid;
   grid.set_num_tiles(columns, rows);
-  uint32_t tile_width = tiles[0]->get_width(heif_channel_interleaved);
-  uint32_t tile_height = tiles[0]->get_height(heif_channel_interleaved);
-  grid.set_output_size(tile_width * columns, tile_height * rows);
+  grid.set_output_size(output_width, output_height);
   std::vector<uint8_t> grid_data = grid.write();
 
   auto file = ctx->get_heif_file();
 
   // Encode Tiles
 
+  heif_encoding_options tile_options = options;
+  tile_options.image_orientation = heif_orientation_normal;
+
+  std::vector<HeifContext::CompressedImage> compressed_tiles(tiles.size());
+
+  Error err = ctx->run_encoding_tasks(tiles.size(), encoder,
+                                      [&](size_t idx, heif_encoder* tile_encoder) {
+                                        return ctx->compress_image(tiles[idx],
+                                                                   tile_encoder,
+                                                                   tile_options,
+                                                                   input_class,
+                                                                   compressed_tiles[idx]);
+                                      });
+  if (err) {
+    return err;
+  }
+
   std::vector<heif_item_id> tile_ids;
 
-  for (int i=0; i<rows*columns; i++) {
-    std::shared_ptr<ImageItem> out_tile;
-    auto encodingResult = ctx->encode_image(tiles[i],
-                                            encoder,
-                                            options,
-                                            heif_image_input_class_normal);
-    if (encodingResult.error) {
-      return encodingResult.error;
+  for (const auto& compressed_tile : compressed_tiles) {
+    auto addResult = ctx->add_compressed_image(compressed_tile, encoder->plugin->compression_format);
+    if (addResult.error) {
+      return addResult.error;
     }
 
+    std::shared_ptr<ImageItem> out_tile = *addResult;
+
     heif_item_id tile_id = out_tile->get_id();
     file->get_infe_box(tile_id)->set_hidden_item(true); // only show the full grid
     tile_ids.push_back(out_tile->get_id());
@@ -734,6 +873,8 @@ Result<std::shared_ptr<ImageItem_Grid>> ImageItem_Grid::add_and_encode_full_grid
 
   heif_item_id grid_id = file->add_new_image(fourcc("grid"));
   griditem = std::make_shared<ImageItem_Grid>(ctx, grid_id);
+  griditem->set_grid_spec(grid);
+  griditem->set_resolution(output_width, output_height);
   ctx->insert_image_item(grid_id, griditem);
   const int construction_method = 1; // 0=mdat 1=idat
   file->append_iloc_data(grid_id, grid_data, construction_method);
@@ -742,17 +883,23 @@ Result<std::shared_ptr<ImageItem_Grid>> ImageItem_Grid::add_and_encode_full_grid
 
   file->add_iref_reference(grid_id, fourcc("dimg"), tile_ids);
 
+  for (uint32_t i = 0; i < tile_ids.size(); i++) {
+    griditem->set_grid_tile_id(i % columns, i / columns, tile_ids[i]);
+  }
+
   // Add ISPE property
 
-  uint32_t image_width = tile_width * columns;
-  uint32_t image_height = tile_height * rows;
-  file->add_ispe_property(grid_id, image_width, image_height, false);
+  file->add_ispe_property(grid_id, output_width, output_height, false);
 
   // Add PIXI property (copy from first tile)
 
   auto pixi = file->get_property<Box_pixi>(tile_ids[0]);
   file->add_property(grid_id, pixi, true);
 
+  // Transformations come after the descriptive properties
+
+  file->add_orientation_properties(grid_id, options.image_orientation);
+
   // Set Brands
 
   file->set_brand(encoder->plugin->compression_format,
@@ -22,6 +22,7 @@
 #define LIBHEIF_IMAGEITEM_GRID_H
 
 #include "image_item.h"
+#include "context.h"
 #include <vector>
 #include <string>
 #include <memory>
@@ -93,12 +94,23 @@ public:
                        const std::shared_ptr<HeifPixelImage>& image,
                        struct heif_encoder* encoder);
 
+  // Adds complete rows of tiles, given in row-major order. The tiles are compressed concurrently
+  // (see HeifContext::run_encoding_tasks()), but added to the file in tile order.
+  Error add_image_tile_rows(heif_item_id grid_id, uint32_t first_row, uint32_t num_rows,
+                            const std::vector<std::shared_ptr<HeifPixelImage>>& tiles,
+                            struct heif_encoder* encoder);
+
+  // The output size may be smaller than the area covered by the tiles. The image orientation is
+  // applied to the grid item, not to the tiles.
   static Result<std::shared_ptr<ImageItem_Grid>> add_and_encode_full_grid(HeifContext* ctx,
                                                                           const std::vector<std::shared_ptr<HeifPixelImage>>& tiles,
                                                                           uint16_t rows,
                                                                           uint16_t columns,
+                                                                          uint32_t output_width,
+                                                                          uint32_t output_height,
                                                                           struct heif_encoder* encoder,
-                                                                          const struct heif_encoding_options& options);
+                                                                          const struct heif_encoding_options& options,
+                                                                          enum heif_image_input_class input_class);
 
 
   // TODO: nclx depends on contained format
@@ -129,6 +141,14 @@ public:
   Result<std::shared_ptr<HeifPixelImage>> decode_compressed_image(const struct heif_decoding_options& options,
                                                                   bool decode_tile_only, uint32_t tile_x0, uint32_t tile_y0) const override;
 
+  Result<std::shared_ptr<HeifPixelImage>> decode_compressed_image_into(const struct heif_decoding_options& options,
+                                                                       const OutputPlaneBuffers& output_buffers) const override;
+
+  Result<std::shared_ptr<HeifPixelImage>> decode_compressed_image_downscaled(const struct heif_decoding_options& options,
+                                                                             uint32_t factor) const override;
+
+  Error get_file_ranges_of_tile(uint32_t tile_x, uint32_t tile_y, std::vector<FileRange>& ranges) const override;
+
 protected:
   std::shared_ptr<Decoder> get_decoder() const override;
 
@@ -156,13 +176,30 @@ private:
 
   Error read_grid_spec();
 
-  Result<std::shared_ptr<HeifPixelImage>> decode_full_grid_image(const heif_decoding_options& options) const;
+  Error add_compressed_tile(heif_item_id grid_id, uint32_t tile_x, uint32_t tile_y,
+                            const HeifContext::CompressedImage& tile,
+                            heif_compression_format compression_format);
+
+  // When the grid is decoded at a reduced resolution, each tile is scaled to 'tile_width' x 'tile_height'
+  // before it is pasted into the smaller canvas.
+  struct TileDownscaling
+  {
+    uint32_t factor = 1;
+    uint32_t tile_width = 0, tile_height = 0;
+    uint32_t canvas_width = 0, canvas_height = 0;
+  };
+
+  Result<std::shared_ptr<HeifPixelImage>> decode_full_grid_image(const heif_decoding_options& options,
+                                                                 const OutputPlaneBuffers* output_buffers,
+                                                                 uint32_t downscale_factor = 1) const;
 
   Result<std::shared_ptr<HeifPixelImage>> decode_grid_tile(const heif_decoding_options& options, uint32_t tx, uint32_t ty) const;
 
   Error decode_and_paste_tile_image(heif_item_id tileID, uint32_t x0, uint32_t y0,
                                     std::shared_ptr<HeifPixelImage>& inout_image,
-                                    const heif_decoding_options& options, int& progress_counter) const;
+                                    const heif_decoding_options& options, int& progress_counter,
+                                    const OutputPlaneBuffers* output_buffers,
+                                    const TileDownscaling& downscaling) const;
 };
 
 
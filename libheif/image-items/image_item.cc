@@ -36,6 +36,8 @@
 #include "api/libheif/api_structs.h"
 #include "plugin_registry.h"
 #include "security_limits.h"
+#include "thread_pool.h"
+#include "range_prefetch.h"
 
 #include <limits>
 #include <cassert>
@@ -366,8 +368,16 @@ Error ImageItem::encode_to_item(HeifContext* ctx,
     return codingResult.error;
   }
 
-  CodedImageData& codedImage = codingResult.value;
+  return add_coded_image_to_file(ctx, image, *codingResult, encoder->plugin->compression_format, options);
+}
+
 
+Error ImageItem::add_coded_image_to_file(HeifContext* ctx,
+                                         const std::shared_ptr<HeifPixelImage>& image,
+                                         const CodedImageData& codedImage,
+                                         heif_compression_format compression_format,
+                                         const struct heif_encoding_options& options)
+{
   auto infe_box = ctx->get_heif_file()->add_new_infe_box(get_infe_type());
   heif_item_id image_id = infe_box->get_item_ID();
   set_id(image_id);
@@ -377,7 +387,7 @@ Error ImageItem::encode_to_item(HeifContext* ctx,
 
   // set item properties
 
-  for (auto& propertyBox : codingResult.value.properties) {
+  for (auto& propertyBox : codedImage.properties) {
     int index = ctx->get_heif_file()->get_ipco_box()->find_or_append_child_box(propertyBox);
     ctx->get_heif_file()->get_ipma_box()->add_property_for_item_ID(image_id, Box_ipma::PropertyAssociation{propertyBox->is_essential(),
                                                                                                            uint16_t(index + 1)});
@@ -390,7 +400,7 @@ Error ImageItem::encode_to_item(HeifContext* ctx,
 
   // We might remove this code at a later point in time when MIAF Amd2 is in wide use.
 
-  if (encoder->plugin->compression_format != heif_compression_AV1 &&
+  if (compression_format != heif_compression_AV1 &&
       image->get_colorspace() == heif_colorspace_YCbCr) {
     if (!is_integer_multiple_of_chroma_size(image->get_width(),
                                             image->get_height(),
@@ -595,7 +605,10 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::convert_colorspace_for_encodi
     //target_nclx->set_from_heif_color_profile_nclx(target_heif_nclx);
 
     output_image = convert_colorspace(image, colorspace, chroma, target_nclx_profile,
-                                      output_bpp, options.color_conversion_options);
+                                      output_bpp, options.color_conversion_options,
+                                      nullptr,
+                                      get_context()->get_color_conversion_thread_pool(image->get_width(),
+                                                                                      image->get_height()).get());
     if (!output_image) {
       return Error(heif_error_Unsupported_feature, heif_suberror_Unsupported_color_conversion);
     }
@@ -731,7 +744,8 @@ Error ImageItem::transform_requested_tile_position_to_original_tile_position(uin
 
 
 Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image(const struct heif_decoding_options& options,
-                                                                bool decode_tile_only, uint32_t tile_x0, uint32_t tile_y0) const
+                                                                bool decode_tile_only, uint32_t tile_x0, uint32_t tile_y0,
+                                                                const OutputPlaneBuffers* output_buffers) const
 {
   // --- check whether image size (according to 'ispe') exceeds maximum
 
@@ -756,15 +770,63 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image(const struct hei
 
   // --- decode image
 
-  Result<std::shared_ptr<HeifPixelImage>> decodingResult = decode_compressed_image(options, decode_tile_only, tile_x0, tile_y0);
+  Result<std::shared_ptr<HeifPixelImage>> decodingResult;
+  if (output_buffers && !decode_tile_only) {
+    decodingResult = decode_compressed_image_into(options, *output_buffers);
+  }
+  else {
+    decodingResult = decode_compressed_image(options, decode_tile_only, tile_x0, tile_y0);
+  }
+
+  if (decodingResult.error) {
+    return decodingResult.error;
+  }
+
+  return postprocess_decoded_image(decodingResult.value, options, decode_tile_only, tile_x0, tile_y0, nullptr);
+}
+
+
+Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image_downscaled(const struct heif_decoding_options& options,
+                                                                           uint32_t factor) const
+{
+  if (factor <= 1) {
+    return decode_image(options, false, 0, 0);
+  }
+
+  auto ispe = m_heif_context->get_heif_file()->get_property<Box_ispe>(m_id);
+  if (ispe) {
+    Error err = check_for_valid_image_size(get_context()->get_security_limits(), ispe->get_width(), ispe->get_height());
+    if (err) {
+      return err;
+    }
+  }
+
+  auto decodingResult = decode_compressed_image_downscaled(options, factor);
   if (decodingResult.error) {
     return decodingResult.error;
   }
 
-  auto img = decodingResult.value;
+  return postprocess_decoded_image(decodingResult.value, options, false, 0, 0, nullptr, factor);
+}
+
 
+Result<std::shared_ptr<HeifPixelImage>> ImageItem::postprocess_decoded_image(std::shared_ptr<HeifPixelImage> img,
+                                                                             const struct heif_decoding_options& options,
+                                                                             bool decode_tile_only, uint32_t tile_x0, uint32_t tile_y0,
+                                                                             const DecodingRegion* region,
+                                                                             uint32_t downscale_factor) const
+{
   std::shared_ptr<HeifFile> file = m_heif_context->get_heif_file();
 
+  // The 'clap' is defined for the full resolution image. When the image was decoded at a reduced resolution,
+  // the crop window is computed for the full size (which changes with rotations) and then scaled down.
+  uint32_t full_width = img->get_width();
+  uint32_t full_height = img->get_height();
+  if (downscale_factor > 1 && get_ispe_width() != 0 && get_ispe_height() != 0) {
+    full_width = get_ispe_width();
+    full_height = get_ispe_height();
+  }
+
 
   // --- apply image transformations
 
@@ -786,6 +848,10 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image(const struct hei
         }
 
         img = rotateResult.value;
+
+        if (rot->get_rotation_ccw() == 90 || rot->get_rotation_ccw() == 270) {
+          std::swap(full_width, full_height);
+        }
       }
 
 
@@ -798,8 +864,9 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image(const struct hei
       }
 
 
-      if (!decode_tile_only) {
+      if (!decode_tile_only && !region) {
         // For tiles decoding, we do not process the 'clap' because this is handled by a shift of the tiling grid.
+        // Regions are already cropped when they are decoded.
 
         if (auto clap = std::dynamic_pointer_cast<Box_clap>(property)) {
           std::shared_ptr<HeifPixelImage> clap_img;
@@ -807,10 +874,17 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image(const struct hei
           uint32_t img_width = img->get_width();
           uint32_t img_height = img->get_height();
 
-          int left = clap->left_rounded(img_width);
-          int right = clap->right_rounded(img_width);
-          int top = clap->top_rounded(img_height);
-          int bottom = clap->bottom_rounded(img_height);
+          int left = clap->left_rounded(full_width);
+          int right = clap->right_rounded(full_width);
+          int top = clap->top_rounded(full_height);
+          int bottom = clap->bottom_rounded(full_height);
+
+          if (full_width != img_width || full_height != img_height) {
+            left = static_cast<int>(int64_t{left} * img_width / full_width);
+            right = static_cast<int>((int64_t{right} + 1) * img_width / full_width) - 1;
+            top = static_cast<int>(int64_t{top} * img_height / full_height);
+            bottom = static_cast<int>((int64_t{bottom} + 1) * img_height / full_height) - 1;
+          }
 
           if (left < 0) { left = 0; }
           if (top < 0) { top = 0; }
@@ -845,7 +919,22 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image(const struct hei
 
   std::shared_ptr<ImageItem> alpha_image = get_alpha_channel();
   if (alpha_image) {
-    auto alphaDecodingResult = alpha_image->decode_image(options, decode_tile_only, tile_x0, tile_y0);
+    Result<std::shared_ptr<HeifPixelImage>> alphaDecodingResult;
+    if (region) {
+      if (alpha_image->get_width() != get_width() || alpha_image->get_height() != get_height()) {
+        return Error{heif_error_Unsupported_feature, heif_suberror_Unspecified,
+                     "Decoding a region of an image with an alpha channel of different size is not supported"};
+      }
+
+      alphaDecodingResult = alpha_image->decode_image_region(options, region->x0, region->y0, region->width, region->height);
+    }
+    else if (downscale_factor > 1) {
+      alphaDecodingResult = alpha_image->decode_image_downscaled(options, downscale_factor);
+    }
+    else {
+      alphaDecodingResult = alpha_image->decode_image(options, decode_tile_only, tile_x0, tile_y0);
+    }
+
     if (alphaDecodingResult.error) {
       return alphaDecodingResult.error;
     }
@@ -877,7 +966,7 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image(const struct hei
     //       It might also be that a specific output format implies that alpha is scaled (RGBA32). That would favor an enum for the scaling filter option + a bool to switch auto-filtering on.
     //       But we can only do this when libheif itself doesn't assume anymore that the alpha channel has the same resolution.
 
-    if ((alpha_image->get_width() != img->get_width()) || (alpha_image->get_height() != img->get_height())) {
+    if ((alpha->get_width() != img->get_width()) || (alpha->get_height() != img->get_height())) {
       std::shared_ptr<HeifPixelImage> scaled_alpha;
       Error err = alpha->scale_nearest_neighbor(scaled_alpha, img->get_width(), img->get_height());
       if (err) {
@@ -941,6 +1030,286 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image(const struct hei
 }
 
 
+Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_image_region(const struct heif_decoding_options& options,
+                                                                       uint32_t x0, uint32_t y0, uint32_t width, uint32_t height) const
+{
+  Error err = check_for_valid_image_size(get_context()->get_security_limits(), width, height);
+  if (err) {
+    return err;
+  }
+
+  DecodingRegion region{x0, y0, width, height};
+
+  // --- transform region to the coordinates of the coded image
+
+  if (options.ignore_transformations == false) {
+    err = transform_requested_region_to_original_region(x0, y0, width, height);
+    if (err) {
+      return err;
+    }
+  }
+  else {
+    heif_image_tiling tiling = get_heif_image_tiling();
+    if (x0 >= tiling.image_width || width > tiling.image_width - x0 ||
+        y0 >= tiling.image_height || height > tiling.image_height - y0) {
+      return Error{heif_error_Usage_error, heif_suberror_Invalid_parameter_value,
+                   "Decoding region exceeds the image area"};
+    }
+  }
+
+  // --- decode region
+
+  auto decodingResult = decode_compressed_region(options, x0, y0, width, height);
+  if (decodingResult.error) {
+    return decodingResult.error;
+  }
+
+  return postprocess_decoded_image(decodingResult.value, options, false, 0, 0, &region);
+}
+
+
+Error ImageItem::transform_requested_region_to_original_region(uint32_t& x0, uint32_t& y0,
+                                                               uint32_t& width, uint32_t& height) const
+{
+  Result<std::vector<std::shared_ptr<Box>>> propertiesResult = get_properties();
+  if (propertiesResult.error) {
+    return propertiesResult.error;
+  }
+
+  // --- compute the image size before each transformation
+
+  struct Transformation
+  {
+    std::shared_ptr<Box> property;
+    uint32_t input_width, input_height;
+    uint32_t crop_left = 0, crop_top = 0;
+  };
+
+  std::vector<Transformation> transformations;
+
+  heif_image_tiling tiling = get_heif_image_tiling();
+  uint32_t w = tiling.image_width;
+  uint32_t h = tiling.image_height;
+
+  for (const auto& property : propertiesResult.value) {
+    Transformation t{property, w, h};
+
+    if (auto rot = std::dynamic_pointer_cast<Box_irot>(property)) {
+      if (rot->get_rotation_ccw() == 90 || rot->get_rotation_ccw() == 270) {
+        std::swap(w, h);
+      }
+    }
+    else if (auto clap = std::dynamic_pointer_cast<Box_clap>(property)) {
+      int left = std::max(clap->left_rounded(w), 0);
+      int top = std::max(clap->top_rounded(h), 0);
+      int right = std::min(clap->right_rounded(w), static_cast<int>(w) - 1);
+      int bottom = std::min(clap->bottom_rounded(h), static_cast<int>(h) - 1);
+
+      if (left > right || top > bottom) {
+        return {heif_error_Invalid_input,
+                heif_suberror_Invalid_clean_aperture};
+      }
+
+      t.crop_left = left;
+      t.crop_top = top;
+      w = right - left + 1;
+      h = bottom - top + 1;
+    }
+    else if (!std::dynamic_pointer_cast<Box_imir>(property)) {
+      continue;
+    }
+
+    transformations.push_back(t);
+  }
+
+  if (x0 >= w || width > w - x0 ||
+      y0 >= h || height > h - y0) {
+    return Error{heif_error_Usage_error, heif_suberror_Invalid_parameter_value,
+                 "Decoding region exceeds the image area"};
+  }
+
+  // --- map the region back through the transformations
+
+  for (auto iter = transformations.rbegin(); iter != transformations.rend(); iter++) {
+    const uint32_t W = iter->input_width;
+    const uint32_t H = iter->input_height;
+
+    if (auto rot = std::dynamic_pointer_cast<Box_irot>(iter->property)) {
+      switch (rot->get_rotation_ccw()) {
+        case 90: {
+          uint32_t rx0 = W - y0 - height;
+          y0 = x0;
+          x0 = rx0;
+          std::swap(width, height);
+          break;
+        }
+        case 180:
+          x0 = W - x0 - width;
+          y0 = H - y0 - height;
+          break;
+        case 270: {
+          uint32_t ry0 = H - x0 - width;
+          x0 = y0;
+          y0 = ry0;
+          std::swap(width, height);
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    else if (auto mirror = std::dynamic_pointer_cast<Box_imir>(iter->property)) {
+      if (mirror->get_mirror_direction() == heif_transform_mirror_direction_horizontal) {
+        x0 = W - x0 - width;
+      }
+      else {
+        y0 = H - y0 - height;
+      }
+    }
+    else {
+      x0 += iter->crop_left;
+      y0 += iter->crop_top;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_compressed_region(const struct heif_decoding_options& options,
+                                                                            uint32_t x0, uint32_t y0,
+                                                                            uint32_t width, uint32_t height) const
+{
+  heif_image_tiling tiling = get_heif_image_tiling();
+  if (tiling.tile_width == 0 || tiling.tile_height == 0) {
+    return Error{heif_error_Invalid_input, heif_suberror_Unspecified, "Image has no valid tiling"};
+  }
+
+  bool single_tile = (tiling.num_columns == 1 && tiling.num_rows == 1);
+
+  uint32_t tx0 = x0 / tiling.tile_width;
+  uint32_t ty0 = y0 / tiling.tile_height;
+  uint32_t tx1 = (x0 + width - 1) / tiling.tile_width;
+  uint32_t ty1 = (y0 + height - 1) / tiling.tile_height;
+  uint32_t num_columns = tx1 - tx0 + 1;
+
+  // --- get the tiles from the cache or decode them in parallel
+
+  size_t num_tiles = size_t{num_columns} * (ty1 - ty0 + 1);
+  std::vector<std::shared_ptr<const HeifPixelImage>> tiles(num_tiles);
+
+  // Tiles decoded with another decoder or other decoder parameters are not reused.
+  // The number of threads does not change the decoded pixels and differs between calling threads.
+
+  DecodedTileCache::DecodingSetup decoding_setup;
+  decoding_setup.decoder_id = options.decoder_id ? options.decoder_id : "";
+  decoding_setup.parameters = get_context()->get_decoder_parameters(options);
+  decoding_setup.parameters.erase(heif_decoder_parameter_name_threads);
+
+  // Take the cached tiles and let the reader preload the data of all other tiles.
+
+  RangePrefetcher prefetcher(get_file()->get_reader());
+  std::vector<std::vector<FileRange>> tile_file_ranges(num_tiles);
+
+  for (uint32_t ty = ty0; ty <= ty1; ty++) {
+    for (uint32_t tx = tx0; tx <= tx1; tx++) {
+      size_t idx = (ty - ty0) * num_columns + (tx - tx0);
+
+      tiles[idx] = m_decoded_tile_cache.get(decoding_setup, tx, ty);
+
+      if (!tiles[idx] && prefetcher.is_enabled()) {
+        Error err = get_file_ranges_of_tile(tx, ty, tile_file_ranges[idx]);
+        if (err) {
+          return err;
+        }
+
+        prefetcher.add_ranges(tile_file_ranges[idx]);
+      }
+    }
+  }
+
+  prefetcher.issue_preload_hints();
+
+  std::shared_ptr<ThreadPool> thread_pool = get_context()->get_thread_pool();
+  TaskGroup tile_tasks(thread_pool.get());
+
+  for (uint32_t ty = ty0; ty <= ty1; ty++) {
+    for (uint32_t tx = tx0; tx <= tx1; tx++) {
+      size_t idx = (ty - ty0) * num_columns + (tx - tx0);
+      if (tiles[idx]) {
+        continue;
+      }
+
+      tile_tasks.run([this, &options, &decoding_setup, &tiles, &tile_file_ranges, &prefetcher,
+                      tx, ty, idx, single_tile]() -> Error {
+        auto tileResult = decode_compressed_image(options, !single_tile, tx, ty);
+
+        prefetcher.release_ranges(tile_file_ranges[idx]);
+
+        if (tileResult.error) {
+          return tileResult.error;
+        }
+
+        tiles[idx] = tileResult.value;
+        m_decoded_tile_cache.put(decoding_setup, tx, ty, tiles[idx]);
+        return Error::Ok;
+      });
+    }
+  }
+
+  Error err = tile_tasks.wait();
+  if (err) {
+    return err;
+  }
+
+  // --- paste the tiles into an image that is aligned to the tile grid
+
+  uint32_t canvas_x0 = tx0 * tiling.tile_width;
+  uint32_t canvas_y0 = ty0 * tiling.tile_height;
+  uint32_t canvas_width = std::min((tx1 + 1) * tiling.tile_width, tiling.image_width) - canvas_x0;
+  uint32_t canvas_height = std::min((ty1 + 1) * tiling.tile_height, tiling.image_height) - canvas_y0;
+
+  auto canvas = std::make_shared<HeifPixelImage>();
+  canvas->set_allocator(get_context()->get_image_allocator());
+  canvas->create_clone_image_at_new_size(tiles[0], canvas_width, canvas_height);
+  canvas->set_color_profile_nclx(tiles[0]->get_color_profile_nclx());
+  canvas->set_color_profile_icc(tiles[0]->get_color_profile_icc());
+
+  for (uint32_t ty = ty0; ty <= ty1; ty++) {
+    for (uint32_t tx = tx0; tx <= tx1; tx++) {
+      const auto& tile = tiles[(ty - ty0) * num_columns + (tx - tx0)];
+
+      if (tile->get_chroma_format() != canvas->get_chroma_format()) {
+        return Error{heif_error_Invalid_input,
+                     heif_suberror_Wrong_tile_image_chroma_format,
+                     "Image tile has different chroma format than combined image"};
+      }
+
+      err = canvas->copy_image_to(tile, tx * tiling.tile_width - canvas_x0, ty * tiling.tile_height - canvas_y0);
+      if (err) {
+        return err;
+      }
+    }
+  }
+
+  // --- crop to the requested region
+
+  if (x0 == canvas_x0 && y0 == canvas_y0 && width == canvas_width && height == canvas_height) {
+    return canvas;
+  }
+
+  return canvas->crop(x0 - canvas_x0, x0 - canvas_x0 + width - 1,
+                      y0 - canvas_y0, y0 - canvas_y0 + height - 1);
+}
+
+
+Error ImageItem::get_file_ranges_of_tile(uint32_t tile_x, uint32_t tile_y, std::vector<FileRange>& ranges) const
+{
+  get_file()->get_file_ranges_from_iloc(get_id(), ranges);
+  return Error::Ok;
+}
+
+
 Result<std::vector<uint8_t>> ImageItem::read_bitstream_configuration_data_override(heif_item_id itemId, heif_compression_format format) const
 {
   auto item_codec = ImageItem::alloc_for_compression_format(const_cast<HeifContext*>(get_context()), format);
@@ -992,7 +1361,8 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem::decode_compressed_image(const
 
   decoder->set_data_extent(std::move(extent));
 
-  return decoder->decode_single_frame_from_compressed_data(options);
+  return decoder->decode_single_frame_from_compressed_data(options, get_context()->get_decoder_instance_pool(),
+                                                           get_context()->get_decoder_parameters(options));
 }
 
 
@@ -24,6 +24,7 @@
 #include "api/libheif/heif.h"
 #include "error.h"
 #include "nclx.h"
+#include "tile_cache.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -34,6 +35,8 @@ class HeifContext;
 
 class HeifPixelImage;
 
+struct OutputPlaneBuffers;
+
 
 class ImageMetadata
 {
@@ -264,14 +267,48 @@ public:
 
   Error init_decoder_from_item(heif_item_id id);
 
+  // If 'output_buffers' is given, the image planes may already be placed into these buffers.
   Result<std::shared_ptr<HeifPixelImage>> decode_image(const struct heif_decoding_options& options,
-                                                       bool decode_tile_only, uint32_t tile_x0, uint32_t tile_y0) const;
+                                                       bool decode_tile_only, uint32_t tile_x0, uint32_t tile_y0,
+                                                       const OutputPlaneBuffers* output_buffers = nullptr) const;
+
+  // Decodes the rectangle [x0, x0+width) x [y0, y0+height). The coordinates refer to the transformed image
+  // unless the transformations are ignored. For tiled images, only the tiles that intersect the region are decoded.
+  Result<std::shared_ptr<HeifPixelImage>> decode_image_region(const struct heif_decoding_options& options,
+                                                              uint32_t x0, uint32_t y0, uint32_t width, uint32_t height) const;
+
+  // Decodes the image at about 1/'factor' of its resolution. Images that cannot be decoded at a reduced
+  // resolution are returned at a larger size, up to the full resolution. The caller has to scale the result.
+  Result<std::shared_ptr<HeifPixelImage>> decode_image_downscaled(const struct heif_decoding_options& options,
+                                                                  uint32_t factor) const;
+
+  // Decoded tiles that are kept for decode_image_region(). Disabled by default.
+  DecodedTileCache& get_decoded_tile_cache() const { return m_decoded_tile_cache; }
 
   virtual Result<std::shared_ptr<HeifPixelImage>> decode_compressed_image(const struct heif_decoding_options& options,
                                                                           bool decode_tile_only, uint32_t tile_x0, uint32_t tile_y0) const;
 
+  // Decodes the whole image, writing the planes directly into the output buffers where this is possible without
+  // an extra copy. The default implementation ignores the buffers.
+  virtual Result<std::shared_ptr<HeifPixelImage>> decode_compressed_image_into(const struct heif_decoding_options& options,
+                                                                               const OutputPlaneBuffers& output_buffers) const
+  {
+    return decode_compressed_image(options, false, 0, 0);
+  }
+
+  // See decode_image_downscaled(). The default implementation decodes the image at full resolution.
+  virtual Result<std::shared_ptr<HeifPixelImage>> decode_compressed_image_downscaled(const struct heif_decoding_options& options,
+                                                                                     uint32_t factor) const
+  {
+    return decode_compressed_image(options, false, 0, 0);
+  }
+
   virtual Result<std::vector<uint8_t>> get_compressed_image_data() const;
 
+  // Appends the file ranges that have to be read for decoding the tile (or the whole image if it is not tiled).
+  // This is used for prefetching and may return fewer ranges if they are not known in advance.
+  virtual Error get_file_ranges_of_tile(uint32_t tile_x, uint32_t tile_y, std::vector<FileRange>& ranges) const;
+
   Result<std::vector<std::shared_ptr<Box>>> get_properties() const;
 
   // === encoding ===
@@ -301,6 +338,14 @@ public:
                        const struct heif_encoding_options& options,
                        enum heif_image_input_class input_class);
 
+  // Creates the item for an image that has been coded with encode_to_bitstream_and_boxes() and adds the
+  // coded data and its properties to the file. This is the part of encode_to_item() that modifies the file.
+  Error add_coded_image_to_file(HeifContext* ctx,
+                                const std::shared_ptr<HeifPixelImage>& image,
+                                const CodedImageData& codedImage,
+                                heif_compression_format compression_format,
+                                const struct heif_encoding_options& options);
+
   const std::shared_ptr<const color_profile_nclx>& get_color_profile_nclx() const { return m_color_profile_nclx; }
 
   const std::shared_ptr<const color_profile_raw>& get_color_profile_icc() const { return m_color_profile_icc; }
@@ -401,6 +446,29 @@ private:
 
   std::vector<Error> m_decoding_warnings;
 
+  mutable DecodedTileCache m_decoded_tile_cache;
+
+  struct DecodingRegion
+  {
+    uint32_t x0, y0, width, height;
+  };
+
+  // Applies the transformations and adds the alpha channel, color profiles and metadata.
+  // When decoding a region, 'region' is the requested region in transformed coordinates.
+  // A 'downscale_factor' larger than 1 indicates that 'img' was decoded by decode_compressed_image_downscaled().
+  Result<std::shared_ptr<HeifPixelImage>> postprocess_decoded_image(std::shared_ptr<HeifPixelImage> img,
+                                                                    const struct heif_decoding_options& options,
+                                                                    bool decode_tile_only, uint32_t tile_x0, uint32_t tile_y0,
+                                                                    const DecodingRegion* region,
+                                                                    uint32_t downscale_factor = 1) const;
+
+  Error transform_requested_region_to_original_region(uint32_t& x0, uint32_t& y0, uint32_t& width, uint32_t& height) const;
+
+  // Assembles the region (in coordinates of the coded image) from the decoded tiles.
+  Result<std::shared_ptr<HeifPixelImage>> decode_compressed_region(const struct heif_decoding_options& options,
+                                                                   uint32_t x0, uint32_t y0,
+                                                                   uint32_t width, uint32_t height) const;
+
 protected:
   Result<std::vector<uint8_t>> read_bitstream_configuration_data_override(heif_item_id itemId, heif_compression_format format) const;
 
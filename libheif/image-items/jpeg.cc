@@ -23,6 +23,8 @@
 #include "codecs/jpeg_boxes.h"
 #include "security_limits.h"
 #include "pixelimage.h"
+#include "context.h"
+#include "libheif/heif_plugin.h"
 #include "api/libheif/api_structs.h"
 #include <cstring>
 #include <utility>
@@ -123,6 +125,33 @@ std::shared_ptr<Decoder> ImageItem_JPEG::get_decoder() const
   return m_decoder;
 }
 
+
+Result<std::shared_ptr<HeifPixelImage>> ImageItem_JPEG::decode_compressed_image_downscaled(const struct heif_decoding_options& options,
+                                                                                           uint32_t factor) const
+{
+  // JPEG decoders can skip the high-frequency DCT coefficients and decode at 1/2, 1/4 or 1/8 of the resolution.
+
+  uint32_t denominator = 1;
+  while (denominator < 8 && denominator * 2 <= factor) {
+    denominator *= 2;
+  }
+
+  if (denominator == 1) {
+    return decode_compressed_image(options, false, 0, 0);
+  }
+
+  DataExtent extent;
+  extent.set_from_image_item(get_file(), get_id());
+
+  m_decoder->set_data_extent(std::move(extent));
+
+  auto parameters = get_context()->get_decoder_parameters(options);
+  parameters[heif_decoder_parameter_name_downscale] = std::to_string(denominator);
+
+  return m_decoder->decode_single_frame_from_compressed_data(options, get_context()->get_decoder_instance_pool(),
+                                                             parameters);
+}
+
 Error ImageItem_JPEG::on_load_file()
 {
   // Note: jpgC box is optional. NULL is a valid value.
@@ -44,6 +44,9 @@ public:
 
   Error on_load_file() override;
 
+  Result<std::shared_ptr<HeifPixelImage>> decode_compressed_image_downscaled(const struct heif_decoding_options& options,
+                                                                             uint32_t factor) const override;
+
 public:
 
   Result<CodedImageData> encode(const std::shared_ptr<HeifPixelImage>& image,
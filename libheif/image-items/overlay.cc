@@ -23,6 +23,7 @@
 #include "file.h"
 #include "color-conversion/colorconversion.h"
 #include "security_limits.h"
+#include "thread_pool.h"
 
 
 template<typename I>
@@ -295,6 +296,7 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem_Overlay::decode_overlay_image(
 
   // TODO: seems we always have to compose this in RGB since the background color is an RGB value
   img = std::make_shared<HeifPixelImage>();
+  img->set_allocator(get_context()->get_image_allocator());
   img->create(w, h,
               heif_colorspace_RGB,
               heif_chroma_444);
@@ -319,32 +321,56 @@ Result<std::shared_ptr<HeifPixelImage>> ImageItem_Overlay::decode_overlay_image(
                    heif_suberror_Unspecified,
                    "Self-reference in 'iovl' image item."};
     }
+  }
 
-    auto imgItem = get_context()->get_image(m_overlay_image_ids[i], true);
-    if (!imgItem) {
-      return Error(heif_error_Invalid_input, heif_suberror_Nonexisting_item_referenced, "'iovl' image references a non-existing item.");
-    }
-    if (auto error = imgItem->get_item_error()) {
-      return error;
-    }
+  // --- decode all overlay images in parallel, they are then composed in their stacking order
 
-    auto decodeResult = imgItem->decode_image(options, false, 0,0);
-    if (decodeResult.error) {
-      return decodeResult.error;
-    }
+  std::vector<std::shared_ptr<HeifPixelImage>> overlay_images(m_overlay_image_ids.size());
+
+  std::shared_ptr<ThreadPool> thread_pool = get_context()->get_thread_pool();
+  TaskGroup decode_tasks(thread_pool.get());
+
+  for (size_t i = 0; i < m_overlay_image_ids.size(); i++) {
+    decode_tasks.run([this, i, &overlay_images, &options]() -> Error {
+      auto imgItem = get_context()->get_image(m_overlay_image_ids[i], true);
+      if (!imgItem) {
+        return Error(heif_error_Invalid_input, heif_suberror_Nonexisting_item_referenced, "'iovl' image references a non-existing item.");
+      }
+      if (auto error = imgItem->get_item_error()) {
+        return error;
+      }
+
+      auto decodeResult = imgItem->decode_image(options, false, 0, 0);
+      if (decodeResult.error) {
+        return decodeResult.error;
+      }
 
-    std::shared_ptr<HeifPixelImage> overlay_img = decodeResult.value;
+      std::shared_ptr<HeifPixelImage> overlay_img = decodeResult.value;
 
 
-    // process overlay in RGB space
+      // process overlay in RGB space
 
-    if (overlay_img->get_colorspace() != heif_colorspace_RGB ||
-        overlay_img->get_chroma_format() != heif_chroma_444) {
-      overlay_img = convert_colorspace(overlay_img, heif_colorspace_RGB, heif_chroma_444, nullptr, 0, options.color_conversion_options);
-      if (!overlay_img) {
-        return Error(heif_error_Unsupported_feature, heif_suberror_Unsupported_color_conversion);
+      if (overlay_img->get_colorspace() != heif_colorspace_RGB ||
+          overlay_img->get_chroma_format() != heif_chroma_444) {
+        overlay_img = convert_colorspace(overlay_img, heif_colorspace_RGB, heif_chroma_444, nullptr, 0, options.color_conversion_options);
+        if (!overlay_img) {
+          return Error(heif_error_Unsupported_feature, heif_suberror_Unsupported_color_conversion);
+        }
       }
-    }
+
+      overlay_images[i] = std::move(overlay_img);
+
+      return Error::Ok;
+    });
+  }
+
+  err = decode_tasks.wait();
+  if (err) {
+    return err;
+  }
+
+  for (size_t i = 0; i < m_overlay_image_ids.size(); i++) {
+    std::shared_ptr<HeifPixelImage>& overlay_img = overlay_images[i];
 
     int32_t dx, dy;
     m_overlay_spec.get_offset(i, &dx, &dy);
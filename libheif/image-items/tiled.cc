@@ -593,6 +593,62 @@ ImageItem_Tiled::add_new_tiled_item(HeifContext* ctx, const heif_tiled_image_par
 Error ImageItem_Tiled::add_image_tile(uint32_t tile_x, uint32_t tile_y,
                                      const std::shared_ptr<HeifPixelImage>& image,
                                      struct heif_encoder* encoder)
+{
+  Result<ImageItem::CodedImageData> encodeResult = encode_tile(image, encoder);
+  if (encodeResult.error) {
+    return encodeResult.error;
+  }
+
+  return add_coded_tile(tile_x, tile_y, image, encodeResult.value, encoder->plugin->compression_format);
+}
+
+
+Error ImageItem_Tiled::add_image_tile_rows(uint32_t first_row, uint32_t num_rows,
+                                          const std::vector<std::shared_ptr<HeifPixelImage>>& tiles,
+                                          struct heif_encoder* encoder)
+{
+  heif_image_tiling tiling = get_heif_image_tiling();
+  if (first_row + num_rows > tiling.num_rows ||
+      tiles.size() != static_cast<size_t>(num_rows) * tiling.num_columns) {
+    return {heif_error_Usage_error,
+            heif_suberror_Invalid_parameter_value,
+            "Tile rows exceed the image size or the number of tiles does not match the number of rows"};
+  }
+
+  std::vector<ImageItem::CodedImageData> coded_tiles(tiles.size());
+
+  Error err = get_context()->run_encoding_tasks(tiles.size(), encoder,
+                                                [&](size_t idx, heif_encoder* tile_encoder) {
+                                                  Result<ImageItem::CodedImageData> encodeResult = encode_tile(tiles[idx], tile_encoder);
+                                                  if (encodeResult.error) {
+                                                    return encodeResult.error;
+                                                  }
+
+                                                  coded_tiles[idx] = std::move(encodeResult.value);
+                                                  return Error::Ok;
+                                                });
+  if (err) {
+    return err;
+  }
+
+  // append the tiles in the tile order, independent of the order in which they were compressed
+
+  for (size_t i = 0; i < coded_tiles.size(); i++) {
+    uint32_t tile_x = static_cast<uint32_t>(i % tiling.num_columns);
+    uint32_t tile_y = first_row + static_cast<uint32_t>(i / tiling.num_columns);
+
+    err = add_coded_tile(tile_x, tile_y, tiles[i], coded_tiles[i], encoder->plugin->compression_format);
+    if (err) {
+      return err;
+    }
+  }
+
+  return Error::Ok;
+}
+
+
+Result<ImageItem::CodedImageData> ImageItem_Tiled::encode_tile(const std::shared_ptr<HeifPixelImage>& image,
+                                                               struct heif_encoder* encoder)
 {
   auto item = ImageItem::alloc_for_compression_format(get_context(), encoder->plugin->compression_format);
 
@@ -609,12 +665,17 @@ Error ImageItem_Tiled::add_image_tile(uint32_t tile_x, uint32_t tile_y,
   Result<ImageItem::CodedImageData> encodeResult = item->encode_to_bitstream_and_boxes(colorConvertedImage, encoder, *options, heif_image_input_class_normal); // TODO (other than JPEG)
   heif_encoding_options_free(options);
 
-  if (encodeResult.error) {
-    return encodeResult.error;
-  }
+  return encodeResult;
+}
+
 
+Error ImageItem_Tiled::add_coded_tile(uint32_t tile_x, uint32_t tile_y,
+                                      const std::shared_ptr<HeifPixelImage>& image,
+                                      const ImageItem::CodedImageData& codedTile,
+                                      heif_compression_format compression_format)
+{
   const int construction_method = 0; // 0=mdat 1=idat
-  get_file()->append_iloc_data(get_id(), encodeResult.value.bitstream, construction_method);
+  get_file()->append_iloc_data(get_id(), codedTile.bitstream, construction_method);
 
   auto& header = m_tild_header;
 
@@ -631,12 +692,12 @@ Error ImageItem_Tiled::add_image_tile(uint32_t tile_x, uint32_t tile_y,
   }
 
   uint64_t offset = get_next_tild_position();
-  size_t dataSize = encodeResult.value.bitstream.size();
+  size_t dataSize = codedTile.bitstream.size();
   if (dataSize > 0xFFFFFFFF) {
     return {heif_error_Encoding_error, heif_suberror_Unspecified, "Compressed tile size exceeds maximum tile size."};
   }
   header.set_tild_tile_range(tile_x, tile_y, offset, static_cast<uint32_t>(dataSize));
-  set_next_tild_position(offset + encodeResult.value.bitstream.size());
+  set_next_tild_position(offset + codedTile.bitstream.size());
 
   std::vector<std::shared_ptr<Box>> existing_properties;
   Error err = get_file()->get_properties(get_id(), existing_properties);
@@ -644,7 +705,7 @@ Error ImageItem_Tiled::add_image_tile(uint32_t tile_x, uint32_t tile_y,
     return err;
   }
 
-  for (auto& propertyBox : encodeResult.value.properties) {
+  for (auto& propertyBox : codedTile.properties) {
     if (propertyBox->get_short_type() == fourcc("ispe")) {
       continue;
     }
@@ -661,7 +722,7 @@ Error ImageItem_Tiled::add_image_tile(uint32_t tile_x, uint32_t tile_y,
     get_file()->add_property(get_id(), propertyBox, propertyBox->is_essential());
   }
 
-  get_file()->set_brand(encoder->plugin->compression_format,
+  get_file()->set_brand(compression_format,
                         true); // TODO: out_grid_image->is_miaf_compatible());
 
   return Error::Ok;
@@ -697,15 +758,23 @@ Error ImageItem_Tiled::append_compressed_tile_data(std::vector<uint8_t>& data, u
 {
   uint32_t idx = (uint32_t) (ty * nTiles_h(m_tild_header.get_parameters()) + tx);
 
-  if (!m_tild_header.is_tile_offset_known(idx)) {
-    Error err = const_cast<ImageItem_Tiled*>(this)->load_tile_offset_entry(idx);
-    if (err) {
-      return err;
+  uint64_t offset, size;
+
+  {
+#if ENABLE_PARALLEL_TILE_DECODING
+    std::lock_guard<std::mutex> lock(m_offset_table_mutex);
+#endif
+
+    if (!m_tild_header.is_tile_offset_known(idx)) {
+      Error err = const_cast<ImageItem_Tiled*>(this)->load_tile_offset_entry(idx);
+      if (err) {
+        return err;
+      }
     }
-  }
 
-  uint64_t offset = m_tild_header.get_tile_offset(idx);
-  uint64_t size = m_tild_header.get_tile_size(idx);
+    offset = m_tild_header.get_tile_offset(idx);
+    size = m_tild_header.get_tile_size(idx);
+  }
 
   Error err = get_file()->append_data_from_iloc(get_id(), data, offset, size);
   if (err.error_code) {
@@ -716,6 +785,37 @@ Error ImageItem_Tiled::append_compressed_tile_data(std::vector<uint8_t>& data, u
 }
 
 
+Error ImageItem_Tiled::get_file_ranges_of_tile(uint32_t tx, uint32_t ty, std::vector<FileRange>& ranges) const
+{
+  uint32_t idx = (uint32_t) (ty * nTiles_h(m_tild_header.get_parameters()) + tx);
+
+  uint64_t offset, size;
+
+  {
+#if ENABLE_PARALLEL_TILE_DECODING
+    std::lock_guard<std::mutex> lock(m_offset_table_mutex);
+#endif
+
+    // This loads the offset table in chunks, so that collecting the ranges of many tiles needs only a few reads.
+    if (!m_tild_header.is_tile_offset_known(idx)) {
+      Error err = const_cast<ImageItem_Tiled*>(this)->load_tile_offset_entry(idx);
+      if (err) {
+        return err;
+      }
+    }
+
+    offset = m_tild_header.get_tile_offset(idx);
+    size = m_tild_header.get_tile_size(idx);
+  }
+
+  if (size > 0) {
+    get_file()->get_file_ranges_from_iloc(get_id(), ranges, offset, size);
+  }
+
+  return Error::Ok;
+}
+
+
 Result<std::shared_ptr<HeifPixelImage>>
 ImageItem_Tiled::decode_grid_tile(const heif_decoding_options& options, uint32_t tx, uint32_t ty) const
 {
@@ -737,12 +837,22 @@ ImageItem_Tiled::decode_grid_tile(const heif_decoding_options& options, uint32_t
 
   // --- decode
 
+  // Use a separate Decoder for each call so that tiles can be decoded concurrently on the thread pool.
+  std::shared_ptr<Decoder> tile_decoder = Decoder::alloc_for_infe_type(get_context(), get_id(),
+                                                                      m_tild_header.get_parameters().compression_format_fourcc);
+  if (!tile_decoder) {
+    return Error{heif_error_Unsupported_feature,
+                 heif_suberror_Unsupported_codec,
+                 "'tild' image with unsupported compression format."};
+  }
+
   DataExtent extent;
-  extent.m_raw = data;
+  extent.m_raw = std::move(data);
 
-  m_tile_decoder->set_data_extent(std::move(extent));
+  tile_decoder->set_data_extent(std::move(extent));
 
-  return m_tile_decoder->decode_single_frame_from_compressed_data(options);
+  return tile_decoder->decode_single_frame_from_compressed_data(options, get_context()->get_decoder_instance_pool(),
+                                                                get_context()->get_decoder_parameters(options));
 }
 
 
@@ -30,6 +30,10 @@
 #include <utility>
 #include "libheif/heif_experimental.h"
 
+#if ENABLE_PARALLEL_TILE_DECODING
+#include <mutex>
+#endif
+
 
 uint64_t number_of_tiles(const heif_tiled_image_parameters& params);
 
@@ -155,6 +159,12 @@ public:
                        const std::shared_ptr<HeifPixelImage>& image,
                        struct heif_encoder* encoder);
 
+  // Adds complete rows of tiles, given in row-major order. The tiles are compressed concurrently
+  // (see HeifContext::run_encoding_tasks()), but appended to the file in tile order.
+  Error add_image_tile_rows(uint32_t first_row, uint32_t num_rows,
+                            const std::vector<std::shared_ptr<HeifPixelImage>>& tiles,
+                            struct heif_encoder* encoder);
+
 
   Error on_load_file() override;
 
@@ -191,6 +201,8 @@ public:
 
   void get_tile_size(uint32_t& w, uint32_t& h) const override;
 
+  Error get_file_ranges_of_tile(uint32_t tile_x, uint32_t tile_y, std::vector<FileRange>& ranges) const override;
+
 private:
   TiledHeader m_tild_header;
   uint64_t m_next_tild_position = 0;
@@ -200,10 +212,22 @@ private:
 
   std::shared_ptr<class Decoder> m_tile_decoder;
 
+#if ENABLE_PARALLEL_TILE_DECODING
+  mutable std::mutex m_offset_table_mutex; // lazy loading of the offset table
+#endif
+
   Result<std::shared_ptr<HeifPixelImage>> decode_grid_tile(const heif_decoding_options& options, uint32_t tx, uint32_t ty) const;
 
   Error load_tile_offset_entry(uint32_t idx);
 
+  // Compresses a tile without modifying the file. Can be called concurrently with different encoder instances.
+  Result<CodedImageData> encode_tile(const std::shared_ptr<HeifPixelImage>& image, struct heif_encoder* encoder);
+
+  Error add_coded_tile(uint32_t tile_x, uint32_t tile_y,
+                       const std::shared_ptr<HeifPixelImage>& image,
+                       const CodedImageData& codedTile,
+                       heif_compression_format compression_format);
+
   Error append_compressed_tile_data(std::vector<uint8_t>& data, uint32_t tx, uint32_t ty) const;
 };
 
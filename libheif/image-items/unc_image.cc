@@ -481,6 +481,20 @@ void ImageItem_uncompressed::get_tile_size(uint32_t& w, uint32_t& h) const
 }
 
 
+Error ImageItem_uncompressed::get_file_ranges_of_tile(uint32_t tile_x, uint32_t tile_y, std::vector<FileRange>& ranges) const
+{
+  // The position of a tile within the item data depends on the compression and is only known when decoding.
+  // We therefore only report the ranges of images that consist of a single tile.
+
+  heif_image_tiling tiling = get_heif_image_tiling();
+  if (tiling.num_columns > 1 || tiling.num_rows > 1) {
+    return Error::Ok;
+  }
+
+  return ImageItem::get_file_ranges_of_tile(tile_x, tile_y, ranges);
+}
+
+
 heif_image_tiling ImageItem_uncompressed::get_heif_image_tiling() const
 {
   heif_image_tiling tiling{};
@@ -61,6 +61,8 @@ public:
 
   heif_image_tiling get_heif_image_tiling() const override;
 
+  Error get_file_ranges_of_tile(uint32_t tile_x, uint32_t tile_y, std::vector<FileRange>& ranges) const override;
+
   Error on_load_file() override;
 
 public:
@@ -0,0 +1,235 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_allocator.h"
+
+#include <new>
+#include <utility>
+
+
+uint8_t* DefaultImageAllocator::allocate(size_t size)
+{
+  return new(std::nothrow) uint8_t[size];
+}
+
+
+void DefaultImageAllocator::release(uint8_t* mem, size_t size)
+{
+  (void) size;
+
+  delete[] mem;
+}
+
+
+uint8_t* CustomImageAllocator::allocate(size_t size)
+{
+  return static_cast<uint8_t*>(m_allocator->allocate(m_userdata, size));
+}
+
+
+void CustomImageAllocator::release(uint8_t* mem, size_t size)
+{
+  m_allocator->release(m_userdata, mem, size);
+}
+
+
+PooledImageAllocator::PooledImageAllocator(std::shared_ptr<ImageAllocator> upstream, size_t max_cached_bytes)
+    : m_upstream(std::move(upstream)), m_max_cached_bytes(max_cached_bytes)
+{
+}
+
+
+PooledImageAllocator::~PooledImageAllocator()
+{
+  trim();
+}
+
+
+size_t PooledImageAllocator::get_size_class(size_t size)
+{
+  const size_t min_size_class = 4096;
+
+  if (size <= min_size_class) {
+    return min_size_class;
+  }
+
+  size_t power_of_two = min_size_class;
+  while (power_of_two <= size / 2) {
+    power_of_two *= 2;
+  }
+
+  // round up to a multiple of a quarter of the largest power of two below 'size'
+  size_t step = power_of_two / 4;
+  return (size + step - 1) / step * step;
+}
+
+
+uint8_t* PooledImageAllocator::allocate(size_t size)
+{
+  size_t size_class = get_size_class(size);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto iter = m_free_buffers.find(size_class);
+    if (iter != m_free_buffers.end() && !iter->second.empty()) {
+      uint8_t* mem = iter->second.back();
+      iter->second.pop_back();
+      m_cached_bytes -= size_class;
+      m_hits++;
+      return mem;
+    }
+
+    m_misses++;
+  }
+
+  return m_upstream->allocate(size_class);
+}
+
+
+void PooledImageAllocator::release(uint8_t* mem, size_t size)
+{
+  size_t size_class = get_size_class(size);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_cached_bytes + size_class <= m_max_cached_bytes) {
+      m_free_buffers[size_class].push_back(mem);
+      m_cached_bytes += size_class;
+      return;
+    }
+  }
+
+  m_upstream->release(mem, size_class);
+}
+
+
+void PooledImageAllocator::trim()
+{
+  std::map<size_t, std::vector<uint8_t*>> free_buffers;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::swap(free_buffers, m_free_buffers);
+    m_cached_bytes = 0;
+  }
+
+  for (const auto& size_class : free_buffers) {
+    for (uint8_t* mem : size_class.second) {
+      m_upstream->release(mem, size_class.first);
+    }
+  }
+}
+
+
+heif_image_buffer_pool_statistics PooledImageAllocator::get_statistics() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  heif_image_buffer_pool_statistics stats{};
+  stats.hits = m_hits;
+  stats.misses = m_misses;
+  stats.cached_bytes = m_cached_bytes;
+
+  for (const auto& size_class : m_free_buffers) {
+    stats.num_cached_buffers += size_class.second.size();
+  }
+
+  return stats;
+}
+
+
+static std::mutex global_allocator_mutex;
+static std::shared_ptr<ImageAllocator> global_base_allocator;
+static std::shared_ptr<PooledImageAllocator> global_buffer_pool;
+
+
+std::shared_ptr<ImageAllocator> get_global_image_allocator()
+{
+  std::lock_guard<std::mutex> lock(global_allocator_mutex);
+
+  if (global_buffer_pool) {
+    return global_buffer_pool;
+  }
+
+  if (!global_base_allocator) {
+    global_base_allocator = std::make_shared<DefaultImageAllocator>();
+  }
+
+  return global_base_allocator;
+}
+
+
+std::shared_ptr<ImageAllocator> get_global_base_image_allocator()
+{
+  std::lock_guard<std::mutex> lock(global_allocator_mutex);
+
+  if (!global_base_allocator) {
+    global_base_allocator = std::make_shared<DefaultImageAllocator>();
+  }
+
+  return global_base_allocator;
+}
+
+
+void set_global_image_allocator(std::shared_ptr<ImageAllocator> allocator)
+{
+  std::lock_guard<std::mutex> lock(global_allocator_mutex);
+
+  if (!allocator) {
+    allocator = std::make_shared<DefaultImageAllocator>();
+  }
+
+  global_base_allocator = std::move(allocator);
+
+  // Buffers that are still in use keep the previous pool alive and are returned to it.
+  // New allocations go through a new pool that uses the new allocator.
+
+  if (global_buffer_pool) {
+    global_buffer_pool = std::make_shared<PooledImageAllocator>(global_base_allocator,
+                                                                global_buffer_pool->get_max_cached_bytes());
+  }
+}
+
+
+void set_global_image_buffer_pool(size_t max_cached_bytes)
+{
+  std::lock_guard<std::mutex> lock(global_allocator_mutex);
+
+  if (!global_base_allocator) {
+    global_base_allocator = std::make_shared<DefaultImageAllocator>();
+  }
+
+  if (max_cached_bytes == 0) {
+    global_buffer_pool.reset();
+  }
+  else {
+    global_buffer_pool = std::make_shared<PooledImageAllocator>(global_base_allocator, max_cached_bytes);
+  }
+}
+
+
+std::shared_ptr<PooledImageAllocator> get_global_image_buffer_pool()
+{
+  std::lock_guard<std::mutex> lock(global_allocator_mutex);
+
+  return global_buffer_pool;
+}
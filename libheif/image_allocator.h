@@ -0,0 +1,126 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_IMAGE_ALLOCATOR_H
+#define LIBHEIF_IMAGE_ALLOCATOR_H
+
+#include "libheif/heif.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// Source of the memory for the image planes of HeifPixelImage.
+// Implementations have to be thread-safe.
+class ImageAllocator
+{
+public:
+  virtual ~ImageAllocator() = default;
+
+  // Returns nullptr if the memory could not be allocated.
+  virtual uint8_t* allocate(size_t size) = 0;
+
+  // 'size' is the size that was passed to allocate().
+  virtual void release(uint8_t* mem, size_t size) = 0;
+};
+
+
+// Plain new[]/delete[].
+class DefaultImageAllocator : public ImageAllocator
+{
+public:
+  uint8_t* allocate(size_t size) override;
+
+  void release(uint8_t* mem, size_t size) override;
+};
+
+
+// Forwards to the callbacks of a heif_image_allocator set through the public API.
+class CustomImageAllocator : public ImageAllocator
+{
+public:
+  CustomImageAllocator(const heif_image_allocator* allocator, void* userdata)
+      : m_allocator(allocator), m_userdata(userdata) {}
+
+  uint8_t* allocate(size_t size) override;
+
+  void release(uint8_t* mem, size_t size) override;
+
+private:
+  const heif_image_allocator* m_allocator;
+  void* m_userdata;
+};
+
+
+// Keeps released buffers for reuse instead of returning them to the upstream allocator.
+// Requests are rounded up to size classes with four classes per power of two,
+// so that images of similar size can share buffers without wasting much memory.
+class PooledImageAllocator : public ImageAllocator
+{
+public:
+  PooledImageAllocator(std::shared_ptr<ImageAllocator> upstream, size_t max_cached_bytes);
+
+  ~PooledImageAllocator() override;
+
+  uint8_t* allocate(size_t size) override;
+
+  void release(uint8_t* mem, size_t size) override;
+
+  // Returns all cached buffers to the upstream allocator.
+  void trim();
+
+  heif_image_buffer_pool_statistics get_statistics() const;
+
+  size_t get_max_cached_bytes() const { return m_max_cached_bytes; }
+
+  static size_t get_size_class(size_t size);
+
+private:
+  std::shared_ptr<ImageAllocator> m_upstream;
+  size_t m_max_cached_bytes;
+
+  mutable std::mutex m_mutex;
+  std::map<size_t, std::vector<uint8_t*>> m_free_buffers; // key: size class
+  size_t m_cached_bytes = 0;
+
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+};
+
+
+// The allocator for images that are not created within a heif_context with its own allocator.
+std::shared_ptr<ImageAllocator> get_global_image_allocator();
+
+// The global allocator without the global buffer pool.
+std::shared_ptr<ImageAllocator> get_global_base_image_allocator();
+
+void set_global_image_allocator(std::shared_ptr<ImageAllocator> allocator);
+
+// 'max_cached_bytes' == 0 disables the pool.
+void set_global_image_buffer_pool(size_t max_cached_bytes);
+
+// Returns nullptr if there is no global buffer pool.
+std::shared_ptr<PooledImageAllocator> get_global_image_buffer_pool();
+
+#endif
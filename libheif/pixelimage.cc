@@ -28,6 +28,7 @@
 #include <utility>
 #include <limits>
 #include <algorithm>
+#include <sstream>
 #include <color-conversion/colorconversion.h>
 
 
@@ -90,10 +91,16 @@ uint32_t channel_height(uint32_t h, heif_chroma chroma, heif_channel channel)
   }
 }
 
+HeifPixelImage::HeifPixelImage()
+    : m_allocator(get_global_image_allocator())
+{
+}
+
+
 HeifPixelImage::~HeifPixelImage()
 {
   for (auto& iter : m_planes) {
-    delete[] iter.second.allocated_mem;
+    iter.second.release_memory();
   }
 }
 
@@ -206,7 +213,8 @@ bool HeifPixelImage::add_plane(heif_channel channel, uint32_t width, uint32_t he
     bit_depth = 8;
   }
 
-  if (plane.alloc(width, height, heif_channel_datatype_unsigned_integer, bit_depth, num_interleaved_pixels)) {
+  if (plane.alloc(width, height, heif_channel_datatype_unsigned_integer, bit_depth, num_interleaved_pixels,
+                  m_allocator, get_plane_buffer(channel))) {
     m_planes.insert(std::make_pair(channel, plane));
     return true;
   }
@@ -219,7 +227,7 @@ bool HeifPixelImage::add_plane(heif_channel channel, uint32_t width, uint32_t he
 bool HeifPixelImage::add_channel(heif_channel channel, uint32_t width, uint32_t height, heif_channel_datatype datatype, int bit_depth)
 {
   ImagePlane plane;
-  if (plane.alloc(width, height, datatype, bit_depth, 1)) {
+  if (plane.alloc(width, height, datatype, bit_depth, 1, m_allocator, get_plane_buffer(channel))) {
     m_planes.insert(std::make_pair(channel, plane));
     return true;
   }
@@ -229,8 +237,21 @@ bool HeifPixelImage::add_channel(heif_channel channel, uint32_t width, uint32_t
 }
 
 
+const PlaneBuffer* HeifPixelImage::get_plane_buffer(heif_channel channel) const
+{
+  auto iter = m_plane_buffers.find(channel);
+  if (iter == m_plane_buffers.end()) {
+    return nullptr;
+  }
+
+  return &iter->second;
+}
+
+
 bool HeifPixelImage::ImagePlane::alloc(uint32_t width, uint32_t height, heif_channel_datatype datatype, int bit_depth,
-                                       int num_interleaved_components) // heif_chroma chroma)
+                                       int num_interleaved_components, // heif_chroma chroma)
+                                       const std::shared_ptr<ImageAllocator>& plane_allocator,
+                                       const PlaneBuffer* buffer)
 {
   assert(bit_depth >= 1);
   assert(bit_depth <= 128);
@@ -254,6 +275,17 @@ bool HeifPixelImage::ImagePlane::alloc(uint32_t width, uint32_t height, heif_cha
   int bytes_per_component = get_bytes_per_pixel();
   int bytes_per_pixel = num_interleaved_components * bytes_per_component;
 
+  if (buffer && fits_into(*buffer)) {
+    m_mem_width = width;
+    m_mem_height = height;
+
+    mem = buffer->data;
+    allocated_mem = nullptr;
+    stride = static_cast<uint32_t>(buffer->stride);
+
+    return true;
+  }
+
   stride = m_mem_width * bytes_per_pixel;
   stride = (stride + alignment - 1U) & ~(alignment - 1U);
 
@@ -261,25 +293,108 @@ bool HeifPixelImage::ImagePlane::alloc(uint32_t width, uint32_t height, heif_cha
     return false;
   }
 
-  try {
-    allocated_mem = new uint8_t[static_cast<size_t>(m_mem_height) * stride + alignment - 1];
-    uint8_t* mem_8 = allocated_mem;
+  allocated_size = static_cast<size_t>(m_mem_height) * stride + alignment - 1;
+  allocated_mem = plane_allocator->allocate(allocated_size);
+  if (allocated_mem == nullptr) {
+    return false;
+  }
+
+  allocator = plane_allocator;
 
-    // shift beginning of image data to aligned memory position
+  uint8_t* mem_8 = allocated_mem;
+
+  // shift beginning of image data to aligned memory position
+
+  auto mem_start_addr = (uint64_t) mem_8;
+  auto mem_start_offset = (mem_start_addr & (alignment - 1U));
+  if (mem_start_offset != 0) {
+    mem_8 += alignment - mem_start_offset;
+  }
+
+  mem = mem_8;
+
+  return true;
+}
+
+
+void HeifPixelImage::ImagePlane::release_memory()
+{
+  if (allocated_mem) {
+    allocator->release(allocated_mem, allocated_size);
+  }
+
+  allocated_mem = nullptr;
+  allocated_size = 0;
+  allocator.reset();
+  mem = nullptr;
+}
 
-    auto mem_start_addr = (uint64_t) mem_8;
-    auto mem_start_offset = (mem_start_addr & (alignment - 1U));
-    if (mem_start_offset != 0) {
-      mem_8 += alignment - mem_start_offset;
-    }
 
-    mem = mem_8;
+bool HeifPixelImage::ImagePlane::fits_into(const PlaneBuffer& buffer) const
+{
+  size_t row_size = static_cast<size_t>(m_width) * m_num_interleaved_components * get_bytes_per_pixel();
+
+  if (buffer.data == nullptr ||
+      buffer.stride == 0 ||
+      buffer.stride < row_size ||
+      buffer.stride > std::numeric_limits<uint32_t>::max()) {
+    return false;
+  }
 
+  if (m_height == 0) {
     return true;
   }
-  catch (const std::bad_alloc& excpt) {
+
+  if (buffer.size < row_size) {
     return false;
   }
+
+  // the last row does not need padding up to the full stride
+  return (buffer.size - row_size) / buffer.stride >= m_height - 1;
+}
+
+
+Error HeifPixelImage::move_planes_into_plane_buffers()
+{
+  for (const auto& iter : m_plane_buffers) {
+    auto planeIter = m_planes.find(iter.first);
+    if (planeIter == m_planes.end()) {
+      continue;
+    }
+
+    ImagePlane& plane = planeIter->second;
+    const PlaneBuffer& buffer = iter.second;
+
+    if (plane.mem == buffer.data) {
+      continue;
+    }
+
+    if (!plane.fits_into(buffer)) {
+      std::stringstream sstr;
+      sstr << "Output buffer for channel " << iter.first << " is too small for a "
+           << plane.m_width << "x" << plane.m_height << " plane";
+
+      return {heif_error_Usage_error,
+              heif_suberror_Invalid_parameter_value,
+              sstr.str()};
+    }
+
+    size_t row_size = static_cast<size_t>(plane.m_width) * plane.m_num_interleaved_components * plane.get_bytes_per_pixel();
+
+    for (uint32_t y = 0; y < plane.m_height; y++) {
+      memcpy(buffer.data + y * buffer.stride,
+             static_cast<const uint8_t*>(plane.mem) + y * static_cast<size_t>(plane.stride),
+             row_size);
+    }
+
+    plane.release_memory();
+    plane.mem = buffer.data;
+    plane.stride = static_cast<uint32_t>(buffer.stride);
+    plane.m_mem_width = plane.m_width;
+    plane.m_mem_height = plane.m_height;
+  }
+
+  return Error::Ok;
 }
 
 
@@ -301,7 +416,8 @@ bool HeifPixelImage::extend_padding_to_size(uint32_t width, uint32_t height, boo
         plane->m_mem_height < subsampled_height) {
 
       ImagePlane newPlane;
-      if (!newPlane.alloc(subsampled_width, subsampled_height, plane->m_datatype, plane->m_bit_depth, num_interleaved_pixels_per_plane(m_chroma))) {
+      if (!newPlane.alloc(subsampled_width, subsampled_height, plane->m_datatype, plane->m_bit_depth, num_interleaved_pixels_per_plane(m_chroma),
+                          m_allocator)) {
         return false;
       }
 
@@ -313,6 +429,7 @@ bool HeifPixelImage::extend_padding_to_size(uint32_t width, uint32_t height, boo
                plane->m_width * bytes_per_pixel);
       }
 
+      plane->release_memory();
       planeIter.second = newPlane;
       plane = &planeIter.second;
     }
@@ -371,7 +488,8 @@ bool HeifPixelImage::extend_to_size_with_zero(uint32_t width, uint32_t height)
         plane->m_mem_height < subsampled_height) {
 
       ImagePlane newPlane;
-      if (!newPlane.alloc(subsampled_width, subsampled_height, plane->m_datatype, plane->m_bit_depth, num_interleaved_pixels_per_plane(m_chroma))) {
+      if (!newPlane.alloc(subsampled_width, subsampled_height, plane->m_datatype, plane->m_bit_depth, num_interleaved_pixels_per_plane(m_chroma),
+                          m_allocator)) {
         return false;
       }
 
@@ -383,6 +501,7 @@ bool HeifPixelImage::extend_to_size_with_zero(uint32_t width, uint32_t height)
                plane->m_width * bytes_per_pixel);
       }
 
+      plane->release_memory();
       planeIter.second = newPlane;
       plane = &planeIter.second;
     }
@@ -763,6 +882,7 @@ Result<std::shared_ptr<HeifPixelImage>> HeifPixelImage::rotate_ccw(int angle_deg
   }
 
   std::shared_ptr<HeifPixelImage> out_img = std::make_shared<HeifPixelImage>();
+  out_img->set_allocator(m_allocator);
   out_img->create(out_width, out_height, m_colorspace, m_chroma);
 
 
@@ -974,6 +1094,7 @@ Result<std::shared_ptr<HeifPixelImage>> HeifPixelImage::crop(uint32_t left, uint
 
 
   auto out_img = std::make_shared<HeifPixelImage>();
+  out_img->set_allocator(m_allocator);
   out_img->create(right - left + 1, bottom - top + 1, m_colorspace, m_chroma);
 
 
@@ -1244,6 +1365,7 @@ Error HeifPixelImage::scale_nearest_neighbor(std::shared_ptr<HeifPixelImage>& ou
                                              uint32_t width, uint32_t height) const
 {
   out_img = std::make_shared<HeifPixelImage>();
+  out_img->set_allocator(m_allocator);
   out_img->create(width, height, m_colorspace, m_chroma);
 
 
@@ -1349,6 +1471,139 @@ Error HeifPixelImage::scale_nearest_neighbor(std::shared_ptr<HeifPixelImage>& ou
 }
 
 
+template <typename T, bool swap_bytes>
+static inline uint32_t load_sample(const uint8_t* row, uint32_t idx)
+{
+  T v = reinterpret_cast<const T*>(row)[idx];
+  if (swap_bytes) {
+    v = static_cast<T>((v >> 8) | (v << 8));
+  }
+  return v;
+}
+
+
+template <typename T, bool swap_bytes>
+static void scale_plane_area_average(const uint8_t* in_data, uint32_t in_stride, uint32_t in_w, uint32_t in_h,
+                                     uint8_t* out_data, uint32_t out_stride, uint32_t out_w, uint32_t out_h,
+                                     uint32_t components)
+{
+  // Input range [x_start[x], x_end[x]) of each output column. When upscaling, each range covers one sample.
+
+  std::vector<uint32_t> x_start(out_w), x_end(out_w);
+  for (uint32_t x = 0; x < out_w; x++) {
+    x_start[x] = static_cast<uint32_t>(uint64_t{x} * in_w / out_w);
+    x_end[x] = std::max(x_start[x] + 1, static_cast<uint32_t>(uint64_t{x + 1} * in_w / out_w));
+  }
+
+  std::vector<uint64_t> column_sums(size_t{in_w} * components);
+
+  for (uint32_t y = 0; y < out_h; y++) {
+    uint32_t y_start = static_cast<uint32_t>(uint64_t{y} * in_h / out_h);
+    uint32_t y_end = std::max(y_start + 1, static_cast<uint32_t>(uint64_t{y + 1} * in_h / out_h));
+
+    std::fill(column_sums.begin(), column_sums.end(), 0);
+
+    for (uint32_t iy = y_start; iy < y_end; iy++) {
+      const uint8_t* in_row = in_data + size_t{iy} * in_stride;
+      for (uint32_t i = 0; i < in_w * components; i++) {
+        column_sums[i] += load_sample<T, swap_bytes>(in_row, i);
+      }
+    }
+
+    T* out_row = reinterpret_cast<T*>(out_data + size_t{y} * out_stride);
+
+    for (uint32_t x = 0; x < out_w; x++) {
+      uint64_t count = uint64_t{x_end[x] - x_start[x]} * (y_end - y_start);
+
+      for (uint32_t c = 0; c < components; c++) {
+        uint64_t sum = 0;
+        for (uint32_t ix = x_start[x]; ix < x_end[x]; ix++) {
+          sum += column_sums[ix * components + c];
+        }
+
+        auto v = static_cast<T>((sum + count / 2) / count);
+        if (swap_bytes) {
+          v = static_cast<T>((v >> 8) | (v << 8));
+        }
+
+        out_row[x * components + c] = v;
+      }
+    }
+  }
+}
+
+
+Error HeifPixelImage::scale_area_average(std::shared_ptr<HeifPixelImage>& out_img,
+                                         uint32_t width, uint32_t height) const
+{
+  if (width == 0 || height == 0) {
+    return {heif_error_Usage_error, heif_suberror_Invalid_parameter_value, "Cannot scale image to zero size"};
+  }
+
+  out_img = std::make_shared<HeifPixelImage>();
+  out_img->set_allocator(m_allocator);
+  out_img->create(width, height, m_colorspace, m_chroma);
+  out_img->m_premultiplied_alpha = m_premultiplied_alpha;
+  out_img->m_color_profile_nclx = m_color_profile_nclx;
+  out_img->m_color_profile_icc = m_color_profile_icc;
+
+  const uint16_t endian_probe = 1;
+  const bool little_endian_host = *reinterpret_cast<const uint8_t*>(&endian_probe) == 1;
+
+  for (const auto& plane_pair : m_planes) {
+    heif_channel channel = plane_pair.first;
+    const ImagePlane& plane = plane_pair.second;
+
+    uint32_t out_w, out_h;
+    get_subsampled_size(width, height, channel, m_chroma, &out_w, &out_h);
+
+    if (!out_img->add_plane(channel, out_w, out_h, plane.m_bit_depth)) {
+      return {heif_error_Memory_allocation_error, heif_suberror_Unspecified};
+    }
+
+    uint32_t bytes_per_component = (plane.m_bit_depth <= 8) ? 1 : 2;
+    uint32_t storage_bits = get_storage_bits_per_pixel(channel);
+    if (plane.m_datatype != heif_channel_datatype_unsigned_integer ||
+        plane.m_bit_depth > 16 || storage_bits % (8 * bytes_per_component) != 0) {
+      return {heif_error_Unsupported_feature,
+              heif_suberror_Unspecified,
+              "Can currently only scale unsigned integer images with up to 16 bits per component"};
+    }
+
+    uint32_t components = storage_bits / (8 * bytes_per_component);
+
+    uint32_t in_stride = plane.stride;
+    const auto* in_data = static_cast<const uint8_t*>(plane.mem);
+
+    uint32_t out_stride = 0;
+    auto* out_data = out_img->get_plane(channel, &out_stride);
+
+    uint32_t in_w = get_width(channel);
+    uint32_t in_h = get_height(channel);
+
+    if (bytes_per_component == 1) {
+      scale_plane_area_average<uint8_t, false>(in_data, in_stride, in_w, in_h, out_data, out_stride, out_w, out_h, components);
+    }
+    else {
+      // Interleaved images store the samples with an explicit endianness, planes use the host byte order.
+      bool big_endian_data = (m_chroma == heif_chroma_interleaved_RRGGBB_BE ||
+                              m_chroma == heif_chroma_interleaved_RRGGBBAA_BE);
+      bool little_endian_data = (m_chroma == heif_chroma_interleaved_RRGGBB_LE ||
+                                 m_chroma == heif_chroma_interleaved_RRGGBBAA_LE);
+
+      if ((big_endian_data && little_endian_host) || (little_endian_data && !little_endian_host)) {
+        scale_plane_area_average<uint16_t, true>(in_data, in_stride, in_w, in_h, out_data, out_stride, out_w, out_h, components);
+      }
+      else {
+        scale_plane_area_average<uint16_t, false>(in_data, in_stride, in_w, in_h, out_data, out_stride, out_w, out_h, components);
+      }
+    }
+  }
+
+  return Error::Ok;
+}
+
+
 void HeifPixelImage::debug_dump() const
 {
   auto channels = get_channel_set();
@@ -1395,3 +1650,42 @@ void HeifPixelImage::create_clone_image_at_new_size(const std::shared_ptr<const
       add_plane(heif_channel_Alpha, w, h, source->get_bits_per_pixel(heif_channel_Alpha));
   }
 }
+
+
+std::shared_ptr<HeifPixelImage> HeifPixelImage::create_row_strip_view(uint32_t first_row, uint32_t num_rows)
+{
+  assert(first_row + num_rows <= m_height);
+  assert(m_chroma != heif_chroma_420 || first_row % 2 == 0);
+
+  auto view = std::make_shared<HeifPixelImage>();
+  view->create(m_width, num_rows, m_colorspace, m_chroma);
+  view->m_allocator = m_allocator;
+  view->m_premultiplied_alpha = m_premultiplied_alpha;
+  view->m_color_profile_nclx = m_color_profile_nclx;
+  view->m_color_profile_icc = m_color_profile_icc;
+
+  for (const auto& iter : m_planes) {
+    heif_channel channel = iter.first;
+    const ImagePlane& plane = iter.second;
+
+    uint32_t w, row_offset, plane_rows;
+    get_subsampled_size(m_width, first_row, channel, m_chroma, &w, &row_offset);
+    get_subsampled_size(m_width, num_rows, channel, m_chroma, &w, &plane_rows);
+
+    // the view does not own the memory
+    ImagePlane view_plane;
+    view_plane.m_datatype = plane.m_datatype;
+    view_plane.m_bit_depth = plane.m_bit_depth;
+    view_plane.m_num_interleaved_components = plane.m_num_interleaved_components;
+    view_plane.m_width = plane.m_width;
+    view_plane.m_height = plane_rows;
+    view_plane.m_mem_width = plane.m_width;
+    view_plane.m_mem_height = plane_rows;
+    view_plane.mem = static_cast<uint8_t*>(plane.mem) + static_cast<size_t>(row_offset) * plane.stride;
+    view_plane.stride = plane.stride;
+
+    view->m_planes.insert(std::make_pair(channel, view_plane));
+  }
+
+  return view;
+}
@@ -25,6 +25,7 @@
 //#include "heif.h"
 #include "error.h"
 #include "nclx.h"
+#include "image_allocator.h"
 #include <libheif/heif_experimental.h>
 
 #include <vector>
@@ -71,11 +72,30 @@ enum heif_chroma420_sample_position {
 };
 
 
+// Caller-owned memory for an image plane.
+struct PlaneBuffer
+{
+  uint8_t* data = nullptr;
+  size_t stride = 0; // bytes per row
+  size_t size = 0; // total size of the memory in bytes
+};
+
+
+// Caller-owned memory into which an image is decoded, and the colorspace it is requested in.
+struct OutputPlaneBuffers
+{
+  heif_colorspace colorspace = heif_colorspace_undefined;
+  heif_chroma chroma = heif_chroma_undefined;
+
+  std::map<heif_channel, PlaneBuffer> planes;
+};
+
+
 class HeifPixelImage : public std::enable_shared_from_this<HeifPixelImage>,
                        public ErrorBuffer
 {
 public:
-  explicit HeifPixelImage() = default;
+  explicit HeifPixelImage();
 
   ~HeifPixelImage();
 
@@ -83,12 +103,30 @@ public:
 
   void create_clone_image_at_new_size(const std::shared_ptr<const HeifPixelImage>& source, uint32_t w, uint32_t h);
 
+  // Returns an image that shares the memory of the rows [first_row, first_row + num_rows) of this image.
+  // 'first_row' has to be a multiple of the vertical chroma subsampling. The view must not outlive this image.
+  std::shared_ptr<HeifPixelImage> create_row_strip_view(uint32_t first_row, uint32_t num_rows);
+
   bool add_plane(heif_channel channel, uint32_t width, uint32_t height, int bit_depth);
 
   bool add_channel(heif_channel channel, uint32_t width, uint32_t height, heif_channel_datatype datatype, int bit_depth);
 
   bool has_channel(heif_channel channel) const;
 
+  // The allocator for planes that are added afterwards. Defaults to the global image allocator.
+  // Planes keep the allocator they were allocated with.
+  void set_allocator(std::shared_ptr<ImageAllocator> allocator) { m_allocator = std::move(allocator); }
+
+  const std::shared_ptr<ImageAllocator>& get_allocator() const { return m_allocator; }
+
+  // Planes that are added afterwards are placed into these buffers instead of newly allocated memory
+  // if their size fits. The buffers are not owned by the image and must outlive it.
+  void set_plane_buffers(const std::map<heif_channel, PlaneBuffer>& buffers) { m_plane_buffers = buffers; }
+
+  // Copies all planes that are not yet stored in their plane buffer into it and releases their own memory.
+  // Buffers for channels that do not exist in the image are ignored.
+  Error move_planes_into_plane_buffers();
+
   // Has alpha information either as a separate channel or in the interleaved format.
   bool has_alpha() const;
 
@@ -180,6 +218,10 @@ public:
 
   Error scale_nearest_neighbor(std::shared_ptr<HeifPixelImage>& output, uint32_t width, uint32_t height) const;
 
+  // Scales each plane by averaging all input samples that are covered by an output sample (box filter).
+  // This is intended for downscaling. The color profiles and the alpha premultiplication are kept.
+  Error scale_area_average(std::shared_ptr<HeifPixelImage>& output, uint32_t width, uint32_t height) const;
+
   void set_color_profile_nclx(const std::shared_ptr<const color_profile_nclx>& profile) { m_color_profile_nclx = profile; }
 
   const std::shared_ptr<const color_profile_nclx>& get_color_profile_nclx() const { return m_color_profile_nclx; }
@@ -243,7 +285,13 @@ public:
 private:
   struct ImagePlane
   {
-    bool alloc(uint32_t width, uint32_t height, heif_channel_datatype datatype, int bit_depth, int num_interleaved_components);
+    // Uses the given buffer (if not NULL and large enough) instead of allocating new memory.
+    bool alloc(uint32_t width, uint32_t height, heif_channel_datatype datatype, int bit_depth, int num_interleaved_components,
+               const std::shared_ptr<ImageAllocator>& allocator, const PlaneBuffer* buffer = nullptr);
+
+    void release_memory();
+
+    bool fits_into(const PlaneBuffer& buffer) const;
 
     heif_channel_datatype m_datatype = heif_channel_datatype_unsigned_integer;
     uint8_t m_bit_depth = 0;
@@ -258,7 +306,9 @@ private:
     uint32_t m_mem_height = 0;
 
     void* mem = nullptr; // aligned memory start
-    uint8_t* allocated_mem = nullptr; // unaligned memory we allocated
+    uint8_t* allocated_mem = nullptr; // unaligned memory we allocated, NULL if 'mem' is a caller-owned PlaneBuffer
+    size_t allocated_size = 0;
+    std::shared_ptr<ImageAllocator> allocator; // that 'allocated_mem' was allocated with
     uint32_t stride = 0; // bytes per line
 
     int get_bytes_per_pixel() const;
@@ -280,6 +330,10 @@ private:
   std::shared_ptr<const color_profile_raw> m_color_profile_icc;
 
   std::map<heif_channel, ImagePlane> m_planes;
+  std::map<heif_channel, PlaneBuffer> m_plane_buffers;
+  std::shared_ptr<ImageAllocator> m_allocator;
+
+  const PlaneBuffer* get_plane_buffer(heif_channel channel) const;
 
   uint32_t m_PixelAspectRatio_h = 1;
   uint32_t m_PixelAspectRatio_v = 1;
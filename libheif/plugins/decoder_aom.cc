@@ -24,6 +24,7 @@
 #include <memory>
 #include <cstring>
 #include <cassert>
+#include <algorithm>
 
 #include <aom/aom_decoder.h>
 #include <aom/aomdx.h>
@@ -32,11 +33,14 @@
 struct aom_decoder
 {
   aom_codec_ctx_t codec;
-  bool codec_initialized = false;
+  bool codec_initialized = false; // initialized when the first data is pushed, after the parameters have been set
 
   aom_codec_iface_t* iface;
 
   bool strict_decoding = false;
+
+  unsigned int num_threads = 1;
+  bool row_mt = true;
 };
 
 static const char kSuccess[] = "Success";
@@ -62,8 +66,51 @@ static const char* aom_plugin_name()
 }
 
 
+static const int MAX_AOM_DECODER_THREADS = 64;
+
+static const char* kParam_row_mt = "row-mt";
+
+#define MAX_NPARAMETERS 2
+
+static struct heif_encoder_parameter aom_decoder_params[MAX_NPARAMETERS];
+static const struct heif_encoder_parameter* aom_decoder_parameter_ptrs[MAX_NPARAMETERS + 1];
+
+
+static void aom_init_parameters()
+{
+  struct heif_encoder_parameter* p = aom_decoder_params;
+  const struct heif_encoder_parameter** d = aom_decoder_parameter_ptrs;
+  int i = 0;
+
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = heif_decoder_parameter_name_threads;
+  p->type = heif_encoder_parameter_type_integer;
+  p->integer.default_value = 1;
+  p->has_default = true;
+  p->integer.have_minimum_maximum = true;
+  p->integer.minimum = 1;
+  p->integer.maximum = MAX_AOM_DECODER_THREADS;
+  p->integer.valid_values = NULL;
+  p->integer.num_valid_values = 0;
+  d[i++] = p++;
+
+  // Row-based multithreading within tiles. Only has an effect with more than one thread.
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = kParam_row_mt;
+  p->type = heif_encoder_parameter_type_boolean;
+  p->boolean.default_value = true;
+  p->has_default = true;
+  d[i++] = p++;
+
+  d[i++] = nullptr;
+}
+
+
 static void aom_init_plugin()
 {
+  aom_init_parameters();
 }
 
 
@@ -89,17 +136,6 @@ struct heif_error aom_new_decoder(void** dec)
 
   decoder->iface = aom_codec_av1_dx();
 
-  aom_codec_err_t aomerr = aom_codec_dec_init(&decoder->codec, decoder->iface, NULL, 0);
-  if (aomerr) {
-    *dec = NULL;
-
-    delete decoder;
-
-    struct heif_error err = {heif_error_Decoder_plugin_error, heif_suberror_Unspecified, aom_codec_err_to_string(aomerr)};
-    return err;
-  }
-
-  decoder->codec_initialized = true;
   *dec = decoder;
 
   struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
@@ -132,6 +168,62 @@ void aom_set_strict_decoding(void* decoder_raw, int flag)
 }
 
 
+static const struct heif_encoder_parameter** aom_list_parameters()
+{
+  return aom_decoder_parameter_ptrs;
+}
+
+
+static struct heif_error error_decoder_already_initialized = {heif_error_Usage_error,
+                                                              heif_suberror_Unsupported_parameter,
+                                                              "Decoder parameters cannot be changed after decoding started"};
+
+
+static struct heif_error aom_set_parameter_integer(void* decoder_raw, const char* name, int value)
+{
+  struct aom_decoder* decoder = (aom_decoder*) decoder_raw;
+
+  if (strcmp(name, heif_decoder_parameter_name_threads) == 0) {
+    auto num_threads = static_cast<unsigned int>(std::min(std::max(value, 1), MAX_AOM_DECODER_THREADS));
+
+    // Once the codec is initialized, only the current value can be set again.
+    if (decoder->codec_initialized && num_threads != decoder->num_threads) {
+      return error_decoder_already_initialized;
+    }
+
+    decoder->num_threads = num_threads;
+  }
+  else {
+    struct heif_error err = {heif_error_Usage_error, heif_suberror_Unsupported_parameter, kEmptyString};
+    return err;
+  }
+
+  struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+  return err;
+}
+
+
+static struct heif_error aom_set_parameter_boolean(void* decoder_raw, const char* name, int value)
+{
+  struct aom_decoder* decoder = (aom_decoder*) decoder_raw;
+
+  if (strcmp(name, kParam_row_mt) == 0) {
+    if (decoder->codec_initialized && (value != 0) != decoder->row_mt) {
+      return error_decoder_already_initialized;
+    }
+
+    decoder->row_mt = (value != 0);
+  }
+  else {
+    struct heif_error err = {heif_error_Usage_error, heif_suberror_Unsupported_parameter, kEmptyString};
+    return err;
+  }
+
+  struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+  return err;
+}
+
+
 struct heif_error aom_push_data(void* decoder_raw, const void* frame_data, size_t frame_size)
 {
   struct aom_decoder* decoder = (struct aom_decoder*) decoder_raw;
@@ -140,6 +232,26 @@ struct heif_error aom_push_data(void* decoder_raw, const void* frame_data, size_
   (void)ver;
 
   aom_codec_err_t aomerr;
+
+  if (!decoder->codec_initialized) {
+    aom_codec_dec_cfg_t cfg{};
+    cfg.threads = decoder->num_threads;
+    // Keep the default of libaom when no configuration is passed. Otherwise, 8-bit images are returned in 16-bit buffers.
+    cfg.allow_lowbitdepth = 1;
+
+    aomerr = aom_codec_dec_init(&decoder->codec, decoder->iface, &cfg, 0);
+    if (aomerr) {
+      struct heif_error err = {heif_error_Decoder_plugin_error, heif_suberror_Unspecified, aom_codec_err_to_string(aomerr)};
+      return err;
+    }
+
+    decoder->codec_initialized = true;
+
+#ifdef AOM_CTRL_AV1D_SET_ROW_MT
+    aom_codec_control(&decoder->codec, AV1D_SET_ROW_MT, (unsigned int) decoder->row_mt);
+#endif
+  }
+
   aomerr = aom_codec_decode(&decoder->codec, (const uint8_t*) frame_data, frame_size, NULL);
   if (aomerr) {
     struct heif_error err = {heif_error_Invalid_input, heif_suberror_Unspecified, aom_codec_err_to_string(aomerr)};
@@ -276,7 +388,7 @@ struct heif_error aom_decode_image(void* decoder_raw, struct heif_image** out_im
 
 static const struct heif_decoder_plugin decoder_aom
     {
-        3,
+        5,
         aom_plugin_name,
         aom_init_plugin,
         aom_deinit_plugin,
@@ -286,7 +398,12 @@ static const struct heif_decoder_plugin decoder_aom
         aom_push_data,
         aom_decode_image,
         aom_set_strict_decoding,
-        "aom"
+        "aom",
+        nullptr,
+        aom_list_parameters,
+        aom_set_parameter_integer,
+        aom_set_parameter_boolean,
+        nullptr
     };
 
 
@@ -29,6 +29,7 @@
 #include <cstdio>
 #include <limits>
 #include <utility>
+#include <algorithm>
 
 #include <dav1d/version.h>
 #include <dav1d/dav1d.h>
@@ -36,7 +37,7 @@
 struct dav1d_decoder
 {
   Dav1dSettings settings;
-  Dav1dContext* context;
+  Dav1dContext* context = nullptr; // opened when the first data is pushed, after the parameters have been set
   Dav1dData data;
   bool strict_decoding = false;
 };
@@ -65,8 +66,64 @@ static const char* dav1d_plugin_name()
 }
 
 
+static const char* kParam_max_frame_delay = "max-frame-delay";
+static const char* kParam_apply_film_grain = "apply-film-grain";
+
+#define MAX_NPARAMETERS 3
+
+static struct heif_encoder_parameter dav1d_decoder_params[MAX_NPARAMETERS];
+static const struct heif_encoder_parameter* dav1d_decoder_parameter_ptrs[MAX_NPARAMETERS + 1];
+
+
+static void dav1d_init_parameters()
+{
+  struct heif_encoder_parameter* p = dav1d_decoder_params;
+  const struct heif_encoder_parameter** d = dav1d_decoder_parameter_ptrs;
+  int i = 0;
+
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = heif_decoder_parameter_name_threads;
+  p->type = heif_encoder_parameter_type_integer;
+  p->integer.default_value = 0; // automatic
+  p->has_default = true;
+  p->integer.have_minimum_maximum = true;
+  p->integer.minimum = 0;
+  p->integer.maximum = DAV1D_MAX_THREADS;
+  p->integer.valid_values = NULL;
+  p->integer.num_valid_values = 0;
+  d[i++] = p++;
+
+  // Number of frames decoded in parallel. Still images consist of a single frame, so 1 saves
+  // the memory of the frame threads without losing speed.
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = kParam_max_frame_delay;
+  p->type = heif_encoder_parameter_type_integer;
+  p->integer.default_value = 0; // automatic
+  p->has_default = true;
+  p->integer.have_minimum_maximum = true;
+  p->integer.minimum = 0;
+  p->integer.maximum = DAV1D_MAX_FRAME_DELAY;
+  p->integer.valid_values = NULL;
+  p->integer.num_valid_values = 0;
+  d[i++] = p++;
+
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = kParam_apply_film_grain;
+  p->type = heif_encoder_parameter_type_boolean;
+  p->boolean.default_value = true;
+  p->has_default = true;
+  d[i++] = p++;
+
+  d[i++] = nullptr;
+}
+
+
 static void dav1d_init_plugin()
 {
+  dav1d_init_parameters();
 }
 
 
@@ -101,12 +158,6 @@ struct heif_error dav1d_new_decoder(void** dec)
 
   decoder->settings.all_layers = 0;
 
-  if (dav1d_open(&decoder->context, &decoder->settings) != 0) {
-    delete decoder;
-    struct heif_error err = {heif_error_Decoder_plugin_error, heif_suberror_Unspecified, kSuccess};
-    return err;
-  }
-
   memset(&decoder->data, 0, sizeof(Dav1dData));
 
   *dec = decoder;
@@ -142,12 +193,101 @@ void dav1d_set_strict_decoding(void* decoder_raw, int flag)
   decoder->strict_decoding = flag;
 }
 
+static const struct heif_encoder_parameter** dav1d_list_parameters()
+{
+  return dav1d_decoder_parameter_ptrs;
+}
+
+
+static struct heif_error error_decoder_already_opened = {heif_error_Usage_error,
+                                                         heif_suberror_Unsupported_parameter,
+                                                         "Decoder parameters cannot be changed after decoding started"};
+
+
+static struct heif_error dav1d_set_parameter_integer(void* decoder_raw, const char* name, int value)
+{
+  auto* decoder = (struct dav1d_decoder*) decoder_raw;
+
+  int* setting;
+
+  if (strcmp(name, heif_decoder_parameter_name_threads) == 0) {
+    setting = &decoder->settings.n_threads;
+    value = std::min(std::max(value, 0), DAV1D_MAX_THREADS);
+  }
+  else if (strcmp(name, kParam_max_frame_delay) == 0) {
+    setting = &decoder->settings.max_frame_delay;
+    value = std::min(std::max(value, 0), DAV1D_MAX_FRAME_DELAY);
+  }
+  else {
+    struct heif_error err = {heif_error_Usage_error, heif_suberror_Unsupported_parameter, kEmptyString};
+    return err;
+  }
+
+  // The settings are passed to dav1d when the context is opened. Afterwards, only the current value can be set again.
+  if (decoder->context && *setting != value) {
+    return error_decoder_already_opened;
+  }
+
+  *setting = value;
+
+  struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+  return err;
+}
+
+
+static struct heif_error dav1d_set_parameter_boolean(void* decoder_raw, const char* name, int value)
+{
+  auto* decoder = (struct dav1d_decoder*) decoder_raw;
+
+  if (strcmp(name, kParam_apply_film_grain) == 0) {
+    int apply_grain = value ? 1 : 0;
+
+    if (decoder->context && decoder->settings.apply_grain != apply_grain) {
+      return error_decoder_already_opened;
+    }
+
+    decoder->settings.apply_grain = apply_grain;
+  }
+  else {
+    struct heif_error err = {heif_error_Usage_error, heif_suberror_Unsupported_parameter, kEmptyString};
+    return err;
+  }
+
+  struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+  return err;
+}
+
+
+struct heif_error dav1d_reset_decoder(void* decoder_raw)
+{
+  auto* decoder = (struct dav1d_decoder*) decoder_raw;
+
+  if (decoder->data.sz) {
+    dav1d_data_unref(&decoder->data);
+  }
+
+  if (decoder->context) {
+    dav1d_flush(decoder->context);
+  }
+
+  struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+  return err;
+}
+
 struct heif_error dav1d_push_data(void* decoder_raw, const void* frame_data, size_t frame_size)
 {
   auto* decoder = (struct dav1d_decoder*) decoder_raw;
 
   assert(decoder->data.sz == 0);
 
+  if (!decoder->context) {
+    if (dav1d_open(&decoder->context, &decoder->settings) != 0) {
+      decoder->context = nullptr;
+      struct heif_error err = {heif_error_Decoder_plugin_error, heif_suberror_Unspecified, kSuccess};
+      return err;
+    }
+  }
+
   uint8_t* d = dav1d_data_create(&decoder->data, frame_size);
   if (d == nullptr) {
     struct heif_error err = {heif_error_Memory_allocation_error, heif_suberror_Unspecified, kSuccess};
@@ -301,7 +441,7 @@ struct heif_error dav1d_decode_image(void* decoder_raw, struct heif_image** out_
 
 static const struct heif_decoder_plugin decoder_dav1d
     {
-        3,
+        5,
         dav1d_plugin_name,
         dav1d_init_plugin,
         dav1d_deinit_plugin,
@@ -311,7 +451,12 @@ static const struct heif_decoder_plugin decoder_dav1d
         dav1d_push_data,
         dav1d_decode_image,
         dav1d_set_strict_decoding,
-        "dav1d"
+        "dav1d",
+        dav1d_reset_decoder,
+        dav1d_list_parameters,
+        dav1d_set_parameter_integer,
+        dav1d_set_parameter_boolean,
+        nullptr
     };
 
 
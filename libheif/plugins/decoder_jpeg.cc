@@ -35,9 +35,13 @@ extern "C" {
 struct jpeg_decoder
 {
   std::vector<uint8_t> data;
+
+  // decode at 1/scale_denominator of the resolution
+  unsigned int scale_denominator = 1;
 };
 
 static const char kSuccess[] = "Success";
+static const char kEmptyString[] = "";
 
 static const int JPEG_PLUGIN_PRIORITY = 100;
 
@@ -61,8 +65,38 @@ static const char* jpeg_plugin_name()
 }
 
 
+#define MAX_NPARAMETERS 1
+
+static struct heif_encoder_parameter jpeg_decoder_params[MAX_NPARAMETERS];
+static const struct heif_encoder_parameter* jpeg_decoder_parameter_ptrs[MAX_NPARAMETERS + 1];
+
+static int jpeg_valid_scale_denominators[] = {1, 2, 4, 8};
+
+
+static void jpeg_init_parameters()
+{
+  struct heif_encoder_parameter* p = jpeg_decoder_params;
+  const struct heif_encoder_parameter** d = jpeg_decoder_parameter_ptrs;
+  int i = 0;
+
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = heif_decoder_parameter_name_downscale;
+  p->type = heif_encoder_parameter_type_integer;
+  p->integer.default_value = 1;
+  p->has_default = true;
+  p->integer.have_minimum_maximum = false;
+  p->integer.valid_values = jpeg_valid_scale_denominators;
+  p->integer.num_valid_values = 4;
+  d[i++] = p++;
+
+  d[i++] = nullptr;
+}
+
+
 static void jpeg_init_plugin()
 {
+  jpeg_init_parameters();
 }
 
 
@@ -104,6 +138,45 @@ void jpeg_free_decoder(void* decoder_raw)
 }
 
 
+struct heif_error jpeg_reset_decoder(void* decoder_raw)
+{
+  struct jpeg_decoder* decoder = (jpeg_decoder*) decoder_raw;
+
+  decoder->data.clear();
+
+  struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+  return err;
+}
+
+
+static const struct heif_encoder_parameter** jpeg_list_parameters()
+{
+  return jpeg_decoder_parameter_ptrs;
+}
+
+
+static struct heif_error jpeg_set_parameter_integer(void* decoder_raw, const char* name, int value)
+{
+  struct jpeg_decoder* decoder = (jpeg_decoder*) decoder_raw;
+
+  if (strcmp(name, heif_decoder_parameter_name_downscale) == 0) {
+    // libjpeg supports the scaling factors 1/1, 1/2, 1/4 and 1/8 in all versions.
+    unsigned int denominator = 1;
+    while (denominator < 8 && (int) denominator * 2 <= value) {
+      denominator *= 2;
+    }
+
+    decoder->scale_denominator = denominator;
+
+    struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+    return err;
+  }
+
+  struct heif_error err = {heif_error_Usage_error, heif_suberror_Unsupported_parameter, kEmptyString};
+  return err;
+}
+
+
 void jpeg_set_strict_decoding(void* decoder_raw, int flag)
 {
 //  struct jpeg_decoder* decoder = (jpeg_decoder*) decoder_raw;
@@ -152,6 +225,9 @@ struct heif_error jpeg_decode_image(void* decoder_raw, struct heif_image** out_i
 
   jpeg_read_header(&cinfo, TRUE);
 
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = decoder->scale_denominator;
+
 //  bool embeddedIccFlag = ReadICCProfileFromJPEG(&cinfo, &iccBuffer, &iccLen);
 //  bool embeddedXMPFlag = ReadXMPFromJPEG(&cinfo, xmpData);
 //  if (embeddedXMPFlag) {
@@ -295,7 +371,7 @@ struct heif_error jpeg_decode_image(void* decoder_raw, struct heif_image** out_i
 
 static const struct heif_decoder_plugin decoder_jpeg
     {
-        3,
+        5,
         jpeg_plugin_name,
         jpeg_init_plugin,
         jpeg_deinit_plugin,
@@ -305,7 +381,12 @@ static const struct heif_decoder_plugin decoder_jpeg
         jpeg_push_data,
         jpeg_decode_image,
         jpeg_set_strict_decoding,
-        "jpeg"
+        "jpeg",
+        jpeg_reset_decoder,
+        jpeg_list_parameters,
+        jpeg_set_parameter_integer,
+        nullptr,
+        nullptr
     };
 
 
@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <memory>
 #include <cstring>
+#include <algorithm>
 
 #include <libde265/de265.h>
 
@@ -35,6 +36,9 @@ struct libde265_decoder
 {
   de265_decoder_context* ctx;
   bool strict_decoding = false;
+
+  int num_threads = 1;
+  bool worker_threads_started = false;
 };
 
 static const char kEmptyString[] = "";
@@ -62,9 +66,71 @@ static const char* libde265_plugin_name()
 }
 
 
+// libde265 does not accept more worker threads than this
+static const int MAX_LIBDE265_THREADS = 32;
+
+static const char* kParam_disable_deblocking = "disable-deblocking";
+static const char* kParam_disable_sao = "disable-sao";
+
+#if defined(__EMSCRIPTEN__)
+// Speed up decoding from JavaScript.
+static const bool kDefault_disable_filters = true;
+#else
+static const bool kDefault_disable_filters = false;
+#endif
+
+#define MAX_NPARAMETERS 3
+
+static struct heif_encoder_parameter libde265_decoder_params[MAX_NPARAMETERS];
+static const struct heif_encoder_parameter* libde265_decoder_parameter_ptrs[MAX_NPARAMETERS + 1];
+
+
+static void libde265_init_parameters()
+{
+  struct heif_encoder_parameter* p = libde265_decoder_params;
+  const struct heif_encoder_parameter** d = libde265_decoder_parameter_ptrs;
+  int i = 0;
+
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = heif_decoder_parameter_name_threads;
+  p->type = heif_encoder_parameter_type_integer;
+  p->integer.default_value = 1;
+  p->has_default = true;
+  p->integer.have_minimum_maximum = true;
+  p->integer.minimum = 1;
+  p->integer.maximum = MAX_LIBDE265_THREADS;
+  p->integer.valid_values = NULL;
+  p->integer.num_valid_values = 0;
+  d[i++] = p++;
+
+  // Skipping the in-loop filters speeds up decoding at the cost of visible artifacts.
+
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = kParam_disable_deblocking;
+  p->type = heif_encoder_parameter_type_boolean;
+  p->boolean.default_value = kDefault_disable_filters;
+  p->has_default = true;
+  d[i++] = p++;
+
+  assert(i < MAX_NPARAMETERS);
+  p->version = 2;
+  p->name = kParam_disable_sao;
+  p->type = heif_encoder_parameter_type_boolean;
+  p->boolean.default_value = kDefault_disable_filters;
+  p->has_default = true;
+  d[i++] = p++;
+
+  d[i++] = nullptr;
+}
+
+
 static void libde265_init_plugin()
 {
   de265_init();
+
+  libde265_init_parameters();
 }
 
 
@@ -163,19 +229,29 @@ static struct heif_error libde265_new_decoder(void** dec)
   struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
 
   decoder->ctx = de265_new_decoder();
-#if defined(__EMSCRIPTEN__)
-  // Speed up decoding from JavaScript.
-  de265_set_parameter_bool(decoder->ctx, DE265_DECODER_PARAM_DISABLE_DEBLOCKING, 1);
-  de265_set_parameter_bool(decoder->ctx, DE265_DECODER_PARAM_DISABLE_SAO, 1);
-#else
-  // Worker threads are not supported when running on Emscripten.
-  de265_start_worker_threads(decoder->ctx, 1);
-#endif
+  de265_set_parameter_bool(decoder->ctx, DE265_DECODER_PARAM_DISABLE_DEBLOCKING, kDefault_disable_filters);
+  de265_set_parameter_bool(decoder->ctx, DE265_DECODER_PARAM_DISABLE_SAO, kDefault_disable_filters);
+
+  // The worker threads are started when the first data is pushed, after the parameters have been set.
 
   *dec = decoder;
   return err;
 }
 
+
+static void start_worker_threads(struct libde265_decoder* decoder)
+{
+#if !defined(__EMSCRIPTEN__)
+  // Worker threads are not supported when running on Emscripten.
+  if (!decoder->worker_threads_started) {
+    de265_start_worker_threads(decoder->ctx, decoder->num_threads);
+    decoder->worker_threads_started = true;
+  }
+#else
+  (void) decoder;
+#endif
+}
+
 static void libde265_free_decoder(void* decoder_raw)
 {
   struct libde265_decoder* decoder = (struct libde265_decoder*) decoder_raw;
@@ -201,6 +277,8 @@ static struct heif_error libde265_v2_push_data(void* decoder_raw, const void* da
 {
   struct libde265_decoder* decoder = (struct libde265_decoder*)decoder_raw;
 
+  start_worker_threads(decoder);
+
   const uint8_t* cdata = (const uint8_t*)data;
 
   size_t ptr=0;
@@ -266,10 +344,75 @@ static struct heif_error libde265_v2_decode_image(void* decoder_raw,
 
 #else
 
+static const struct heif_encoder_parameter** libde265_list_parameters()
+{
+  return libde265_decoder_parameter_ptrs;
+}
+
+
+static struct heif_error libde265_set_parameter_integer(void* decoder_raw, const char* name, int value)
+{
+  struct libde265_decoder* decoder = (struct libde265_decoder*) decoder_raw;
+
+  if (strcmp(name, heif_decoder_parameter_name_threads) == 0) {
+    int num_threads = std::min(std::max(value, 1), MAX_LIBDE265_THREADS);
+
+    // Setting the thread count again is fine as long as it does not change.
+    if (decoder->worker_threads_started && num_threads != decoder->num_threads) {
+      struct heif_error err = {heif_error_Usage_error,
+                               heif_suberror_Unsupported_parameter,
+                               "The number of threads cannot be changed after decoding started"};
+      return err;
+    }
+
+    decoder->num_threads = num_threads;
+
+    struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+    return err;
+  }
+
+  struct heif_error err = {heif_error_Usage_error, heif_suberror_Unsupported_parameter, kEmptyString};
+  return err;
+}
+
+
+static struct heif_error libde265_set_parameter_boolean(void* decoder_raw, const char* name, int value)
+{
+  struct libde265_decoder* decoder = (struct libde265_decoder*) decoder_raw;
+
+  if (strcmp(name, kParam_disable_deblocking) == 0) {
+    de265_set_parameter_bool(decoder->ctx, DE265_DECODER_PARAM_DISABLE_DEBLOCKING, value);
+  }
+  else if (strcmp(name, kParam_disable_sao) == 0) {
+    de265_set_parameter_bool(decoder->ctx, DE265_DECODER_PARAM_DISABLE_SAO, value);
+  }
+  else {
+    struct heif_error err = {heif_error_Usage_error, heif_suberror_Unsupported_parameter, kEmptyString};
+    return err;
+  }
+
+  struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+  return err;
+}
+
+
+static struct heif_error libde265_reset_decoder(void* decoder_raw)
+{
+  struct libde265_decoder* decoder = (struct libde265_decoder*) decoder_raw;
+
+  de265_reset(decoder->ctx);
+
+  struct heif_error err = {heif_error_Ok, heif_suberror_Unspecified, kSuccess};
+  return err;
+}
+
+
 static struct heif_error libde265_v1_push_data(void* decoder_raw, const void* data, size_t size)
 {
   struct libde265_decoder* decoder = (struct libde265_decoder*) decoder_raw;
 
+  start_worker_threads(decoder);
+
   const uint8_t* cdata = (const uint8_t*) data;
 
   size_t ptr = 0;
@@ -391,7 +534,7 @@ static const struct heif_decoder_plugin decoder_libde265
 
 static const struct heif_decoder_plugin decoder_libde265
     {
-        3,
+        5,
         libde265_plugin_name,
         libde265_init_plugin,
         libde265_deinit_plugin,
@@ -401,7 +544,12 @@ static const struct heif_decoder_plugin decoder_libde265
         libde265_v1_push_data,
         libde265_v1_decode_image,
         libde265_set_strict_decoding,
-        "libde265"
+        "libde265",
+        libde265_reset_decoder,
+        libde265_list_parameters,
+        libde265_set_parameter_integer,
+        libde265_set_parameter_boolean,
+        nullptr
     };
 
 #endif
@@ -0,0 +1,216 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "probe.h"
+#include "box.h"
+#include "file_layout.h"
+#include "security_limits.h"
+#include "image-items/image_item.h"
+#include "image-items/tiled.h"
+
+#include <vector>
+
+
+// The boxes of the 'meta' box that are needed to look up the items.
+struct MetaBoxes
+{
+  std::shared_ptr<Box_iinf> iinf;
+  std::shared_ptr<Box_iref> iref;
+  std::shared_ptr<Box_ipco> ipco;
+  std::shared_ptr<Box_ipma> ipma;
+};
+
+
+static std::shared_ptr<Box_infe> find_infe(const MetaBoxes& meta, heif_item_id id)
+{
+  return meta.iinf->get_infe_box(id);
+}
+
+
+template <typename T>
+static std::shared_ptr<T> find_property(const MetaBoxes& meta, heif_item_id id)
+{
+  if (!meta.ipco || !meta.ipma) {
+    return nullptr;
+  }
+
+  std::vector<std::shared_ptr<Box>> properties;
+  Error err = meta.ipco->get_properties_for_item_ID(id, meta.ipma, properties);
+  if (err) {
+    return nullptr;
+  }
+
+  for (const auto& property : properties) {
+    if (auto box = std::dynamic_pointer_cast<T>(property)) {
+      return box;
+    }
+  }
+
+  return nullptr;
+}
+
+
+Error probe_heif_file(const std::shared_ptr<StreamReader>& reader, heif_probe_result* out_result)
+{
+  *out_result = {};
+  out_result->version = 1;
+  out_result->luma_bits_per_pixel = -1;
+  out_result->chroma_bits_per_pixel = -1;
+
+  FileLayout layout;
+  Error err = layout.read(reader, &global_security_limits);
+  if (err) {
+    return err;
+  }
+
+  if (auto ftyp = layout.get_ftyp_box()) {
+    out_result->main_brand = ftyp->get_major_brand();
+  }
+
+  auto meta_box = layout.get_meta_box();
+  if (!meta_box) {
+    return {heif_error_Invalid_input,
+            heif_suberror_No_meta_box};
+  }
+
+  auto pitm = meta_box->get_child_box<Box_pitm>();
+  if (!pitm) {
+    return {heif_error_Invalid_input,
+            heif_suberror_No_pitm_box};
+  }
+
+  MetaBoxes meta;
+  meta.iinf = meta_box->get_child_box<Box_iinf>();
+  meta.iref = meta_box->get_child_box<Box_iref>();
+
+  if (!meta.iinf) {
+    return {heif_error_Invalid_input,
+            heif_suberror_No_iinf_box};
+  }
+
+  if (auto iprp = meta_box->get_child_box<Box_iprp>()) {
+    meta.ipco = iprp->get_child_box<Box_ipco>();
+    meta.ipma = iprp->get_child_box<Box_ipma>();
+  }
+
+  heif_item_id primary_id = pitm->get_item_ID();
+  out_result->primary_image_id = primary_id;
+
+  auto primary_infe = find_infe(meta, primary_id);
+  if (!primary_infe) {
+    return {heif_error_Invalid_input,
+            heif_suberror_Nonexisting_item_referenced,
+            "'pitm' box references a non-existing item"};
+  }
+
+  out_result->primary_item_type = primary_infe->get_item_type_4cc();
+
+
+  // --- size and bit depth
+
+  if (auto ispe = find_property<Box_ispe>(meta, primary_id)) {
+    out_result->ispe_width = ispe->get_width();
+    out_result->ispe_height = ispe->get_height();
+  }
+
+
+  // --- follow derived images to the first coded image
+
+  heif_item_id coded_id = primary_id;
+  uint32_t coded_type = primary_infe->get_item_type_4cc();
+
+  for (int depth = 0; depth < MAX_BOX_NESTING_LEVEL; depth++) {
+    if (coded_type != fourcc("grid") &&
+        coded_type != fourcc("iden") &&
+        coded_type != fourcc("iovl")) {
+      break;
+    }
+
+    if (!meta.iref) {
+      break;
+    }
+
+    auto refs = meta.iref->get_references(coded_id, fourcc("dimg"));
+    if (refs.empty()) {
+      break;
+    }
+
+    auto infe = find_infe(meta, refs[0]);
+    if (!infe) {
+      break;
+    }
+
+    coded_id = refs[0];
+    coded_type = infe->get_item_type_4cc();
+  }
+
+  if (coded_type == fourcc("tili")) {
+    if (auto tilC = find_property<Box_tilC>(meta, coded_id)) {
+      out_result->compression_format = ImageItem::compression_format_from_fourcc_infe_type(tilC->get_parameters().compression_format_fourcc);
+    }
+  }
+  else {
+    out_result->compression_format = ImageItem::compression_format_from_fourcc_infe_type(coded_type);
+  }
+
+  auto pixi = find_property<Box_pixi>(meta, primary_id);
+  if (!pixi) {
+    pixi = find_property<Box_pixi>(meta, coded_id);
+  }
+
+  if (pixi && pixi->get_num_channels() > 0) {
+    out_result->luma_bits_per_pixel = pixi->get_bits_per_channel(0);
+
+    if (pixi->get_num_channels() > 1) {
+      out_result->chroma_bits_per_pixel = pixi->get_bits_per_channel(1);
+    }
+  }
+
+
+  // --- auxiliary images of the primary image
+
+  if (meta.iref) {
+    for (const auto& ref : meta.iref->get_references_to(primary_id)) {
+      if (ref.header.get_short_type() != fourcc("auxl")) {
+        continue;
+      }
+
+      auto auxC = find_property<Box_auxC>(meta, ref.from_item_ID);
+      if (!auxC) {
+        continue;
+      }
+
+      const std::string& aux_type = auxC->get_aux_type();
+
+      if (aux_type == "urn:mpeg:avc:2015:auxid:1" ||
+          aux_type == "urn:mpeg:hevc:2015:auxid:1" ||
+          aux_type == "urn:mpeg:mpegB:cicp:systems:auxiliary:alpha") {
+        out_result->has_alpha_channel = 1;
+      }
+
+      if (aux_type == "urn:mpeg:hevc:2015:auxid:2" ||
+          aux_type == "urn:mpeg:mpegB:cicp:systems:auxiliary:depth") {
+        out_result->has_depth_channel = 1;
+      }
+    }
+  }
+
+  return Error::Ok;
+}
@@ -0,0 +1,35 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_PROBE_H
+#define LIBHEIF_PROBE_H
+
+#include "error.h"
+#include "bitstream.h"
+#include "libheif/heif_probe.h"
+
+#include <memory>
+
+
+// Reads the 'ftyp' and 'meta' boxes and fills 'out_result' from the boxes of the primary image,
+// without setting up a HeifFile or HeifContext.
+Error probe_heif_file(const std::shared_ptr<StreamReader>& reader, heif_probe_result* out_result);
+
+#endif
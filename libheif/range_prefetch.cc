@@ -0,0 +1,104 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "range_prefetch.h"
+
+#include <algorithm>
+#include <utility>
+
+
+RangePrefetcher::RangePrefetcher(std::shared_ptr<StreamReader> reader)
+{
+  // there is nothing to prefetch when the whole file is in memory
+  if (reader && reader->get_data_pointer(0, 0) == nullptr) {
+    m_reader = std::move(reader);
+  }
+}
+
+
+void RangePrefetcher::add_ranges(const std::vector<FileRange>& ranges)
+{
+  if (!m_reader) {
+    return;
+  }
+
+  for (const FileRange& range : ranges) {
+    if (range.end > range.start) {
+      m_ranges.push_back(range);
+    }
+  }
+}
+
+
+void RangePrefetcher::issue_preload_hints()
+{
+  if (!m_reader) {
+    return;
+  }
+
+  m_preloaded_ranges = coalesce_ranges(std::move(m_ranges), m_max_gap);
+  m_ranges.clear();
+
+  // The hints do not move the read position, so they are not serialized with the file accesses.
+  // They may block (e.g. on the network) and would otherwise stall the reads of all other files.
+
+  for (const FileRange& range : m_preloaded_ranges) {
+    m_reader->preload_range_hint(range.start, range.end);
+  }
+}
+
+
+void RangePrefetcher::release_ranges(const std::vector<FileRange>& ranges)
+{
+  if (!m_reader) {
+    return;
+  }
+
+  for (const FileRange& range : ranges) {
+    if (range.end > range.start) {
+      m_reader->release_range(range.start, range.end);
+    }
+  }
+}
+
+
+std::vector<FileRange> RangePrefetcher::coalesce_ranges(std::vector<FileRange> ranges, uint64_t max_gap)
+{
+  std::sort(ranges.begin(), ranges.end(), [](const FileRange& a, const FileRange& b) {
+    return a.start < b.start;
+  });
+
+  std::vector<FileRange> merged;
+
+  for (const FileRange& range : ranges) {
+    if (range.end <= range.start) {
+      continue;
+    }
+
+    if (!merged.empty() && range.start <= merged.back().end + max_gap) {
+      merged.back().end = std::max(merged.back().end, range.end);
+    }
+    else {
+      merged.push_back(range);
+    }
+  }
+
+  return merged;
+}
@@ -0,0 +1,68 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_RANGE_PREFETCH_H
+#define LIBHEIF_RANGE_PREFETCH_H
+
+#include "bitstream.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// Plans the file accesses of a decode request for readers that load the file on demand (e.g. over HTTP).
+// The file ranges of all tiles that will be decoded are collected and merged into a few large ranges,
+// which are passed to the reader as preload hints before the decoders start. The reader can then load
+// them in large batches instead of one round trip per tile. The ranges of each tile are released when
+// the tile has been decoded.
+// For readers that hold the whole file in memory, the prefetcher does nothing.
+class RangePrefetcher
+{
+public:
+  explicit RangePrefetcher(std::shared_ptr<StreamReader> reader);
+
+  bool is_enabled() const { return m_reader != nullptr; }
+
+  void add_ranges(const std::vector<FileRange>& ranges);
+
+  // Ranges that are at most this number of bytes apart are merged into one preload request.
+  void set_max_gap(uint64_t max_gap) { m_max_gap = max_gap; }
+
+  void issue_preload_hints();
+
+  // May be called concurrently from the threads that decode the tiles.
+  void release_ranges(const std::vector<FileRange>& ranges);
+
+  // The merged ranges of the last issue_preload_hints().
+  const std::vector<FileRange>& get_preloaded_ranges() const { return m_preloaded_ranges; }
+
+  // Sorts the ranges and merges overlapping ranges and ranges with gaps of at most 'max_gap' bytes.
+  static std::vector<FileRange> coalesce_ranges(std::vector<FileRange> ranges, uint64_t max_gap);
+
+private:
+  std::shared_ptr<StreamReader> m_reader;
+  uint64_t m_max_gap = 64 * 1024;
+
+  std::vector<FileRange> m_ranges;
+  std::vector<FileRange> m_preloaded_ranges;
+};
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread_pool.h"
+
+#include <chrono>
+#include <utility>
+
+
+// The pool and queue index of the worker running in the current thread.
+static thread_local const ThreadPool* tl_current_pool = nullptr;
+static thread_local size_t tl_current_queue = 0;
+
+
+ThreadPool::ThreadPool(int num_threads)
+{
+#if ENABLE_MULTITHREADING_SUPPORT
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+
+  for (int i = 0; i < num_threads; i++) {
+    m_queues.emplace_back(std::make_unique<WorkerQueue>());
+  }
+
+  for (size_t i = 0; i < m_queues.size(); i++) {
+    m_threads.emplace_back(&ThreadPool::worker_main, this, i);
+  }
+#else
+  (void) num_threads;
+#endif
+}
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+    m_shutdown = true;
+  }
+
+  m_wakeup.notify_all();
+
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+}
+
+
+bool ThreadPool::is_worker_thread() const
+{
+  return tl_current_pool == this;
+}
+
+
+void ThreadPool::submit(std::function<void()> task)
+{
+  size_t queue_idx;
+  if (is_worker_thread()) {
+    queue_idx = tl_current_queue;
+  }
+  else {
+    queue_idx = m_next_queue++ % m_queues.size();
+  }
+
+  {
+    // Increment under the wakeup mutex so that a worker cannot miss the notification
+    // between checking the counter and going to sleep.
+    // The counter is also changed under the queue mutex, together with the queue itself,
+    // so that it never differs from the number of queued tasks when seen by pop_task().
+    std::lock_guard<std::mutex> wakeup_lock(m_wakeup_mutex);
+    std::lock_guard<std::mutex> queue_lock(m_queues[queue_idx]->mutex);
+    m_queues[queue_idx]->tasks.push_back(std::move(task));
+    m_num_queued++;
+  }
+
+  m_wakeup.notify_one();
+}
+
+
+bool ThreadPool::pop_task(size_t queue_idx, bool from_back, std::function<void()>& out_task)
+{
+  WorkerQueue& queue = *m_queues[queue_idx];
+
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty()) {
+    return false;
+  }
+
+  if (from_back) {
+    out_task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+  }
+  else {
+    out_task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+  }
+
+  m_num_queued--;
+
+  return true;
+}
+
+
+bool ThreadPool::run_one_task()
+{
+  if (m_queues.empty()) {
+    return false;
+  }
+
+  std::function<void()> task;
+
+  // Own queue first (most recently queued task, its data is probably still in the cache),
+  // then steal the oldest task from one of the other workers.
+
+  size_t own_queue = is_worker_thread() ? tl_current_queue : 0;
+  bool found = is_worker_thread() && pop_task(own_queue, true, task);
+
+  for (size_t i = 1; !found && i <= m_queues.size(); i++) {
+    found = pop_task((own_queue + i) % m_queues.size(), false, task);
+  }
+
+  if (!found) {
+    return false;
+  }
+
+  task();
+  return true;
+}
+
+
+void ThreadPool::worker_main(size_t idx)
+{
+  tl_current_pool = this;
+  tl_current_queue = idx;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_wakeup_mutex);
+      m_wakeup.wait(lock, [this]() { return m_shutdown || m_num_queued > 0; });
+
+      if (m_shutdown && m_num_queued == 0) {
+        break;
+      }
+    }
+
+    run_one_task();
+  }
+
+  tl_current_pool = nullptr;
+}
+
+
+TaskGroup::TaskGroup(ThreadPool* pool)
+    : m_pool(pool)
+{
+  if (m_pool && m_pool->get_num_threads() == 0) {
+    m_pool = nullptr;
+  }
+}
+
+
+TaskGroup::~TaskGroup()
+{
+  wait();
+}
+
+
+void TaskGroup::run(std::function<Error()> task)
+{
+  if (!m_pool) {
+    if (!m_failed) {
+      Error err = task();
+      if (err) {
+        task_finished(err);
+      }
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_num_unfinished++;
+  }
+
+  m_pool->submit([this, task = std::move(task)]() {
+    if (m_failed) {
+      task_finished(Error::Ok);
+    }
+    else {
+      task_finished(task());
+    }
+  });
+}
+
+
+void TaskGroup::task_finished(const Error& err)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (err && !m_failed) {
+    m_first_error = err;
+    m_failed = true;
+  }
+
+  if (m_pool) {
+    m_num_unfinished--;
+    if (m_num_unfinished == 0) {
+      m_finished.notify_all();
+    }
+  }
+}
+
+
+Error TaskGroup::wait()
+{
+  if (m_pool && m_pool->is_worker_thread()) {
+    // A worker must not block on its group, because the queued tasks of the group may
+    // only be reachable by this very worker (nested task groups). Help out instead.
+
+    for (;;) {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_num_unfinished == 0) {
+          break;
+        }
+      }
+
+      if (!m_pool->run_one_task()) {
+        // All remaining tasks are running in other threads. Check back in a moment in case
+        // they spawn more nested tasks that we can help with.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_finished.wait_for(lock, std::chrono::milliseconds(1), [this]() { return m_num_unfinished == 0; });
+      }
+    }
+  }
+  else if (m_pool) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [this]() { return m_num_unfinished == 0; });
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_first_error;
+}
@@ -0,0 +1,124 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_THREAD_POOL_H
+#define LIBHEIF_THREAD_POOL_H
+
+#include "error.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed-size pool of worker threads with one task queue per worker.
+// A worker takes tasks from the back of its own queue and steals from the front
+// of the other queues when its own queue runs empty. Tasks submitted from within
+// a worker go into that worker's queue, all other tasks are distributed round-robin.
+//
+// Tasks are not submitted directly, but through a TaskGroup that tracks their completion.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(int num_threads);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int get_num_threads() const { return static_cast<int>(m_threads.size()); }
+
+  // Whether the calling thread is one of the workers of this pool.
+  bool is_worker_thread() const;
+
+private:
+  friend class TaskGroup;
+
+  struct WorkerQueue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+  std::vector<std::thread> m_threads;
+
+  std::mutex m_wakeup_mutex;
+  std::condition_variable m_wakeup;
+  std::atomic<size_t> m_num_queued{0};
+  std::atomic<size_t> m_next_queue{0};
+  bool m_shutdown = false;
+
+  void submit(std::function<void()> task);
+
+  // Runs one queued task in the calling thread. Returns false if there was none.
+  bool run_one_task();
+
+  bool pop_task(size_t queue_idx, bool from_back, std::function<void()>& out_task);
+
+  void worker_main(size_t idx);
+};
+
+
+// A set of tasks whose completion can be waited for.
+// Tasks may finish in any order. After the first task failed, the remaining tasks
+// of the group that did not start yet are skipped.
+//
+// If no ThreadPool is given, each task is executed immediately in the calling thread.
+class TaskGroup
+{
+public:
+  explicit TaskGroup(ThreadPool* pool);
+
+  // Waits for all tasks that are still running.
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup&) = delete;
+
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  void run(std::function<Error()> task);
+
+  // Blocks until all tasks are finished and returns the error of the first failed task.
+  // When called from a worker thread, the thread processes queued tasks while waiting.
+  Error wait();
+
+  bool has_failed() const { return m_failed; }
+
+private:
+  ThreadPool* m_pool;
+
+  std::mutex m_mutex;
+  std::condition_variable m_finished;
+  size_t m_num_unfinished = 0;
+  std::atomic<bool> m_failed{false};
+  Error m_first_error;
+
+  void task_finished(const Error& err);
+};
+
+#endif
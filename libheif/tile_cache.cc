@@ -0,0 +1,130 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tile_cache.h"
+#include "pixelimage.h"
+
+
+static size_t get_image_memory_size(const HeifPixelImage& image)
+{
+  size_t size = 0;
+
+  for (heif_channel channel : image.get_channel_set()) {
+    uint32_t stride;
+    image.get_plane(channel, &stride);
+    size += static_cast<size_t>(stride) * image.get_height(channel);
+  }
+
+  return size;
+}
+
+
+void DecodedTileCache::set_max_bytes(size_t max_bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_max_bytes = max_bytes;
+  m_lru.clear();
+  m_entries.clear();
+  m_statistics = {};
+}
+
+
+size_t DecodedTileCache::get_max_bytes() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_max_bytes;
+}
+
+
+std::shared_ptr<const HeifPixelImage> DecodedTileCache::get(const DecodingSetup& setup, uint32_t tile_x, uint32_t tile_y)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_max_bytes == 0) {
+    return nullptr;
+  }
+
+  auto iter = m_entries.find(TileKey{setup.decoder_id, setup.parameters, tile_x, tile_y});
+  if (iter == m_entries.end()) {
+    m_statistics.misses++;
+    return nullptr;
+  }
+
+  m_statistics.hits++;
+
+  // move to the front of the LRU list
+  m_lru.splice(m_lru.begin(), m_lru, iter->second);
+
+  return iter->second->tile;
+}
+
+
+void DecodedTileCache::put(const DecodingSetup& setup, uint32_t tile_x, uint32_t tile_y,
+                           const std::shared_ptr<const HeifPixelImage>& tile)
+{
+  size_t size = get_image_memory_size(*tile);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (size > m_max_bytes) {
+    return;
+  }
+
+  TileKey key{setup.decoder_id, setup.parameters, tile_x, tile_y};
+
+  // The tile may have been decoded concurrently by another thread.
+  if (m_entries.find(key) != m_entries.end()) {
+    return;
+  }
+
+  while (m_statistics.cached_bytes + size > m_max_bytes) {
+    const Entry& oldest = m_lru.back();
+    m_statistics.cached_bytes -= oldest.size;
+    m_entries.erase(oldest.key);
+    m_lru.pop_back();
+  }
+
+  m_lru.push_front(Entry{key, tile, size});
+  m_entries[key] = m_lru.begin();
+  m_statistics.cached_bytes += size;
+}
+
+
+void DecodedTileCache::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_lru.clear();
+  m_entries.clear();
+  m_statistics.cached_bytes = 0;
+}
+
+
+DecodedTileCache::Statistics DecodedTileCache::get_statistics() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  Statistics stats = m_statistics;
+  stats.num_cached_tiles = m_lru.size();
+
+  return stats;
+}
@@ -0,0 +1,92 @@
+/*
+ * HEIF codec.
+ * Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+ *
+ * This file is part of libheif.
+ *
+ * libheif is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libheif is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libheif.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBHEIF_TILE_CACHE_H
+#define LIBHEIF_TILE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+
+class HeifPixelImage;
+
+
+// Keeps the most recently used decoded tiles of an image, up to a maximum number of bytes.
+// The cached images are shared and must not be modified. Thread-safe.
+class DecodedTileCache
+{
+public:
+  // The decoder plugin and the decoder parameters that a tile was decoded with.
+  // Tiles decoded with different settings are cached separately.
+  struct DecodingSetup
+  {
+    std::string decoder_id;
+    std::map<std::string, std::string> parameters;
+  };
+
+  // 0 disables the cache. Changing the size drops all cached tiles.
+  void set_max_bytes(size_t max_bytes);
+
+  size_t get_max_bytes() const;
+
+  // Returns nullptr if the tile is not in the cache.
+  std::shared_ptr<const HeifPixelImage> get(const DecodingSetup& setup, uint32_t tile_x, uint32_t tile_y);
+
+  void put(const DecodingSetup& setup, uint32_t tile_x, uint32_t tile_y, const std::shared_ptr<const HeifPixelImage>& tile);
+
+  void clear();
+
+  struct Statistics
+  {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t cached_bytes = 0;
+    size_t num_cached_tiles = 0;
+  };
+
+  Statistics get_statistics() const;
+
+private:
+  using TileKey = std::tuple<std::string, std::map<std::string, std::string>, uint32_t, uint32_t>;
+
+  struct Entry
+  {
+    TileKey key;
+    std::shared_ptr<const HeifPixelImage> tile;
+    size_t size;
+  };
+
+  mutable std::mutex m_mutex;
+  size_t m_max_bytes = 0;
+
+  // most recently used tile first
+  std::list<Entry> m_lru;
+  std::map<TileKey, std::list<Entry>::iterator> m_entries;
+
+  Statistics m_statistics;
+};
+
+#endif
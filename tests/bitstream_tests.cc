@@ -26,10 +26,15 @@
 
 #include "catch.hpp"
 #include "error.h"
+#include "test-config.h"
 #include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <iterator>
 #include <memory>
 #include <bitstream.h>
+#include <file.h>
 
 
 TEST_CASE("read bits") {
@@ -84,3 +89,50 @@ TEST_CASE("read float") {
   float f = uut.read_float32();
   REQUIRE(f == 2.0);
 }
+
+TEST_CASE("read memory mapped file") {
+  std::string filename = tests_data_directory + "/lightning_mini.heif";
+
+  std::ifstream istr(filename, std::ios::binary);
+  std::vector<uint8_t> contents((std::istreambuf_iterator<char>(istr)), std::istreambuf_iterator<char>());
+  REQUIRE(contents.size() > 16);
+
+  auto mapped = StreamReader_mmap::map_file(filename.c_str());
+#if defined(_WIN32)
+  REQUIRE(mapped == nullptr);
+#else
+  REQUIRE(mapped != nullptr);
+  REQUIRE(mapped->wait_for_file_size(contents.size()) == StreamReader::grow_status::size_reached);
+  REQUIRE(mapped->wait_for_file_size(contents.size() + 1) == StreamReader::grow_status::size_beyond_eof);
+
+  const uint8_t* data = mapped->get_data_pointer(0, contents.size());
+  REQUIRE(data != nullptr);
+  REQUIRE(std::equal(contents.begin(), contents.end(), data));
+  REQUIRE(mapped->get_data_pointer(contents.size(), 0) != nullptr);
+  REQUIRE(mapped->get_data_pointer(contents.size() - 4, 5) == nullptr);
+
+  uint8_t buffer[8];
+  REQUIRE(mapped->seek(8));
+  REQUIRE(mapped->read(buffer, sizeof(buffer)));
+  REQUIRE(std::equal(buffer, buffer + sizeof(buffer), contents.begin() + 8));
+#endif
+
+  REQUIRE(StreamReader_mmap::map_file((tests_data_directory + "/does-not-exist.heif").c_str()) == nullptr);
+}
+
+TEST_CASE("open file reader") {
+  std::string filename = tests_data_directory + "/lightning_mini.heif";
+
+  // Files are read through a file stream unless memory mapping is requested.
+  auto streamResult = HeifFile::open_file_reader(filename.c_str());
+  REQUIRE(!streamResult.error);
+  REQUIRE(std::dynamic_pointer_cast<StreamReader_mmap>(streamResult.value) == nullptr);
+
+  auto mappedResult = HeifFile::open_file_reader(filename.c_str(), true);
+  REQUIRE(!mappedResult.error);
+#if defined(_WIN32)
+  REQUIRE(std::dynamic_pointer_cast<StreamReader_mmap>(mappedResult.value) == nullptr);
+#else
+  REQUIRE(std::dynamic_pointer_cast<StreamReader_mmap>(mappedResult.value) != nullptr);
+#endif
+}
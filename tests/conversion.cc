@@ -24,10 +24,15 @@
   SOFTWARE.
 */
 
+#include <chrono>
+#include <cstring>
 #include <iomanip>
+#include <limits>
 #include "catch.hpp"
 #include "color-conversion/colorconversion.h"
+#include "cpu_features.h"
 #include "pixelimage.h"
+#include "thread_pool.h"
 
 // Enable for more verbose test output.
 constexpr bool kEnableDebugOutput = false;
@@ -706,3 +711,508 @@ TEST_CASE("RGB 5-6-5 to RGB")
   assert_plane(out, heif_channel_G, {28, 32, 36, 40, 44, 48});
   assert_plane(out, heif_channel_B, {107, 115, 123, 132, 140, 148});
 }
+
+
+static std::shared_ptr<HeifPixelImage> make_random_YCbCr420_image(uint32_t width, uint32_t height, int bpp, bool with_alpha,
+                                                                  heif_matrix_coefficients matrix, bool full_range)
+{
+  auto img = std::make_shared<HeifPixelImage>();
+  img->create(width, height, heif_colorspace_YCbCr, heif_chroma_420);
+
+  auto nclx = std::make_shared<color_profile_nclx>();
+  nclx->set_matrix_coefficients(matrix);
+  nclx->set_full_range_flag(full_range);
+  img->set_color_profile_nclx(nclx);
+
+  std::vector<heif_channel> channels{heif_channel_Y, heif_channel_Cb, heif_channel_Cr};
+  if (with_alpha) {
+    channels.push_back(heif_channel_Alpha);
+  }
+
+  uint32_t random = 12345;
+
+  for (heif_channel channel : channels) {
+    uint32_t w = (channel == heif_channel_Cb || channel == heif_channel_Cr) ? (width + 1) / 2 : width;
+    uint32_t h = (channel == heif_channel_Cb || channel == heif_channel_Cr) ? (height + 1) / 2 : height;
+    REQUIRE(img->add_plane(channel, w, h, bpp));
+
+    uint32_t stride;
+    uint8_t* p = img->get_plane(channel, &stride);
+
+    for (uint32_t y = 0; y < h; y++) {
+      for (uint32_t x = 0; x < w; x++) {
+        random = random * 1103515245 + 12345;
+        uint16_t v = static_cast<uint16_t>((random >> 8) & ((1 << bpp) - 1));
+
+        if (bpp == 8) {
+          p[y * stride + x] = static_cast<uint8_t>(v);
+        }
+        else {
+          reinterpret_cast<uint16_t*>(p + y * stride)[x] = v;
+        }
+      }
+    }
+  }
+
+  return img;
+}
+
+
+TEST_CASE("SIMD YCbCr 4:2:0 to RGB matches scalar code")
+{
+  heif_color_conversion_options options = {
+      .preferred_chroma_upsampling_algorithm = heif_chroma_upsampling_nearest_neighbor,
+      .only_use_preferred_chroma_algorithm = true};
+
+  heif_matrix_coefficients matrix = GENERATE(heif_matrix_coefficients_ITU_R_BT_709_5,
+                                             heif_matrix_coefficients_ITU_R_BT_601_6,
+                                             heif_matrix_coefficients_ITU_R_BT_2020_2_non_constant_luminance);
+  bool with_alpha = GENERATE(false, true);
+  SimdLevel simd_level = GENERATE(SimdLevel::SSE41, SimdLevel::NEON);
+
+  // cover the vector loops as well as the scalar code for the remaining pixels
+  const uint32_t width = 77;
+  const uint32_t height = 5;
+
+  SECTION("8 bit") {
+    heif_chroma chroma = GENERATE(heif_chroma_interleaved_RGB, heif_chroma_interleaved_RGBA);
+    auto img = make_random_YCbCr420_image(width, height, 8, with_alpha, matrix, true);
+
+    set_max_simd_level(SimdLevel::None);
+    auto reference = convert_colorspace(img, heif_colorspace_RGB, chroma, nullptr, 8, options);
+    set_max_simd_level(simd_level);
+    auto simd = convert_colorspace(img, heif_colorspace_RGB, chroma, nullptr, 8, options);
+
+    INFO("SIMD level: " << get_simd_level_name(get_simd_level()));
+    set_max_simd_level(SimdLevel::NEON);
+
+    REQUIRE(reference);
+    REQUIRE(simd);
+
+    uint32_t ref_stride, simd_stride;
+    const uint8_t* ref_p = reference->get_plane(heif_channel_interleaved, &ref_stride);
+    const uint8_t* simd_p = simd->get_plane(heif_channel_interleaved, &simd_stride);
+
+    uint32_t bytes_per_pixel = (chroma == heif_chroma_interleaved_RGB) ? 3 : 4;
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width * bytes_per_pixel; x++) {
+        INFO("row: " << y << " byte: " << x);
+        REQUIRE((int) simd_p[y * simd_stride + x] == (int) ref_p[y * ref_stride + x]);
+      }
+    }
+  }
+
+  SECTION("high bit depth") {
+    int bpp = GENERATE(10, 12);
+    bool full_range = GENERATE(false, true);
+    bool big_endian = GENERATE(false, true);
+    heif_chroma chroma;
+    if (with_alpha) {
+      chroma = big_endian ? heif_chroma_interleaved_RRGGBBAA_BE : heif_chroma_interleaved_RRGGBBAA_LE;
+    }
+    else {
+      chroma = big_endian ? heif_chroma_interleaved_RRGGBB_BE : heif_chroma_interleaved_RRGGBB_LE;
+    }
+
+    auto img = make_random_YCbCr420_image(width, height, bpp, with_alpha, matrix, full_range);
+
+    set_max_simd_level(SimdLevel::None);
+    auto reference = convert_colorspace(img, heif_colorspace_RGB, chroma, nullptr, bpp, options);
+    set_max_simd_level(simd_level);
+    auto simd = convert_colorspace(img, heif_colorspace_RGB, chroma, nullptr, bpp, options);
+
+    INFO("SIMD level: " << get_simd_level_name(get_simd_level()));
+    set_max_simd_level(SimdLevel::NEON);
+
+    REQUIRE(reference);
+    REQUIRE(simd);
+
+    uint32_t ref_stride, simd_stride;
+    const uint8_t* ref_p = reference->get_plane(heif_channel_interleaved, &ref_stride);
+    const uint8_t* simd_p = simd->get_plane(heif_channel_interleaved, &simd_stride);
+
+    uint32_t components = with_alpha ? 4 : 3;
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width * components; x++) {
+        const uint8_t* ref_v = ref_p + y * ref_stride + 2 * x;
+        const uint8_t* simd_v = simd_p + y * simd_stride + 2 * x;
+        int ref_value = big_endian ? (ref_v[0] << 8 | ref_v[1]) : (ref_v[1] << 8 | ref_v[0]);
+        int simd_value = big_endian ? (simd_v[0] << 8 | simd_v[1]) : (simd_v[1] << 8 | simd_v[0]);
+
+        // The scalar code may be compiled with fused multiply-adds.
+        INFO("row: " << y << " component: " << x);
+        REQUIRE(std::abs(simd_value - ref_value) <= 1);
+      }
+    }
+  }
+}
+
+
+static std::shared_ptr<HeifPixelImage> make_random_RGB_image(uint32_t width, uint32_t height, heif_chroma chroma, int bpp)
+{
+  auto img = std::make_shared<HeifPixelImage>();
+  img->create(width, height, heif_colorspace_RGB, chroma);
+
+  uint32_t random = 12345;
+  auto fill_plane = [&](heif_channel channel, uint32_t samples_per_row, bool big_endian) {
+    REQUIRE(img->add_plane(channel, width, height, bpp));
+
+    uint32_t stride;
+    uint8_t* p = img->get_plane(channel, &stride);
+
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < samples_per_row; x++) {
+        random = random * 1103515245 + 12345;
+        uint16_t v = static_cast<uint16_t>((random >> 8) & ((1 << bpp) - 1));
+
+        if (bpp == 8) {
+          p[y * stride + x] = static_cast<uint8_t>(v);
+        }
+        else {
+          p[y * stride + 2 * x + (big_endian ? 1 : 0)] = static_cast<uint8_t>(v & 0xFF);
+          p[y * stride + 2 * x + (big_endian ? 0 : 1)] = static_cast<uint8_t>(v >> 8);
+        }
+      }
+    }
+  };
+
+  if (chroma == heif_chroma_444) {
+    for (heif_channel channel : {heif_channel_R, heif_channel_G, heif_channel_B}) {
+      fill_plane(channel, width, PlatformIsBigEndian());
+    }
+  }
+  else {
+    fill_plane(heif_channel_interleaved, width * num_interleaved_pixels_per_plane(chroma),
+               chroma == heif_chroma_interleaved_RRGGBB_BE || chroma == heif_chroma_interleaved_RRGGBBAA_BE);
+  }
+
+  return img;
+}
+
+
+TEST_CASE("SIMD RGB to YCbCr 4:2:0 matches scalar code")
+{
+  heif_color_conversion_options options = {
+      .preferred_chroma_downsampling_algorithm = heif_chroma_downsampling_nearest_neighbor,
+      .only_use_preferred_chroma_algorithm = true};
+
+  heif_matrix_coefficients matrix = GENERATE(heif_matrix_coefficients_ITU_R_BT_709_5,
+                                             heif_matrix_coefficients_ITU_R_BT_601_6,
+                                             heif_matrix_coefficients_ITU_R_BT_2020_2_non_constant_luminance);
+  bool full_range = GENERATE(false, true);
+  SimdLevel simd_level = GENERATE(SimdLevel::SSE41, SimdLevel::NEON);
+
+  // odd sizes, to cover the scalar code for the remaining pixels and the last chroma row
+  uint32_t width = GENERATE(77, 80);
+  const uint32_t height = 5;
+
+  heif_chroma chroma = heif_chroma_undefined;
+  int bpp = 8;
+
+  SECTION("8 bit interleaved") {
+    chroma = GENERATE(heif_chroma_interleaved_RGB, heif_chroma_interleaved_RGBA);
+    bpp = 8;
+  }
+
+  SECTION("planar") {
+    chroma = heif_chroma_444;
+    bpp = GENERATE(8, 10, 12);
+  }
+
+  SECTION("high bit depth interleaved") {
+    chroma = GENERATE(heif_chroma_interleaved_RRGGBB_LE, heif_chroma_interleaved_RRGGBB_BE,
+                      heif_chroma_interleaved_RRGGBBAA_LE, heif_chroma_interleaved_RRGGBBAA_BE);
+    bpp = GENERATE(10, 12);
+  }
+
+  auto img = make_random_RGB_image(width, height, chroma, bpp);
+
+  auto nclx = std::make_shared<color_profile_nclx>();
+  nclx->set_matrix_coefficients(matrix);
+  nclx->set_full_range_flag(full_range);
+
+  set_max_simd_level(SimdLevel::None);
+  auto reference = convert_colorspace(img, heif_colorspace_YCbCr, heif_chroma_420, nclx, bpp, options);
+  set_max_simd_level(simd_level);
+  auto simd = convert_colorspace(img, heif_colorspace_YCbCr, heif_chroma_420, nclx, bpp, options);
+
+  INFO("SIMD level: " << get_simd_level_name(get_simd_level()));
+  set_max_simd_level(SimdLevel::NEON);
+
+  REQUIRE(reference);
+  REQUIRE(simd);
+
+  for (heif_channel channel : {heif_channel_Y, heif_channel_Cb, heif_channel_Cr, heif_channel_Alpha}) {
+    REQUIRE(simd->has_channel(channel) == reference->has_channel(channel));
+    if (!reference->has_channel(channel)) {
+      continue;
+    }
+
+    uint32_t w = reference->get_width(channel);
+    uint32_t h = reference->get_height(channel);
+    uint32_t ref_stride, simd_stride;
+    const uint8_t* ref_p = reference->get_plane(channel, &ref_stride);
+    const uint8_t* simd_p = simd->get_plane(channel, &simd_stride);
+
+    for (uint32_t y = 0; y < h; y++) {
+      for (uint32_t x = 0; x < w; x++) {
+        int ref_value, simd_value;
+        if (bpp == 8) {
+          ref_value = ref_p[y * ref_stride + x];
+          simd_value = simd_p[y * simd_stride + x];
+        }
+        else {
+          ref_value = reinterpret_cast<const uint16_t*>(ref_p + y * ref_stride)[x];
+          simd_value = reinterpret_cast<const uint16_t*>(simd_p + y * simd_stride)[x];
+        }
+
+        // The scalar code may be compiled with fused multiply-adds.
+        INFO("channel: " << channel << " row: " << y << " column: " << x);
+        REQUIRE(std::abs(simd_value - ref_value) <= 1);
+      }
+    }
+  }
+}
+
+
+// Not run by default. Run with: conversion "[.benchmark]"
+TEST_CASE("SIMD color conversion speed", "[.benchmark]")
+{
+  heif_color_conversion_options options = {
+      .preferred_chroma_downsampling_algorithm = heif_chroma_downsampling_nearest_neighbor,
+      .preferred_chroma_upsampling_algorithm = heif_chroma_upsampling_nearest_neighbor,
+      .only_use_preferred_chroma_algorithm = true};
+
+  const uint32_t width = 4032;
+  const uint32_t height = 3024;
+
+  auto nclx = std::make_shared<color_profile_nclx>();
+  nclx->set_matrix_coefficients(heif_matrix_coefficients_ITU_R_BT_601_6);
+  nclx->set_full_range_flag(true);
+
+  struct Conversion
+  {
+    const char* name;
+    std::shared_ptr<HeifPixelImage> input;
+    heif_colorspace colorspace;
+    heif_chroma chroma;
+    int bpp;
+  };
+
+  std::vector<Conversion> conversions{
+      {"YCbCr 4:2:0 -> RGBA", make_random_YCbCr420_image(width, height, 8, false, heif_matrix_coefficients_ITU_R_BT_601_6, true),
+       heif_colorspace_RGB, heif_chroma_interleaved_RGBA, 8},
+      {"YCbCr 4:2:0 10 bit -> RRGGBB", make_random_YCbCr420_image(width, height, 10, false, heif_matrix_coefficients_ITU_R_BT_601_6, true),
+       heif_colorspace_RGB, heif_chroma_interleaved_RRGGBB_LE, 10},
+      {"RGBA -> YCbCr 4:2:0", make_random_RGB_image(width, height, heif_chroma_interleaved_RGBA, 8),
+       heif_colorspace_YCbCr, heif_chroma_420, 8},
+      {"planar RGB 10 bit -> YCbCr 4:2:0", make_random_RGB_image(width, height, heif_chroma_444, 10),
+       heif_colorspace_YCbCr, heif_chroma_420, 10},
+      {"RRGGBB 10 bit -> YCbCr 4:2:0", make_random_RGB_image(width, height, heif_chroma_interleaved_RRGGBB_LE, 10),
+       heif_colorspace_YCbCr, heif_chroma_420, 10},
+  };
+
+  auto best_time_ms = [&](const Conversion& conversion) {
+    double best = 0;
+    for (int i = 0; i < 5; i++) {
+      auto start = std::chrono::steady_clock::now();
+      auto out = convert_colorspace(conversion.input, conversion.colorspace, conversion.chroma, nclx, conversion.bpp, options);
+      auto end = std::chrono::steady_clock::now();
+      REQUIRE(out);
+
+      double ms = std::chrono::duration<double, std::milli>(end - start).count();
+      if (i == 0 || ms < best) {
+        best = ms;
+      }
+    }
+    return best;
+  };
+
+  for (const auto& conversion : conversions) {
+    set_max_simd_level(SimdLevel::None);
+    double scalar_ms = best_time_ms(conversion);
+    set_max_simd_level(SimdLevel::NEON);
+    double simd_ms = best_time_ms(conversion);
+
+    WARN(conversion.name << ": scalar " << scalar_ms << " ms, "
+                         << get_simd_level_name(get_simd_level()) << " " << simd_ms << " ms");
+
+    if (get_simd_level() != SimdLevel::None) {
+      CHECK(simd_ms < scalar_ms);
+    }
+  }
+}
+
+
+static void check_images_equal(const std::shared_ptr<const HeifPixelImage>& a, const std::shared_ptr<const HeifPixelImage>& b)
+{
+  REQUIRE(a->get_chroma_format() == b->get_chroma_format());
+  REQUIRE(a->get_channel_set() == b->get_channel_set());
+
+  for (heif_channel channel : a->get_channel_set()) {
+    REQUIRE(a->get_width(channel) == b->get_width(channel));
+    REQUIRE(a->get_height(channel) == b->get_height(channel));
+
+    uint32_t a_stride, b_stride;
+    const uint8_t* a_p = a->get_plane(channel, &a_stride);
+    const uint8_t* b_p = b->get_plane(channel, &b_stride);
+
+    uint32_t bytes_per_row = a->get_width(channel) * (a->get_storage_bits_per_pixel(channel) / 8);
+    for (uint32_t y = 0; y < a->get_height(channel); y++) {
+      INFO("channel: " << channel << " row: " << y);
+      REQUIRE(memcmp(a_p + y * a_stride, b_p + y * b_stride, bytes_per_row) == 0);
+    }
+  }
+}
+
+
+TEST_CASE("Conversion in strips matches whole image conversion")
+{
+  heif_color_conversion_options options = {
+      .preferred_chroma_downsampling_algorithm = heif_chroma_downsampling_average,
+      .preferred_chroma_upsampling_algorithm = heif_chroma_upsampling_bilinear,
+      .only_use_preferred_chroma_algorithm = true};
+
+  uint32_t width = GENERATE(33, 40);
+  uint32_t height = GENERATE(37, 50);
+  uint32_t strip_height = GENERATE(2, 6, 16);
+
+  std::shared_ptr<HeifPixelImage> img;
+  heif_colorspace colorspace = heif_colorspace_undefined;
+  heif_chroma chroma = heif_chroma_undefined;
+  int bpp = 8;
+
+  SECTION("YCbCr 4:2:0 to RGBA") {
+    img = make_random_YCbCr420_image(width, height, 8, true, heif_matrix_coefficients_ITU_R_BT_601_6, true);
+    colorspace = heif_colorspace_RGB;
+    chroma = heif_chroma_interleaved_RGBA;
+    bpp = 8;
+  }
+
+  SECTION("YCbCr 4:2:0 10 bit to RGB") {
+    img = make_random_YCbCr420_image(width, height, 10, false, heif_matrix_coefficients_ITU_R_BT_709_5, false);
+    colorspace = heif_colorspace_RGB;
+    chroma = heif_chroma_interleaved_RGB;
+    bpp = 8;
+  }
+
+  SECTION("RGB to YCbCr 4:2:0") {
+    img = make_random_RGB_image(width, height, heif_chroma_interleaved_RGB, 8);
+    colorspace = heif_colorspace_YCbCr;
+    chroma = heif_chroma_420;
+    bpp = 8;
+  }
+
+  auto nclx = std::make_shared<color_profile_nclx>();
+  nclx->set_matrix_coefficients(heif_matrix_coefficients_ITU_R_BT_601_6);
+
+  ColorConversionPipeline::set_strip_height(std::numeric_limits<uint32_t>::max());
+  auto reference = convert_colorspace(img, colorspace, chroma, nclx, bpp, options);
+  ColorConversionPipeline::set_strip_height(strip_height);
+  auto strips = convert_colorspace(img, colorspace, chroma, nclx, bpp, options);
+  ColorConversionPipeline::set_strip_height(0);
+
+  REQUIRE(reference);
+  REQUIRE(strips);
+  check_images_equal(reference, strips);
+}
+
+
+TEST_CASE("Multithreaded conversion matches single-threaded conversion")
+{
+  heif_color_conversion_options options = {
+      .preferred_chroma_downsampling_algorithm = heif_chroma_downsampling_average,
+      .preferred_chroma_upsampling_algorithm = heif_chroma_upsampling_bilinear,
+      .only_use_preferred_chroma_algorithm = true};
+
+  uint32_t width = 45;
+  uint32_t height = GENERATE(50, 301);
+
+  std::shared_ptr<HeifPixelImage> img;
+  heif_colorspace colorspace = heif_colorspace_undefined;
+  heif_chroma chroma = heif_chroma_undefined;
+  int bpp = 8;
+
+  SECTION("YCbCr 4:2:0 to RGBA") {
+    img = make_random_YCbCr420_image(width, height, 8, true, heif_matrix_coefficients_ITU_R_BT_601_6, true);
+    colorspace = heif_colorspace_RGB;
+    chroma = heif_chroma_interleaved_RGBA;
+    bpp = 8;
+  }
+
+  SECTION("YCbCr 4:2:0 10 bit to RRGGBB") {
+    img = make_random_YCbCr420_image(width, height, 10, false, heif_matrix_coefficients_ITU_R_BT_709_5, false);
+    colorspace = heif_colorspace_RGB;
+    chroma = heif_chroma_interleaved_RRGGBB_LE;
+    bpp = 10;
+  }
+
+  SECTION("RGB to YCbCr 4:2:0") {
+    img = make_random_RGB_image(width, height, heif_chroma_interleaved_RGB, 8);
+    colorspace = heif_colorspace_YCbCr;
+    chroma = heif_chroma_420;
+    bpp = 8;
+  }
+
+  auto nclx = std::make_shared<color_profile_nclx>();
+  nclx->set_matrix_coefficients(heif_matrix_coefficients_ITU_R_BT_601_6);
+
+  ThreadPool pool(4);
+
+  auto reference = convert_colorspace(img, colorspace, chroma, nclx, bpp, options);
+  ColorConversionPipeline::set_strip_height(16);
+  auto threaded = convert_colorspace(img, colorspace, chroma, nclx, bpp, options, nullptr, &pool);
+  ColorConversionPipeline::set_strip_height(0);
+
+  REQUIRE(reference);
+  REQUIRE(threaded);
+  check_images_equal(reference, threaded);
+}
+
+TEST_CASE("Only large images are converted on several threads")
+{
+  REQUIRE(!ColorConversionPipeline::is_worth_threading(160, 120));
+  REQUIRE(!ColorConversionPipeline::is_worth_threading(100000, 4));
+  REQUIRE(ColorConversionPipeline::is_worth_threading(4000, 3000));
+}
+
+
+TEST_CASE("Pipeline cache")
+{
+  heif_color_conversion_options options{};
+  heif_color_conversion_options_set_defaults(&options);
+
+  ColorState input_state(heif_colorspace_YCbCr, heif_chroma_420, false, 8);
+  input_state.nclx_profile.set_matrix_coefficients(heif_matrix_coefficients_ITU_R_BT_601_6);
+  ColorState target_state(heif_colorspace_RGB, heif_chroma_interleaved_RGBA, true, 8);
+
+  ColorConversionPipeline::clear_cache();
+
+  ColorConversionPipeline first;
+  REQUIRE(first.construct_pipeline(input_state, target_state, options));
+
+  ColorConversionPipeline second;
+  REQUIRE(second.construct_pipeline(input_state, target_state, options));
+  REQUIRE(first.debug_dump_pipeline() == second.debug_dump_pipeline());
+
+  heif_color_conversion_cache_statistics stats;
+  heif_get_color_conversion_cache_statistics(&stats);
+  REQUIRE(stats.misses == 1);
+  REQUIRE(stats.hits == 1);
+  REQUIRE(stats.num_cached_pipelines == 1);
+
+  // different options and nclx profiles must not reuse the cached pipeline
+
+  options.preferred_chroma_upsampling_algorithm = heif_chroma_upsampling_nearest_neighbor;
+  ColorConversionPipeline third;
+  REQUIRE(third.construct_pipeline(input_state, target_state, options));
+
+  input_state.nclx_profile.set_full_range_flag(false);
+  ColorConversionPipeline fourth;
+  REQUIRE(fourth.construct_pipeline(input_state, target_state, options));
+
+  heif_get_color_conversion_cache_statistics(&stats);
+  REQUIRE(stats.misses == 3);
+  REQUIRE(stats.hits == 1);
+  REQUIRE(stats.num_cached_pipelines == 3);
+}
@@ -0,0 +1,315 @@
+/*
+  libheif integration tests for decoding at a reduced output size
+
+  MIT License
+
+  Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include "libheif/heif.h"
+#include "test_utils.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+
+// Writes the file and reads it back into a new context.
+static heif_context* reload(heif_context* ctx, std::vector<uint8_t>& buffer)
+{
+  buffer = write_to_memory(ctx);
+
+  heif_context* read_ctx = heif_context_alloc();
+  heif_error err = heif_context_read_from_memory_without_copy(read_ctx, buffer.data(), buffer.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  return read_ctx;
+}
+
+
+static heif_image* decode_primary(heif_context* ctx, uint32_t max_width, uint32_t max_height,
+                                  heif_colorspace colorspace = heif_colorspace_monochrome,
+                                  heif_chroma chroma = heif_chroma_monochrome)
+{
+  heif_image_handle* handle;
+  heif_error err = heif_context_get_primary_image_handle(ctx, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_decoding_options* options = heif_decoding_options_alloc();
+  options->max_output_width = max_width;
+  options->max_output_height = max_height;
+
+  heif_image* img = nullptr;
+  err = heif_decode_image(handle, &img, colorspace, chroma, options);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_decoding_options_free(options);
+  heif_image_handle_release(handle);
+
+  return img;
+}
+
+
+static uint8_t get_pixel(const heif_image* img, int x, int y)
+{
+  int stride;
+  const uint8_t* p = heif_image_get_plane_readonly(img, heif_channel_Y, &stride);
+  return p[y * stride + x];
+}
+
+
+TEST_CASE("downscaled decode of a single image")
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  // left half 0, right half 200
+  heif_image* image = create_mono_image(64, 48, 0);
+  int stride;
+  uint8_t* p = heif_image_get_plane(image, heif_channel_Y, &stride);
+  for (int y = 0; y < 48; y++) {
+    for (int x = 32; x < 64; x++) {
+      p[y * stride + x] = 200;
+    }
+  }
+
+  err = heif_context_encode_image(ctx, image, encoder, nullptr, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  std::vector<uint8_t> buffer;
+  heif_context* read_ctx = reload(ctx, buffer);
+
+  heif_image* img = decode_primary(read_ctx, 16, 16);
+  REQUIRE(heif_image_get_primary_width(img) == 16);
+  REQUIRE(heif_image_get_primary_height(img) == 12);
+  REQUIRE(get_pixel(img, 0, 0) == 0);
+  REQUIRE(get_pixel(img, 7, 11) == 0);
+  REQUIRE(get_pixel(img, 8, 0) == 200);
+  REQUIRE(get_pixel(img, 15, 11) == 200);
+  heif_image_release(img);
+
+  // odd factor: each output pixel in the middle column covers both halves
+  img = decode_primary(read_ctx, 0, 16);
+  REQUIRE(heif_image_get_primary_width(img) == 21);
+  REQUIRE(heif_image_get_primary_height(img) == 16);
+  REQUIRE(get_pixel(img, 10, 5) == 67);
+  heif_image_release(img);
+
+  // no upscaling
+  img = decode_primary(read_ctx, 100, 100);
+  REQUIRE(heif_image_get_primary_width(img) == 64);
+  REQUIRE(heif_image_get_primary_height(img) == 48);
+  heif_image_release(img);
+
+  heif_context_free(read_ctx);
+  heif_image_release(image);
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+}
+
+
+TEST_CASE("downscaled decode of a grid image")
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  // 2x2 grid of 64x64 tiles, the image is cropped to 120x100
+  heif_encoding_options* encoding_options = heif_encoding_options_alloc();
+  heif_image_handle* grid_handle;
+  err = heif_context_add_grid_image(ctx, 120, 100, 2, 2, encoding_options, &grid_handle);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_encoding_options_free(encoding_options);
+
+  err = heif_context_set_primary_image(ctx, grid_handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  const uint8_t tile_values[4] = {10, 50, 90, 130};
+  for (uint32_t ty = 0; ty < 2; ty++) {
+    for (uint32_t tx = 0; tx < 2; tx++) {
+      heif_image* tile = create_mono_image(64, 64, tile_values[ty * 2 + tx]);
+      err = heif_context_add_image_tile(ctx, grid_handle, tx, ty, tile, encoder);
+      REQUIRE(err.code == heif_error_Ok);
+      heif_image_release(tile);
+    }
+  }
+
+  heif_image_handle_release(grid_handle);
+
+  std::vector<uint8_t> buffer;
+  heif_context* read_ctx = reload(ctx, buffer);
+
+  heif_image* img = decode_primary(read_ctx, 30, 30);
+  REQUIRE(heif_image_get_primary_width(img) == 30);
+  REQUIRE(heif_image_get_primary_height(img) == 25);
+  REQUIRE(get_pixel(img, 0, 0) == 10);
+  REQUIRE(get_pixel(img, 29, 0) == 50);
+  REQUIRE(get_pixel(img, 0, 24) == 90);
+  REQUIRE(get_pixel(img, 29, 24) == 130);
+  heif_image_release(img);
+
+  // the tiles are reduced to 32x32 and the result is scaled to the exact size
+  img = decode_primary(read_ctx, 50, 0);
+  REQUIRE(heif_image_get_primary_width(img) == 50);
+  REQUIRE(heif_image_get_primary_height(img) == 42);
+  REQUIRE(get_pixel(img, 0, 0) == 10);
+  REQUIRE(get_pixel(img, 49, 41) == 130);
+  heif_image_release(img);
+
+  heif_context_free(read_ctx);
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+}
+
+
+TEST_CASE("downscaled decode uses a large enough thumbnail")
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* image = create_mono_image(256, 128, 100);
+  heif_image_handle* handle;
+  err = heif_context_encode_image(ctx, image, encoder, nullptr, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  // The thumbnail has different content, so that we can see which image was decoded.
+  heif_image* thumbnail_image = create_mono_image(256, 128, 30);
+  heif_image_handle* thumbnail_handle;
+  err = heif_context_encode_thumbnail(ctx, thumbnail_image, handle, encoder, nullptr, 64, &thumbnail_handle);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(thumbnail_handle != nullptr);
+
+  heif_image_handle_release(thumbnail_handle);
+  heif_image_handle_release(handle);
+
+  std::vector<uint8_t> buffer;
+  heif_context* read_ctx = reload(ctx, buffer);
+
+  heif_image* img = decode_primary(read_ctx, 32, 32);
+  REQUIRE(heif_image_get_primary_width(img) == 32);
+  REQUIRE(heif_image_get_primary_height(img) == 16);
+  REQUIRE(get_pixel(img, 5, 5) == 30);
+  heif_image_release(img);
+
+  // the thumbnail is too small for this size
+  img = decode_primary(read_ctx, 128, 128);
+  REQUIRE(heif_image_get_primary_width(img) == 128);
+  REQUIRE(heif_image_get_primary_height(img) == 64);
+  REQUIRE(get_pixel(img, 5, 5) == 100);
+  heif_image_release(img);
+
+  heif_context_free(read_ctx);
+  heif_image_release(thumbnail_image);
+  heif_image_release(image);
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+}
+
+
+// Records the size of the largest image plane that is allocated while it is installed.
+struct LargestAllocation
+{
+  std::mutex mutex;
+  size_t size = 0;
+};
+
+static const heif_image_allocator recording_allocator{
+    1,
+    [](void* userdata, size_t size) -> void* {
+      auto* largest = static_cast<LargestAllocation*>(userdata);
+      std::lock_guard<std::mutex> lock(largest->mutex);
+      largest->size = std::max(largest->size, size);
+      return malloc(size);
+    },
+    [](void*, void* mem, size_t) { free(mem); }
+};
+
+
+TEST_CASE("downscaled decode of a JPEG image")
+{
+  if (!heif_have_encoder_for_format(heif_compression_JPEG) ||
+      !heif_have_decoder_for_format(heif_compression_JPEG)) {
+    WARN("JPEG codec not available");
+    return;
+  }
+
+  heif_context* ctx = heif_context_alloc();
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_JPEG, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_encoder_set_lossy_quality(encoder, 95);
+
+  // left half 0, right half 200, the edge is on an 8x8 block boundary
+  heif_image* image = create_mono_image(256, 192, 0);
+  int stride;
+  uint8_t* p = heif_image_get_plane(image, heif_channel_Y, &stride);
+  for (int y = 0; y < 192; y++) {
+    for (int x = 128; x < 256; x++) {
+      p[y * stride + x] = 200;
+    }
+  }
+
+  err = heif_context_encode_image(ctx, image, encoder, nullptr, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  std::vector<uint8_t> buffer;
+  heif_context* read_ctx = reload(ctx, buffer);
+
+  // The JPEG decoder scales by 1/8 in the DCT domain, so no plane is allocated at full resolution.
+  LargestAllocation largest;
+  err = heif_set_image_allocator(&recording_allocator, &largest);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* img = decode_primary(read_ctx, 32, 32, heif_colorspace_YCbCr, heif_chroma_420);
+  REQUIRE(heif_image_get_primary_width(img) == 32);
+  REQUIRE(heif_image_get_primary_height(img) == 24);
+  REQUIRE(get_pixel(img, 0, 0) < 8);
+  REQUIRE(get_pixel(img, 15, 23) < 8);
+  REQUIRE(get_pixel(img, 16, 0) > 192);
+  REQUIRE(get_pixel(img, 31, 23) > 192);
+  heif_image_release(img);
+
+  REQUIRE(largest.size > 0);
+  REQUIRE(largest.size < 256 * 192 / 4);
+
+  // decoding at full resolution is not affected by the scaled decode
+  img = decode_primary(read_ctx, 0, 0, heif_colorspace_YCbCr, heif_chroma_420);
+  REQUIRE(heif_image_get_primary_width(img) == 256);
+  REQUIRE(heif_image_get_primary_height(img) == 192);
+  heif_image_release(img);
+
+  REQUIRE(largest.size >= 256 * 192);
+
+  err = heif_set_image_allocator(nullptr, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_context_free(read_ctx);
+  heif_image_release(image);
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+}
@@ -0,0 +1,509 @@
+/*
+  libheif unit tests for the decoder plugin instance pool
+
+  MIT License
+
+  Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include "codecs/decoder.h"
+#include "context.h"
+#include "libheif/api_structs.h"
+#include "libheif/heif_plugin.h"
+#include <cstring>
+
+
+// Fake decoder plugin that counts its live instances and records its 'threads', 'fast' and 'level' parameters.
+
+struct FakeDecoder
+{
+  int threads = 0;
+  bool fast = false;
+  int level = 0;
+};
+
+static int num_live_decoders = 0;
+
+static struct heif_encoder_parameter fake_param_threads;
+static struct heif_encoder_parameter fake_param_fast;
+static struct heif_encoder_parameter fake_param_level;
+
+static const struct heif_encoder_parameter* fake_parameters[] = {&fake_param_threads, &fake_param_fast, &fake_param_level, nullptr};
+
+static const heif_error fake_ok = {heif_error_Ok, heif_suberror_Unspecified, "Success"};
+
+static heif_error fake_new_decoder(void** dec)
+{
+  *dec = new FakeDecoder();
+  num_live_decoders++;
+  return fake_ok;
+}
+
+static void fake_free_decoder(void* dec)
+{
+  delete (FakeDecoder*) dec;
+  num_live_decoders--;
+}
+
+static heif_error fake_reset_decoder(void*)
+{
+  return fake_ok;
+}
+
+static heif_error fake_reset_decoder_failing(void*)
+{
+  return {heif_error_Decoder_plugin_error, heif_suberror_Unspecified, "cannot reset"};
+}
+
+static const struct heif_encoder_parameter** fake_list_parameters()
+{
+  return fake_parameters;
+}
+
+static heif_error fake_set_parameter_integer(void* dec, const char* name, int value)
+{
+  if (strcmp(name, "level") == 0) {
+    ((FakeDecoder*) dec)->level = value;
+    return fake_ok;
+  }
+
+  REQUIRE(strcmp(name, heif_decoder_parameter_name_threads) == 0);
+  ((FakeDecoder*) dec)->threads = value;
+  return fake_ok;
+}
+
+static heif_error fake_set_parameter_boolean(void* dec, const char* name, int value)
+{
+  REQUIRE(strcmp(name, "fast") == 0);
+  ((FakeDecoder*) dec)->fast = value;
+  return fake_ok;
+}
+
+static heif_error fake_set_parameter_string(void*, const char*, const char*)
+{
+  return {heif_error_Usage_error, heif_suberror_Unsupported_parameter, ""};
+}
+
+static heif_decoder_plugin make_fake_plugin()
+{
+  fake_param_threads.version = 2;
+  fake_param_threads.name = heif_decoder_parameter_name_threads;
+  fake_param_threads.type = heif_encoder_parameter_type_integer;
+  fake_param_threads.integer.have_minimum_maximum = true;
+  fake_param_threads.integer.minimum = 1;
+  fake_param_threads.integer.maximum = 64;
+
+  fake_param_fast.version = 2;
+  fake_param_fast.name = "fast";
+  fake_param_fast.type = heif_encoder_parameter_type_boolean;
+
+  fake_param_level.version = 2;
+  fake_param_level.name = "level";
+  fake_param_level.type = heif_encoder_parameter_type_integer;
+  fake_param_level.integer.have_minimum_maximum = true;
+  fake_param_level.integer.minimum = 0;
+  fake_param_level.integer.maximum = 10;
+
+  heif_decoder_plugin plugin{};
+  plugin.plugin_api_version = 5;
+  plugin.new_decoder = fake_new_decoder;
+  plugin.free_decoder = fake_free_decoder;
+  plugin.reset_decoder = fake_reset_decoder;
+  plugin.list_parameters = fake_list_parameters;
+  plugin.set_parameter_integer = fake_set_parameter_integer;
+  plugin.set_parameter_boolean = fake_set_parameter_boolean;
+  plugin.set_parameter_string = fake_set_parameter_string;
+  return plugin;
+}
+
+
+TEST_CASE("released decoders are reused")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+  std::vector<uint8_t> configuration{1, 2, 3};
+
+  {
+    DecoderInstancePool pool;
+
+    auto decoder1 = pool.acquire(&plugin, configuration, {});
+    REQUIRE(!decoder1.error);
+    pool.release(&plugin, configuration, {}, decoder1.value);
+    REQUIRE(pool.get_number_of_idle_instances() == 1);
+
+    auto decoder2 = pool.acquire(&plugin, configuration, {});
+    REQUIRE(!decoder2.error);
+    REQUIRE(decoder2.value == decoder1.value);
+    REQUIRE(pool.get_number_of_idle_instances() == 0);
+    pool.release(&plugin, configuration, {}, decoder2.value);
+
+    REQUIRE(pool.get_number_of_allocated_instances() == 1);
+    REQUIRE(pool.get_number_of_reused_instances() == 1);
+    REQUIRE(num_live_decoders == 1);
+  }
+
+  // the pool frees its idle decoders
+  REQUIRE(num_live_decoders == 0);
+}
+
+
+TEST_CASE("decoders are only reused for the same codec configuration")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+  std::vector<uint8_t> configuration1{1, 2, 3};
+  std::vector<uint8_t> configuration2{4, 5};
+
+  {
+    DecoderInstancePool pool;
+
+    auto decoder1 = pool.acquire(&plugin, configuration1, {});
+    REQUIRE(!decoder1.error);
+    pool.release(&plugin, configuration1, {}, decoder1.value);
+
+    auto decoder2 = pool.acquire(&plugin, configuration2, {});
+    REQUIRE(!decoder2.error);
+    REQUIRE(decoder2.value != decoder1.value);
+    pool.release(&plugin, configuration2, {}, decoder2.value);
+
+    auto decoder3 = pool.acquire(&plugin, configuration1, {});
+    REQUIRE(decoder3.value == decoder1.value);
+    pool.release(&plugin, configuration1, {}, decoder3.value);
+
+    REQUIRE(pool.get_number_of_allocated_instances() == 2);
+    REQUIRE(pool.get_number_of_reused_instances() == 1);
+    REQUIRE(pool.get_number_of_idle_instances() == 2);
+  }
+
+  REQUIRE(num_live_decoders == 0);
+}
+
+
+TEST_CASE("the number of idle decoders is limited")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+  std::vector<uint8_t> configuration{1, 2, 3};
+
+  DecoderInstancePool pool;
+  pool.set_max_idle_instances(2);
+
+  std::vector<void*> decoders;
+  for (int i = 0; i < 3; i++) {
+    auto decoder = pool.acquire(&plugin, configuration, {});
+    REQUIRE(!decoder.error);
+    decoders.push_back(decoder.value);
+  }
+
+  for (void* decoder : decoders) {
+    pool.release(&plugin, configuration, {}, decoder);
+  }
+
+  REQUIRE(pool.get_number_of_idle_instances() == 2);
+  REQUIRE(num_live_decoders == 2);
+
+  // lowering the limit frees the decoders above it
+  pool.set_max_idle_instances(0);
+  REQUIRE(pool.get_number_of_idle_instances() == 0);
+  REQUIRE(num_live_decoders == 0);
+}
+
+
+TEST_CASE("decoders that cannot be reset are freed")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+  std::vector<uint8_t> configuration{1, 2, 3};
+
+  DecoderInstancePool pool;
+
+  plugin.reset_decoder = fake_reset_decoder_failing;
+  auto decoder = pool.acquire(&plugin, configuration, {});
+  REQUIRE(!decoder.error);
+  pool.release(&plugin, configuration, {}, decoder.value);
+  REQUIRE(pool.get_number_of_idle_instances() == 0);
+  REQUIRE(num_live_decoders == 0);
+
+  // plugins before API version 4 have no reset_decoder()
+  plugin = make_fake_plugin();
+  plugin.plugin_api_version = 3;
+  decoder = pool.acquire(&plugin, configuration, {});
+  REQUIRE(!decoder.error);
+  pool.release(&plugin, configuration, {}, decoder.value);
+  REQUIRE(pool.get_number_of_idle_instances() == 0);
+  REQUIRE(num_live_decoders == 0);
+}
+
+
+TEST_CASE("decoder instances are reused per parameter set")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+  std::vector<uint8_t> configuration{1, 2, 3};
+
+  DecoderParameters single_thread{{heif_decoder_parameter_name_threads, "1"}};
+  DecoderParameters four_threads{{heif_decoder_parameter_name_threads, "4"}};
+
+  {
+    DecoderInstancePool pool;
+
+    auto decoder1 = pool.acquire(&plugin, configuration, four_threads);
+    REQUIRE(!decoder1.error);
+    REQUIRE(((FakeDecoder*) decoder1.value)->threads == 4);
+    pool.release(&plugin, configuration, four_threads, decoder1.value);
+
+    // a decoder with another thread count is not reused
+    auto decoder2 = pool.acquire(&plugin, configuration, single_thread);
+    REQUIRE(!decoder2.error);
+    REQUIRE(decoder2.value != decoder1.value);
+    REQUIRE(((FakeDecoder*) decoder2.value)->threads == 1);
+    pool.release(&plugin, configuration, single_thread, decoder2.value);
+
+    auto decoder3 = pool.acquire(&plugin, configuration, four_threads);
+    REQUIRE(decoder3.value == decoder1.value);
+    pool.release(&plugin, configuration, four_threads, decoder3.value);
+
+    REQUIRE(pool.get_number_of_allocated_instances() == 2);
+    REQUIRE(pool.get_number_of_reused_instances() == 1);
+  }
+
+  REQUIRE(num_live_decoders == 0);
+}
+
+
+// Like a decoder that opens its codec when the first data is pushed: parameters cannot be set afterwards.
+
+struct StatefulFakeDecoder : FakeDecoder
+{
+  bool opened = false;
+};
+
+static heif_error stateful_fake_new_decoder(void** dec)
+{
+  *dec = new StatefulFakeDecoder();
+  num_live_decoders++;
+  return fake_ok;
+}
+
+static void stateful_fake_free_decoder(void* dec)
+{
+  delete (StatefulFakeDecoder*) dec;
+  num_live_decoders--;
+}
+
+static heif_error stateful_fake_push_data(void* dec, const void*, size_t)
+{
+  ((StatefulFakeDecoder*) dec)->opened = true;
+  return fake_ok;
+}
+
+static heif_error stateful_fake_set_parameter_integer(void* dec, const char* name, int value)
+{
+  if (((StatefulFakeDecoder*) dec)->opened) {
+    return {heif_error_Usage_error, heif_suberror_Unsupported_parameter, "decoder already opened"};
+  }
+
+  return fake_set_parameter_integer(dec, name, value);
+}
+
+static heif_error stateful_fake_set_parameter_boolean(void* dec, const char* name, int value)
+{
+  if (((StatefulFakeDecoder*) dec)->opened) {
+    return {heif_error_Usage_error, heif_suberror_Unsupported_parameter, "decoder already opened"};
+  }
+
+  return fake_set_parameter_boolean(dec, name, value);
+}
+
+
+TEST_CASE("reused decoders keep their parameters")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+  plugin.new_decoder = stateful_fake_new_decoder;
+  plugin.free_decoder = stateful_fake_free_decoder;
+  plugin.push_data = stateful_fake_push_data;
+  plugin.set_parameter_integer = stateful_fake_set_parameter_integer;
+  plugin.set_parameter_boolean = stateful_fake_set_parameter_boolean;
+
+  std::vector<uint8_t> configuration{1, 2, 3};
+  DecoderParameters parameters{{heif_decoder_parameter_name_threads, "4"},
+                               {"fast", "true"}};
+
+  {
+    DecoderInstancePool pool;
+
+    auto decoder1 = pool.acquire(&plugin, configuration, parameters);
+    REQUIRE(!decoder1.error);
+    REQUIRE(plugin.push_data(decoder1.value, nullptr, 0).code == heif_error_Ok);
+    pool.release(&plugin, configuration, parameters, decoder1.value);
+
+    auto decoder2 = pool.acquire(&plugin, configuration, parameters);
+    REQUIRE(!decoder2.error);
+    REQUIRE(decoder2.value == decoder1.value);
+    REQUIRE(((StatefulFakeDecoder*) decoder2.value)->threads == 4);
+    REQUIRE(((StatefulFakeDecoder*) decoder2.value)->fast);
+    pool.release(&plugin, configuration, parameters, decoder2.value);
+
+    REQUIRE(pool.get_number_of_reused_instances() == 1);
+  }
+
+  REQUIRE(num_live_decoders == 0);
+}
+
+
+TEST_CASE("unknown decoder parameters are rejected")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+
+  DecoderInstancePool pool;
+  auto decoder = pool.acquire(&plugin, {}, {{"no-such-parameter", "1"}});
+  REQUIRE(decoder.error.error_code == heif_error_Usage_error);
+  REQUIRE(decoder.error.sub_error_code == heif_suberror_Unsupported_parameter);
+  REQUIRE(num_live_decoders == 0);
+
+  // plugins before API version 5 do not support any parameters, but ignore the ones set by libheif
+  plugin.plugin_api_version = 4;
+  decoder = pool.acquire(&plugin, {}, {{"fast", "true"}});
+  REQUIRE(decoder.error.sub_error_code == heif_suberror_Unsupported_parameter);
+
+  decoder = pool.acquire(&plugin, {}, {{heif_decoder_parameter_name_threads, "2"},
+                                       {heif_decoder_parameter_name_downscale, "2"}});
+  REQUIRE(!decoder.error);
+  REQUIRE(((FakeDecoder*) decoder.value)->threads == 0);
+  plugin.free_decoder(decoder.value);
+}
+
+
+TEST_CASE("parameters without a setter in the plugin are rejected")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+  plugin.set_parameter_boolean = nullptr;
+
+  DecoderInstancePool pool;
+  auto decoder = pool.acquire(&plugin, {}, {{"fast", "true"}});
+  REQUIRE(decoder.error.error_code == heif_error_Usage_error);
+  REQUIRE(decoder.error.sub_error_code == heif_suberror_Unsupported_parameter);
+  REQUIRE(num_live_decoders == 0);
+}
+
+
+TEST_CASE("invalid decoder parameter values are rejected")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+
+  DecoderParameters parameters = GENERATE(values<DecoderParameters>({
+      {{heif_decoder_parameter_name_threads, ""}},
+      {{heif_decoder_parameter_name_threads, "abc"}},
+      {{heif_decoder_parameter_name_threads, "4x"}},
+      {{heif_decoder_parameter_name_threads, "99999999999"}},
+      {{"level", "-1"}},
+      {{"level", "11"}},
+      {{"fast", "yes"}}
+  }));
+
+  DecoderInstancePool pool;
+  auto decoder = pool.acquire(&plugin, {}, parameters);
+  REQUIRE(decoder.error.error_code == heif_error_Usage_error);
+  REQUIRE(decoder.error.sub_error_code == heif_suberror_Invalid_parameter_value);
+  REQUIRE(num_live_decoders == 0);
+}
+
+
+TEST_CASE("the number of decoder threads is clamped to the range of the decoder")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+
+  DecoderInstancePool pool;
+  auto decoder = pool.acquire(&plugin, {}, {{heif_decoder_parameter_name_threads, "1000"}});
+  REQUIRE(!decoder.error);
+  REQUIRE(((FakeDecoder*) decoder.value)->threads == 64);
+  plugin.free_decoder(decoder.value);
+}
+
+
+TEST_CASE("decoder parameters are converted to the declared type")
+{
+  heif_decoder_plugin plugin = make_fake_plugin();
+
+  DecoderParameters parameters{{heif_decoder_parameter_name_threads, "3"},
+                               {"fast", "true"},
+                               {"level", "10"}};
+
+  DecoderInstancePool pool;
+  auto decoder = pool.acquire(&plugin, {}, parameters);
+  REQUIRE(!decoder.error);
+  REQUIRE(((FakeDecoder*) decoder.value)->threads == 3);
+  REQUIRE(((FakeDecoder*) decoder.value)->fast);
+  REQUIRE(((FakeDecoder*) decoder.value)->level == 10);
+  pool.release(&plugin, {}, parameters, decoder.value);
+
+  parameters["fast"] = "0";
+  decoder = pool.acquire(&plugin, {}, parameters);
+  REQUIRE(!decoder.error);
+  REQUIRE(!((FakeDecoder*) decoder.value)->fast);
+  pool.release(&plugin, {}, parameters, decoder.value);
+
+  REQUIRE(pool.get_number_of_allocated_instances() == 2);
+}
+
+
+static int fake_does_support_format(enum heif_compression_format)
+{
+  return 0;
+}
+
+
+TEST_CASE("decoder plugins with API version 5 can be registered")
+{
+  // the registry keeps a pointer to the plugin
+  static heif_decoder_plugin plugin = make_fake_plugin();
+  plugin.does_support_format = fake_does_support_format;
+
+  heif_error err = heif_register_decoder_plugin(&plugin);
+  REQUIRE(err.code == heif_error_Ok);
+
+  static heif_decoder_plugin future_plugin = make_fake_plugin();
+  future_plugin.plugin_api_version = 6;
+  future_plugin.does_support_format = fake_does_support_format;
+
+  err = heif_register_decoder_plugin(&future_plugin);
+  REQUIRE(err.code == heif_error_Usage_error);
+  REQUIRE(err.subcode == heif_suberror_Unsupported_plugin_version);
+}
+
+
+TEST_CASE("number of decoder threads is only passed when set explicitly")
+{
+  heif_context* heif_ctx = heif_context_alloc();
+  HeifContext& ctx = *heif_ctx->context;
+  heif_decoding_options* options = heif_decoding_options_alloc();
+
+  auto parameters = ctx.get_decoder_parameters(*options);
+  REQUIRE(parameters.find(heif_decoder_parameter_name_threads) == parameters.end());
+
+  ctx.set_max_decoding_threads(2);
+  parameters = ctx.get_decoder_parameters(*options);
+  REQUIRE(parameters[heif_decoder_parameter_name_threads] == "2");
+
+  // without a thread pool, the codec gets a single thread
+  ctx.set_max_decoding_threads(0);
+  parameters = ctx.get_decoder_parameters(*options);
+  REQUIRE(parameters[heif_decoder_parameter_name_threads] == "1");
+
+  heif_decoding_options_free(options);
+  heif_context_free(heif_ctx);
+}
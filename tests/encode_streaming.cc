@@ -0,0 +1,218 @@
+/*
+  libheif integration tests for writing files in streaming and temporary file mode
+
+  MIT License
+
+  Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "catch.hpp"
+#include "libheif/heif.h"
+#include "test_utils.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+// A grid image of 2x2 tiles and a single image, so that the data of several items is interleaved with the grid data.
+static void add_images(heif_context* ctx)
+{
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_encoding_options* options = heif_encoding_options_alloc();
+  heif_image_handle* grid_handle;
+  err = heif_context_add_grid_image(ctx, 128, 128, 2, 2, options, &grid_handle);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_encoding_options_free(options);
+
+  err = heif_context_set_primary_image(ctx, grid_handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  for (uint32_t ty = 0; ty < 2; ty++) {
+    for (uint32_t tx = 0; tx < 2; tx++) {
+      heif_image* tile = create_mono_image(64, 64, static_cast<uint8_t>(10 + 40 * (ty * 2 + tx)));
+      err = heif_context_add_image_tile(ctx, grid_handle, tx, ty, tile, encoder);
+      REQUIRE(err.code == heif_error_Ok);
+      heif_image_release(tile);
+    }
+  }
+
+  heif_image* image = create_mono_image(64, 64, 200);
+  err = heif_context_encode_image(ctx, image, encoder, nullptr, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_image_release(image);
+
+  heif_image_handle_release(grid_handle);
+  heif_encoder_release(encoder);
+}
+
+
+static std::vector<uint8_t> read_file(const std::string& filename)
+{
+  std::ifstream istr(filename, std::ios_base::binary);
+  REQUIRE(istr);
+  return {std::istreambuf_iterator<char>(istr), std::istreambuf_iterator<char>()};
+}
+
+
+static void check_images(const std::vector<uint8_t>& data)
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_read_from_memory_without_copy(ctx, data.data(), data.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_context_get_number_of_top_level_images(ctx) == 2);
+
+  heif_item_id ids[2];
+  heif_context_get_list_of_top_level_image_IDs(ctx, ids, 2);
+
+  const int positions[5][3] = {{0, 0, 10}, {127, 0, 50}, {0, 127, 90}, {127, 127, 130}, {0, 0, 200}};
+
+  for (int i = 0; i < 2; i++) {
+    heif_image_handle* handle;
+    err = heif_context_get_image_handle(ctx, ids[i], &handle);
+    REQUIRE(err.code == heif_error_Ok);
+
+    heif_image* img;
+    err = heif_decode_image(handle, &img, heif_colorspace_monochrome, heif_chroma_monochrome, nullptr);
+    REQUIRE(err.code == heif_error_Ok);
+
+    int stride;
+    const uint8_t* p = heif_image_get_plane_readonly(img, heif_channel_Y, &stride);
+    if (i == 0) {
+      REQUIRE(heif_image_get_primary_width(img) == 128);
+      for (int k = 0; k < 4; k++) {
+        REQUIRE(p[positions[k][1] * stride + positions[k][0]] == positions[k][2]);
+      }
+    }
+    else {
+      REQUIRE(heif_image_get_primary_width(img) == 64);
+      REQUIRE(p[0] == positions[4][2]);
+    }
+
+    heif_image_release(img);
+    heif_image_handle_release(handle);
+  }
+
+  heif_context_free(ctx);
+}
+
+
+static std::vector<uint8_t> encode_in_memory()
+{
+  heif_context* ctx = heif_context_alloc();
+  add_images(ctx);
+  std::vector<uint8_t> data = write_to_memory(ctx);
+  heif_context_free(ctx);
+
+  return data;
+}
+
+
+TEST_CASE("image data in temporary file")
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_use_tmp_file_for_image_data(ctx);
+  REQUIRE(err.code == heif_error_Ok);
+
+  add_images(ctx);
+  std::vector<uint8_t> data = write_to_memory(ctx);
+  heif_context_free(ctx);
+
+  REQUIRE(data == encode_in_memory());
+  check_images(data);
+}
+
+
+TEST_CASE("streaming to file")
+{
+  std::string filename = "encode_streaming_test.heif";
+
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_start_streaming_to_file(ctx, filename.c_str(), 0);
+  REQUIRE(err.code == heif_error_Ok);
+
+  add_images(ctx);
+
+  // the image data is already in the file (except for what is still buffered)
+  std::vector<uint8_t> partial = read_file(filename);
+  REQUIRE(partial.size() > 64 * 1024);
+
+  std::vector<uint8_t> buffer;
+  heif_writer writer{};
+  writer.writer_api_version = 1;
+  writer.write = write_to_vector;
+  err = heif_context_write(ctx, &writer, &buffer);
+  REQUIRE(err.code == heif_error_Usage_error);
+
+  err = heif_context_finish_streaming_to_file(ctx);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_context_free(ctx);
+
+  std::vector<uint8_t> data = read_file(filename);
+  // reserved header, 'mdat' header with 64-bit size, uncompressed image data
+  REQUIRE(data.size() == 64 * 1024 + 16 + 5 * 64 * 64);
+  check_images(data);
+
+  std::remove(filename.c_str());
+}
+
+
+TEST_CASE("streaming to file with meta box after the image data")
+{
+  std::string filename = "encode_streaming_test_meta_at_end.heif";
+
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_start_streaming_to_file(ctx, filename.c_str(), 64);
+  REQUIRE(err.code == heif_error_Ok);
+
+  add_images(ctx);
+
+  err = heif_context_finish_streaming_to_file(ctx);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_context_free(ctx);
+
+  std::vector<uint8_t> data = read_file(filename);
+  check_images(data);
+
+  // 'ftyp' and 'free' fill the reserved space, 'mdat' follows
+  REQUIRE(memcmp(data.data() + 64 + 4, "mdat", 4) == 0);
+
+  std::remove(filename.c_str());
+}
+
+
+TEST_CASE("write mode cannot be changed after adding images")
+{
+  heif_context* ctx = heif_context_alloc();
+  add_images(ctx);
+
+  heif_error err = heif_context_use_tmp_file_for_image_data(ctx);
+  REQUIRE(err.code == heif_error_Usage_error);
+
+  heif_context_free(ctx);
+}
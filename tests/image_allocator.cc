@@ -0,0 +1,143 @@
+/*
+  libheif unit tests for the image allocators and the image buffer pool
+
+  MIT License
+
+  Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include "image_allocator.h"
+#include "pixelimage.h"
+
+
+// Counts the allocations that reach it.
+class CountingAllocator : public ImageAllocator
+{
+public:
+  uint8_t* allocate(size_t size) override
+  {
+    num_allocations++;
+    return new uint8_t[size];
+  }
+
+  void release(uint8_t* mem, size_t size) override
+  {
+    num_releases++;
+    delete[] mem;
+  }
+
+  int num_allocations = 0;
+  int num_releases = 0;
+};
+
+
+TEST_CASE("size classes")
+{
+  REQUIRE(PooledImageAllocator::get_size_class(1) == 4096);
+  REQUIRE(PooledImageAllocator::get_size_class(4096) == 4096);
+  REQUIRE(PooledImageAllocator::get_size_class(4097) == 5120);
+  REQUIRE(PooledImageAllocator::get_size_class(8192) == 8192);
+  REQUIRE(PooledImageAllocator::get_size_class(8193) == 10240);
+
+  for (size_t size = 1; size < 10000000; size = size * 3 + 7) {
+    size_t size_class = PooledImageAllocator::get_size_class(size);
+    REQUIRE(size_class >= size);
+    REQUIRE(size_class <= size + size / 4 + 4096);
+  }
+}
+
+
+TEST_CASE("pool reuses released buffers")
+{
+  auto upstream = std::make_shared<CountingAllocator>();
+
+  {
+    PooledImageAllocator pool(upstream, 1000000);
+
+    uint8_t* mem1 = pool.allocate(100000);
+    pool.release(mem1, 100000);
+
+    // same size class
+    uint8_t* mem2 = pool.allocate(99000);
+    REQUIRE(mem2 == mem1);
+
+    // different size class
+    uint8_t* mem3 = pool.allocate(200000);
+    REQUIRE(mem3 != mem1);
+
+    pool.release(mem2, 99000);
+    pool.release(mem3, 200000);
+
+    heif_image_buffer_pool_statistics stats = pool.get_statistics();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 2);
+    REQUIRE(stats.num_cached_buffers == 2);
+    REQUIRE(stats.cached_bytes == PooledImageAllocator::get_size_class(100000) + PooledImageAllocator::get_size_class(200000));
+
+    REQUIRE(upstream->num_allocations == 2);
+    REQUIRE(upstream->num_releases == 0);
+  }
+
+  REQUIRE(upstream->num_releases == 2);
+}
+
+
+TEST_CASE("pool size limit")
+{
+  auto upstream = std::make_shared<CountingAllocator>();
+  PooledImageAllocator pool(upstream, 300000);
+
+  uint8_t* mem1 = pool.allocate(200000);
+  uint8_t* mem2 = pool.allocate(200000);
+  pool.release(mem1, 200000);
+  pool.release(mem2, 200000);
+
+  REQUIRE(pool.get_statistics().num_cached_buffers == 1);
+  REQUIRE(upstream->num_releases == 1);
+
+  pool.trim();
+
+  REQUIRE(pool.get_statistics().cached_bytes == 0);
+  REQUIRE(upstream->num_releases == 2);
+}
+
+
+TEST_CASE("image planes use the image allocator")
+{
+  auto upstream = std::make_shared<CountingAllocator>();
+  auto pool = std::make_shared<PooledImageAllocator>(upstream, 10000000);
+
+  for (int i = 0; i < 5; i++) {
+    auto img = std::make_shared<HeifPixelImage>();
+    img->set_allocator(pool);
+    img->create(640, 480, heif_colorspace_YCbCr, heif_chroma_420);
+    REQUIRE(img->add_plane(heif_channel_Y, 640, 480, 8));
+    REQUIRE(img->add_plane(heif_channel_Cb, 320, 240, 8));
+    REQUIRE(img->add_plane(heif_channel_Cr, 320, 240, 8));
+
+    // planes keep their allocator when the image allocator changes
+    img->set_allocator(std::make_shared<DefaultImageAllocator>());
+  }
+
+  REQUIRE(upstream->num_allocations == 3);
+  REQUIRE(pool->get_statistics().hits == 12);
+}
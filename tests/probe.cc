@@ -0,0 +1,263 @@
+/*
+  libheif integration tests for the file probe API
+
+  MIT License
+
+  Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include "libheif/heif.h"
+#include "libheif/heif_probe.h"
+#include "test-config.h"
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+static std::vector<uint8_t> read_test_file(const std::string& filename)
+{
+  std::ifstream istr(tests_data_directory + "/" + filename, std::ios::binary);
+  REQUIRE(istr.good());
+  return {std::istreambuf_iterator<char>(istr), std::istreambuf_iterator<char>()};
+}
+
+
+TEST_CASE("probe file") {
+  heif_probe_result result;
+  result.version = 1;
+  std::string path = tests_data_directory + "/uncompressed_comp_ABGR.heif";
+  heif_error err = heif_probe_file(path.c_str(), &result);
+  REQUIRE(err.code == heif_error_Ok);
+
+  REQUIRE(result.main_brand == heif_brand2_mif1);
+  REQUIRE(result.primary_image_id == 1);
+  REQUIRE(result.primary_item_type == heif_fourcc('u', 'n', 'c', 'i'));
+  REQUIRE(result.compression_format == heif_compression_uncompressed);
+  REQUIRE(result.ispe_width == 30);
+  REQUIRE(result.ispe_height == 20);
+
+  // this file has no 'pixi' property
+  REQUIRE(result.luma_bits_per_pixel == -1);
+  REQUIRE(result.has_alpha_channel == 0);
+  REQUIRE(result.has_depth_channel == 0);
+}
+
+
+TEST_CASE("probe memory") {
+  std::vector<uint8_t> data = read_test_file("rgb_generic_compressed_zlib_tiled.heif");
+
+  heif_probe_result result;
+  result.version = 1;
+  heif_error err = heif_probe_memory(data.data(), data.size(), &result);
+  REQUIRE(err.code == heif_error_Ok);
+
+  REQUIRE(result.version == 1);
+  REQUIRE(result.primary_image_id == 10);
+  REQUIRE(result.compression_format == heif_compression_uncompressed);
+  REQUIRE(result.ispe_width == 128);
+  REQUIRE(result.ispe_height == 72);
+  REQUIRE(result.has_alpha_channel == 0);
+}
+
+
+TEST_CASE("probe invalid input") {
+  heif_probe_result result;
+  result.version = 1;
+
+  std::vector<uint8_t> garbage(100, 0x55);
+  heif_error err = heif_probe_memory(garbage.data(), garbage.size(), &result);
+  REQUIRE(err.code != heif_error_Ok);
+
+  err = heif_probe_memory(nullptr, 0, &result);
+  REQUIRE(err.code == heif_error_Usage_error);
+
+  std::string path = tests_data_directory + "/does_not_exist.heif";
+  err = heif_probe_file(path.c_str(), &result);
+  REQUIRE(err.code != heif_error_Ok);
+  REQUIRE(std::string(err.message).find("Error opening file") != std::string::npos);
+
+  // the caller has to set the struct version
+  std::vector<uint8_t> data = read_test_file("uncompressed_comp_RGB.heif");
+  result.version = 0;
+  err = heif_probe_memory(data.data(), data.size(), &result);
+  REQUIRE(err.code == heif_error_Usage_error);
+  REQUIRE(err.subcode == heif_suberror_Unsupported_parameter);
+}
+
+
+static void append_u16(std::vector<uint8_t>& data, uint16_t v)
+{
+  data.push_back(static_cast<uint8_t>(v >> 8));
+  data.push_back(static_cast<uint8_t>(v & 0xFF));
+}
+
+static void append_u32(std::vector<uint8_t>& data, uint32_t v)
+{
+  append_u16(data, static_cast<uint16_t>(v >> 16));
+  append_u16(data, static_cast<uint16_t>(v & 0xFFFF));
+}
+
+static void append_string(std::vector<uint8_t>& data, const std::string& str)
+{
+  data.insert(data.end(), str.begin(), str.end());
+}
+
+static std::vector<uint8_t> box(const std::string& type, const std::vector<uint8_t>& payload)
+{
+  std::vector<uint8_t> data;
+  append_u32(data, static_cast<uint32_t>(payload.size() + 8));
+  append_string(data, type);
+  data.insert(data.end(), payload.begin(), payload.end());
+  return data;
+}
+
+// version 0, flags 0
+static std::vector<uint8_t> full_box(const std::string& type, std::vector<uint8_t> payload)
+{
+  payload.insert(payload.begin(), 4, 0);
+  return box(type, payload);
+}
+
+static std::vector<uint8_t> concat(const std::vector<std::vector<uint8_t>>& parts)
+{
+  std::vector<uint8_t> data;
+  for (const auto& part : parts) {
+    data.insert(data.end(), part.begin(), part.end());
+  }
+  return data;
+}
+
+static std::vector<uint8_t> infe(uint16_t id, const std::string& type)
+{
+  std::vector<uint8_t> payload;
+  append_u16(payload, id);
+  append_u16(payload, 0); // protection index
+  append_string(payload, type);
+  payload.push_back(0); // empty item name
+
+  payload.insert(payload.begin(), {2, 0, 0, 0}); // version 2
+  return box("infe", payload);
+}
+
+static std::vector<uint8_t> single_item_reference(const std::string& type, uint16_t from, uint16_t to)
+{
+  std::vector<uint8_t> payload;
+  append_u16(payload, from);
+  append_u16(payload, 1);
+  append_u16(payload, to);
+  return box(type, payload);
+}
+
+static std::vector<uint8_t> auxC(const std::string& aux_type)
+{
+  std::vector<uint8_t> payload;
+  append_string(payload, aux_type);
+  payload.push_back(0);
+  return full_box("auxC", payload);
+}
+
+
+// A 64x48 'grid' image with one HEVC tile and optional depth and alpha images.
+// Probing does not read the image data, so the file has no 'iloc' and 'mdat' boxes.
+static std::vector<uint8_t> create_grid_file(bool with_depth, bool with_alpha)
+{
+  std::vector<uint8_t> ftyp;
+  append_string(ftyp, "heic");
+  append_u32(ftyp, 0);
+  append_string(ftyp, "mif1heic");
+
+  std::vector<uint8_t> hdlr;
+  append_u32(hdlr, 0);
+  append_string(hdlr, "pict");
+  hdlr.insert(hdlr.end(), 13, 0); // reserved, empty name
+
+  std::vector<uint8_t> pitm;
+  append_u16(pitm, 1);
+
+  std::vector<uint8_t> iinf;
+  append_u16(iinf, 4);
+  iinf = concat({iinf, infe(1, "grid"), infe(2, "hvc1"), infe(3, "hvc1"), infe(4, "hvc1")});
+
+  std::vector<uint8_t> iref = single_item_reference("dimg", 1, 2);
+  if (with_depth) {
+    iref = concat({iref, single_item_reference("auxl", 3, 1)});
+  }
+  if (with_alpha) {
+    iref = concat({iref, single_item_reference("auxl", 4, 1)});
+  }
+
+  std::vector<uint8_t> ispe;
+  append_u32(ispe, 64);
+  append_u32(ispe, 48);
+
+  std::vector<uint8_t> ipco = concat({full_box("ispe", ispe),
+                                      auxC("urn:mpeg:hevc:2015:auxid:2"),
+                                      auxC("urn:mpeg:mpegB:cicp:systems:auxiliary:alpha")});
+
+  // item ID, number of properties, property index (1-based)
+  std::vector<uint8_t> ipma;
+  append_u32(ipma, 3);
+  const uint16_t items[] = {1, 3, 4};
+  for (uint16_t item : items) {
+    append_u16(ipma, item);
+    ipma.push_back(1);
+    ipma.push_back(static_cast<uint8_t>(item == 1 ? 1 : item - 1));
+  }
+
+  std::vector<uint8_t> iprp = concat({box("ipco", ipco), full_box("ipma", ipma)});
+
+  std::vector<uint8_t> meta = concat({full_box("hdlr", hdlr),
+                                      full_box("pitm", pitm),
+                                      full_box("iinf", iinf),
+                                      full_box("iref", iref),
+                                      box("iprp", iprp)});
+
+  return concat({box("ftyp", ftyp), full_box("meta", meta)});
+}
+
+
+TEST_CASE("probe grid image") {
+  bool with_depth = GENERATE(false, true);
+  bool with_alpha = GENERATE(false, true);
+  INFO("depth: " << with_depth << ", alpha: " << with_alpha);
+
+  std::vector<uint8_t> data = create_grid_file(with_depth, with_alpha);
+
+  heif_probe_result result;
+  result.version = 1;
+  heif_error err = heif_probe_memory(data.data(), data.size(), &result);
+  REQUIRE(err.code == heif_error_Ok);
+
+  REQUIRE(result.main_brand == heif_brand2_heic);
+  REQUIRE(result.primary_image_id == 1);
+  REQUIRE(result.primary_item_type == heif_fourcc('g', 'r', 'i', 'd'));
+
+  // the format of the first tile
+  REQUIRE(result.compression_format == heif_compression_HEVC);
+  REQUIRE(result.ispe_width == 64);
+  REQUIRE(result.ispe_height == 48);
+  REQUIRE(result.luma_bits_per_pixel == -1);
+
+  REQUIRE(result.has_depth_channel == (with_depth ? 1 : 0));
+  REQUIRE(result.has_alpha_channel == (with_alpha ? 1 : 0));
+}
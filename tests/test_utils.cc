@@ -170,6 +170,44 @@ struct heif_image * createImage_RGB_planar()
 }
 
 
+struct heif_image * create_mono_image(int w, int h, uint8_t value)
+{
+  struct heif_image* image;
+  struct heif_error err = heif_image_create(w, h, heif_colorspace_monochrome, heif_chroma_monochrome, &image);
+  REQUIRE(err.code == heif_error_Ok);
+
+  err = heif_image_add_plane(image, heif_channel_Y, w, h, 8);
+  REQUIRE(err.code == heif_error_Ok);
+
+  int stride;
+  uint8_t* p = heif_image_get_plane(image, heif_channel_Y, &stride);
+  for (int y = 0; y < h; y++) {
+    memset(p + y * stride, value, w);
+  }
+
+  return image;
+}
+
+struct heif_error write_to_vector(struct heif_context*, const void* data, size_t size, void* userdata)
+{
+  auto* buffer = static_cast<std::vector<uint8_t>*>(userdata);
+  buffer->insert(buffer->end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+  return heif_error_success;
+}
+
+std::vector<uint8_t> write_to_memory(heif_context* ctx)
+{
+  struct heif_writer writer{};
+  writer.writer_api_version = 1;
+  writer.write = write_to_vector;
+
+  std::vector<uint8_t> buffer;
+  struct heif_error err = heif_context_write(ctx, &writer, &buffer);
+  REQUIRE(err.code == heif_error_Ok);
+
+  return buffer;
+}
+
 std::string get_path_for_heifio_test_file(std::string filename)
 {
   return libheifio_tests_data_directory + "/" + filename;
@@ -24,7 +24,9 @@
   SOFTWARE.
 */
 
+#include <cstdint>
 #include <string>
+#include <vector>
 #include "libheif/heif.h"
 
 struct heif_context * get_context_for_test_file(std::string filename);
@@ -40,4 +42,12 @@ void fill_new_plane(heif_image* img, heif_channel channel, int w, int h);
 
 struct heif_image * createImage_RGB_planar();
 
+// 8-bit monochrome image with all pixels set to 'value'
+struct heif_image * create_mono_image(int w, int h, uint8_t value);
+
+// heif_writer callback that appends the data to the std::vector<uint8_t> passed as 'userdata'
+struct heif_error write_to_vector(struct heif_context* ctx, const void* data, size_t size, void* userdata);
+
+std::vector<uint8_t> write_to_memory(heif_context* ctx);
+
 std::string get_path_for_heifio_test_file(std::string filename);
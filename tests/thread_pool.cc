@@ -0,0 +1,168 @@
+/*
+  libheif unit tests for the tile decoding thread pool
+
+  MIT License
+
+  Copyright (c) 2024 Dirk Farin <dirk.farin@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include "thread_pool.h"
+#include "context.h"
+#include "libheif/api_structs.h"
+#include <atomic>
+#include <thread>
+
+
+TEST_CASE("task group without pool runs inline")
+{
+  int counter = 0;
+
+  TaskGroup tasks(nullptr);
+  for (int i = 0; i < 10; i++) {
+    tasks.run([&counter]() {
+      counter++;
+      return Error::Ok;
+    });
+  }
+
+  REQUIRE(counter == 10);
+  REQUIRE(tasks.wait() == Error::Ok);
+}
+
+
+TEST_CASE("task group on thread pool")
+{
+  ThreadPool pool(4);
+
+  std::atomic<int> counter{0};
+
+  TaskGroup tasks(&pool);
+  for (int i = 0; i < 1000; i++) {
+    tasks.run([&counter]() {
+      counter++;
+      return Error::Ok;
+    });
+  }
+
+  REQUIRE(tasks.wait() == Error::Ok);
+  REQUIRE(counter == 1000);
+}
+
+
+TEST_CASE("nested task groups")
+{
+  // A single worker has to process the nested tasks itself while waiting for them.
+  ThreadPool pool(1);
+
+  std::atomic<int> counter{0};
+
+  TaskGroup outer(&pool);
+  for (int i = 0; i < 8; i++) {
+    outer.run([&pool, &counter]() {
+      TaskGroup inner(&pool);
+      for (int k = 0; k < 8; k++) {
+        inner.run([&counter]() {
+          counter++;
+          return Error::Ok;
+        });
+      }
+
+      return inner.wait();
+    });
+  }
+
+  REQUIRE(outer.wait() == Error::Ok);
+  REQUIRE(counter == 64);
+}
+
+
+TEST_CASE("task group error")
+{
+  ThreadPool pool(2);
+
+  TaskGroup tasks(&pool);
+  for (int i = 0; i < 100; i++) {
+    tasks.run([i]() {
+      if (i == 10) {
+        return Error(heif_error_Decoder_plugin_error);
+      }
+      return Error::Ok;
+    });
+  }
+
+  Error err = tasks.wait();
+  REQUIRE(err.error_code == heif_error_Decoder_plugin_error);
+  REQUIRE(tasks.has_failed());
+}
+
+
+TEST_CASE("change number of decoding threads while the pool is used")
+{
+  heif_context* heif_ctx = heif_context_alloc();
+  HeifContext& ctx = *heif_ctx->context;
+
+  // The running task groups keep using the pool they started with while the context switches to new pools.
+  std::atomic<bool> done{false};
+  std::thread reconfigure([&ctx, &done]() {
+    for (int n = 0; !done; n++) {
+      ctx.set_max_decoding_threads(n % 5);
+      std::this_thread::yield();
+    }
+  });
+
+  for (int i = 0; i < 200; i++) {
+    std::shared_ptr<ThreadPool> pool = ctx.get_thread_pool();
+
+    std::atomic<int> counter{0};
+
+    TaskGroup tasks(pool.get());
+    for (int k = 0; k < 16; k++) {
+      tasks.run([&counter]() {
+        counter++;
+        return Error::Ok;
+      });
+    }
+
+    REQUIRE(tasks.wait() == Error::Ok);
+    REQUIRE(counter == 16);
+  }
+
+  done = true;
+  reconfigure.join();
+
+  heif_context_free(heif_ctx);
+}
+
+
+TEST_CASE("color conversion of small images does not create the thread pool")
+{
+  heif_context* heif_ctx = heif_context_alloc();
+  HeifContext& ctx = *heif_ctx->context;
+
+  REQUIRE(ctx.get_color_conversion_thread_pool(64, 64) == nullptr);
+
+  // An existing pool is used for all sizes.
+  std::shared_ptr<ThreadPool> pool = ctx.get_thread_pool();
+  REQUIRE(ctx.get_color_conversion_thread_pool(64, 64) == pool);
+
+  heif_context_free(heif_ctx);
+}
@@ -25,11 +25,18 @@
 */
 #include "catch.hpp"
 #include "libheif/heif.h"
+#include "libheif/heif_items.h"
+#include "libheif/heif_batch_decoder.h"
 #include "libheif/api_structs.h"
+#include <chrono>
 #include <cstdint>
+#include <mutex>
 #include <stdio.h>
 #include "test_utils.h"
+#include "test-config.h"
 #include <string.h>
+#include <utility>
+#include <vector>
 
 #include "uncompressed_decode.h"
 
@@ -168,3 +175,721 @@ TEST_CASE("check uncompressed is advertised") {
   REQUIRE(heif_have_decoder_for_format(heif_compression_uncompressed));
 }
 
+
+// Writes a grid image of uncompressed tiles. Tile i is filled with the value i*16.
+static std::vector<uint8_t> create_grid_file(uint16_t rows, uint16_t columns, int tile_size,
+                                             const char* xmp = nullptr)
+{
+  std::vector<heif_image*> tile_images;
+  for (int i = 0; i < rows * columns; i++) {
+    heif_image* tile;
+    heif_error err = heif_image_create(tile_size, tile_size, heif_colorspace_RGB, heif_chroma_interleaved_RGB, &tile);
+    REQUIRE(err.code == heif_error_Ok);
+    err = heif_image_add_plane(tile, heif_channel_interleaved, tile_size, tile_size, 8);
+    REQUIRE(err.code == heif_error_Ok);
+
+    int stride;
+    uint8_t* p = heif_image_get_plane(tile, heif_channel_interleaved, &stride);
+    for (int y = 0; y < tile_size; y++) {
+      memset(p + y * stride, (i * 16) & 0xFF, tile_size * 3);
+    }
+
+    tile_images.push_back(tile);
+  }
+
+  heif_context* ctx = heif_context_alloc();
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_encoding_options* encoding_options = heif_encoding_options_alloc();
+  heif_image_handle* grid_handle;
+  err = heif_context_add_grid_image(ctx, columns * tile_size, rows * tile_size, columns, rows, encoding_options, &grid_handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  for (uint32_t ty = 0; ty < rows; ty++) {
+    for (uint32_t tx = 0; tx < columns; tx++) {
+      err = heif_context_add_image_tile(ctx, grid_handle, tx, ty, tile_images[ty * columns + tx], encoder);
+      REQUIRE(err.code == heif_error_Ok);
+    }
+  }
+
+  err = heif_context_set_primary_image(ctx, grid_handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  if (xmp) {
+    err = heif_context_add_XMP_metadata(ctx, grid_handle, xmp, (int) strlen(xmp));
+    REQUIRE(err.code == heif_error_Ok);
+  }
+
+  heif_image_handle_release(grid_handle);
+  heif_encoding_options_free(encoding_options);
+  heif_encoder_release(encoder);
+  for (heif_image* tile : tile_images) {
+    heif_image_release(tile);
+  }
+
+  std::vector<uint8_t> file_data = write_to_memory(ctx);
+  heif_context_free(ctx);
+
+  return file_data;
+}
+
+
+static void check_region(const heif_image_handle* handle, const heif_image* full_image,
+                         const heif_decoding_options* options,
+                         uint32_t x0, uint32_t y0, uint32_t width, uint32_t height) {
+  INFO("region: " << x0 << ";" << y0 << " " << width << "x" << height);
+
+  heif_image* region;
+  heif_error err = heif_image_handle_decode_region(handle, &region, heif_colorspace_RGB,
+                                                   heif_chroma_interleaved_RGBA, options,
+                                                   x0, y0, width, height);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_image_get_primary_width(region) == (int) width);
+  REQUIRE(heif_image_get_primary_height(region) == (int) height);
+
+  int full_stride, region_stride;
+  const uint8_t* full_data = heif_image_get_plane_readonly(full_image, heif_channel_interleaved, &full_stride);
+  const uint8_t* region_data = heif_image_get_plane_readonly(region, heif_channel_interleaved, &region_stride);
+
+  for (uint32_t y = 0; y < height; y++) {
+    REQUIRE(memcmp(region_data + y * region_stride,
+                   full_data + (y0 + y) * full_stride + x0 * 4,
+                   width * 4) == 0);
+  }
+
+  heif_image_release(region);
+}
+
+TEST_CASE("decode region") {
+  auto file = GENERATE(FILES_RGB);
+  auto context = get_context_for_test_file(file);
+  INFO("file name: " << file);
+
+  heif_image_handle* handle = get_primary_image_handle(context);
+  heif_image_handle_set_decoded_tile_cache_size(handle, 1024 * 1024);
+
+  heif_image* full_image;
+  heif_error err = heif_decode_image(handle, &full_image, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  // The second round gets the tiles from the cache.
+  for (int i = 0; i < 2; i++) {
+    check_region(handle, full_image, nullptr, 0, 0, 30, 20);
+    check_region(handle, full_image, nullptr, 3, 5, 10, 7);
+    check_region(handle, full_image, nullptr, 13, 1, 17, 19);
+    check_region(handle, full_image, nullptr, 29, 19, 1, 1);
+  }
+
+  heif_image* region;
+  err = heif_image_handle_decode_region(handle, &region, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, nullptr,
+                                        20, 10, 11, 5);
+  REQUIRE(err.code == heif_error_Usage_error);
+
+  heif_image_release(full_image);
+  heif_image_handle_release(handle);
+  heif_context_free(context);
+}
+
+TEST_CASE("decoded tile cache depends on the decoder parameters") {
+  auto context = get_context_for_test_file("uncompressed_comp_RGB_tiled.heif");
+  heif_image_handle* handle = get_primary_image_handle(context);
+  heif_image_handle_set_decoded_tile_cache_size(handle, 1024 * 1024);
+  DecodedTileCache& cache = handle->image->get_decoded_tile_cache();
+
+  heif_image* full_image;
+  heif_error err = heif_decode_image(handle, &full_image, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  const char* const filters_off[] = {"disable-deblocking", "true", nullptr, nullptr};
+  heif_decoding_options* options = heif_decoding_options_alloc();
+
+  check_region(handle, full_image, nullptr, 3, 5, 10, 7);
+  uint64_t misses = cache.get_statistics().misses;
+  REQUIRE(misses > 0);
+
+  // The tiles decoded without parameters are not used for decodes with other parameters.
+  options->decoder_parameters = filters_off;
+  check_region(handle, full_image, options, 3, 5, 10, 7);
+  REQUIRE(cache.get_statistics().misses == 2 * misses);
+
+  // Both sets of tiles are kept.
+  uint64_t hits = cache.get_statistics().hits;
+  check_region(handle, full_image, options, 3, 5, 10, 7);
+  check_region(handle, full_image, nullptr, 3, 5, 10, 7);
+  REQUIRE(cache.get_statistics().misses == 2 * misses);
+  REQUIRE(cache.get_statistics().hits == hits + 2 * misses);
+
+  // A different decoder does not use them either.
+  options->decoder_parameters = nullptr;
+  options->decoder_id = "other";
+  check_region(handle, full_image, options, 3, 5, 10, 7);
+  REQUIRE(cache.get_statistics().misses == 3 * misses);
+
+  heif_decoding_options_free(options);
+  heif_image_release(full_image);
+  heif_image_handle_release(handle);
+  heif_context_free(context);
+}
+
+TEST_CASE("decode region of transformed image") {
+  auto orientation = GENERATE(heif_orientation_normal, heif_orientation_flip_horizontally,
+                              heif_orientation_rotate_180, heif_orientation_flip_vertically,
+                              heif_orientation_rotate_90_cw_then_flip_horizontally, heif_orientation_rotate_90_cw,
+                              heif_orientation_rotate_90_cw_then_flip_vertically, heif_orientation_rotate_270_cw);
+  INFO("orientation: " << orientation);
+
+  heif_image* image;
+  heif_error err = heif_image_create(36, 22, heif_colorspace_RGB, heif_chroma_interleaved_RGB, &image);
+  REQUIRE(err.code == heif_error_Ok);
+  err = heif_image_add_plane(image, heif_channel_interleaved, 36, 22, 8);
+  REQUIRE(err.code == heif_error_Ok);
+
+  int stride;
+  uint8_t* p = heif_image_get_plane(image, heif_channel_interleaved, &stride);
+  for (int y = 0; y < 22; y++) {
+    for (int x = 0; x < 36 * 3; x++) {
+      p[y * stride + x] = static_cast<uint8_t>(x * 7 + y * 13);
+    }
+  }
+
+  heif_context* ctx = heif_context_alloc();
+  heif_encoder* encoder;
+  err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_encoding_options* encoding_options = heif_encoding_options_alloc();
+  encoding_options->image_orientation = orientation;
+  err = heif_context_encode_image(ctx, image, encoder, encoding_options, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_encoding_options_free(encoding_options);
+  heif_encoder_release(encoder);
+  heif_image_release(image);
+
+  std::vector<uint8_t> file_data = write_to_memory(ctx);
+  heif_context_free(ctx);
+
+  ctx = heif_context_alloc();
+  err = heif_context_read_from_memory_without_copy(ctx, file_data.data(), file_data.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image_handle* handle = get_primary_image_handle(ctx);
+
+  heif_image* full_image;
+  err = heif_decode_image(handle, &full_image, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  uint32_t w = heif_image_get_primary_width(full_image);
+  uint32_t h = heif_image_get_primary_height(full_image);
+  REQUIRE(w == (orientation >= heif_orientation_rotate_90_cw_then_flip_horizontally ? 22 : 36));
+
+  check_region(handle, full_image, nullptr, 0, 0, w, h);
+  check_region(handle, full_image, nullptr, 1, 2, 11, 5);
+  check_region(handle, full_image, nullptr, w - 9, h - 3, 9, 3);
+
+  heif_image_release(full_image);
+  heif_image_handle_release(handle);
+  heif_context_free(ctx);
+}
+
+// A reader that serves a file from memory like a remote file, recording which ranges libheif announces.
+struct RecordingReader
+{
+  const std::vector<uint8_t>* data;
+  int64_t position = 0;
+  std::mutex hints_mutex; // the hints may be issued from several decoding threads
+  std::vector<std::pair<uint64_t, uint64_t>> preload_hints;
+  std::vector<std::pair<uint64_t, uint64_t>> released_ranges;
+};
+
+static heif_reader recording_reader{
+    2,
+    [](void* userdata) -> int64_t { return static_cast<RecordingReader*>(userdata)->position; },
+    [](void* data, size_t size, void* userdata) -> int {
+      auto* reader = static_cast<RecordingReader*>(userdata);
+      if (reader->position + size > reader->data->size()) {
+        return 1;
+      }
+      memcpy(data, reader->data->data() + reader->position, size);
+      reader->position += size;
+      return 0;
+    },
+    [](int64_t position, void* userdata) -> int {
+      static_cast<RecordingReader*>(userdata)->position = position;
+      return 0;
+    },
+    [](int64_t target_size, void* userdata) -> heif_reader_grow_status {
+      auto* reader = static_cast<RecordingReader*>(userdata);
+      return (static_cast<uint64_t>(target_size) <= reader->data->size()) ? heif_reader_grow_status_size_reached : heif_reader_grow_status_size_beyond_eof;
+    },
+    [](uint64_t start_pos, uint64_t end_pos, void* userdata) -> heif_reader_range_request_result {
+      auto* reader = static_cast<RecordingReader*>(userdata);
+      if (end_pos <= reader->data->size()) {
+        return {heif_reader_grow_status_size_reached, end_pos, 0, nullptr};
+      }
+      return {heif_reader_grow_status_size_beyond_eof, reader->data->size(), 0, nullptr};
+    },
+    [](uint64_t start_pos, uint64_t end_pos, void* userdata) {
+      auto* reader = static_cast<RecordingReader*>(userdata);
+      std::lock_guard<std::mutex> lock(reader->hints_mutex);
+      reader->preload_hints.emplace_back(start_pos, end_pos);
+    },
+    [](uint64_t start_pos, uint64_t end_pos, void* userdata) {
+      auto* reader = static_cast<RecordingReader*>(userdata);
+      std::lock_guard<std::mutex> lock(reader->hints_mutex);
+      reader->released_ranges.emplace_back(start_pos, end_pos);
+    },
+    nullptr
+};
+
+TEST_CASE("prefetch grid tiles") {
+  const int tile_size = 8;
+  const uint16_t rows = 3;
+  const uint16_t columns = 4;
+
+  std::vector<uint8_t> file_data = create_grid_file(rows, columns, tile_size);
+
+  heif_context* ctx;
+  heif_error err;
+
+  RecordingReader reader;
+  reader.data = &file_data;
+
+  ctx = heif_context_alloc();
+  err = heif_context_read_from_reader(ctx, &recording_reader, &reader, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image_handle* handle = get_primary_image_handle(ctx);
+
+  SECTION("full image") {
+    heif_image* image;
+    err = heif_decode_image(handle, &image, heif_colorspace_RGB, heif_chroma_interleaved_RGB, nullptr);
+    REQUIRE(err.code == heif_error_Ok);
+
+    int stride;
+    const uint8_t* p = heif_image_get_plane_readonly(image, heif_channel_interleaved, &stride);
+    REQUIRE(p[(2 * tile_size) * stride + (3 * tile_size) * 3] == 11 * 16);
+    heif_image_release(image);
+
+    // The tiles are stored next to each other and are announced as a single range.
+    REQUIRE(reader.preload_hints.size() == 1);
+    REQUIRE(reader.released_ranges.size() == rows * columns);
+    for (const auto& range : reader.released_ranges) {
+      REQUIRE(range.first >= reader.preload_hints[0].first);
+      REQUIRE(range.second <= reader.preload_hints[0].second);
+    }
+  }
+
+  SECTION("region") {
+    heif_image* image;
+    err = heif_image_handle_decode_region(handle, &image, heif_colorspace_RGB, heif_chroma_interleaved_RGB, nullptr,
+                                          tile_size - 1, tile_size - 1, 2, 2);
+    REQUIRE(err.code == heif_error_Ok);
+
+    int stride;
+    const uint8_t* p = heif_image_get_plane_readonly(image, heif_channel_interleaved, &stride);
+    REQUIRE(p[0] == 0);
+    REQUIRE(p[stride + 3] == (columns + 1) * 16);
+    heif_image_release(image);
+
+    REQUIRE(reader.preload_hints.size() >= 1);
+    REQUIRE(reader.released_ranges.size() == 4);
+  }
+
+  heif_image_handle_release(handle);
+  heif_context_free(ctx);
+}
+
+static heif_context* read_grid_file(const std::vector<uint8_t>& file_data, bool deferred, bool arena = false)
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_context_get_security_limits(ctx)->max_items = 100000;
+  heif_context_set_deferred_image_interpretation(ctx, deferred);
+  heif_context_set_arena_allocation(ctx, arena);
+  heif_error err = heif_context_read_from_memory_without_copy(ctx, file_data.data(), file_data.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+  return ctx;
+}
+
+
+TEST_CASE("deferred image interpretation") {
+  const int tile_size = 4;
+  const uint16_t rows = 10;
+  const uint16_t columns = 12;
+  const char xmp[] = "<x:xmpmeta xmlns:x='adobe:ns:meta/'></x:xmpmeta>";
+
+  std::vector<uint8_t> file_data = create_grid_file(rows, columns, tile_size, xmp);
+
+  heif_context* eager_ctx = read_grid_file(file_data, false);
+  heif_context* deferred_ctx = read_grid_file(file_data, true);
+
+  REQUIRE(heif_context_get_number_of_top_level_images(deferred_ctx) == 1);
+  REQUIRE(heif_context_get_number_of_top_level_images(eager_ctx) == 1);
+
+  heif_image_handle* eager_handle = get_primary_image_handle(eager_ctx);
+  heif_image_handle* deferred_handle = get_primary_image_handle(deferred_ctx);
+
+  REQUIRE(heif_image_handle_get_width(deferred_handle) == columns * tile_size);
+  REQUIRE(heif_image_handle_get_height(deferred_handle) == rows * tile_size);
+  REQUIRE(heif_image_handle_get_number_of_metadata_blocks(deferred_handle, "mime") == 1);
+
+  heif_item_id metadata_id;
+  REQUIRE(heif_image_handle_get_list_of_metadata_block_IDs(deferred_handle, "mime", &metadata_id, 1) == 1);
+  REQUIRE(heif_image_handle_get_metadata_size(deferred_handle, metadata_id) == strlen(xmp));
+
+  heif_image* eager_image;
+  heif_error err = heif_decode_image(eager_handle, &eager_image, heif_colorspace_RGB, heif_chroma_interleaved_RGB, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* deferred_image;
+  err = heif_decode_image(deferred_handle, &deferred_image, heif_colorspace_RGB, heif_chroma_interleaved_RGB, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  int eager_stride, deferred_stride;
+  const uint8_t* eager_p = heif_image_get_plane_readonly(eager_image, heif_channel_interleaved, &eager_stride);
+  const uint8_t* deferred_p = heif_image_get_plane_readonly(deferred_image, heif_channel_interleaved, &deferred_stride);
+  for (int y = 0; y < rows * tile_size; y++) {
+    REQUIRE(memcmp(eager_p + y * eager_stride, deferred_p + y * deferred_stride, columns * tile_size * 3) == 0);
+  }
+
+  heif_image_release(eager_image);
+  heif_image_release(deferred_image);
+
+  // the tiles are hidden images that can still be accessed by their ID
+  heif_item_id tile_ids[2];
+  REQUIRE(heif_context_get_list_of_item_IDs(deferred_ctx, tile_ids, 2) == 2);
+
+  heif_image_handle* tile_handle;
+  err = heif_context_get_image_handle(deferred_ctx, tile_ids[1], &tile_handle);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_image_handle_get_width(tile_handle) == tile_size);
+  heif_image_handle_release(tile_handle);
+
+  heif_image_handle_release(eager_handle);
+  heif_image_handle_release(deferred_handle);
+  heif_context_free(eager_ctx);
+  heif_context_free(deferred_ctx);
+}
+
+
+TEST_CASE("deferred image interpretation open time", "[.benchmark]") {
+  auto best_open_time_ms = [](const std::vector<uint8_t>& file_data, bool deferred) {
+    double best = 0;
+    for (int i = 0; i < 5; i++) {
+      auto start = std::chrono::steady_clock::now();
+      heif_context* ctx = read_grid_file(file_data, deferred);
+      auto end = std::chrono::steady_clock::now();
+      heif_context_free(ctx);
+
+      double ms = std::chrono::duration<double, std::milli>(end - start).count();
+      if (i == 0 || ms < best) {
+        best = ms;
+      }
+    }
+    return best;
+  };
+
+  for (uint16_t size : {uint16_t(16), uint16_t(64), uint16_t(128)}) {
+    std::vector<uint8_t> file_data = create_grid_file(size, size, 1);
+
+    double eager_ms = best_open_time_ms(file_data, false);
+    double deferred_ms = best_open_time_ms(file_data, true);
+
+    WARN(size * size << " tiles: eager " << eager_ms << " ms, deferred " << deferred_ms << " ms");
+  }
+}
+
+
+TEST_CASE("arena allocation") {
+  const int tile_size = 4;
+  const uint16_t rows = 6;
+  const uint16_t columns = 5;
+
+  std::vector<uint8_t> file_data = create_grid_file(rows, columns, tile_size);
+
+  bool deferred = GENERATE(false, true);
+
+  heif_context* heap_ctx = read_grid_file(file_data, deferred, false);
+  heif_context* arena_ctx = read_grid_file(file_data, deferred, true);
+
+  heif_image_handle* heap_handle = get_primary_image_handle(heap_ctx);
+  heif_image_handle* arena_handle = get_primary_image_handle(arena_ctx);
+
+  // the boxes allocated from the arena have to stay valid after the context is freed
+  heif_context_free(arena_ctx);
+
+  heif_image* heap_image;
+  heif_error err = heif_decode_image(heap_handle, &heap_image, heif_colorspace_RGB, heif_chroma_interleaved_RGB, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* arena_image;
+  err = heif_decode_image(arena_handle, &arena_image, heif_colorspace_RGB, heif_chroma_interleaved_RGB, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image_handle_release(arena_handle);
+
+  int heap_stride, arena_stride;
+  const uint8_t* heap_p = heif_image_get_plane_readonly(heap_image, heif_channel_interleaved, &heap_stride);
+  const uint8_t* arena_p = heif_image_get_plane_readonly(arena_image, heif_channel_interleaved, &arena_stride);
+  for (int y = 0; y < rows * tile_size; y++) {
+    REQUIRE(memcmp(heap_p + y * heap_stride, arena_p + y * arena_stride, columns * tile_size * 3) == 0);
+  }
+
+  heif_image_release(heap_image);
+  heif_image_release(arena_image);
+  heif_image_handle_release(heap_handle);
+  heif_context_free(heap_ctx);
+}
+
+
+TEST_CASE("arena allocation open time", "[.benchmark]") {
+  auto best_open_time_ms = [](const std::vector<uint8_t>& file_data, bool deferred, bool arena) {
+    double best = 0;
+    for (int i = 0; i < 5; i++) {
+      auto start = std::chrono::steady_clock::now();
+      heif_context* ctx = read_grid_file(file_data, deferred, arena);
+      heif_context_free(ctx);
+      auto end = std::chrono::steady_clock::now();
+
+      double ms = std::chrono::duration<double, std::milli>(end - start).count();
+      if (i == 0 || ms < best) {
+        best = ms;
+      }
+    }
+    return best;
+  };
+
+  for (uint16_t size : {uint16_t(16), uint16_t(64), uint16_t(128)}) {
+    std::vector<uint8_t> file_data = create_grid_file(size, size, 1);
+
+    for (bool deferred : {false, true}) {
+      double heap_ms = best_open_time_ms(file_data, deferred, false);
+      double arena_ms = best_open_time_ms(file_data, deferred, true);
+
+      WARN(size * size << " tiles" << (deferred ? ", deferred" : "") << ": heap " << heap_ms << " ms, arena " << arena_ms << " ms");
+    }
+  }
+}
+
+struct BatchResults
+{
+  std::mutex mutex;
+  std::vector<heif_error_code> errors;
+  std::vector<heif_image*> images;
+};
+
+static void batch_job_finished(heif_error err, heif_image* image, void* job_userdata, void* userdata)
+{
+  auto* results = (BatchResults*) userdata;
+  size_t job = (size_t) job_userdata;
+
+  std::lock_guard<std::mutex> lock(results->mutex);
+  results->errors[job] = err.code;
+  results->images[job] = image;
+}
+
+
+TEST_CASE("batch decoder") {
+  const int tile_size = 8;
+  const uint16_t rows = 3;
+  const uint16_t columns = 4;
+
+  std::vector<uint8_t> grid_file = create_grid_file(rows, columns, tile_size);
+
+  const size_t num_grid_jobs = 8;
+  std::vector<std::string> files = {FILES_RGB};
+
+  BatchResults results;
+  size_t num_jobs = num_grid_jobs + files.size() + 2;
+  results.errors.resize(num_jobs, heif_error_Ok);
+  results.images.resize(num_jobs, nullptr);
+
+  int num_threads = GENERATE(0, 4);
+  heif_batch_decoder* decoder = heif_batch_decoder_alloc(num_threads, batch_job_finished, &results);
+  REQUIRE(decoder != nullptr);
+  heif_batch_decoder_set_image_buffer_pool_size(decoder, 16 * 1024 * 1024);
+
+  heif_batch_decode_job job{};
+  job.version = 1;
+  job.colorspace = heif_colorspace_RGB;
+  job.chroma = heif_chroma_interleaved_RGB;
+
+  size_t job_idx = 0;
+  for (size_t i = 0; i < num_grid_jobs; i++, job_idx++) {
+    job.userdata = (void*) job_idx;
+    heif_error err = heif_batch_decoder_add_memory(decoder, grid_file.data(), grid_file.size(), &job);
+    REQUIRE(err.code == heif_error_Ok);
+  }
+
+  for (const auto& file : files) {
+    job.userdata = (void*) job_idx++;
+    std::string path = tests_data_directory + "/" + file;
+    heif_error err = heif_batch_decoder_add_file(decoder, path.c_str(), &job);
+    REQUIRE(err.code == heif_error_Ok);
+  }
+
+  // failing jobs do not affect the other jobs
+  size_t missing_file_job = job_idx++;
+  job.userdata = (void*) missing_file_job;
+  std::string missing_path = tests_data_directory + "/does_not_exist.heif";
+  REQUIRE(heif_batch_decoder_add_file(decoder, missing_path.c_str(), &job).code == heif_error_Ok);
+
+  size_t missing_item_job = job_idx++;
+  job.userdata = (void*) missing_item_job;
+  job.item_id = 9999;
+  REQUIRE(heif_batch_decoder_add_memory(decoder, grid_file.data(), grid_file.size(), &job).code == heif_error_Ok);
+
+  heif_batch_decoder_wait(decoder);
+
+  for (size_t i = 0; i < num_grid_jobs; i++) {
+    REQUIRE(results.errors[i] == heif_error_Ok);
+    REQUIRE(results.images[i] != nullptr);
+    REQUIRE(heif_image_get_primary_width(results.images[i]) == columns * tile_size);
+
+    int stride;
+    const uint8_t* p = heif_image_get_plane_readonly(results.images[i], heif_channel_interleaved, &stride);
+    REQUIRE(p[(2 * tile_size) * stride + (3 * tile_size) * 3] == 11 * 16);
+  }
+
+  for (size_t i = 0; i < files.size(); i++) {
+    INFO("file name: " << files[i]);
+    REQUIRE(results.errors[num_grid_jobs + i] == heif_error_Ok);
+    REQUIRE(heif_image_get_primary_width(results.images[num_grid_jobs + i]) == 30);
+  }
+
+  REQUIRE(results.errors[missing_file_job] != heif_error_Ok);
+  REQUIRE(results.images[missing_file_job] == nullptr);
+  REQUIRE(results.errors[missing_item_job] != heif_error_Ok);
+  REQUIRE(results.images[missing_item_job] == nullptr);
+
+  for (heif_image* image : results.images) {
+    if (image) {
+      heif_image_release(image);
+    }
+  }
+
+  heif_image_buffer_pool_statistics stats;
+  REQUIRE(heif_batch_decoder_get_image_buffer_pool_statistics(decoder, &stats).code == heif_error_Ok);
+  REQUIRE(stats.misses > 0);
+
+  heif_batch_decoder_free(decoder);
+}
+
+
+// Decodes the image into a caller-owned buffer with the given row padding and compares it to heif_decode_image().
+static void check_decode_into(heif_image_handle* handle, heif_chroma chroma, int bytes_per_pixel, size_t row_padding)
+{
+  heif_image* reference;
+  heif_error err = heif_decode_image(handle, &reference, heif_colorspace_RGB, chroma, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  uint32_t width = heif_image_get_primary_width(reference);
+  uint32_t height = heif_image_get_primary_height(reference);
+  size_t row_size = static_cast<size_t>(width) * bytes_per_pixel;
+
+  heif_image_plane_buffer buffer{};
+  buffer.channel = heif_channel_interleaved;
+  buffer.stride = row_size + row_padding;
+  buffer.size = buffer.stride * height;
+  std::vector<uint8_t> memory(buffer.size, 0xAB);
+  buffer.data = memory.data();
+
+  heif_image* image;
+  err = heif_decode_image_into(handle, &image, heif_colorspace_RGB, chroma, nullptr, &buffer, 1);
+  REQUIRE(err.code == heif_error_Ok);
+
+  // the returned image uses the buffer
+  int stride;
+  const uint8_t* p = heif_image_get_plane_readonly(image, heif_channel_interleaved, &stride);
+  REQUIRE(p == memory.data());
+  REQUIRE(static_cast<size_t>(stride) == buffer.stride);
+
+  int reference_stride;
+  const uint8_t* ref = heif_image_get_plane_readonly(reference, heif_channel_interleaved, &reference_stride);
+
+  bool identical = true;
+  bool padding_untouched = true;
+  for (uint32_t y = 0; y < height; y++) {
+    identical &= (memcmp(memory.data() + y * buffer.stride, ref + y * reference_stride, row_size) == 0);
+    for (size_t x = row_size; x < buffer.stride; x++) {
+      padding_untouched &= (memory[y * buffer.stride + x] == 0xAB);
+    }
+  }
+  REQUIRE(identical);
+  REQUIRE(padding_untouched);
+
+  heif_image_release(image);
+
+  // the buffer stays valid after releasing the image
+  REQUIRE(memcmp(memory.data(), ref, row_size) == 0);
+
+  heif_image_release(reference);
+}
+
+
+TEST_CASE("decode into caller-owned buffer") {
+  size_t row_padding = GENERATE(0, 13);
+  INFO("row padding: " << row_padding);
+
+  SECTION("image converted into the buffer") {
+    auto file = GENERATE(FILES_RGB);
+    INFO("file name: " << file);
+    auto context = get_context_for_test_file(file);
+    heif_image_handle* handle = get_primary_image_handle(context);
+
+    check_decode_into(handle, heif_chroma_interleaved_RGBA, 4, row_padding);
+
+    heif_image_handle_release(handle);
+    heif_context_free(context);
+  }
+
+  SECTION("grid assembled in the buffer") {
+    std::vector<uint8_t> file_data = create_grid_file(3, 4, 8);
+    heif_context* context = heif_context_alloc();
+    heif_error err = heif_context_read_from_memory_without_copy(context, file_data.data(), file_data.size(), nullptr);
+    REQUIRE(err.code == heif_error_Ok);
+    heif_image_handle* handle = get_primary_image_handle(context);
+
+    check_decode_into(handle, heif_chroma_interleaved_RGB, 3, row_padding);
+
+    heif_image_handle_release(handle);
+    heif_context_free(context);
+  }
+}
+
+
+TEST_CASE("decode into too small buffer") {
+  auto context = get_context_for_test_file("uncompressed_comp_RGB.heif");
+  heif_image_handle* handle = get_primary_image_handle(context);
+
+  size_t width = static_cast<size_t>(heif_image_handle_get_width(handle));
+  size_t height = static_cast<size_t>(heif_image_handle_get_height(handle));
+  size_t row_size = width * 4;
+
+  std::vector<uint8_t> memory(row_size * height);
+
+  heif_image_plane_buffer buffer{};
+  buffer.channel = heif_channel_interleaved;
+  buffer.data = memory.data();
+
+  SECTION("stride smaller than a row") {
+    buffer.stride = row_size - 1;
+    buffer.size = memory.size();
+  }
+
+  SECTION("size smaller than the image") {
+    buffer.stride = row_size;
+    buffer.size = memory.size() - 1;
+  }
+
+  heif_image* image = nullptr;
+  heif_error err = heif_decode_image_into(handle, &image, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, nullptr,
+                                          &buffer, 1);
+  REQUIRE(err.code == heif_error_Usage_error);
+  REQUIRE(err.subcode == heif_suberror_Invalid_parameter_value);
+  REQUIRE(image == nullptr);
+
+  heif_image_handle_release(handle);
+  heif_context_free(context);
+}
@@ -776,3 +776,481 @@ TEST_CASE("Encode RGBA planar")
   heif_image *input_image = createImage_RGBA_planar();
   do_encode(input_image, "encode_rgba_planar.heif", true);
 }
+
+
+static void check_grid_tile_values(const std::vector<uint8_t>& data, uint32_t columns, uint32_t rows, int tile_size)
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_read_from_memory_without_copy(ctx, data.data(), data.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image_handle* handle;
+  err = heif_context_get_primary_image_handle(ctx, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* img;
+  err = heif_decode_image(handle, &img, heif_colorspace_monochrome, heif_chroma_monochrome, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_image_get_primary_width(img) == int(columns) * tile_size);
+  REQUIRE(heif_image_get_primary_height(img) == int(rows) * tile_size);
+
+  int stride;
+  const uint8_t* p = heif_image_get_plane_readonly(img, heif_channel_Y, &stride);
+  for (uint32_t ty = 0; ty < rows; ty++) {
+    for (uint32_t tx = 0; tx < columns; tx++) {
+      REQUIRE(p[(ty * tile_size + tile_size / 2) * stride + tx * tile_size + tile_size / 2] == ty * columns + tx);
+    }
+  }
+
+  heif_image_release(img);
+  heif_image_handle_release(handle);
+  heif_context_free(ctx);
+}
+
+
+static std::vector<uint8_t> encode_full_grid(int encoding_threads)
+{
+  const uint16_t columns = 4, rows = 3;
+
+  heif_context* ctx = heif_context_alloc();
+  heif_context_set_max_encoding_threads(ctx, encoding_threads);
+
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+  err = heif_encoder_set_lossless(encoder, true);
+  REQUIRE(err.code == heif_error_Ok);
+
+  std::vector<heif_image*> tiles;
+  for (int i = 0; i < columns * rows; i++) {
+    tiles.push_back(create_mono_image(64, 64, static_cast<uint8_t>(i)));
+  }
+
+  heif_image_handle* handle = nullptr;
+  err = heif_context_encode_grid(ctx, tiles.data(), rows, columns, encoder, nullptr, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(handle != nullptr);
+  REQUIRE(heif_image_handle_get_width(handle) == columns * 64);
+  REQUIRE(heif_image_handle_get_height(handle) == rows * 64);
+
+  std::vector<uint8_t> data = write_to_memory(ctx);
+
+  heif_image_handle_release(handle);
+  for (auto* tile : tiles) {
+    heif_image_release(tile);
+  }
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+
+  return data;
+}
+
+
+TEST_CASE("Encode grid with parallel tile encoding")
+{
+  std::vector<uint8_t> sequential = encode_full_grid(1);
+  std::vector<uint8_t> parallel = encode_full_grid(4);
+
+  // the tiles are written in tile order, independent of the encoding order
+  REQUIRE(sequential == parallel);
+
+  check_grid_tile_values(parallel, 4, 3, 64);
+}
+
+
+static std::vector<uint8_t> encode_grid_by_tile_rows(int encoding_threads)
+{
+  const uint32_t columns = 3, rows = 3;
+
+  heif_context* ctx = heif_context_alloc();
+  heif_context_set_max_encoding_threads(ctx, encoding_threads);
+
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_encoding_options* options = heif_encoding_options_alloc();
+  heif_image_handle* grid_handle;
+  err = heif_context_add_grid_image(ctx, columns * 64, rows * 64, columns, rows, options, &grid_handle);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_encoding_options_free(options);
+
+  err = heif_context_set_primary_image(ctx, grid_handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  std::vector<heif_image*> tiles;
+  for (uint32_t i = 0; i < columns * rows; i++) {
+    tiles.push_back(create_mono_image(64, 64, static_cast<uint8_t>(i)));
+  }
+
+  // first two rows at once, then the last row
+  err = heif_context_add_image_tile_rows(ctx, grid_handle, 0, 2, tiles.data(), encoder);
+  REQUIRE(err.code == heif_error_Ok);
+  err = heif_context_add_image_tile_rows(ctx, grid_handle, 2, 1, tiles.data() + 2 * columns, encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  // rows outside of the grid
+  err = heif_context_add_image_tile_rows(ctx, grid_handle, 2, 2, tiles.data(), encoder);
+  REQUIRE(err.code == heif_error_Usage_error);
+
+  err = heif_context_add_image_tile_rows(ctx, grid_handle, 0, 1, tiles.data(), nullptr);
+  REQUIRE(err.code == heif_error_Usage_error);
+  REQUIRE(err.subcode == heif_suberror_Null_pointer_argument);
+
+  std::vector<uint8_t> data = write_to_memory(ctx);
+
+  heif_image_handle_release(grid_handle);
+  for (auto* tile : tiles) {
+    heif_image_release(tile);
+  }
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+
+  return data;
+}
+
+
+TEST_CASE("Add grid tile rows with parallel tile encoding")
+{
+  std::vector<uint8_t> sequential = encode_grid_by_tile_rows(1);
+  std::vector<uint8_t> parallel = encode_grid_by_tile_rows(3);
+
+  REQUIRE(sequential == parallel);
+
+  check_grid_tile_values(parallel, 3, 3, 64);
+}
+
+
+static std::vector<uint8_t> encode_split_into_grid(heif_orientation orientation)
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_context_set_max_encoding_threads(ctx, 2);
+
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* image;
+  err = heif_image_create(150, 100, heif_colorspace_monochrome, heif_chroma_monochrome, &image);
+  REQUIRE(err.code == heif_error_Ok);
+  err = heif_image_add_plane(image, heif_channel_Y, 150, 100, 8);
+  REQUIRE(err.code == heif_error_Ok);
+
+  int stride;
+  uint8_t* p = heif_image_get_plane(image, heif_channel_Y, &stride);
+  for (int y = 0; y < 100; y++) {
+    for (int x = 0; x < 150; x++) {
+      p[y * stride + x] = static_cast<uint8_t>(x + y);
+    }
+  }
+
+  heif_encoding_options* options = heif_encoding_options_alloc();
+  options->grid_tile_width = 64;
+  options->grid_tile_height = 64;
+  options->image_orientation = orientation;
+
+  heif_image_handle* handle;
+  err = heif_context_encode_image(ctx, image, encoder, options, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+  heif_encoding_options_free(options);
+
+  std::vector<uint8_t> data = write_to_memory(ctx);
+
+  heif_image_handle_release(handle);
+  heif_image_release(image);
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+
+  return data;
+}
+
+
+TEST_CASE("Encode image split into a grid")
+{
+  std::vector<uint8_t> data = encode_split_into_grid(heif_orientation_normal);
+
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_read_from_memory_without_copy(ctx, data.data(), data.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image_handle* handle;
+  err = heif_context_get_primary_image_handle(ctx, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_image_handle_get_width(handle) == 150);
+  REQUIRE(heif_image_handle_get_height(handle) == 100);
+
+  heif_image_tiling tiling;
+  err = heif_image_handle_get_image_tiling(handle, 1, &tiling);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(tiling.num_columns == 3);
+  REQUIRE(tiling.num_rows == 2);
+  REQUIRE(tiling.tile_width == 64);
+  REQUIRE(tiling.tile_height == 64);
+
+  heif_image* img;
+  err = heif_decode_image(handle, &img, heif_colorspace_monochrome, heif_chroma_monochrome, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_image_get_primary_width(img) == 150);
+  REQUIRE(heif_image_get_primary_height(img) == 100);
+
+  int stride;
+  const uint8_t* p = heif_image_get_plane_readonly(img, heif_channel_Y, &stride);
+  bool identical = true;
+  for (int y = 0; y < 100; y++) {
+    for (int x = 0; x < 150; x++) {
+      identical &= (p[y * stride + x] == static_cast<uint8_t>(x + y));
+    }
+  }
+  REQUIRE(identical);
+
+  heif_image_release(img);
+  heif_image_handle_release(handle);
+  heif_context_free(ctx);
+}
+
+
+TEST_CASE("Encode image split into a grid with orientation")
+{
+  std::vector<uint8_t> data = encode_split_into_grid(heif_orientation_rotate_90_cw);
+
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_read_from_memory_without_copy(ctx, data.data(), data.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image_handle* handle;
+  err = heif_context_get_primary_image_handle(ctx, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* img;
+  err = heif_decode_image(handle, &img, heif_colorspace_monochrome, heif_chroma_monochrome, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_image_get_primary_width(img) == 100);
+  REQUIRE(heif_image_get_primary_height(img) == 150);
+
+  // the top-left pixel of the rotated image is the bottom-left pixel of the input
+  int stride;
+  const uint8_t* p = heif_image_get_plane_readonly(img, heif_channel_Y, &stride);
+  REQUIRE(p[0] == 99);
+
+  heif_image_release(img);
+  heif_image_handle_release(handle);
+  heif_context_free(ctx);
+}
+
+
+TEST_CASE("Encode image split into a grid with the maximum number of columns")
+{
+  int width = GENERATE(256, 257);
+
+  heif_image* image;
+  heif_error err = heif_image_create(width, 2, heif_colorspace_monochrome, heif_chroma_monochrome, &image);
+  REQUIRE(err.code == heif_error_Ok);
+  err = heif_image_add_plane(image, heif_channel_Y, width, 2, 8);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_context* ctx = heif_context_alloc();
+  heif_encoder* encoder;
+  err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_encoding_options* options = heif_encoding_options_alloc();
+  options->grid_tile_width = 1;
+  options->grid_tile_height = 2;
+
+  heif_image_handle* handle = nullptr;
+  err = heif_context_encode_image(ctx, image, encoder, options, &handle);
+
+  if (width == 256) {
+    REQUIRE(err.code == heif_error_Ok);
+    heif_image_handle_release(handle);
+
+    std::vector<uint8_t> data = write_to_memory(ctx);
+
+    heif_context* read_ctx = heif_context_alloc();
+    err = heif_context_read_from_memory_without_copy(read_ctx, data.data(), data.size(), nullptr);
+    REQUIRE(err.code == heif_error_Ok);
+    err = heif_context_get_primary_image_handle(read_ctx, &handle);
+    REQUIRE(err.code == heif_error_Ok);
+
+    heif_image_tiling tiling;
+    err = heif_image_handle_get_image_tiling(handle, 1, &tiling);
+    REQUIRE(err.code == heif_error_Ok);
+    REQUIRE(tiling.num_columns == 256);
+    REQUIRE(tiling.num_rows == 1);
+
+    heif_image_handle_release(handle);
+    heif_context_free(read_ctx);
+  }
+  else {
+    // the 'grid' box cannot store more than 256 columns
+    REQUIRE(err.code == heif_error_Usage_error);
+    REQUIRE(err.subcode == heif_suberror_Invalid_parameter_value);
+  }
+
+  heif_encoding_options_free(options);
+  heif_encoder_release(encoder);
+  heif_image_release(image);
+  heif_context_free(ctx);
+}
+
+
+// Encodes a batch of images, one of which is large enough to be split into a grid.
+static std::vector<uint8_t> encode_image_batch(bool pipelined, int encoding_threads)
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_context_set_max_encoding_threads(ctx, encoding_threads);
+
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_encoding_options* options = heif_encoding_options_alloc();
+  options->grid_tile_width = 64;
+  options->grid_tile_height = 64;
+
+  const int num_images = 6;
+  std::vector<heif_image*> images;
+  for (int i = 0; i < num_images; i++) {
+    int size = (i == 3 ? 128 : 64);
+    images.push_back(create_mono_image(size, size, static_cast<uint8_t>(i * 40)));
+  }
+
+  std::vector<heif_image_handle*> handles(num_images);
+
+  if (pipelined) {
+    err = heif_context_encode_images(ctx, images.data(), num_images, encoder, options, handles.data());
+    REQUIRE(err.code == heif_error_Ok);
+  }
+  else {
+    for (int i = 0; i < num_images; i++) {
+      err = heif_context_encode_image(ctx, images[i], encoder, options, &handles[i]);
+      REQUIRE(err.code == heif_error_Ok);
+    }
+  }
+
+  for (int i = 0; i < num_images; i++) {
+    REQUIRE(handles[i] != nullptr);
+    REQUIRE(heif_image_handle_get_width(handles[i]) == (i == 3 ? 128 : 64));
+    heif_image_handle_release(handles[i]);
+    heif_image_release(images[i]);
+  }
+
+  std::vector<uint8_t> data = write_to_memory(ctx);
+
+  heif_encoding_options_free(options);
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+
+  return data;
+}
+
+
+TEST_CASE("Encode image batch with pipelined encoding")
+{
+  std::vector<uint8_t> sequential = encode_image_batch(false, 1);
+
+  REQUIRE(encode_image_batch(true, 1) == sequential);
+  REQUIRE(encode_image_batch(true, 3) == sequential);
+
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_read_from_memory_without_copy(ctx, sequential.data(), sequential.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_context_get_number_of_top_level_images(ctx) == 6);
+
+  heif_item_id ids[6];
+  heif_context_get_list_of_top_level_image_IDs(ctx, ids, 6);
+
+  heif_image_handle* handle;
+  err = heif_context_get_image_handle(ctx, ids[5], &handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* img;
+  err = heif_decode_image(handle, &img, heif_colorspace_monochrome, heif_chroma_monochrome, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  int stride;
+  const uint8_t* p = heif_image_get_plane_readonly(img, heif_channel_Y, &stride);
+  REQUIRE(p[0] == 200);
+
+  heif_image_release(img);
+  heif_image_handle_release(handle);
+  heif_context_free(ctx);
+}
+
+
+static std::vector<uint8_t> encode_with_thumbnail(int encoding_threads)
+{
+  heif_context* ctx = heif_context_alloc();
+  heif_context_set_max_encoding_threads(ctx, encoding_threads);
+
+  heif_encoder* encoder;
+  heif_error err = heif_context_get_encoder_for_format(ctx, heif_compression_uncompressed, &encoder);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image* image = create_mono_image(128, 128, 0);
+  int stride;
+  uint8_t* p = heif_image_get_plane(image, heif_channel_Y, &stride);
+  for (int y = 0; y < 128; y++) {
+    for (int x = 0; x < 128; x++) {
+      p[y * stride + x] = static_cast<uint8_t>(x);
+    }
+  }
+
+  heif_encoding_options* options = heif_encoding_options_alloc();
+  options->thumbnail_bbox_size = 32;
+
+  heif_image_handle* handle;
+  err = heif_context_encode_image(ctx, image, encoder, options, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+
+  std::vector<uint8_t> data = write_to_memory(ctx);
+
+  heif_image_handle_release(handle);
+  heif_image_release(image);
+  heif_encoding_options_free(options);
+  heif_encoder_release(encoder);
+  heif_context_free(ctx);
+
+  return data;
+}
+
+
+TEST_CASE("Encode image and thumbnail concurrently")
+{
+  std::vector<uint8_t> data = encode_with_thumbnail(1);
+
+  REQUIRE(encode_with_thumbnail(3) == data);
+
+  heif_context* ctx = heif_context_alloc();
+  heif_error err = heif_context_read_from_memory_without_copy(ctx, data.data(), data.size(), nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  heif_image_handle* handle;
+  err = heif_context_get_primary_image_handle(ctx, &handle);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_image_handle_get_number_of_thumbnails(handle) == 1);
+
+  heif_item_id thumbnail_id;
+  heif_image_handle_get_list_of_thumbnail_IDs(handle, &thumbnail_id, 1);
+
+  heif_image_handle* thumbnail_handle;
+  err = heif_image_handle_get_thumbnail(handle, thumbnail_id, &thumbnail_handle);
+  REQUIRE(err.code == heif_error_Ok);
+  REQUIRE(heif_image_handle_get_width(thumbnail_handle) == 32);
+  REQUIRE(heif_image_handle_get_height(thumbnail_handle) == 32);
+
+  heif_image* img;
+  err = heif_decode_image(thumbnail_handle, &img, heif_colorspace_monochrome, heif_chroma_monochrome, nullptr);
+  REQUIRE(err.code == heif_error_Ok);
+
+  int stride;
+  const uint8_t* p = heif_image_get_plane_readonly(img, heif_channel_Y, &stride);
+  // each thumbnail pixel is the average of 4x4 image pixels
+  REQUIRE(p[1] == 6);
+  REQUIRE(p[31] == 126);
+
+  heif_image_release(img);
+  heif_image_handle_release(thumbnail_handle);
+  heif_image_handle_release(handle);
+  heif_context_free(ctx);
+}